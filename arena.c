@@ -0,0 +1,110 @@
+/* Kinetrix Arena Allocator Implementation */
+
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16
+#define ARENA_DEFAULT_CHUNK (64 * 1024)
+#define ARENA_MAX_CHUNK (4 * 1024 * 1024)
+
+static size_t arena_align_up(size_t n) {
+  return (n + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static ArenaChunk *arena_new_chunk(Arena *arena, size_t min_size) {
+  size_t size = arena->chunk_size;
+  if (size < min_size)
+    size = min_size;
+  /* Grow geometrically so big inputs need only a handful of chunks */
+  if (arena->chunk_size < ARENA_MAX_CHUNK)
+    arena->chunk_size *= 2;
+  /* calloc keeps the "arena memory is zeroed" guarantee for free */
+  size_t header = arena_align_up(sizeof(ArenaChunk));
+  ArenaChunk *chunk = calloc(1, header + size);
+  if (!chunk)
+    return NULL;
+  chunk->data = (char *)chunk + header;
+  chunk->size = size;
+  chunk->used = 0;
+  chunk->next = arena->head;
+  arena->head = chunk;
+  arena->bytes_reserved += size;
+  arena->chunk_count++;
+  return chunk;
+}
+
+Arena *arena_create(size_t chunk_size) {
+  Arena *arena = calloc(1, sizeof(Arena));
+  if (!arena)
+    return NULL;
+  arena->chunk_size = chunk_size ? arena_align_up(chunk_size)
+                                 : ARENA_DEFAULT_CHUNK;
+  return arena;
+}
+
+void arena_destroy(Arena *arena) {
+  if (arena == NULL)
+    return;
+  ArenaChunk *chunk = arena->head;
+  while (chunk) {
+    ArenaChunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  free(arena);
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+  size_t rounded = arena_align_up(size ? size : 1);
+  ArenaChunk *chunk = arena->head;
+  if (chunk == NULL || chunk->size - chunk->used < rounded) {
+    chunk = arena_new_chunk(arena, rounded);
+    if (!chunk)
+      return NULL;
+  }
+  void *ptr = chunk->data + chunk->used;
+  chunk->used += rounded;
+  arena->bytes_allocated += size;
+  arena->alloc_count++;
+  return ptr;
+}
+
+void *arena_realloc(Arena *arena, void *ptr, size_t old_size,
+                    size_t new_size) {
+  if (ptr == NULL)
+    return arena_alloc(arena, new_size);
+  if (new_size <= old_size)
+    return ptr;
+
+  /* Grow in place when ptr is the most recent allocation in the head chunk */
+  ArenaChunk *chunk = arena->head;
+  size_t old_rounded = arena_align_up(old_size ? old_size : 1);
+  size_t new_rounded = arena_align_up(new_size);
+  if (chunk && (char *)ptr + old_rounded == chunk->data + chunk->used &&
+      chunk->used - old_rounded + new_rounded <= chunk->size) {
+    chunk->used += new_rounded - old_rounded;
+    arena->bytes_allocated += new_size - old_size;
+    return ptr;
+  }
+
+  void *grown = arena_alloc(arena, new_size);
+  if (grown)
+    memcpy(grown, ptr, old_size);
+  return grown;
+}
+
+char *arena_strndup(Arena *arena, const char *s, size_t n) {
+  char *copy = arena_alloc(arena, n + 1);
+  if (!copy)
+    return NULL;
+  memcpy(copy, s, n);
+  copy[n] = '\0';
+  return copy;
+}
+
+char *arena_strdup(Arena *arena, const char *s) {
+  if (s == NULL)
+    return NULL;
+  return arena_strndup(arena, s, strlen(s));
+}
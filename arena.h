@@ -0,0 +1,49 @@
+/* Kinetrix Arena Allocator
+ * Bump allocation for per-compilation data (AST nodes, types, strings)
+ * with O(1)-per-chunk bulk teardown
+ */
+
+#ifndef KINETRIX_ARENA_H
+#define KINETRIX_ARENA_H
+
+#include <stddef.h>
+
+/* Storage class for per-thread globals (the installed AST arena) */
+#if defined(_MSC_VER)
+#define KX_THREAD_LOCAL __declspec(thread)
+#else
+#define KX_THREAD_LOCAL __thread
+#endif
+
+// ============================================================================
+// ARENA
+// ============================================================================
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t size;  // Usable bytes in data[]
+    size_t used;
+    char *data;   // Aligned storage following the header
+} ArenaChunk;
+
+typedef struct Arena {
+    ArenaChunk *head;       // Chunk currently being filled
+    size_t chunk_size;      // Size of the next chunk (grows to a cap)
+    size_t bytes_allocated; // Sum of all requested sizes
+    size_t bytes_reserved;  // Sum of all chunk sizes
+    size_t alloc_count;     // Number of allocations served
+    size_t chunk_count;
+    size_t node_count;      // AST nodes allocated here (maintained by ast.c)
+} Arena;
+
+Arena *arena_create(size_t chunk_size);
+void arena_destroy(Arena *arena);
+
+/* All arena memory is zero-initialised. Allocations live until
+ * arena_destroy(); there is no per-object free. */
+void *arena_alloc(Arena *arena, size_t size);
+void *arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+char *arena_strdup(Arena *arena, const char *s);
+char *arena_strndup(Arena *arena, const char *s, size_t n);
+
+#endif /* KINETRIX_ARENA_H */
@@ -4,16 +4,62 @@
 
 #define _POSIX_C_SOURCE 200809L
 #include "ast.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// ============================================================================
+// AST MEMORY
+// ============================================================================
+
+/* Arena installed on this thread; NULL means plain malloc/free */
+static KX_THREAD_LOCAL Arena *ast_arena = NULL;
+/* Pool that canonicalises identifier names; NULL means plain copies */
+static KX_THREAD_LOCAL StringPool *ast_strings = NULL;
+
+void ast_set_arena(Arena *arena) { ast_arena = arena; }
+
+Arena *ast_get_arena(void) { return ast_arena; }
+
+void ast_set_string_pool(StringPool *pool) { ast_strings = pool; }
+
+StringPool *ast_get_string_pool(void) { return ast_strings; }
+
+void *ast_alloc(size_t size) {
+  if (ast_arena)
+    return arena_alloc(ast_arena, size);
+  return calloc(1, size);
+}
+
+void *ast_realloc(void *ptr, size_t old_size, size_t new_size) {
+  if (ast_arena)
+    return arena_realloc(ast_arena, ptr, old_size, new_size);
+  return realloc(ptr, new_size);
+}
+
+char *ast_strdup(const char *s) {
+  if (s == NULL)
+    return NULL;
+  if (ast_arena)
+    return arena_strdup(ast_arena, s);
+  return strdup(s);
+}
+
+char *ast_intern(const char *s) {
+  /* Interned text is shared; the AST keeps it in plain char * fields but
+   * never writes through them */
+  if (ast_strings)
+    return (char *)string_pool_intern_str(ast_strings, s);
+  return ast_strdup(s);
+}
+
 // ============================================================================
 // TYPE SYSTEM IMPLEMENTATION
 // ============================================================================
 
 Type *type_void() {
-  Type *t = malloc(sizeof(Type));
+  Type *t = ast_alloc(sizeof(Type));
   t->kind = TYPE_VOID;
   t->element_type = NULL;
   t->return_type = NULL;
@@ -25,19 +71,20 @@ Type *type_void() {
 }
 
 Type *type_int() {
-  Type *t = malloc(sizeof(Type));
+  Type *t = ast_alloc(sizeof(Type));
   t->kind = TYPE_INT;
   t->element_type = NULL;
   t->return_type = NULL;
   t->param_types = NULL;
   t->param_count = 0;
   t->array_size = 0;
+  t->bits = 0;
   t->struct_name = NULL;
   return t;
 }
 
 Type *type_float() {
-  Type *t = malloc(sizeof(Type));
+  Type *t = ast_alloc(sizeof(Type));
   t->kind = TYPE_FLOAT;
   t->element_type = NULL;
   t->return_type = NULL;
@@ -49,7 +96,7 @@ Type *type_float() {
 }
 
 Type *type_bool() {
-  Type *t = malloc(sizeof(Type));
+  Type *t = ast_alloc(sizeof(Type));
   t->kind = TYPE_BOOL;
   t->element_type = NULL;
   t->return_type = NULL;
@@ -61,7 +108,7 @@ Type *type_bool() {
 }
 
 Type *type_byte() {
-  Type *t = malloc(sizeof(Type));
+  Type *t = ast_alloc(sizeof(Type));
   t->kind = TYPE_BYTE;
   t->element_type = NULL;
   t->return_type = NULL;
@@ -73,7 +120,7 @@ Type *type_byte() {
 }
 
 Type *type_string() {
-  Type *t = malloc(sizeof(Type));
+  Type *t = ast_alloc(sizeof(Type));
   t->kind = TYPE_STRING;
   t->element_type = NULL;
   t->return_type = NULL;
@@ -85,7 +132,7 @@ Type *type_string() {
 }
 
 Type *type_buffer(Type *element_type, int size) {
-  Type *t = malloc(sizeof(Type));
+  Type *t = ast_alloc(sizeof(Type));
   t->kind = TYPE_BUFFER;
   t->element_type = element_type;
   t->return_type = NULL;
@@ -97,19 +144,19 @@ Type *type_buffer(Type *element_type, int size) {
 }
 
 Type *type_struct(const char *name) {
-  Type *t = malloc(sizeof(Type));
+  Type *t = ast_alloc(sizeof(Type));
   t->kind = TYPE_STRUCT;
   t->element_type = NULL;
   t->return_type = NULL;
   t->param_types = NULL;
   t->param_count = 0;
   t->array_size = 0;
-  t->struct_name = strdup(name);
+  t->struct_name = ast_intern(name);
   return t;
 }
 
 Type *type_array(Type *element_type, int size) {
-  Type *t = malloc(sizeof(Type));
+  Type *t = ast_alloc(sizeof(Type));
   t->kind = TYPE_ARRAY;
   t->element_type = element_type;
   t->return_type = NULL;
@@ -120,7 +167,7 @@ Type *type_array(Type *element_type, int size) {
 }
 
 Type *type_function(Type *return_type, Type **param_types, int param_count) {
-  Type *t = malloc(sizeof(Type));
+  Type *t = ast_alloc(sizeof(Type));
   t->kind = TYPE_FUNCTION;
   t->element_type = NULL;
   t->return_type = return_type;
@@ -131,7 +178,7 @@ Type *type_function(Type *return_type, Type **param_types, int param_count) {
 }
 
 Type *type_inferred() {
-  Type *t = malloc(sizeof(Type));
+  Type *t = ast_alloc(sizeof(Type));
   t->kind = TYPE_INFERRED;
   t->element_type = NULL;
   t->return_type = NULL;
@@ -142,7 +189,7 @@ Type *type_inferred() {
 }
 
 Type *type_error() {
-  Type *t = malloc(sizeof(Type));
+  Type *t = ast_alloc(sizeof(Type));
   t->kind = TYPE_ERROR;
   t->element_type = NULL;
   t->return_type = NULL;
@@ -179,7 +226,7 @@ int type_equals(Type *a, Type *b) {
 const char *type_to_string(Type *t) {
   if (t == NULL)
     return "null";
-  static char buffer[256];
+  static KX_THREAD_LOCAL char buffer[256];
   switch (t->kind) {
   case TYPE_VOID:
     return "void";
@@ -221,7 +268,7 @@ const char *type_to_ctype(Type *t) {
     return "float";
   switch (t->kind) {
   case TYPE_INT:
-    return "int";
+    return t->bits == 16 ? "int16_t" : t->bits == 32 ? "int32_t" : "int";
   case TYPE_FLOAT:
     return "float";
   case TYPE_BOOL:
@@ -243,16 +290,17 @@ Type *type_clone(Type *t) {
   if (t == NULL)
     return NULL;
 
-  Type *clone = malloc(sizeof(Type));
+  Type *clone = ast_alloc(sizeof(Type));
   clone->kind = t->kind;
   clone->element_type = type_clone(t->element_type);
   clone->return_type = type_clone(t->return_type);
   clone->array_size = t->array_size;
+  clone->bits = t->bits;
   clone->param_count = t->param_count;
-  clone->struct_name = t->struct_name ? strdup(t->struct_name) : NULL;
+  clone->struct_name = t->struct_name ? ast_intern(t->struct_name) : NULL;
 
   if (t->param_types != NULL) {
-    clone->param_types = malloc(sizeof(Type *) * t->param_count);
+    clone->param_types = ast_alloc(sizeof(Type *) * t->param_count);
     for (int i = 0; i < t->param_count; i++) {
       clone->param_types[i] = type_clone(t->param_types[i]);
     }
@@ -264,7 +312,8 @@ Type *type_clone(Type *t) {
 }
 
 void type_free(Type *t) {
-  if (t == NULL)
+  /* Arena-allocated types are released with the arena */
+  if (t == NULL || ast_arena != NULL)
     return;
 
   type_free(t->element_type);
@@ -286,7 +335,9 @@ void type_free(Type *t) {
 // ============================================================================
 
 static ASTNode *ast_create(NodeType type) {
-  ASTNode *node = malloc(sizeof(ASTNode));
+  ASTNode *node = ast_alloc(sizeof(ASTNode));
+  if (ast_arena)
+    ast_arena->node_count++;
   node->type = type;
   node->value_type = type_inferred();
   node->line = 0;
@@ -309,7 +360,7 @@ ASTNode *ast_number(double value) {
 
 ASTNode *ast_string(const char *value) {
   ASTNode *node = ast_create(NODE_STRING);
-  node->data.string.value = strdup(value);
+  node->data.string.value = ast_strdup(value);
   type_free(node->value_type);
   node->value_type = type_string();
   return node;
@@ -325,7 +376,7 @@ ASTNode *ast_bool(int value) {
 
 ASTNode *ast_identifier(const char *name) {
   ASTNode *node = ast_create(NODE_IDENTIFIER);
-  node->data.identifier.name = strdup(name);
+  node->data.identifier.name = ast_intern(name);
   return node;
 }
 
@@ -356,7 +407,7 @@ ASTNode *ast_unary_op(Operator op, ASTNode *operand) {
 
 ASTNode *ast_call(const char *name, ASTNode **args, int arg_count) {
   ASTNode *node = ast_create(NODE_CALL);
-  node->data.call.name = strdup(name);
+  node->data.call.name = ast_intern(name);
   node->data.call.args = args;
   node->data.call.arg_count = arg_count;
   return node;
@@ -378,7 +429,7 @@ ASTNode *ast_array_literal(ASTNode **elements, int element_count) {
 
 ASTNode *ast_var_decl(const char *name, Type *type, ASTNode *initializer) {
   ASTNode *node = ast_create(NODE_VAR_DECL);
-  node->data.var_decl.name = strdup(name);
+  node->data.var_decl.name = ast_intern(name);
   node->data.var_decl.declared_type = type;
   node->data.var_decl.initializer = initializer;
   node->data.var_decl.is_array = 0;
@@ -391,7 +442,7 @@ ASTNode *ast_var_decl(const char *name, Type *type, ASTNode *initializer) {
  * which creates NODE_ARRAY_DECL instead. */
 ASTNode *ast_array_decl_compat(const char *name, Type *element_type, int size) {
   ASTNode *node = ast_create(NODE_VAR_DECL);
-  node->data.var_decl.name = strdup(name);
+  node->data.var_decl.name = ast_intern(name);
   node->data.var_decl.declared_type = type_array(element_type, size);
   node->data.var_decl.initializer = NULL;
   node->data.var_decl.is_array = 1;
@@ -437,7 +488,7 @@ ASTNode *ast_forever(ASTNode *body) {
 ASTNode *ast_for(const char *var_name, ASTNode *start_expr, ASTNode *end_expr,
                  ASTNode *step_expr, ASTNode *body) {
   ASTNode *node = ast_create(NODE_FOR);
-  node->data.for_loop.var_name = strdup(var_name);
+  node->data.for_loop.var_name = ast_intern(var_name);
   node->data.for_loop.start_expr = start_expr;
   node->data.for_loop.end_expr = end_expr;
   node->data.for_loop.step_expr = step_expr;
@@ -576,7 +627,7 @@ ASTNode *ast_function_def(const char *name, char **param_names,
                           Type **param_types, int param_count,
                           Type *return_type, ASTNode *body) {
   ASTNode *node = ast_create(NODE_FUNCTION_DEF);
-  node->data.function_def.name = strdup(name);
+  node->data.function_def.name = ast_intern(name);
   node->data.function_def.param_names = param_names;
   node->data.function_def.param_types = param_types;
   node->data.function_def.param_count = param_count;
@@ -591,14 +642,14 @@ ASTNode *ast_extern_function_def(const char *name, char **param_names,
                                  Type **param_types, int param_count,
                                  Type *return_type, const char *extern_lang) {
   ASTNode *node = ast_create(NODE_FUNCTION_DEF);
-  node->data.function_def.name = strdup(name);
+  node->data.function_def.name = ast_intern(name);
   node->data.function_def.param_names = param_names;
   node->data.function_def.param_types = param_types;
   node->data.function_def.param_count = param_count;
   node->data.function_def.return_type = return_type;
   node->data.function_def.body = NULL;
   node->data.function_def.is_extern = 1;
-  node->data.function_def.extern_lang = strdup(extern_lang);
+  node->data.function_def.extern_lang = ast_strdup(extern_lang);
   return node;
 }
 
@@ -627,7 +678,7 @@ ASTNode *ast_cast(Type *target_type, ASTNode *operand) {
 
 ASTNode *ast_array_decl(const char *name, Type *elem_type, int size) {
   ASTNode *node = ast_create(NODE_ARRAY_DECL);
-  node->data.array_decl.name = strdup(name);
+  node->data.array_decl.name = ast_intern(name);
   node->data.array_decl.elem_type = elem_type;
   node->data.array_decl.size = size;
   return node;
@@ -640,7 +691,7 @@ ASTNode *ast_array_decl_old(const char *name, Type *element_type, int size) {
 
 ASTNode *ast_buffer_decl(const char *name, Type *elem_type, int size) {
   ASTNode *node = ast_create(NODE_BUFFER_DECL);
-  node->data.array_decl.name = strdup(name);
+  node->data.array_decl.name = ast_intern(name);
   node->data.array_decl.elem_type = elem_type;
   node->data.array_decl.size = size;
   return node;
@@ -648,7 +699,7 @@ ASTNode *ast_buffer_decl(const char *name, Type *elem_type, int size) {
 
 ASTNode *ast_buffer_push(const char *buffer_name, ASTNode *value) {
   ASTNode *node = ast_create(NODE_BUFFER_PUSH);
-  node->data.buffer_push.buffer_name = strdup(buffer_name);
+  node->data.buffer_push.buffer_name = ast_intern(buffer_name);
   node->data.buffer_push.value = value;
   return node;
 }
@@ -656,7 +707,7 @@ ASTNode *ast_buffer_push(const char *buffer_name, ASTNode *value) {
 ASTNode *ast_struct_access(ASTNode *object, const char *member) {
   ASTNode *node = ast_create(NODE_STRUCT_ACCESS);
   node->data.struct_access.object = object;
-  node->data.struct_access.member = strdup(member);
+  node->data.struct_access.member = ast_intern(member);
   return node;
 }
 
@@ -689,7 +740,7 @@ ASTNode *ast_interrupt_timer(int interval, int is_us, ASTNode *body) {
   node->data.interrupt_timer.interval = interval;
   node->data.interrupt_timer.is_us = is_us;
   node->data.interrupt_timer.body = body;
-  node->data.interrupt_timer.timer_id = 0; /* Updated in codegen pass */
+  node->data.interrupt_timer.timer_id = 0; /* Set by ast_number_timers() */
   return node;
 }
 
@@ -726,7 +777,7 @@ ASTNode *ast_i2c_device_read_array(ASTNode *device_addr, ASTNode *reg_addr,
   node->data.i2c_device_read_array.device_addr = device_addr;
   node->data.i2c_device_read_array.reg_addr = reg_addr;
   node->data.i2c_device_read_array.count = count;
-  node->data.i2c_device_read_array.array_name = strdup(array_name);
+  node->data.i2c_device_read_array.array_name = ast_intern(array_name);
   return node;
 }
 
@@ -756,7 +807,7 @@ ASTNode *ast_spi_transfer(ASTNode *data) {
 ASTNode *ast_device_def(const char *name, ProtocolType protocol,
                         ASTNode *addr) {
   ASTNode *node = ast_create(NODE_DEVICE_DEF);
-  node->data.device_def.device_name = strdup(name);
+  node->data.device_def.device_name = ast_intern(name);
   node->data.device_def.protocol = protocol;
   node->data.device_def.address_or_baud = addr;
   return node;
@@ -765,7 +816,7 @@ ASTNode *ast_device_def(const char *name, ProtocolType protocol,
 ASTNode *ast_device_read(const char *device_name, ProtocolType protocol,
                          ASTNode *reg) {
   ASTNode *node = ast_create(NODE_DEVICE_READ);
-  node->data.device_read.device_name = strdup(device_name);
+  node->data.device_read.device_name = ast_intern(device_name);
   node->data.device_read.protocol = protocol;
   node->data.device_read.reg = reg;
   return node;
@@ -774,7 +825,7 @@ ASTNode *ast_device_read(const char *device_name, ProtocolType protocol,
 ASTNode *ast_device_write(const char *device_name, ProtocolType protocol,
                           ASTNode *value) {
   ASTNode *node = ast_create(NODE_DEVICE_WRITE);
-  node->data.device_write.device_name = strdup(device_name);
+  node->data.device_write.device_name = ast_intern(device_name);
   node->data.device_write.protocol = protocol;
   node->data.device_write.value = value;
   return node;
@@ -800,8 +851,8 @@ ASTNode *ast_watchdog_feed() { return ast_create(NODE_WATCHDOG_FEED); }
 ASTNode *ast_ota_enable(const char *hostname, const char *password) {
   ASTNode *node = ast_create(NODE_OTA_ENABLE);
   node->data.ota_enable.hostname =
-      hostname ? strdup(hostname) : strdup("kinetrix");
-  node->data.ota_enable.password = password ? strdup(password) : NULL;
+      hostname ? ast_strdup(hostname) : ast_strdup("kinetrix");
+  node->data.ota_enable.password = password ? ast_strdup(password) : NULL;
   return node;
 }
 
@@ -823,7 +874,7 @@ ASTNode *ast_assert(ASTNode *condition, ASTNode *action) {
 ASTNode *ast_struct_def(const char *name, StructField *fields,
                         int field_count) {
   ASTNode *node = ast_create(NODE_STRUCT_DEF);
-  node->data.struct_def.name = strdup(name);
+  node->data.struct_def.name = ast_intern(name);
   node->data.struct_def.fields = fields;
   node->data.struct_def.field_count = field_count;
   return node;
@@ -831,8 +882,8 @@ ASTNode *ast_struct_def(const char *name, StructField *fields,
 
 ASTNode *ast_struct_instance(const char *struct_type, const char *var_name) {
   ASTNode *node = ast_create(NODE_STRUCT_INSTANCE);
-  node->data.struct_instance.struct_type = strdup(struct_type);
-  node->data.struct_instance.var_name = strdup(var_name);
+  node->data.struct_instance.struct_type = ast_intern(struct_type);
+  node->data.struct_instance.var_name = ast_intern(var_name);
   return node;
 }
 
@@ -840,14 +891,14 @@ ASTNode *ast_struct_instance(const char *struct_type, const char *var_name) {
 
 ASTNode *ast_task_def(const char *name, ASTNode *body) {
   ASTNode *node = ast_create(NODE_TASK_DEF);
-  node->data.task_def.name = strdup(name);
+  node->data.task_def.name = ast_intern(name);
   node->data.task_def.body = body;
   return node;
 }
 
 ASTNode *ast_task_start(const char *task_name) {
   ASTNode *node = ast_create(NODE_TASK_START);
-  node->data.task_start.task_name = strdup(task_name);
+  node->data.task_start.task_name = ast_intern(task_name);
   return node;
 }
 
@@ -855,8 +906,403 @@ ASTNode *ast_task_start(const char *task_name) {
 // AST UTILITIES
 // ============================================================================
 
+// ============================================================================
+// AST FIELD LAYOUT
+// ============================================================================
+
+#define FIELD(kind, member) {kind, offsetof(ASTNode, data.member), 0}
+#define LIST(kind, member, count)                                             \
+  {kind, offsetof(ASTNode, data.member), offsetof(ASTNode, data.count)}
+#define INT(member) FIELD(AST_FIELD_INT, member)
+#define NAME(member) FIELD(AST_FIELD_NAME, member)
+#define TEXT(member) FIELD(AST_FIELD_TEXT, member)
+#define TYPE(member) FIELD(AST_FIELD_TYPE, member)
+#define NODE(member) FIELD(AST_FIELD_NODE, member)
+
+static const AstField number_fields[] = {
+    FIELD(AST_FIELD_DOUBLE, number.value)};
+static const AstField string_fields[] = {TEXT(string.value)};
+static const AstField bool_fields[] = {INT(boolean.value)};
+static const AstField identifier_fields[] = {NAME(identifier.name)};
+/* divisor_nonzero is derived later by ast_analyze_ranges() */
+static const AstField binary_op_fields[] = {
+    INT(binary_op.op), NODE(binary_op.left), NODE(binary_op.right)};
+static const AstField unary_op_fields[] = {INT(unary_op.op),
+                                           NODE(unary_op.operand)};
+static const AstField cast_fields[] = {TYPE(cast_op.target_type),
+                                       NODE(cast_op.operand)};
+static const AstField call_fields[] = {
+    NAME(call.name), LIST(AST_FIELD_NODE_LIST, call.args, call.arg_count)};
+static const AstField array_access_fields[] = {NODE(array_access.array),
+                                               NODE(array_access.index)};
+static const AstField array_literal_fields[] = {
+    LIST(AST_FIELD_NODE_LIST, array_literal.elements,
+         array_literal.element_count)};
+static const AstField array_decl_fields[] = {
+    NAME(array_decl.name), TYPE(array_decl.elem_type), INT(array_decl.size)};
+static const AstField buffer_push_fields[] = {NAME(buffer_push.buffer_name),
+                                              NODE(buffer_push.value)};
+static const AstField struct_access_fields[] = {NODE(struct_access.object),
+                                                NAME(struct_access.member)};
+static const AstField var_decl_fields[] = {
+    NAME(var_decl.name),       TYPE(var_decl.declared_type),
+    NODE(var_decl.initializer), INT(var_decl.is_array),
+    INT(var_decl.array_size),  INT(var_decl.is_shared),
+    INT(var_decl.is_const)};
+static const AstField assignment_fields[] = {NODE(assignment.target),
+                                             NODE(assignment.value)};
+static const AstField if_fields[] = {NODE(if_stmt.condition),
+                                     NODE(if_stmt.then_block),
+                                     NODE(if_stmt.else_block)};
+static const AstField while_fields[] = {NODE(while_loop.condition),
+                                        NODE(while_loop.body)};
+static const AstField repeat_fields[] = {NODE(repeat_loop.count),
+                                         NODE(repeat_loop.body)};
+static const AstField forever_fields[] = {NODE(forever_loop.body)};
+static const AstField for_fields[] = {
+    NAME(for_loop.var_name), NODE(for_loop.start_expr),
+    NODE(for_loop.end_expr), NODE(for_loop.step_expr), NODE(for_loop.body)};
+static const AstField block_fields[] = {
+    LIST(AST_FIELD_NODE_LIST, block.statements, block.statement_count)};
+static const AstField return_fields[] = {NODE(return_stmt.value)};
+static const AstField gpio_fields[] = {NODE(gpio.pin), NODE(gpio.value)};
+static const AstField i2c_fields[] = {NODE(i2c.address), NODE(i2c.data)};
+static const AstField unary_fields[] = {NODE(unary.child)};
+static const AstField math_func_fields[] = {
+    INT(math_func.func), NODE(math_func.arg1), NODE(math_func.arg2)};
+static const AstField function_def_fields[] = {
+    NAME(function_def.name),
+    LIST(AST_FIELD_NAME_LIST, function_def.param_names,
+         function_def.param_count),
+    LIST(AST_FIELD_TYPE_LIST, function_def.param_types,
+         function_def.param_count),
+    TYPE(function_def.return_type),
+    NODE(function_def.body),
+    INT(function_def.is_extern),
+    TEXT(function_def.extern_lang)};
+static const AstField interrupt_pin_fields[] = {INT(interrupt_pin.pin_number),
+                                                INT(interrupt_pin.mode),
+                                                NODE(interrupt_pin.body)};
+static const AstField interrupt_timer_fields[] = {
+    INT(interrupt_timer.interval), INT(interrupt_timer.is_us),
+    NODE(interrupt_timer.body), INT(interrupt_timer.timer_id)};
+static const AstField serial_open_fields[] = {INT(serial_open.baud_rate)};
+static const AstField serial_send_fields[] = {NODE(serial_send.value)};
+static const AstField i2c_device_read_fields[] = {
+    NODE(i2c_device_read.device_addr), NODE(i2c_device_read.reg_addr)};
+static const AstField i2c_device_read_array_fields[] = {
+    NODE(i2c_device_read_array.device_addr),
+    NODE(i2c_device_read_array.reg_addr), NODE(i2c_device_read_array.count),
+    NAME(i2c_device_read_array.array_name)};
+static const AstField i2c_device_write_fields[] = {
+    NODE(i2c_device_write.device_addr), NODE(i2c_device_write.value)};
+static const AstField spi_open_fields[] = {INT(spi_open.frequency)};
+static const AstField spi_transfer_fields[] = {NODE(spi_transfer.data)};
+static const AstField device_def_fields[] = {NAME(device_def.device_name),
+                                             INT(device_def.protocol),
+                                             NODE(device_def.address_or_baud)};
+static const AstField device_read_fields[] = {NAME(device_read.device_name),
+                                              NODE(device_read.reg),
+                                              INT(device_read.protocol)};
+static const AstField device_write_fields[] = {NAME(device_write.device_name),
+                                               NODE(device_write.value),
+                                               INT(device_write.protocol)};
+static const AstField radio_send_fields[] = {NODE(radio_send.peer_id),
+                                             NODE(radio_send.data)};
+static const AstField try_fields[] = {NODE(try_stmt.try_block),
+                                      NODE(try_stmt.error_block)};
+static const AstField watchdog_enable_fields[] = {
+    INT(watchdog_enable.timeout_ms)};
+static const AstField ota_enable_fields[] = {TEXT(ota_enable.hostname),
+                                             TEXT(ota_enable.password)};
+static const AstField assert_fields[] = {NODE(assert_stmt.condition),
+                                         NODE(assert_stmt.action)};
+static const AstField struct_def_fields[] = {
+    NAME(struct_def.name),
+    LIST(AST_FIELD_STRUCT_LIST, struct_def.fields, struct_def.field_count)};
+static const AstField struct_instance_fields[] = {
+    NAME(struct_instance.struct_type), NAME(struct_instance.var_name)};
+static const AstField task_def_fields[] = {NAME(task_def.name),
+                                           NODE(task_def.body)};
+static const AstField task_start_fields[] = {NAME(task_start.task_name)};
+static const AstField servo_attach_fields[] = {NODE(servo_attach.pin)};
+static const AstField servo_move_fields[] = {NODE(servo_write.angle)};
+static const AstField servo_detach_fields[] = {NODE(servo_detach.pin)};
+static const AstField distance_read_fields[] = {
+    NODE(distance_read.trigger_pin), NODE(distance_read.echo_pin)};
+static const AstField dht_attach_fields[] = {NODE(dht_attach.pin),
+                                             INT(dht_attach.dht_type)};
+static const AstField neopixel_init_fields[] = {NODE(neopixel_init.pin),
+                                                NODE(neopixel_init.count)};
+static const AstField neopixel_set_fields[] = {
+    NODE(neopixel_set.index), NODE(neopixel_set.r), NODE(neopixel_set.g),
+    NODE(neopixel_set.b)};
+static const AstField lcd_init_fields[] = {NODE(lcd_init.cols),
+                                           NODE(lcd_init.rows)};
+static const AstField lcd_print_fields[] = {NODE(lcd_print.text),
+                                            NODE(lcd_print.line)};
+static const AstField stepper_attach_fields[] = {
+    NODE(stepper_attach.step_pin), NODE(stepper_attach.dir_pin)};
+static const AstField stepper_move_fields[] = {NODE(stepper_move.steps)};
+static const AstField motor_attach_fields[] = {NODE(motor_attach.en_pin),
+                                              NODE(motor_attach.fwd_pin),
+                                              NODE(motor_attach.rev_pin)};
+static const AstField motor_move_fields[] = {INT(motor_move.direction),
+                                            NODE(motor_move.speed)};
+static const AstField encoder_attach_fields[] = {NODE(encoder_attach.pin_a),
+                                                 NODE(encoder_attach.pin_b)};
+static const AstField esc_attach_fields[] = {NODE(esc_attach.pin)};
+static const AstField pid_attach_fields[] = {
+    NODE(pid_attach.kp), NODE(pid_attach.ki), NODE(pid_attach.kd)};
+static const AstField pid_compute_fields[] = {NODE(pid_compute.current_val)};
+static const AstField ble_enable_fields[] = {NODE(ble_enable.name)};
+static const AstField ble_advertise_fields[] = {NODE(ble_advertise.data)};
+static const AstField ble_send_fields[] = {NODE(ble_send.data)};
+static const AstField wifi_connect_fields[] = {NODE(wifi_connect.ssid),
+                                              NODE(wifi_connect.password)};
+static const AstField mqtt_connect_fields[] = {NODE(mqtt_connect.broker),
+                                              NODE(mqtt_connect.port)};
+static const AstField mqtt_subscribe_fields[] = {NODE(mqtt_subscribe.topic)};
+static const AstField mqtt_publish_fields[] = {NODE(mqtt_publish.topic),
+                                              NODE(mqtt_publish.payload)};
+static const AstField http_get_fields[] = {NODE(http_get.url)};
+static const AstField http_post_fields[] = {NODE(http_post.url),
+                                           NODE(http_post.body)};
+static const AstField ws_connect_fields[] = {NODE(ws_connect.url)};
+static const AstField ws_send_fields[] = {NODE(ws_send.data)};
+static const AstField imu_attach_fields[] = {NODE(imu_attach.port)};
+static const AstField gps_attach_fields[] = {NODE(gps_attach.port),
+                                            NODE(gps_attach.baud)};
+static const AstField lidar_attach_fields[] = {NODE(lidar_attach.port)};
+static const AstField sd_mount_fields[] = {NODE(sd_mount.cs_pin)};
+static const AstField file_open_fields[] = {NODE(file_open.filename)};
+static const AstField file_write_fields[] = {NODE(file_write.data)};
+static const AstField oled_attach_fields[] = {NODE(oled_attach.width),
+                                             NODE(oled_attach.height)};
+static const AstField oled_print_fields[] = {
+    NODE(oled_print.text), NODE(oled_print.x), NODE(oled_print.y)};
+static const AstField oled_draw_fields[] = {
+    INT(oled_draw.shape), NODE(oled_draw.x), NODE(oled_draw.y),
+    NODE(oled_draw.param1), NODE(oled_draw.param2)};
+static const AstField audio_attach_fields[] = {NODE(audio_attach.pin)};
+static const AstField play_freq_fields[] = {NODE(play_freq.frequency),
+                                           NODE(play_freq.duration)};
+static const AstField play_sound_fields[] = {NODE(play_sound.name)};
+static const AstField set_volume_fields[] = {NODE(set_volume.level)};
+static const AstField cam_attach_fields[] = {NODE(cam_attach.protocol)};
+static const AstField cam_detect_fields[] = {NODE(cam_detect.label)};
+static const AstField mecanum_attach_fields[] = {
+    NODE(mecanum_attach.fl_pin), NODE(mecanum_attach.fr_pin),
+    NODE(mecanum_attach.bl_pin), NODE(mecanum_attach.br_pin)};
+static const AstField mecanum_move_fields[] = {
+    NODE(mecanum_move.x), NODE(mecanum_move.y), NODE(mecanum_move.turn)};
+static const AstField kalman_compute_fields[] = {
+    NODE(kalman_compute.raw_value)};
+static const AstField ai_load_fields[] = {NODE(ai_load.model_path)};
+static const AstField ai_compute_fields[] = {NODE(ai_compute.input_array)};
+static const AstField arm_attach_fields[] = {
+    NODE(arm_attach.dof), NODE(arm_attach.len1), NODE(arm_attach.len2),
+    NODE(arm_attach.len3)};
+static const AstField arm_move_fields[] = {
+    NODE(arm_move.x), NODE(arm_move.y), NODE(arm_move.z)};
+static const AstField grid_create_fields[] = {NAME(grid_create.name),
+                                             NODE(grid_create.width),
+                                             NODE(grid_create.height)};
+static const AstField grid_obstacle_fields[] = {
+    NAME(grid_obstacle.name), NODE(grid_obstacle.x), NODE(grid_obstacle.y)};
+static const AstField path_compute_fields[] = {
+    NODE(path_compute.from_x), NODE(path_compute.from_y),
+    NODE(path_compute.to_x), NODE(path_compute.to_y)};
+static const AstField drone_attach_fields[] = {
+    NODE(drone_attach.fl), NODE(drone_attach.fr), NODE(drone_attach.bl),
+    NODE(drone_attach.br)};
+static const AstField drone_set_fields[] = {
+    NODE(drone_set.pitch), NODE(drone_set.roll), NODE(drone_set.yaw),
+    NODE(drone_set.throttle)};
+/* pins_used / in_pins_used are derived later by ir_track_pins(), features
+ * by ast_track_features() */
+static const AstField program_fields[] = {
+    LIST(AST_FIELD_NODE_LIST, program.functions, program.function_count),
+    NODE(program.main_block)};
+
+#define LAYOUT(fields) {fields, (int)(sizeof(fields) / sizeof(fields[0]))}
+
+static const AstLayout node_layouts[NODE_PROGRAM + 1] = {
+    [NODE_NUMBER] = LAYOUT(number_fields),
+    [NODE_STRING] = LAYOUT(string_fields),
+    [NODE_BOOL] = LAYOUT(bool_fields),
+    [NODE_IDENTIFIER] = LAYOUT(identifier_fields),
+    [NODE_BINARY_OP] = LAYOUT(binary_op_fields),
+    [NODE_UNARY_OP] = LAYOUT(unary_op_fields),
+    [NODE_CAST] = LAYOUT(cast_fields),
+    [NODE_CALL] = LAYOUT(call_fields),
+    [NODE_ARRAY_ACCESS] = LAYOUT(array_access_fields),
+    [NODE_ARRAY_LITERAL] = LAYOUT(array_literal_fields),
+    [NODE_ARRAY_DECL] = LAYOUT(array_decl_fields),
+    [NODE_BUFFER_DECL] = LAYOUT(array_decl_fields),
+    [NODE_BUFFER_PUSH] = LAYOUT(buffer_push_fields),
+    [NODE_STRUCT_ACCESS] = LAYOUT(struct_access_fields),
+    [NODE_VAR_DECL] = LAYOUT(var_decl_fields),
+    [NODE_ASSIGNMENT] = LAYOUT(assignment_fields),
+    [NODE_IF] = LAYOUT(if_fields),
+    [NODE_WHILE] = LAYOUT(while_fields),
+    [NODE_REPEAT] = LAYOUT(repeat_fields),
+    [NODE_FOREVER] = LAYOUT(forever_fields),
+    [NODE_FOR] = LAYOUT(for_fields),
+    [NODE_BLOCK] = LAYOUT(block_fields),
+    [NODE_RETURN] = LAYOUT(return_fields),
+    [NODE_GPIO_WRITE] = LAYOUT(gpio_fields),
+    [NODE_GPIO_READ] = LAYOUT(gpio_fields),
+    [NODE_ANALOG_READ] = LAYOUT(gpio_fields),
+    [NODE_ANALOG_WRITE] = LAYOUT(gpio_fields),
+    [NODE_PULSE_READ] = LAYOUT(gpio_fields),
+    [NODE_SERVO_WRITE] = LAYOUT(gpio_fields),
+    [NODE_I2C_BEGIN] = LAYOUT(i2c_fields),
+    [NODE_I2C_START] = LAYOUT(i2c_fields),
+    [NODE_I2C_SEND] = LAYOUT(i2c_fields),
+    [NODE_I2C_STOP] = LAYOUT(i2c_fields),
+    [NODE_I2C_READ] = LAYOUT(i2c_fields),
+    [NODE_TONE] = LAYOUT(gpio_fields),
+    [NODE_NOTONE] = LAYOUT(gpio_fields),
+    [NODE_WAIT] = LAYOUT(unary_fields),
+    [NODE_PRINT] = LAYOUT(unary_fields),
+    [NODE_PRINTLN] = LAYOUT(unary_fields),
+    [NODE_MATH_FUNC] = LAYOUT(math_func_fields),
+    [NODE_FUNCTION_DEF] = LAYOUT(function_def_fields),
+    [NODE_INTERRUPT_PIN] = LAYOUT(interrupt_pin_fields),
+    [NODE_INTERRUPT_TIMER] = LAYOUT(interrupt_timer_fields),
+    [NODE_SERIAL_OPEN] = LAYOUT(serial_open_fields),
+    [NODE_SERIAL_SEND] = LAYOUT(serial_send_fields),
+    [NODE_I2C_DEVICE_READ] = LAYOUT(i2c_device_read_fields),
+    [NODE_I2C_DEVICE_READ_ARRAY] = LAYOUT(i2c_device_read_array_fields),
+    [NODE_I2C_DEVICE_WRITE] = LAYOUT(i2c_device_write_fields),
+    [NODE_SPI_OPEN] = LAYOUT(spi_open_fields),
+    [NODE_SPI_TRANSFER] = LAYOUT(spi_transfer_fields),
+    [NODE_DEVICE_DEF] = LAYOUT(device_def_fields),
+    [NODE_DEVICE_READ] = LAYOUT(device_read_fields),
+    [NODE_DEVICE_READ_REG] = LAYOUT(device_read_fields),
+    [NODE_DEVICE_WRITE] = LAYOUT(device_write_fields),
+    [NODE_RADIO_SEND] = LAYOUT(radio_send_fields),
+    [NODE_TRY] = LAYOUT(try_fields),
+    [NODE_WATCHDOG_ENABLE] = LAYOUT(watchdog_enable_fields),
+    [NODE_OTA_ENABLE] = LAYOUT(ota_enable_fields),
+    [NODE_ASSERT] = LAYOUT(assert_fields),
+    [NODE_STRUCT_DEF] = LAYOUT(struct_def_fields),
+    [NODE_STRUCT_INSTANCE] = LAYOUT(struct_instance_fields),
+    [NODE_TASK_DEF] = LAYOUT(task_def_fields),
+    [NODE_TASK_START] = LAYOUT(task_start_fields),
+    [NODE_SHARED_DECL] = LAYOUT(var_decl_fields),
+    [NODE_SERVO_ATTACH] = LAYOUT(servo_attach_fields),
+    [NODE_SERVO_MOVE] = LAYOUT(servo_move_fields),
+    [NODE_SERVO_DETACH] = LAYOUT(servo_detach_fields),
+    [NODE_DISTANCE_READ] = LAYOUT(distance_read_fields),
+    [NODE_DHT_ATTACH] = LAYOUT(dht_attach_fields),
+    [NODE_NEOPIXEL_INIT] = LAYOUT(neopixel_init_fields),
+    [NODE_NEOPIXEL_SET] = LAYOUT(neopixel_set_fields),
+    [NODE_LCD_INIT] = LAYOUT(lcd_init_fields),
+    [NODE_LCD_PRINT] = LAYOUT(lcd_print_fields),
+    [NODE_STEPPER_ATTACH] = LAYOUT(stepper_attach_fields),
+    [NODE_STEPPER_SPEED] = LAYOUT(unary_fields),
+    [NODE_STEPPER_MOVE] = LAYOUT(stepper_move_fields),
+    [NODE_MOTOR_ATTACH] = LAYOUT(motor_attach_fields),
+    [NODE_MOTOR_MOVE] = LAYOUT(motor_move_fields),
+    [NODE_ENCODER_ATTACH] = LAYOUT(encoder_attach_fields),
+    [NODE_ESC_ATTACH] = LAYOUT(esc_attach_fields),
+    [NODE_ESC_THROTTLE] = LAYOUT(unary_fields),
+    [NODE_PID_ATTACH] = LAYOUT(pid_attach_fields),
+    [NODE_PID_TARGET] = LAYOUT(unary_fields),
+    [NODE_PID_COMPUTE] = LAYOUT(pid_compute_fields),
+    [NODE_BLE_ENABLE] = LAYOUT(ble_enable_fields),
+    [NODE_BLE_ADVERTISE] = LAYOUT(ble_advertise_fields),
+    [NODE_BLE_SEND] = LAYOUT(ble_send_fields),
+    [NODE_WIFI_CONNECT] = LAYOUT(wifi_connect_fields),
+    [NODE_MQTT_CONNECT] = LAYOUT(mqtt_connect_fields),
+    [NODE_MQTT_SUBSCRIBE] = LAYOUT(mqtt_subscribe_fields),
+    [NODE_MQTT_PUBLISH] = LAYOUT(mqtt_publish_fields),
+    [NODE_HTTP_GET] = LAYOUT(http_get_fields),
+    [NODE_HTTP_POST] = LAYOUT(http_post_fields),
+    [NODE_WS_CONNECT] = LAYOUT(ws_connect_fields),
+    [NODE_WS_SEND] = LAYOUT(ws_send_fields),
+    [NODE_IMU_ATTACH] = LAYOUT(imu_attach_fields),
+    [NODE_GPS_ATTACH] = LAYOUT(gps_attach_fields),
+    [NODE_SD_MOUNT] = LAYOUT(sd_mount_fields),
+    [NODE_FILE_OPEN] = LAYOUT(file_open_fields),
+    [NODE_FILE_WRITE] = LAYOUT(file_write_fields),
+    [NODE_LIDAR_ATTACH] = LAYOUT(lidar_attach_fields),
+    [NODE_OLED_ATTACH] = LAYOUT(oled_attach_fields),
+    [NODE_OLED_PRINT] = LAYOUT(oled_print_fields),
+    [NODE_OLED_DRAW] = LAYOUT(oled_draw_fields),
+    [NODE_AUDIO_ATTACH] = LAYOUT(audio_attach_fields),
+    [NODE_PLAY_FREQ] = LAYOUT(play_freq_fields),
+    [NODE_PLAY_SOUND] = LAYOUT(play_sound_fields),
+    [NODE_SET_VOLUME] = LAYOUT(set_volume_fields),
+    [NODE_CAM_ATTACH] = LAYOUT(cam_attach_fields),
+    [NODE_CAM_DETECT] = LAYOUT(cam_detect_fields),
+    [NODE_MECANUM_ATTACH] = LAYOUT(mecanum_attach_fields),
+    [NODE_MECANUM_MOVE] = LAYOUT(mecanum_move_fields),
+    [NODE_KALMAN_COMPUTE] = LAYOUT(kalman_compute_fields),
+    [NODE_AI_LOAD] = LAYOUT(ai_load_fields),
+    [NODE_AI_COMPUTE] = LAYOUT(ai_compute_fields),
+    [NODE_ARM_ATTACH] = LAYOUT(arm_attach_fields),
+    [NODE_ARM_MOVE] = LAYOUT(arm_move_fields),
+    [NODE_GRID_CREATE] = LAYOUT(grid_create_fields),
+    [NODE_GRID_OBSTACLE] = LAYOUT(grid_obstacle_fields),
+    [NODE_PATH_COMPUTE] = LAYOUT(path_compute_fields),
+    [NODE_DRONE_ATTACH] = LAYOUT(drone_attach_fields),
+    [NODE_DRONE_SET] = LAYOUT(drone_set_fields),
+    [NODE_PROGRAM] = LAYOUT(program_fields),
+};
+
+#undef FIELD
+#undef LIST
+#undef INT
+#undef NAME
+#undef TEXT
+#undef TYPE
+#undef NODE
+#undef LAYOUT
+
+const AstLayout *ast_layout(NodeType type) { return &node_layouts[type]; }
+
+unsigned int ast_layout_fingerprint(void) {
+  /* FNV-1a over every field descriptor, the node count and the node size */
+  unsigned int hash = 2166136261u;
+  unsigned int words[3];
+  for (int t = 0; t <= NODE_PROGRAM; t++) {
+    const AstLayout *layout = &node_layouts[t];
+    for (int f = -1; f < layout->field_count; f++) {
+      if (f < 0) {
+        words[0] = (unsigned int)t;
+        words[1] = (unsigned int)layout->field_count;
+        words[2] = (unsigned int)sizeof(ASTNode);
+      } else {
+        words[0] = layout->fields[f].kind;
+        words[1] = layout->fields[f].offset;
+        words[2] = layout->fields[f].count_offset;
+      }
+      for (int w = 0; w < 3; w++) {
+        hash ^= words[w];
+        hash *= 16777619u;
+      }
+    }
+  }
+  return hash;
+}
+
+ASTNode *ast_new_node(NodeType type) {
+  /* Like ast_create(), minus the placeholder type the caller replaces */
+  ASTNode *node = ast_alloc(sizeof(ASTNode));
+  if (ast_arena)
+    ast_arena->node_count++;
+  node->type = type;
+  node->value_type = NULL;
+  node->line = 0;
+  return node;
+}
+
 void ast_free(ASTNode *node) {
-  if (node == NULL)
+  /* Arena-allocated trees are released in bulk by arena_destroy() */
+  if (node == NULL || ast_arena != NULL)
     return;
 
   type_free(node->value_type);
@@ -1522,6 +1968,59 @@ void ast_print(ASTNode *node, int indent) {
   }
 }
 
+/* Timer interrupts are numbered once, in source order, before any backend
+ * runs: backends only read the tree, so one parse can feed several. */
+static void number_timers(ASTNode *node, int *counter) {
+  if (!node)
+    return;
+  switch (node->type) {
+  case NODE_PROGRAM:
+    for (int i = 0; i < node->data.program.function_count; i++)
+      number_timers(node->data.program.functions[i], counter);
+    number_timers(node->data.program.main_block, counter);
+    break;
+  case NODE_BLOCK:
+    for (int i = 0; i < node->data.block.statement_count; i++)
+      number_timers(node->data.block.statements[i], counter);
+    break;
+  case NODE_FUNCTION_DEF:
+    number_timers(node->data.function_def.body, counter);
+    break;
+  case NODE_TASK_DEF:
+    number_timers(node->data.task_def.body, counter);
+    break;
+  case NODE_IF:
+    number_timers(node->data.if_stmt.then_block, counter);
+    number_timers(node->data.if_stmt.else_block, counter);
+    break;
+  case NODE_WHILE:
+    number_timers(node->data.while_loop.body, counter);
+    break;
+  case NODE_FOR:
+    number_timers(node->data.for_loop.body, counter);
+    break;
+  case NODE_REPEAT:
+    number_timers(node->data.repeat_loop.body, counter);
+    break;
+  case NODE_INTERRUPT_PIN:
+    number_timers(node->data.interrupt_pin.body, counter);
+    break;
+  case NODE_INTERRUPT_TIMER:
+    node->data.interrupt_timer.timer_id = (*counter)++;
+    number_timers(node->data.interrupt_timer.body, counter);
+    break;
+  default:
+    break;
+  }
+}
+
+
+int ast_number_timers(ASTNode *program) {
+  int counter = 0;
+  number_timers(program, &counter);
+  return counter;
+}
+
 /* --- Radio APIs --- */
 ASTNode *ast_radio_send(ASTNode *peer_id, ASTNode *data) {
   ASTNode *node = ast_create(NODE_RADIO_SEND);
@@ -1959,7 +2458,7 @@ ASTNode *ast_arm_move(ASTNode *x, ASTNode *y, ASTNode *z) {
 
 ASTNode *ast_grid_create(const char *name, ASTNode *width, ASTNode *height) {
   ASTNode *node = ast_create(NODE_GRID_CREATE);
-  node->data.grid_create.name = strdup(name);
+  node->data.grid_create.name = ast_intern(name);
   node->data.grid_create.width = width;
   node->data.grid_create.height = height;
   return node;
@@ -1967,7 +2466,7 @@ ASTNode *ast_grid_create(const char *name, ASTNode *width, ASTNode *height) {
 
 ASTNode *ast_grid_obstacle(const char *name, ASTNode *x, ASTNode *y) {
   ASTNode *node = ast_create(NODE_GRID_OBSTACLE);
-  node->data.grid_obstacle.name = strdup(name);
+  node->data.grid_obstacle.name = ast_intern(name);
   node->data.grid_obstacle.x = x;
   node->data.grid_obstacle.y = y;
   return node;
@@ -6,6 +6,8 @@
 #ifndef KINETRIX_AST_H
 #define KINETRIX_AST_H
 
+#include "arena.h"
+#include "intern.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -40,6 +42,8 @@ struct Type {
   int param_count;
   int array_size;    /* For fixed-size arrays (-1 for dynamic) */
   char *struct_name; /* For struct types */
+  int bits;          /* TYPE_INT storage width picked by ast_infer_types(),
+                        0 for the platform int */
 };
 
 /* Type constructors */
@@ -362,6 +366,7 @@ struct ASTNode {
       Operator op;
       ASTNode *left;
       ASTNode *right;
+      int divisor_nonzero; /* OP_DIV: see ast_divisor_nonzero() */
     } binary_op;
 
     /* Unary operation */
@@ -927,6 +932,7 @@ struct ASTNode {
       int pin_count;
       int *in_pins_used; /* INPUT pins */
       int in_pin_count;
+      unsigned long long features; /* 1 << Feature, see feature_usage.h */
     } program;
   } data;
 };
@@ -1060,9 +1066,66 @@ ASTNode *ast_program(ASTNode **functions, int function_count,
 // AST UTILITIES
 // ============================================================================
 
+/* Memory: nodes, types, strings and child arrays come from the arena
+ * installed on the calling thread (see ast_set_arena). With an arena
+ * installed, ast_free() and type_free() are no-ops and everything is
+ * released by arena_destroy(); without one they fall back to malloc/free. */
+void ast_set_arena(Arena *arena);
+Arena *ast_get_arena(void);
+void *ast_alloc(size_t size);
+void *ast_realloc(void *ptr, size_t old_size, size_t new_size);
+char *ast_strdup(const char *s);
+
+/* Names (identifiers, functions, members, types, devices, tasks) are
+ * interned through the pool installed on the calling thread, so two nodes
+ * naming the same thing hold the same pointer. A pool is only installed
+ * together with an arena. */
+void ast_set_string_pool(StringPool *pool);
+StringPool *ast_get_string_pool(void);
+char *ast_intern(const char *s);
+
 void ast_free(ASTNode *node);
 void ast_print(ASTNode *node, int indent);
-void ast_track_pins(ASTNode *program);
+int ast_number_timers(ASTNode *program); /* returns how many timers */
+
+// ============================================================================
+// AST FIELD LAYOUT
+// ============================================================================
+
+/* What each node type keeps in its `data` union, so generic code (the
+ * module cache, tree walks) can handle every node without a switch of its
+ * own. Lists store their element count in a separate int field. */
+typedef enum {
+  AST_FIELD_INT,        /* int or enum */
+  AST_FIELD_DOUBLE,     /* double */
+  AST_FIELD_NAME,       /* char *, interned */
+  AST_FIELD_TEXT,       /* char *, a private copy */
+  AST_FIELD_TYPE,       /* Type * */
+  AST_FIELD_NODE,       /* ASTNode * */
+  AST_FIELD_NODE_LIST,  /* ASTNode ** + count */
+  AST_FIELD_NAME_LIST,  /* char ** (interned) + count */
+  AST_FIELD_TYPE_LIST,  /* Type ** + count */
+  AST_FIELD_STRUCT_LIST /* StructField * + count */
+} AstFieldKind;
+
+typedef struct {
+  AstFieldKind kind;
+  unsigned short offset;       /* byte offset of the field in ASTNode */
+  unsigned short count_offset; /* lists: byte offset of the int count */
+} AstField;
+
+typedef struct {
+  const AstField *fields;
+  int field_count;
+} AstLayout;
+
+/* Layout of a node type; node types without data have field_count 0 */
+const AstLayout *ast_layout(NodeType type);
+/* Changes whenever a layout entry changes, for invalidating saved trees */
+unsigned int ast_layout_fingerprint(void);
+/* A node of the given type with empty data, for code that fills it in
+ * through the layout */
+ASTNode *ast_new_node(NodeType type);
 
 /* --- Radio APIs --- */
 ASTNode *ast_radio_send(ASTNode *peer_id, ASTNode *data);
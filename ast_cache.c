@@ -0,0 +1,809 @@
+/* Kinetrix Module Cache Implementation
+ *
+ * Entry layout (integers are little-endian, "varint" is LEB128):
+ *   "KXAC"  u32 format version  u32 ast_layout_fingerprint()
+ *   u64 source hash   string source path
+ *   varint dependency count, then (string path, u64 hash) per dependency
+ *   string warnings
+ *   varint symbol count, then (string name, varint kind, type, varint
+ *     protocol, int initialized, int used, int line) per declared global
+ *   varint use count, then one string per earlier global the module used
+ *   node tree
+ *
+ * A node is varint (type + 1), or 0 for NULL, followed by its line, its
+ * value type and the fields listed by ast_layout(). A string is varint 0
+ * for NULL, an odd value (index << 1 | 1) naming a string written earlier,
+ * or (length + 1) << 1 followed by the bytes, so repeated names cost one
+ * or two bytes and are interned only once when read back.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "ast_cache.h"
+#include "parallel.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define make_dir(path) _mkdir(path)
+#define getpid _getpid
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#define make_dir(path) mkdir(path, 0755)
+#endif
+
+#define CACHE_MAGIC "KXAC"
+#define CACHE_VERSION 2u
+
+// ============================================================================
+// DEPENDENCIES
+// ============================================================================
+
+void cache_deps_add(CacheDeps *deps, const char *path, uint64_t hash) {
+  if (deps->count == deps->capacity) {
+    deps->capacity = deps->capacity ? deps->capacity * 2 : 4;
+    deps->items = realloc(deps->items, deps->capacity * sizeof(CacheDep));
+  }
+  deps->items[deps->count].path = strdup(path);
+  deps->items[deps->count].hash = hash;
+  deps->count++;
+}
+
+void cache_deps_append(CacheDeps *deps, const CacheDeps *more) {
+  for (int i = 0; i < more->count; i++)
+    cache_deps_add(deps, more->items[i].path, more->items[i].hash);
+}
+
+void cache_deps_free(CacheDeps *deps) {
+  for (int i = 0; i < deps->count; i++)
+    free(deps->items[i].path);
+  free(deps->items);
+  deps->items = NULL;
+  deps->count = deps->capacity = 0;
+}
+
+// ============================================================================
+// HASHING
+// ============================================================================
+
+uint64_t module_cache_hash(const char *text, size_t length) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)text[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+int module_cache_hash_stream(FILE *file, uint64_t *hash) {
+  char chunk[8192];
+  uint64_t h = 14695981039346656037ull;
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      h ^= (unsigned char)chunk[i];
+      h *= 1099511628211ull;
+    }
+  }
+  if (ferror(file))
+    return 0;
+  *hash = h;
+  return 1;
+}
+
+static int hash_file(const char *path, uint64_t *hash) {
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return 0;
+  int ok = module_cache_hash_stream(file, hash);
+  fclose(file);
+  return ok;
+}
+
+// ============================================================================
+// WRITER
+// ============================================================================
+
+typedef struct {
+  unsigned char *data;
+  size_t length;
+  size_t capacity;
+  /* Strings written so far, found by pointer: slots hold index + 1 */
+  const char **strings;
+  size_t string_count;
+  size_t *slots;
+  size_t slot_capacity; /* power of two */
+} Writer;
+
+static void put_bytes(Writer *w, const void *bytes, size_t n) {
+  if (w->length + n > w->capacity) {
+    while (w->length + n > w->capacity)
+      w->capacity = w->capacity ? w->capacity * 2 : 4096;
+    w->data = realloc(w->data, w->capacity);
+  }
+  memcpy(w->data + w->length, bytes, n);
+  w->length += n;
+}
+
+static void put_varint(Writer *w, uint64_t v) {
+  unsigned char buf[10];
+  int n = 0;
+  do {
+    buf[n] = (unsigned char)(v & 0x7f);
+    v >>= 7;
+    if (v)
+      buf[n] |= 0x80;
+    n++;
+  } while (v);
+  put_bytes(w, buf, n);
+}
+
+static void put_int(Writer *w, int v) {
+  /* zigzag, so small negative values stay short */
+  put_varint(w, ((uint32_t)v << 1) ^ (v < 0 ? 0xffffffffu : 0u));
+}
+
+static void put_fixed(Writer *w, uint64_t v, int bytes) {
+  unsigned char buf[8];
+  for (int i = 0; i < bytes; i++)
+    buf[i] = (unsigned char)(v >> (8 * i));
+  put_bytes(w, buf, bytes);
+}
+
+static size_t pointer_slot(const Writer *w, const char *s) {
+  uintptr_t h = (uintptr_t)s;
+  h ^= h >> 17;
+  h *= 0x45d9f3bu;
+  return (size_t)h & (w->slot_capacity - 1);
+}
+
+static void remember_string(Writer *w, const char *s) {
+  if ((w->string_count + 1) * 2 > w->slot_capacity) {
+    size_t old_capacity = w->slot_capacity;
+    size_t *old_slots = w->slots;
+    w->slot_capacity = old_capacity ? old_capacity * 2 : 64;
+    w->slots = calloc(w->slot_capacity, sizeof(size_t));
+    for (size_t i = 0; i < old_capacity; i++) {
+      if (old_slots[i] == 0)
+        continue;
+      size_t j = pointer_slot(w, w->strings[old_slots[i] - 1]);
+      while (w->slots[j])
+        j = (j + 1) & (w->slot_capacity - 1);
+      w->slots[j] = old_slots[i];
+    }
+    free(old_slots);
+    w->strings =
+        realloc(w->strings, w->slot_capacity / 2 * sizeof(const char *));
+  }
+  size_t j = pointer_slot(w, s);
+  while (w->slots[j])
+    j = (j + 1) & (w->slot_capacity - 1);
+  w->strings[w->string_count++] = s;
+  w->slots[j] = w->string_count;
+}
+
+static void put_string(Writer *w, const char *s) {
+  if (s == NULL) {
+    put_varint(w, 0);
+    return;
+  }
+  if (w->slot_capacity) {
+    for (size_t j = pointer_slot(w, s); w->slots[j];
+         j = (j + 1) & (w->slot_capacity - 1)) {
+      if (w->strings[w->slots[j] - 1] == s) {
+        put_varint(w, (uint64_t)(w->slots[j] - 1) << 1 | 1);
+        return;
+      }
+    }
+  }
+  size_t length = strlen(s);
+  put_varint(w, (uint64_t)(length + 1) << 1);
+  put_bytes(w, s, length);
+  remember_string(w, s);
+}
+
+static void put_type(Writer *w, const Type *t) {
+  if (t == NULL) {
+    put_varint(w, 0);
+    return;
+  }
+  put_varint(w, (uint64_t)t->kind + 1);
+  put_int(w, t->array_size);
+  put_string(w, t->struct_name);
+  put_type(w, t->element_type);
+  put_type(w, t->return_type);
+  int params = t->param_types ? t->param_count : 0;
+  put_varint(w, (uint64_t)params);
+  for (int i = 0; i < params; i++)
+    put_type(w, t->param_types[i]);
+}
+
+static void put_node(Writer *w, const ASTNode *node) {
+  if (node == NULL) {
+    put_varint(w, 0);
+    return;
+  }
+  put_varint(w, (uint64_t)node->type + 1);
+  put_int(w, node->line);
+  put_type(w, node->value_type);
+
+  const AstLayout *layout = ast_layout(node->type);
+  const char *base = (const char *)node;
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    const void *at = base + field->offset;
+    int count = 0;
+    if (field->kind >= AST_FIELD_NODE_LIST) {
+      memcpy(&count, base + field->count_offset, sizeof(int));
+      if (*(void *const *)at == NULL)
+        count = 0;
+    }
+    switch (field->kind) {
+    case AST_FIELD_INT:
+      put_int(w, *(const int *)at);
+      break;
+    case AST_FIELD_DOUBLE: {
+      uint64_t bits;
+      memcpy(&bits, at, sizeof(bits));
+      put_fixed(w, bits, 8);
+      break;
+    }
+    case AST_FIELD_NAME:
+    case AST_FIELD_TEXT:
+      put_string(w, *(char *const *)at);
+      break;
+    case AST_FIELD_TYPE:
+      put_type(w, *(Type *const *)at);
+      break;
+    case AST_FIELD_NODE:
+      put_node(w, *(ASTNode *const *)at);
+      break;
+    case AST_FIELD_NODE_LIST:
+      put_varint(w, (uint64_t)count);
+      for (int i = 0; i < count; i++)
+        put_node(w, (*(ASTNode **const *)at)[i]);
+      break;
+    case AST_FIELD_NAME_LIST:
+      put_varint(w, (uint64_t)count);
+      for (int i = 0; i < count; i++)
+        put_string(w, (*(char **const *)at)[i]);
+      break;
+    case AST_FIELD_TYPE_LIST:
+      put_varint(w, (uint64_t)count);
+      for (int i = 0; i < count; i++)
+        put_type(w, (*(Type **const *)at)[i]);
+      break;
+    case AST_FIELD_STRUCT_LIST:
+      put_varint(w, (uint64_t)count);
+      for (int i = 0; i < count; i++) {
+        const StructField *sf = &(*(StructField *const *)at)[i];
+        put_string(w, sf->name);
+        put_type(w, sf->type);
+      }
+      break;
+    }
+  }
+}
+
+// ============================================================================
+// READER
+// ============================================================================
+
+typedef struct {
+  const unsigned char *data;
+  size_t length;
+  size_t pos;
+  int failed; /* set on truncated or malformed input */
+  char **strings;
+  size_t string_count;
+  size_t string_capacity;
+  Type *plain_types[TYPE_ERROR + 1];
+} Reader;
+
+static uint64_t get_varint(Reader *r) {
+  uint64_t v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (r->pos >= r->length) {
+      r->failed = 1;
+      return 0;
+    }
+    unsigned char byte = r->data[r->pos++];
+    v |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return v;
+  }
+  r->failed = 1;
+  return 0;
+}
+
+static int get_int(Reader *r) {
+  uint32_t u = (uint32_t)get_varint(r);
+  return (int)((u >> 1) ^ (0u - (u & 1)));
+}
+
+static uint64_t get_fixed(Reader *r, int bytes) {
+  if (r->length - r->pos < (size_t)bytes) {
+    r->failed = 1;
+    return 0;
+  }
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++)
+    v |= (uint64_t)r->data[r->pos++] << (8 * i);
+  return v;
+}
+
+/* Reads a count and checks it against what could possibly be left */
+static int get_count(Reader *r) {
+  uint64_t v = get_varint(r);
+  if (v > r->length - r->pos) {
+    r->failed = 1;
+    return 0;
+  }
+  return (int)v;
+}
+
+static char *get_string(Reader *r, int intern) {
+  uint64_t v = get_varint(r);
+  if (r->failed || v == 0)
+    return NULL;
+  if (v & 1) {
+    uint64_t index = v >> 1;
+    if (index >= r->string_count) {
+      r->failed = 1;
+      return NULL;
+    }
+    return r->strings[index];
+  }
+  uint64_t length = (v >> 1) - 1;
+  if (length > r->length - r->pos) {
+    r->failed = 1;
+    return NULL;
+  }
+  const char *bytes = (const char *)r->data + r->pos;
+  r->pos += length;
+  char *s;
+  StringPool *pool = ast_get_string_pool();
+  if (intern && pool) {
+    s = (char *)string_pool_intern(pool, bytes, length);
+  } else {
+    s = ast_alloc(length + 1);
+    memcpy(s, bytes, length);
+  }
+  if (r->string_count == r->string_capacity) {
+    r->string_capacity = r->string_capacity ? r->string_capacity * 2 : 64;
+    r->strings = realloc(r->strings, r->string_capacity * sizeof(char *));
+  }
+  r->strings[r->string_count++] = s;
+  return s;
+}
+
+static Type *get_type(Reader *r) {
+  uint64_t tag = get_varint(r);
+  if (r->failed || tag == 0)
+    return NULL;
+  if (tag - 1 > TYPE_ERROR) {
+    r->failed = 1;
+    return NULL;
+  }
+  TypeKind kind = (TypeKind)(tag - 1);
+  int array_size = get_int(r);
+  char *struct_name = get_string(r, 1);
+  Type *element_type = get_type(r);
+  Type *return_type = get_type(r);
+  int param_count = get_count(r);
+  /* Types are never modified once built, so every node of the entry can
+   * share one copy of each plain scalar type */
+  int plain = !array_size && !struct_name && !element_type && !return_type &&
+              !param_count;
+  if (plain && r->plain_types[kind])
+    return r->plain_types[kind];
+
+  Type *t = ast_alloc(sizeof(Type));
+  t->kind = kind;
+  t->array_size = array_size;
+  t->struct_name = struct_name;
+  t->element_type = element_type;
+  t->return_type = return_type;
+  t->param_count = param_count;
+  t->param_types = NULL;
+  if (t->param_count > 0) {
+    t->param_types = ast_alloc(sizeof(Type *) * t->param_count);
+    for (int i = 0; i < t->param_count; i++)
+      t->param_types[i] = get_type(r);
+  }
+  if (plain)
+    r->plain_types[kind] = t;
+  return t;
+}
+
+static ASTNode *get_node(Reader *r) {
+  uint64_t tag = get_varint(r);
+  if (r->failed || tag == 0)
+    return NULL;
+  if (tag - 1 > NODE_PROGRAM) {
+    r->failed = 1;
+    return NULL;
+  }
+  ASTNode *node = ast_new_node((NodeType)(tag - 1));
+  node->line = get_int(r);
+  node->value_type = get_type(r);
+
+  const AstLayout *layout = ast_layout(node->type);
+  char *base = (char *)node;
+  for (int f = 0; f < layout->field_count && !r->failed; f++) {
+    const AstField *field = &layout->fields[f];
+    void *at = base + field->offset;
+    int count = 0;
+    if (field->kind >= AST_FIELD_NODE_LIST) {
+      count = get_count(r);
+      memcpy(base + field->count_offset, &count, sizeof(int));
+    }
+    switch (field->kind) {
+    case AST_FIELD_INT:
+      *(int *)at = get_int(r);
+      break;
+    case AST_FIELD_DOUBLE: {
+      uint64_t bits = get_fixed(r, 8);
+      memcpy(at, &bits, sizeof(double));
+      break;
+    }
+    case AST_FIELD_NAME:
+      *(char **)at = get_string(r, 1);
+      break;
+    case AST_FIELD_TEXT:
+      *(char **)at = get_string(r, 0);
+      break;
+    case AST_FIELD_TYPE:
+      *(Type **)at = get_type(r);
+      break;
+    case AST_FIELD_NODE:
+      *(ASTNode **)at = get_node(r);
+      break;
+    case AST_FIELD_NODE_LIST: {
+      ASTNode **items = count ? ast_alloc(sizeof(ASTNode *) * count) : NULL;
+      for (int i = 0; i < count; i++)
+        items[i] = get_node(r);
+      *(ASTNode ***)at = items;
+      break;
+    }
+    case AST_FIELD_NAME_LIST: {
+      char **items = count ? ast_alloc(sizeof(char *) * count) : NULL;
+      for (int i = 0; i < count; i++)
+        items[i] = get_string(r, 1);
+      *(char ***)at = items;
+      break;
+    }
+    case AST_FIELD_TYPE_LIST: {
+      Type **items = count ? ast_alloc(sizeof(Type *) * count) : NULL;
+      for (int i = 0; i < count; i++)
+        items[i] = get_type(r);
+      *(Type ***)at = items;
+      break;
+    }
+    case AST_FIELD_STRUCT_LIST: {
+      StructField *items =
+          count ? ast_alloc(sizeof(StructField) * count) : NULL;
+      for (int i = 0; i < count; i++) {
+        items[i].name = get_string(r, 1);
+        items[i].type = get_type(r);
+      }
+      *(StructField **)at = items;
+      break;
+    }
+    }
+  }
+  return node;
+}
+
+// ============================================================================
+// CACHE FILES
+// ============================================================================
+
+/* The saved bytes of one module, kept by a resident cache */
+typedef struct CacheEntry {
+  struct CacheEntry *next;
+  char *path;
+  unsigned char *data;
+  size_t length;
+} CacheEntry;
+
+ModuleCache *module_cache_create(const char *dir) {
+  ModuleCache *cache = calloc(1, sizeof(ModuleCache));
+  cache->dir = dir ? strdup(dir) : NULL;
+  cache->resident = dir == NULL;
+  return cache;
+}
+
+void module_cache_free(ModuleCache *cache) {
+  if (cache == NULL)
+    return;
+  CacheEntry *entry = cache->entries;
+  while (entry) {
+    CacheEntry *next = entry->next;
+    free(entry->path);
+    free(entry->data);
+    free(entry);
+    entry = next;
+  }
+  parallel_lock_free(cache->lock);
+  free(cache->dir);
+  free(cache);
+}
+
+void module_cache_keep_resident(ModuleCache *cache) {
+  cache->resident = 1;
+}
+
+void module_cache_share(ModuleCache *cache) {
+  if (cache->lock == NULL)
+    cache->lock = parallel_lock_create();
+}
+
+static CacheEntry *resident_entry(ModuleCache *cache, const char *path) {
+  for (CacheEntry *entry = cache->entries; entry; entry = entry->next)
+    if (strcmp(entry->path, path) == 0)
+      return entry;
+  return NULL;
+}
+
+/* Take ownership of `data` as the resident entry for `path` */
+static void keep_entry(ModuleCache *cache, const char *path,
+                       unsigned char *data, size_t length) {
+  CacheEntry *entry = resident_entry(cache, path);
+  if (entry == NULL) {
+    entry = calloc(1, sizeof(CacheEntry));
+    entry->path = strdup(path);
+    entry->next = cache->entries;
+    cache->entries = entry;
+  }
+  free(entry->data);
+  entry->data = data;
+  entry->length = length;
+}
+
+/* One file per module path, so an edited module replaces its old entry */
+static void entry_path(const ModuleCache *cache, const char *path, char *out,
+                       size_t size) {
+  snprintf(out, size, "%s/%016llx.kxc", cache->dir,
+           (unsigned long long)module_cache_hash(path, strlen(path)));
+}
+
+static unsigned char *read_entry(const char *path, size_t *out_length) {
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return NULL;
+  size_t capacity = 8192;
+  size_t length = 0;
+  unsigned char *data = malloc(capacity);
+  size_t n;
+  while ((n = fread(data + length, 1, capacity - length, file)) > 0) {
+    length += n;
+    if (length == capacity) {
+      capacity *= 2;
+      data = realloc(data, capacity);
+    }
+  }
+  fclose(file);
+  *out_length = length;
+  return data;
+}
+
+static ASTNode *cache_load(ModuleCache *cache, const char *path, uint64_t hash,
+                           CacheDeps *deps, CacheNotes *notes) {
+  size_t length;
+  unsigned char *data;
+  CacheEntry *kept = cache->resident ? resident_entry(cache, path) : NULL;
+  if (kept) {
+    data = kept->data;
+    length = kept->length;
+  } else {
+    if (cache->dir == NULL) {
+      cache->misses++;
+      return NULL;
+    }
+    char file_path[1024];
+    entry_path(cache, path, file_path, sizeof(file_path));
+    data = read_entry(file_path, &length);
+    if (data == NULL) {
+      cache->misses++;
+      return NULL;
+    }
+  }
+
+  Reader r = {data, length, 0, 0, NULL, 0, 0, {NULL}};
+  ASTNode *block = NULL;
+  CacheDeps entry_deps = {NULL, 0, 0};
+
+  if (length < 4 || memcmp(data, CACHE_MAGIC, 4) != 0)
+    goto done;
+  r.pos = 4;
+  if (get_fixed(&r, 4) != CACHE_VERSION ||
+      get_fixed(&r, 4) != ast_layout_fingerprint() ||
+      get_fixed(&r, 8) != hash)
+    goto done;
+
+  /* Saved strings are not interned; they only need to outlive the check */
+  uint64_t v = get_varint(&r);
+  if (r.failed || v == 0 || (v & 1) || (v >> 1) - 1 != strlen(path) ||
+      (v >> 1) - 1 > length - r.pos ||
+      memcmp(data + r.pos, path, (v >> 1) - 1) != 0)
+    goto done;
+  r.pos += (v >> 1) - 1;
+
+  int dep_count = get_count(&r);
+  for (int i = 0; i < dep_count && !r.failed; i++) {
+    uint64_t n = get_varint(&r);
+    if (n == 0 || (n & 1) || (n >> 1) - 1 > length - r.pos) {
+      r.failed = 1;
+      break;
+    }
+    size_t path_length = (size_t)(n >> 1) - 1;
+    char *dep_path = malloc(path_length + 1);
+    memcpy(dep_path, data + r.pos, path_length);
+    dep_path[path_length] = '\0';
+    r.pos += path_length;
+    uint64_t saved = get_fixed(&r, 8);
+    uint64_t current;
+    if (!hash_file(dep_path, &current) || current != saved)
+      r.failed = 1;
+    else
+      cache_deps_add(&entry_deps, dep_path, saved);
+    free(dep_path);
+  }
+  if (r.failed)
+    goto done;
+
+  notes->warnings = get_string(&r, 0);
+  notes->symbol_count = get_count(&r);
+  notes->symbols = NULL;
+  if (notes->symbol_count > 0)
+    notes->symbols = ast_alloc(sizeof(Symbol) * notes->symbol_count);
+  for (int i = 0; i < notes->symbol_count && !r.failed; i++) {
+    Symbol *sym = &notes->symbols[i];
+    sym->name = get_string(&r, 1);
+    sym->kind = (SymbolKind)get_varint(&r);
+    sym->type = get_type(&r);
+    sym->protocol = (ProtocolType)get_varint(&r);
+    sym->is_initialized = get_int(&r);
+    sym->is_used = get_int(&r);
+    sym->line_defined = get_int(&r);
+    if (sym->name == NULL || sym->kind > SYMBOL_DEVICE)
+      r.failed = 1;
+  }
+  notes->use_count = get_count(&r);
+  notes->uses = NULL;
+  if (notes->use_count > 0)
+    notes->uses = ast_alloc(sizeof(char *) * notes->use_count);
+  for (int i = 0; i < notes->use_count && !r.failed; i++) {
+    notes->uses[i] = get_string(&r, 1);
+    if (notes->uses[i] == NULL)
+      r.failed = 1;
+  }
+  block = get_node(&r);
+  if (r.failed || block == NULL || block->type != NODE_BLOCK ||
+      r.pos != length)
+    block = NULL;
+
+done:
+  if (block) {
+    cache->hits++;
+    if (deps)
+      cache_deps_append(deps, &entry_deps);
+  } else {
+    cache->misses++;
+  }
+  cache_deps_free(&entry_deps);
+  free(r.strings);
+  if (block && cache->resident && !kept)
+    keep_entry(cache, path, data, length);
+  else if (!kept)
+    free(data);
+  return block;
+}
+
+static void cache_store(ModuleCache *cache, const char *path, uint64_t hash,
+                        const CacheDeps *deps, const CacheNotes *notes,
+                        const ASTNode *block) {
+  Writer w = {NULL, 0, 0, NULL, 0, NULL, 0};
+  put_bytes(&w, CACHE_MAGIC, 4);
+  put_fixed(&w, CACHE_VERSION, 4);
+  put_fixed(&w, ast_layout_fingerprint(), 4);
+  put_fixed(&w, hash, 8);
+  put_varint(&w, (uint64_t)(strlen(path) + 1) << 1);
+  put_bytes(&w, path, strlen(path));
+  int dep_count = deps ? deps->count : 0;
+  put_varint(&w, (uint64_t)dep_count);
+  for (int i = 0; i < dep_count; i++) {
+    size_t n = strlen(deps->items[i].path);
+    put_varint(&w, (uint64_t)(n + 1) << 1);
+    put_bytes(&w, deps->items[i].path, n);
+    put_fixed(&w, deps->items[i].hash, 8);
+  }
+  put_string(&w, notes->warnings);
+  put_varint(&w, (uint64_t)notes->symbol_count);
+  for (int i = 0; i < notes->symbol_count; i++) {
+    const Symbol *sym = &notes->symbols[i];
+    put_string(&w, sym->name);
+    put_varint(&w, (uint64_t)sym->kind);
+    put_type(&w, sym->type);
+    put_varint(&w, (uint64_t)sym->protocol);
+    put_int(&w, sym->is_initialized);
+    put_int(&w, sym->is_used);
+    put_int(&w, sym->line_defined);
+  }
+  put_varint(&w, (uint64_t)notes->use_count);
+  for (int i = 0; i < notes->use_count; i++)
+    put_string(&w, notes->uses[i]);
+  put_node(&w, block);
+
+  if (cache->dir == NULL) {
+    keep_entry(cache, path, (unsigned char *)w.data, w.length);
+    cache->stores++;
+    free(w.strings);
+    free(w.slots);
+    return;
+  }
+
+  /* Write a private temp file and rename it over the entry, so a reader
+   * never sees half an entry */
+  char file_path[1024];
+  char temp_path[1100];
+  entry_path(cache, path, file_path, sizeof(file_path));
+  snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", file_path,
+           (int)getpid());
+  make_dir(cache->dir);
+  FILE *file = fopen(temp_path, "wb");
+  if (file) {
+    size_t written = fwrite(w.data, 1, w.length, file);
+    if (fclose(file) == 0 && written == w.length) {
+#ifdef _WIN32
+      remove(file_path); /* rename() does not replace an existing file */
+#endif
+      if (rename(temp_path, file_path) == 0)
+        cache->stores++;
+      else
+        remove(temp_path);
+    } else {
+      remove(temp_path);
+    }
+  }
+  if (cache->resident)
+    keep_entry(cache, path, (unsigned char *)w.data, w.length);
+  else
+    free(w.data);
+  free(w.strings);
+  free(w.slots);
+}
+
+/* A shared cache serialises whole loads and stores: a load reads resident
+ * bytes a store may replace, and stores from one process share temp names */
+ASTNode *module_cache_load(ModuleCache *cache, const char *path, uint64_t hash,
+                           CacheDeps *deps, CacheNotes *notes) {
+  if (cache->lock)
+    parallel_lock_acquire(cache->lock);
+  ASTNode *block = cache_load(cache, path, hash, deps, notes);
+  if (cache->lock)
+    parallel_lock_release(cache->lock);
+  return block;
+}
+
+void module_cache_reject(ModuleCache *cache) {
+  if (cache->lock)
+    parallel_lock_acquire(cache->lock);
+  cache->hits--;
+  cache->misses++;
+  if (cache->lock)
+    parallel_lock_release(cache->lock);
+}
+
+void module_cache_store(ModuleCache *cache, const char *path, uint64_t hash,
+                        const CacheDeps *deps, const CacheNotes *notes,
+                        const ASTNode *block) {
+  if (cache->lock)
+    parallel_lock_acquire(cache->lock);
+  cache_store(cache, path, hash, deps, notes, block);
+  if (cache->lock)
+    parallel_lock_release(cache->lock);
+}
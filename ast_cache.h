@@ -0,0 +1,94 @@
+/* Kinetrix Module Cache
+ * Installed modules and included libraries are parsed once and saved as a
+ * compact binary AST under .kxcache/. An entry is keyed by the module's
+ * path and checked against a hash of its text and of every file it
+ * included, so an unchanged module is loaded instead of lexed and parsed.
+ */
+
+#ifndef KINETRIX_AST_CACHE_H
+#define KINETRIX_AST_CACHE_H
+
+#include "ast.h"
+#include "symbol_table.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#define KX_CACHE_DIR ".kxcache"
+
+// ============================================================================
+// DEPENDENCIES
+// ============================================================================
+
+/* Files (other than the module itself) whose text went into a saved tree */
+typedef struct {
+    char *path;
+    uint64_t hash;
+} CacheDep;
+
+typedef struct {
+    CacheDep *items;
+    int count;
+    int capacity;
+} CacheDeps;
+
+void cache_deps_add(CacheDeps *deps, const char *path, uint64_t hash);
+void cache_deps_append(CacheDeps *deps, const CacheDeps *more);
+void cache_deps_free(CacheDeps *deps);
+
+/* What parsing a module left behind besides its tree, replayed on a hit:
+ * the warnings it printed and, for installed modules (whose globals share
+ * the program's symbol table), the globals it declared and the earlier ones
+ * it used. */
+typedef struct {
+    const char *warnings;  // May be NULL
+    Symbol *symbols;
+    int symbol_count;
+    char **uses;
+    int use_count;
+} CacheNotes;
+
+// ============================================================================
+// CACHE
+// ============================================================================
+
+typedef struct ModuleCache {
+    char *dir;   // Directory holding one entry per module path, or NULL
+    int hits;
+    int misses;
+    int stores;
+    int resident;                // Also keep entries in memory
+    struct CacheEntry *entries;  // Resident entries, one per module path
+    struct ParallelLock *lock;   // Set once the cache is shared by threads
+} ModuleCache;
+
+/* A NULL `dir` makes a memory-only cache; it is resident from the start */
+ModuleCache *module_cache_create(const char *dir);
+void module_cache_free(ModuleCache *cache);
+/* Keep every entry loaded or stored from now on in memory as well, so a
+ * long-running compiler (kcc --serve) stops rereading .kxcache/. Entries
+ * are still checked against the module and its includes on every load. */
+void module_cache_keep_resident(ModuleCache *cache);
+/* Allow loads and stores from several compiles running at once */
+void module_cache_share(ModuleCache *cache);
+
+/* 64-bit FNV-1a of a module's text */
+uint64_t module_cache_hash(const char *text, size_t length);
+/* Hash of everything left in `file`; returns 0 if it cannot be read */
+int module_cache_hash_stream(FILE *file, uint64_t *hash);
+
+/* The block of top-level statements saved for `path` when its text hashed
+ * to `hash`, rebuilt in the installed AST arena; NULL on a miss. On a hit
+ * the entry's dependencies are appended to `deps` (which may be NULL) and
+ * `notes` is filled in, also from the arena. */
+ASTNode *module_cache_load(ModuleCache *cache, const char *path, uint64_t hash,
+                           CacheDeps *deps, CacheNotes *notes);
+/* The caller could not use the block its last load returned (it would
+ * duplicate a file the compilation already has): count it as a miss */
+void module_cache_reject(ModuleCache *cache);
+/* Save `block` for `path`. Failures are silent: the cache is only an
+ * optimisation. */
+void module_cache_store(ModuleCache *cache, const char *path, uint64_t hash,
+                        const CacheDeps *deps, const CacheNotes *notes,
+                        const ASTNode *block);
+
+#endif // KINETRIX_AST_CACHE_H
@@ -0,0 +1,58 @@
+#!/bin/bash
+
+# Kinetrix compile benchmark
+# Generates synthetic corpora with bench/corpus_gen and compiles each one
+# for every target with a release build of kcc. Reports the best-of-N
+# wall time as lines/sec, peak RSS and generated output size per backend.
+#
+# Usage: bench/compile_bench.sh [size] [runs]     (run by `make bench`)
+
+SIZE=${1:-2000}
+RUNS=${2:-3}
+KCC=./bench/kcc
+GEN=./bench/corpus_gen
+SHAPES=("functions" "tasks" "nesting" "globals" "wrappers" "mixed")
+TARGETS=("arduino" "esp32" "rpi" "pico" "ros2")
+
+if [ ! -x "$KCC" ] || [ ! -x "$GEN" ]; then
+    echo "Build first: make bench/kcc bench/corpus_gen"
+    exit 1
+fi
+
+work=$(mktemp -d /tmp/kx_bench.XXXXXX)
+trap 'rm -rf "$work"' EXIT
+
+echo "Kinetrix compile benchmark (size $SIZE, best of $RUNS)"
+printf "%-10s %-8s %8s %10s %12s %10s %12s\n" \
+       "corpus" "target" "lines" "ms" "lines/sec" "peak KB" "output B"
+
+for shape in "${SHAPES[@]}"; do
+    src="$work/$shape.kx"
+    "$GEN" "$shape" "$SIZE" > "$src"
+    lines=$(wc -l < "$src")
+    for target in "${TARGETS[@]}"; do
+        best=""
+        peak=""
+        for ((run = 0; run < RUNS; run++)); do
+            # The JSON report ends with the totals line on stderr
+            if ! "$KCC" "$src" -t "$target" -o "$work/out" --no-cache \
+                   --time-passes=json > /dev/null 2> "$work/report"; then
+                echo "$shape ($target): compile failed"
+                exit 1
+            fi
+            totals=$(grep '"total_ms"' "$work/report")
+            ms=$(echo "$totals" | sed 's/.*"total_ms": \([0-9.]*\).*/\1/')
+            kb=$(echo "$totals" | sed 's/.*"peak_rss_kb": \(-\{0,1\}[0-9]*\).*/\1/')
+            if [ -z "$best" ] || awk "BEGIN { exit !($ms < $best) }"; then
+                best=$ms
+            fi
+            if [ -z "$peak" ] || [ "$kb" -gt "$peak" ]; then
+                peak=$kb
+            fi
+        done
+        size=$(wc -c < "$work/out")
+        rate=$(awk "BEGIN { printf \"%.0f\", ($best > 0 ? $lines * 1000 / $best : 0) }")
+        printf "%-10s %-8s %8d %10.3f %12s %10s %12d\n" \
+               "$shape" "$target" "$lines" "$best" "$rate" "$peak" "$size"
+    done
+done
@@ -0,0 +1,211 @@
+/* Kinetrix synthetic corpus generator
+ * Writes a scalable .kx program to stdout for the compile benchmark. Every
+ * shape compiles on all five targets.
+ *
+ * Usage: bench/corpus_gen <shape> [n]
+ *   functions  n library functions with loops, branches and arithmetic
+ *   tasks      n tasks, each blinking its own pin, all started by program
+ *   nesting    n statements nested up to 200 blocks deep
+ *   globals    n * 10 global variables, read back in program
+ *   wrappers   n functions driving the Wave 1-7 hardware wrappers
+ *   mixed      all of the above at size n / 4
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_DEPTH 200
+
+static void gen_functions(int n) {
+  for (int i = 0; i < n; i++) {
+    printf("make var state_%d = 0\n", i);
+    printf("def update_%d(int error, int last_error) {\n", i);
+    printf("  make int gain = error * %d - last_error / 2\n", i % 7 + 1);
+    printf("  if gain > 255 {\n");
+    printf("    set gain to 255\n");
+    printf("  } else {\n");
+    printf("    if gain < 0 - 255 { set gain to 0 - 255 }\n");
+    printf("  }\n");
+    printf("  repeat 4 { change state_%d by 1 }\n", i);
+    printf("  for i from 0 to 10 { set gain to gain + i * 2 }\n");
+    printf("  return gain + state_%d\n", i);
+    printf("}\n");
+  }
+}
+
+static void call_functions(int n) {
+  for (int i = 0; i < n; i++)
+    printf("  print update_%d(%d, 1)\n", i, i);
+}
+
+static void gen_tasks(int n) {
+  for (int i = 0; i < n; i++) {
+    printf("task worker_%d {\n", i);
+    printf("  loop forever {\n");
+    printf("    turn on pin %d\n", 2 + i % 20);
+    printf("    wait %d\n", 50 + i % 100);
+    printf("    turn off pin %d\n", 2 + i % 20);
+    printf("    wait %d\n", 100 + i % 100);
+    printf("  }\n");
+    printf("}\n");
+  }
+}
+
+static void start_tasks(int n) {
+  for (int i = 0; i < n; i++)
+    printf("  start task worker_%d\n", i);
+}
+
+static void indent(int depth) {
+  for (int d = 0; d < depth; d++)
+    fputs("  ", stdout);
+}
+
+/* Statements are spread over towers of nested if / repeat / while blocks */
+static void gen_nesting(int n) {
+  printf("make var depth_total = 0\n");
+  printf("def nested() {\n");
+  int emitted = 0;
+  while (emitted < n) {
+    int depth = n - emitted < MAX_DEPTH ? n - emitted : MAX_DEPTH;
+    for (int d = 1; d <= depth; d++) {
+      indent(d);
+      switch (d % 3) {
+      case 0:
+        printf("if depth_total < %d {\n", d * 1000);
+        break;
+      case 1:
+        printf("repeat 2 {\n");
+        break;
+      default:
+        printf("while depth_total < %d {\n", d * 10);
+        break;
+      }
+      indent(d + 1);
+      printf("change depth_total by %d\n", d % 5 + 1);
+    }
+    for (int d = depth; d >= 1; d--) {
+      indent(d);
+      printf("}\n");
+    }
+    emitted += depth;
+  }
+  printf("}\n");
+}
+
+static void gen_globals(int n) {
+  for (int i = 0; i < n * 10; i++)
+    printf("make var global_%d = %d\n", i, i % 1000);
+}
+
+static void use_globals(int n) {
+  printf("  make var global_sum = 0\n");
+  for (int i = 0; i < n * 10; i++)
+    printf("  change global_sum by global_%d\n", i);
+  printf("  print global_sum\n");
+}
+
+static void gen_wrappers(int n) {
+  printf("attach servo pin 9\n");
+  printf("attach strip pin 6 count 30\n");
+  printf("attach stepper step 2 dir 3\n");
+  printf("attach motor enable 9 forward 8 reverse 7\n");
+  printf("attach pid kp 2.0 ki 0.5 kd 1.0\n");
+  printf("connect mqtt \"broker.local\" port 1883\n");
+  printf("attach imu i2c\n");
+  printf("attach gps serial 9600\n");
+  printf("attach lidar i2c\n");
+  printf("attach oled width 128 height 64\n");
+  printf("attach audio pin 25\n");
+  printf("attach camera protocol i2c\n");
+  printf("attach mecanum fl 2 fr 3 bl 4 br 5\n");
+  printf("attach kalman\n");
+  printf("attach arm dof 3 length1 10.5 length2 8.2 length3 5.0\n");
+  for (int i = 0; i < n; i++) {
+    printf("def sense_%d() {\n", i);
+    printf("  move servo to %d\n", i % 180);
+    printf("  set pixel %d to 255 %d 0\n", i % 30, i % 256);
+    printf("  show pixels\n");
+    printf("  move stepper %d\n", 10 + i % 200);
+    printf("  move motor forward at %d\n", i % 256);
+    printf("  mqtt publish \"kinetrix/tick\" \"%d\"\n", i);
+    printf("  make float ax = read accel x\n");
+    printf("  make float head = read orientation\n");
+    printf("  make float lat = read latitude\n");
+    printf("  make float dist = read distance precise\n");
+    printf("  make float smooth = compute kalman raw dist\n");
+    printf("  make float out = compute pid smooth\n");
+    printf("  oled print \"tick %d\" at x 10 y 20\n", i);
+    printf("  oled show\n");
+    printf("  play frequency %d duration 100\n", 220 + i % 660);
+    printf("  move mecanum x %d y 0 turn %d\n", i % 100, i % 45);
+    printf("  move arm to x %d y 5 z 10\n", 5 + i % 10);
+    printf("  make float cx = read camera object x\n");
+    printf("  return ax + head + lat + out + cx\n");
+    printf("}\n");
+  }
+}
+
+static void call_wrappers(int n) {
+  for (int i = 0; i < n; i++)
+    printf("  print sense_%d()\n", i);
+  printf("  stop mecanum\n");
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <functions|tasks|nesting|globals|wrappers|"
+                    "mixed> [n]\n",
+            argv[0]);
+    return 1;
+  }
+  const char *shape = argv[1];
+  int n = argc > 2 ? atoi(argv[2]) : 1000;
+  if (n < 1)
+    n = 1;
+
+  printf("# Generated by bench/corpus_gen %s %d\n", shape, n);
+  if (strcmp(shape, "functions") == 0) {
+    gen_functions(n);
+    printf("program {\n");
+    call_functions(n);
+    printf("}\n");
+  } else if (strcmp(shape, "tasks") == 0) {
+    gen_tasks(n);
+    printf("program {\n");
+    start_tasks(n);
+    printf("}\n");
+  } else if (strcmp(shape, "nesting") == 0) {
+    gen_nesting(n);
+    printf("program {\n  nested()\n  print depth_total\n}\n");
+  } else if (strcmp(shape, "globals") == 0) {
+    gen_globals(n);
+    printf("program {\n");
+    use_globals(n);
+    printf("}\n");
+  } else if (strcmp(shape, "wrappers") == 0) {
+    gen_wrappers(n);
+    printf("program {\n");
+    call_wrappers(n);
+    printf("}\n");
+  } else if (strcmp(shape, "mixed") == 0) {
+    int part = n / 4 > 0 ? n / 4 : 1;
+    gen_globals(part);
+    gen_functions(part);
+    gen_tasks(part);
+    gen_nesting(part);
+    gen_wrappers(part);
+    printf("program {\n");
+    use_globals(part);
+    call_functions(part);
+    start_tasks(part);
+    printf("  nested()\n");
+    call_wrappers(part);
+    printf("}\n");
+  } else {
+    fprintf(stderr, "Unknown shape '%s'\n", shape);
+    return 1;
+  }
+  return 0;
+}
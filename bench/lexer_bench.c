@@ -0,0 +1,91 @@
+/* Kinetrix lexer micro-benchmark
+ * Generates a large synthetic .kx corpus and measures how fast the lexer
+ * turns it into tokens. Only the public lexer API is used, so the numbers
+ * reflect what the parser sees.
+ *
+ * Usage: bench/lexer_bench [lines] [iterations]
+ */
+
+#include "../parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Typical statement shapes: keyword-heavy lines mixed with user identifiers
+ * that must fall through the whole keyword lookup. */
+static const char *corpus_lines[] = {
+    "make var motor_speed_%d = 0\n",
+    "set target_heading_%d to read analog pin A0 * 2 + offset_%d\n",
+    "if distance_cm_%d < 20 and obstacle_flag_%d == true {\n",
+    "  turn on pin 13\n",
+    "  wait 250\n",
+    "} else {\n",
+    "  change counter_%d by 1\n",
+    "}\n",
+    "repeat 10 times { print \"tick %d\" }\n",
+    "for i_%d from 0 to 100 { set accumulator_%d to accumulator_%d + i_%d }\n",
+    "while running_%d { move servo_%d to 90 }\n",
+    "def compute_gain_%d(error_%d, last_error_%d) {\n",
+    "  return error_%d * 0x1F - last_error_%d / 3\n",
+    "}\n",
+    "# comment line with words that look like keywords: read write loop\n",
+};
+
+static char *build_corpus(int lines, size_t *out_len) {
+  size_t cap = (size_t)lines * 96 + 64;
+  char *buf = malloc(cap);
+  size_t len = 0;
+  int n = (int)(sizeof(corpus_lines) / sizeof(corpus_lines[0]));
+  for (int i = 0; i < lines; i++) {
+    const char *fmt = corpus_lines[i % n];
+    int w = snprintf(buf + len, cap - len, fmt, i, i, i, i, i);
+    if (w < 0 || (size_t)w >= cap - len)
+      break;
+    len += (size_t)w;
+  }
+  *out_len = len;
+  return buf;
+}
+
+int main(int argc, char **argv) {
+  int lines = argc > 1 ? atoi(argv[1]) : 200000;
+  int iterations = argc > 2 ? atoi(argv[2]) : 5;
+  size_t len;
+  char *corpus = build_corpus(lines, &len);
+
+  FILE *f = tmpfile();
+  if (!f) {
+    perror("tmpfile");
+    return 1;
+  }
+  fwrite(corpus, 1, len, f);
+  free(corpus);
+
+  double best = 0;
+  long tokens = 0;
+  for (int it = 0; it < iterations; it++) {
+    ErrorList *errors = error_list_create(100);
+    StringPool *strings = string_pool_create();
+    rewind(f);
+    clock_t t0 = clock();
+    Lexer *lexer = lexer_create(f, "<bench>", errors, strings);
+    tokens = 0;
+    while (lexer->current_token.type != TOK_EOF) {
+      tokens++;
+      lexer_next_token(lexer);
+    }
+    double secs = (double)(clock() - t0) / CLOCKS_PER_SEC;
+    lexer_free(lexer);
+    string_pool_free(strings);
+    error_list_free(errors);
+    if (it == 0 || secs < best)
+      best = secs;
+  }
+  fclose(f);
+
+  printf("lexer: %d lines, %.1f MB, %ld tokens\n", lines, len / 1e6, tokens);
+  printf("best of %d: %.3f s  (%.2f M tokens/s, %.1f MB/s)\n", iterations,
+         best, best > 0 ? tokens / best / 1e6 : 0.0,
+         best > 0 ? len / best / 1e6 : 0.0);
+  return 0;
+}
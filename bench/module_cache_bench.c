@@ -0,0 +1,148 @@
+/* Kinetrix module cache benchmark
+ * Writes a synthetic project of installed modules plus a main file, then
+ * times parsing it three ways: with the cache disabled, against an empty
+ * cache (parse + store), and against a warm cache (load only).
+ *
+ * Usage: bench/module_cache_bench [modules] [functions] [iterations]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../parser.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* One library function; %d is the module number, %d the function number */
+static const char *function_template =
+    "make var state_%d_%d = 0\n"
+    "def update_%d_%d(int error, int last_error) {\n"
+    "  make int gain = error * 3 - last_error / 2\n"
+    "  if gain > 255 {\n"
+    "    set gain to 255\n"
+    "  } else {\n"
+    "    if gain < 0 - 255 { set gain to 0 - 255 }\n"
+    "  }\n"
+    "  repeat 4 { change state_%d_%d by 1 }\n"
+    "  for i from 0 to 10 { set gain to gain + i * 2 }\n"
+    "  return gain + state_%d_%d\n"
+    "}\n";
+
+static char root[] = "/tmp/kxbench.XXXXXX";
+
+static void write_project(int modules, int functions) {
+  char path[512];
+  for (int m = 0; m < modules; m++) {
+    snprintf(path, sizeof(path), "%s/module_%02d.kx", root, m);
+    FILE *f = fopen(path, "w");
+    for (int fn = 0; fn < functions; fn++)
+      fprintf(f, function_template, m, fn, m, fn, m, fn, m, fn);
+    fclose(f);
+  }
+  snprintf(path, sizeof(path), "%s/main.kx", root);
+  FILE *f = fopen(path, "w");
+  fprintf(f, "program {\n");
+  for (int m = 0; m < modules; m++)
+    fprintf(f, "  print update_%d_0(%d, 1)\n", m, m);
+  fprintf(f, "}\n");
+  fclose(f);
+}
+
+/* Parse the project once; returns CPU seconds spent */
+static double parse_project(int modules, const char *cache_dir) {
+  SourceFile *files = malloc(sizeof(SourceFile) * (modules + 1));
+  char **paths = malloc(sizeof(char *) * (modules + 1));
+  for (int m = 0; m <= modules; m++) {
+    char path[512];
+    if (m < modules)
+      snprintf(path, sizeof(path), "%s/module_%02d.kx", root, m);
+    else
+      snprintf(path, sizeof(path), "%s/main.kx", root);
+    paths[m] = strdup(path);
+    files[m].file = fopen(path, "r");
+    files[m].path = paths[m];
+    files[m].text = NULL;
+  }
+
+  clock_t t0 = clock();
+  ErrorList *errors = error_list_create(10);
+  ModuleCache *cache = cache_dir ? module_cache_create(cache_dir) : NULL;
+  Parser *parser = parser_create_multi(files, modules + 1, errors);
+  parser_set_cache(parser, cache);
+  ASTNode *program = parser_parse(parser);
+  if (!program || errors->count > 0) {
+    fprintf(stderr, "bench project failed to parse\n");
+    error_print_all(errors, stderr);
+    exit(1);
+  }
+  parser_free(parser);
+  module_cache_free(cache);
+  error_list_free(errors);
+  double secs = (double)(clock() - t0) / CLOCKS_PER_SEC;
+
+  for (int m = 0; m <= modules; m++) {
+    fclose(files[m].file);
+    free(paths[m]);
+  }
+  free(files);
+  free(paths);
+  return secs;
+}
+
+static void remove_tree(const char *dir) {
+  DIR *d = opendir(dir);
+  if (!d)
+    return;
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+    if (remove(path) != 0)
+      remove_tree(path);
+  }
+  closedir(d);
+  rmdir(dir);
+}
+
+int main(int argc, char **argv) {
+  int modules = argc > 1 ? atoi(argv[1]) : 20;
+  int functions = argc > 2 ? atoi(argv[2]) : 200;
+  int iterations = argc > 3 ? atoi(argv[3]) : 5;
+  if (!mkdtemp(root)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  write_project(modules, functions);
+
+  double uncached = 0, cold = 0, warm = 0;
+  char cache_dir[512];
+  for (int it = 0; it < iterations; it++) {
+    double secs = parse_project(modules, NULL);
+    if (it == 0 || secs < uncached)
+      uncached = secs;
+
+    snprintf(cache_dir, sizeof(cache_dir), "%s/cold%d", root, it);
+    secs = parse_project(modules, cache_dir);
+    if (it == 0 || secs < cold)
+      cold = secs;
+  }
+
+  snprintf(cache_dir, sizeof(cache_dir), "%s/warm", root);
+  parse_project(modules, cache_dir);
+  for (int it = 0; it < iterations; it++) {
+    double secs = parse_project(modules, cache_dir);
+    if (it == 0 || secs < warm)
+      warm = secs;
+  }
+  remove_tree(root);
+
+  printf("module cache: %d modules x %d functions\n", modules, functions);
+  printf("best of %d:  no cache %.3f s   cold %.3f s   warm %.3f s  "
+         "(%.1fx)\n",
+         iterations, uncached, cold, warm, warm > 0 ? cold / warm : 0.0);
+  return 0;
+}
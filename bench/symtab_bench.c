@@ -0,0 +1,85 @@
+/* Kinetrix symbol table micro-benchmark
+ * Measures insert, lookup (hits and misses) and scope enter/exit at
+ * 10, 1k and 100k symbols through the public symbol table API.
+ *
+ * Usage: bench/symtab_bench
+ */
+
+#include "../symbol_table.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double seconds_since(clock_t t0) {
+  return (double)(clock() - t0) / CLOCKS_PER_SEC;
+}
+
+static void run(int symbol_count, long lookups) {
+  StringPool *strings = string_pool_create();
+  Type *int_type = type_int();
+  char buf[32];
+
+  /* Names are interned up front, as the lexer does during parsing */
+  const char **names = malloc(sizeof(char *) * symbol_count);
+  const char **missing = malloc(sizeof(char *) * symbol_count);
+  for (int i = 0; i < symbol_count; i++) {
+    snprintf(buf, sizeof(buf), "sym_%d", i);
+    names[i] = string_pool_intern_str(strings, buf);
+    snprintf(buf, sizeof(buf), "nope_%d", i);
+    missing[i] = string_pool_intern_str(strings, buf);
+  }
+
+  SymbolTable *table = symbol_table_create(strings);
+
+  clock_t t0 = clock();
+  for (int i = 0; i < symbol_count; i++)
+    symbol_table_add(table, names[i], SYMBOL_PARAMETER, int_type, i);
+  double insert_s = seconds_since(t0);
+
+  /* Look up from inside a few nested scopes, like code in a loop body */
+  for (int d = 0; d < 4; d++)
+    symbol_table_enter_scope(table);
+
+  long found = 0;
+  t0 = clock();
+  for (long i = 0; i < lookups; i++)
+    found += symbol_table_lookup(table, names[i % symbol_count]) != NULL;
+  double hit_s = seconds_since(t0);
+
+  t0 = clock();
+  for (long i = 0; i < lookups; i++)
+    found += symbol_table_lookup(table, missing[i % symbol_count]) != NULL;
+  double miss_s = seconds_since(t0);
+
+  for (int d = 0; d < 4; d++)
+    symbol_table_exit_scope(table);
+
+  /* Block-heavy code: a scope per loop with one loop variable */
+  long scopes = lookups / 10;
+  t0 = clock();
+  for (long i = 0; i < scopes; i++) {
+    symbol_table_enter_scope(table);
+    symbol_table_add(table, names[i % symbol_count], SYMBOL_PARAMETER,
+                     int_type, 0);
+    symbol_table_exit_scope(table);
+  }
+  double scope_s = seconds_since(t0);
+
+  printf("%7d symbols | insert %8.1f ns | hit %6.1f ns | miss %6.1f ns | "
+         "scope %7.1f ns  (%ld)\n",
+         symbol_count, insert_s * 1e9 / symbol_count, hit_s * 1e9 / lookups,
+         miss_s * 1e9 / lookups, scope_s * 1e9 / scopes, found);
+
+  symbol_table_free(table);
+  type_free(int_type);
+  free(names);
+  free(missing);
+  string_pool_free(strings);
+}
+
+int main(void) {
+  run(10, 2000000);
+  run(1000, 2000000);
+  run(100000, 200000);
+  return 0;
+}
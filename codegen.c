@@ -1,6 +1,8 @@
 /* Kinetrix Code Generator Implementation - Multi-Target Dispatcher */
 
 #include "codegen.h"
+#include "feature_usage.h"
+#include "value_range.h"
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
@@ -41,6 +43,23 @@ const char *target_extension(Target t) {
   }
 }
 
+const char *target_key(Target t) {
+  switch (t) {
+  case TARGET_ARDUINO:
+    return "arduino";
+  case TARGET_ESP32:
+    return "esp32";
+  case TARGET_RPI:
+    return "rpi";
+  case TARGET_PICO:
+    return "pico";
+  case TARGET_ROS2:
+    return "ros2";
+  default:
+    return "unknown";
+  }
+}
+
 // ── Constructor / Destructor ───────────────────────────────────────────────
 
 CodeGen *codegen_create(FILE *output) {
@@ -49,37 +68,63 @@ CodeGen *codegen_create(FILE *output) {
 
 CodeGen *codegen_create_for_target(FILE *output, Target target) {
   CodeGen *gen = malloc(sizeof(CodeGen));
+  outbuf_init(&gen->out);
   gen->output = output;
   gen->indent_level = 0;
   gen->temp_var_counter = 0;
   gen->loop_counter = 0;
   gen->target = target;
+  gen->inside_task = 0;
   return gen;
 }
 
-void codegen_free(CodeGen *gen) { free(gen); }
+void codegen_free(CodeGen *gen) {
+  outbuf_free(&gen->out);
+  free(gen);
+}
 
 // ── Shared emit helpers ────────────────────────────────────────────────────
 
 void codegen_emit_indent(CodeGen *gen) {
-  for (int i = 0; i < gen->indent_level; i++)
-    fprintf(gen->output, "  ");
+  outbuf_spaces(&gen->out, gen->indent_level * 2);
 }
 
 void codegen_emit(CodeGen *gen, const char *format, ...) {
   va_list args;
   va_start(args, format);
-  vfprintf(gen->output, format, args);
+  outbuf_vprintf(&gen->out, format, args);
   va_end(args);
 }
 
+void codegen_emit_number(CodeGen *gen, const ASTNode *number) {
+  double value = number->data.number.value;
+  char text[32];
+  for (int precision = 6; precision <= 17; precision++) {
+    snprintf(text, sizeof(text), "%.*g", precision, value);
+    if (strtod(text, NULL) == value)
+      break;
+  }
+  int python = gen->target == TARGET_RPI || gen->target == TARGET_PICO;
+  if (!python && number->value_type &&
+      number->value_type->kind == TYPE_FLOAT && !strpbrk(text, ".en"))
+    strcat(text, ".0");
+  outbuf_puts(&gen->out, text);
+}
+
+const char *codegen_counter_type(const ASTNode *for_loop) {
+  const Type *type = for_loop->value_type;
+  if (type && (type->kind == TYPE_INT || type->kind == TYPE_BYTE))
+    return type_to_ctype((Type *)type);
+  return "int";
+}
+
 void codegen_emit_line(CodeGen *gen, const char *format, ...) {
   codegen_emit_indent(gen);
   va_list args;
   va_start(args, format);
-  vfprintf(gen->output, format, args);
+  outbuf_vprintf(&gen->out, format, args);
   va_end(args);
-  fprintf(gen->output, "\n");
+  outbuf_putc(&gen->out, '\n');
 }
 
 // ── Main dispatcher ────────────────────────────────────────────────────────
@@ -103,6 +148,8 @@ void codegen_generate(CodeGen *gen, ASTNode *program) {
     codegen_generate_arduino(gen, program);
     break;
   }
+  if (gen->output)
+    outbuf_flush(&gen->out, gen->output);
 }
 
 // Forward declarations
@@ -119,7 +166,7 @@ static void codegen_emit_escaped_string(CodeGen *gen, const char *s) {
     case '\n': codegen_emit(gen, "\\n"); break;
     case '\r': codegen_emit(gen, "\\r"); break;
     case '\t': codegen_emit(gen, "\\t"); break;
-    default:   fputc(*p, gen->output); break;
+    default:   outbuf_putc(&gen->out, *p); break;
     }
   }
   codegen_emit(gen, "\"");
@@ -132,7 +179,7 @@ static void codegen_expression(CodeGen *gen, ASTNode *node) {
 
   switch (node->type) {
   case NODE_NUMBER:
-    codegen_emit(gen, "%g", node->data.number.value);
+    codegen_emit_number(gen, node);
     break;
 
   case NODE_BOOL:
@@ -212,7 +259,15 @@ static void codegen_expression(CodeGen *gen, ASTNode *node) {
       codegen_emit(gen, ") + String(");
       codegen_expression(gen, node->data.binary_op.right);
       codegen_emit(gen, "))");
-    } else if (node->data.binary_op.op == OP_DIV) {
+    } else if (node->data.binary_op.op == OP_DIV &&
+               ast_divisor_nonzero(node, RANGE_INT_BITS_AVR)) {
+      codegen_emit(gen, "((");
+      codegen_expression(gen, node->data.binary_op.left);
+      codegen_emit(gen, ") / (");
+      codegen_expression(gen, node->data.binary_op.right);
+      codegen_emit(gen, "))");
+    } else if (node->data.binary_op.op == OP_DIV &&
+               ast_expr_is_pure(node->data.binary_op.right)) {
       codegen_emit(gen, "((");
       codegen_expression(gen, node->data.binary_op.right);
       codegen_emit(gen, ") == 0 ? 0 : ((");
@@ -220,6 +275,13 @@ static void codegen_expression(CodeGen *gen, ASTNode *node) {
       codegen_emit(gen, ") / (");
       codegen_expression(gen, node->data.binary_op.right);
       codegen_emit(gen, ")))");
+    } else if (node->data.binary_op.op == OP_DIV) {
+      // Evaluate a divisor with side effects (a pin read, a call) once
+      codegen_emit(gen, "_kx_div(");
+      codegen_expression(gen, node->data.binary_op.left);
+      codegen_emit(gen, ", ");
+      codegen_expression(gen, node->data.binary_op.right);
+      codegen_emit(gen, ")");
     } else {
       codegen_emit(gen, "(");
       codegen_expression(gen, node->data.binary_op.left);
@@ -1210,9 +1272,11 @@ static void codegen_statement(CodeGen *gen, ASTNode *node) {
                    loop_id, loop_id, loop_id);
     }
 
+    // ast_infer_types() may have picked a narrower counter
     codegen_emit_line(gen,
-                      "for (int %s = _start_%d; _step_%d > 0 ? %s <= _end_%d : "
+                      "for (%s %s = _start_%d; _step_%d > 0 ? %s <= _end_%d : "
                       "%s >= _end_%d; %s += _step_%d) {\n",
+                      codegen_counter_type(node),
                       node->data.for_loop.var_name, loop_id, loop_id,
                       node->data.for_loop.var_name, loop_id,
                       node->data.for_loop.var_name, loop_id,
@@ -1574,50 +1638,6 @@ static void codegen_statement(CodeGen *gen, ASTNode *node) {
   }
 }
 
-static void codegen_assign_timer_ids(ASTNode *node, int *counter) {
-  if (!node)
-    return;
-  switch (node->type) {
-  case NODE_PROGRAM:
-    for (int i = 0; i < node->data.program.function_count; i++)
-      codegen_assign_timer_ids(node->data.program.functions[i], counter);
-    codegen_assign_timer_ids(node->data.program.main_block, counter);
-    break;
-  case NODE_BLOCK:
-    for (int i = 0; i < node->data.block.statement_count; i++)
-      codegen_assign_timer_ids(node->data.block.statements[i], counter);
-    break;
-  case NODE_FUNCTION_DEF:
-    codegen_assign_timer_ids(node->data.function_def.body, counter);
-    break;
-  case NODE_TASK_DEF:
-    codegen_assign_timer_ids(node->data.task_def.body, counter);
-    break;
-  case NODE_IF:
-    codegen_assign_timer_ids(node->data.if_stmt.then_block, counter);
-    codegen_assign_timer_ids(node->data.if_stmt.else_block, counter);
-    break;
-  case NODE_WHILE:
-    codegen_assign_timer_ids(node->data.while_loop.body, counter);
-    break;
-  case NODE_FOR:
-    codegen_assign_timer_ids(node->data.for_loop.body, counter);
-    break;
-  case NODE_REPEAT:
-    codegen_assign_timer_ids(node->data.repeat_loop.body, counter);
-    break;
-  case NODE_INTERRUPT_PIN:
-    codegen_assign_timer_ids(node->data.interrupt_pin.body, counter);
-    break;
-  case NODE_INTERRUPT_TIMER:
-    node->data.interrupt_timer.timer_id = (*counter)++;
-    codegen_assign_timer_ids(node->data.interrupt_timer.body, counter);
-    break;
-  default:
-    break;
-  }
-}
-
 static void codegen_hoist_isrs(CodeGen *gen, ASTNode *node) {
   if (!node)
     return;
@@ -1682,164 +1702,238 @@ void codegen_generate_arduino(CodeGen *gen, ASTNode *program) {
 
   ASTNode *block = program->data.program.main_block;
 
-  /* --- Includes --- */
-  codegen_emit_line(gen, "#include <Wire.h>\n");
-  codegen_emit_line(gen, "#include <SPI.h>\n");
-  codegen_emit_line(gen, "#include <avr/wdt.h>\n");
-  codegen_emit_line(gen, "#include <Servo.h>\n");
-  codegen_emit_line(gen, "#include <DHT.h>\n");
-  codegen_emit_line(gen, "#include <Adafruit_NeoPixel.h>\n");
-  codegen_emit_line(gen, "#include <LiquidCrystal_I2C.h>\n");
+  /* --- Includes: only the libraries of features the program uses --- */
+  int uses_wire = ast_uses_feature(program, FEATURE_I2C) ||
+                  ast_uses_feature(program, FEATURE_DEVICE) ||
+                  ast_uses_feature(program, FEATURE_LCD) ||
+                  ast_uses_feature(program, FEATURE_IMU) ||
+                  ast_uses_feature(program, FEATURE_LIDAR) ||
+                  ast_uses_feature(program, FEATURE_OLED) ||
+                  ast_uses_feature(program, FEATURE_CAMERA);
+  int uses_spi = ast_uses_feature(program, FEATURE_SPI) ||
+                 ast_uses_feature(program, FEATURE_DEVICE) ||
+                 ast_uses_feature(program, FEATURE_SD);
+  size_t prelude_start = gen->out.length; // Blink needs none of it
+  if (uses_wire)
+    codegen_emit_line(gen, "#include <Wire.h>\n");
+  if (uses_spi)
+    codegen_emit_line(gen, "#include <SPI.h>\n");
+  if (ast_uses_feature(program, FEATURE_WATCHDOG))
+    codegen_emit_line(gen, "#include <avr/wdt.h>\n");
+  if (ast_uses_feature(program, FEATURE_SERVO) ||
+      ast_uses_feature(program, FEATURE_ESC))
+    codegen_emit_line(gen, "#include <Servo.h>\n");
+  if (ast_uses_feature(program, FEATURE_DHT))
+    codegen_emit_line(gen, "#include <DHT.h>\n");
+  if (ast_uses_feature(program, FEATURE_NEOPIXEL))
+    codegen_emit_line(gen, "#include <Adafruit_NeoPixel.h>\n");
+  if (ast_uses_feature(program, FEATURE_LCD))
+    codegen_emit_line(gen, "#include <LiquidCrystal_I2C.h>\n");
   /* Wave 2 Includes */
-  codegen_emit_line(gen, "#include <Stepper.h>\n");
-  codegen_emit_line(gen, "#include <Encoder.h>\n");
-  codegen_emit_line(gen, "#include <PID_v1.h>\n");
+  if (ast_uses_feature(program, FEATURE_STEPPER))
+    codegen_emit_line(gen, "#include <Stepper.h>\n");
+  if (ast_uses_feature(program, FEATURE_ENCODER))
+    codegen_emit_line(gen, "#include <Encoder.h>\n");
+  if (ast_uses_feature(program, FEATURE_PID))
+    codegen_emit_line(gen, "#include <PID_v1.h>\n");
   /* Wave 4 Includes */
-  codegen_emit_line(gen, "#include <SparkFun_BNO080_Arduino_Library.h>\n");
-  codegen_emit_line(gen, "#include <TinyGPSPlus.h>\n");
-  codegen_emit_line(gen, "#include <SoftwareSerial.h>\n");
-  codegen_emit_line(gen, "#include <VL53L0X.h>\n");
-  codegen_emit_line(gen, "#include <SD.h>\n");
-  codegen_emit_line(gen, "\n");
-  codegen_emit_line(gen, "Servo _kx_servo;\n");
-  codegen_emit_line(gen, "DHT *_kx_dht = NULL;\n");
-  codegen_emit_line(gen, "Adafruit_NeoPixel *_kx_strip = NULL;\n");
-  codegen_emit_line(gen, "LiquidCrystal_I2C *_kx_lcd = NULL;\n");
+  if (ast_uses_feature(program, FEATURE_IMU))
+    codegen_emit_line(gen, "#include <SparkFun_BNO080_Arduino_Library.h>\n");
+  if (ast_uses_feature(program, FEATURE_GPS)) {
+    codegen_emit_line(gen, "#include <TinyGPSPlus.h>\n");
+    codegen_emit_line(gen, "#include <SoftwareSerial.h>\n");
+  }
+  if (ast_uses_feature(program, FEATURE_LIDAR))
+    codegen_emit_line(gen, "#include <VL53L0X.h>\n");
+  if (ast_uses_feature(program, FEATURE_SD))
+    codegen_emit_line(gen, "#include <SD.h>\n");
+  if (gen->out.length != prelude_start)
+    codegen_emit_line(gen, "\n");
+  if (ast_uses_feature(program, FEATURE_SERVO))
+    codegen_emit_line(gen, "Servo _kx_servo;\n");
+  if (ast_uses_feature(program, FEATURE_DHT))
+    codegen_emit_line(gen, "DHT *_kx_dht = NULL;\n");
+  if (ast_uses_feature(program, FEATURE_NEOPIXEL))
+    codegen_emit_line(gen, "Adafruit_NeoPixel *_kx_strip = NULL;\n");
+  if (ast_uses_feature(program, FEATURE_LCD))
+    codegen_emit_line(gen, "LiquidCrystal_I2C *_kx_lcd = NULL;\n");
   /* Wave 2 Globals */
-  codegen_emit_line(gen, "Stepper *_kx_stepper = NULL;\n");
+  if (ast_uses_feature(program, FEATURE_STEPPER))
+    codegen_emit_line(gen, "Stepper *_kx_stepper = NULL;\n");
   /* DC Motor uses raw pins */
-  codegen_emit_line(
-      gen, "int _kx_motor_en = -1, _kx_motor_fwd = -1, _kx_motor_rev = -1;\n");
-  codegen_emit_line(gen, "Encoder *_kx_encoder = NULL;\n");
-  codegen_emit_line(gen, "Servo _kx_esc;\n"); // ESC uses Servo protocol
+  if (ast_uses_feature(program, FEATURE_MOTOR))
+    codegen_emit_line(
+        gen, "int _kx_motor_en = -1, _kx_motor_fwd = -1, _kx_motor_rev = -1;\n");
+  if (ast_uses_feature(program, FEATURE_ENCODER))
+    codegen_emit_line(gen, "Encoder *_kx_encoder = NULL;\n");
+  if (ast_uses_feature(program, FEATURE_ESC))
+    codegen_emit_line(gen, "Servo _kx_esc;\n"); // ESC uses Servo protocol
   /* PID globals */
-  codegen_emit_line(
-      gen,
-      "double _kx_pid_setpoint = 0, _kx_pid_input = 0, _kx_pid_output = 0;\n");
-  codegen_emit_line(gen, "PID *_kx_pid = NULL;\n");
+  if (ast_uses_feature(program, FEATURE_PID)) {
+    codegen_emit_line(
+        gen,
+        "double _kx_pid_setpoint = 0, _kx_pid_input = 0, _kx_pid_output = 0;\n");
+    codegen_emit_line(gen, "PID *_kx_pid = NULL;\n");
+  }
   /* Wave 4 Globals */
-  codegen_emit_line(gen, "SparkFun_BNO080 *_kx_imu = NULL;\n");
-  codegen_emit_line(gen, "TinyGPSPlus _kx_gps;\n");
-  codegen_emit_line(gen, "SoftwareSerial _kx_gps_serial(4, 3); // Default "
-                         "RX/TX (Can be overridden)\n");
-  codegen_emit_line(gen, "VL53L0X *_kx_lidar = NULL;\n");
-  codegen_emit_line(gen, "File _kx_file;\n");
-
-  codegen_emit_line(gen, "\n");
+  if (ast_uses_feature(program, FEATURE_IMU))
+    codegen_emit_line(gen, "SparkFun_BNO080 *_kx_imu = NULL;\n");
+  if (ast_uses_feature(program, FEATURE_GPS)) {
+    codegen_emit_line(gen, "TinyGPSPlus _kx_gps;\n");
+    codegen_emit_line(gen, "SoftwareSerial _kx_gps_serial(4, 3); // Default "
+                           "RX/TX (Can be overridden)\n");
+  }
+  if (ast_uses_feature(program, FEATURE_LIDAR))
+    codegen_emit_line(gen, "VL53L0X *_kx_lidar = NULL;\n");
+  if (ast_uses_feature(program, FEATURE_SD))
+    codegen_emit_line(gen, "File _kx_file;\n");
+  if (gen->out.length != prelude_start)
+    codegen_emit_line(gen, "\n");
 
   /* Wave 5 Includes & Globals */
-  codegen_emit_line(gen, "#include <Adafruit_GFX.h>");
-  codegen_emit_line(gen, "#include <Adafruit_SSD1306.h>");
-  codegen_emit_line(gen, "#include <HUSKYLENS.h>\n");
-  codegen_emit_line(gen, "Adafruit_SSD1306 _kx_oled(128, 64, &Wire, -1);");
-  codegen_emit_line(gen, "HUSKYLENS _kx_huskylens;");
-  codegen_emit_line(gen, "int _kx_audio_pin = 25;");
-  codegen_emit_line(gen, "int _kx_volume = 100;\n");
+  if (ast_uses_feature(program, FEATURE_OLED)) {
+    codegen_emit_line(gen, "#include <Adafruit_GFX.h>");
+    codegen_emit_line(gen, "#include <Adafruit_SSD1306.h>");
+    codegen_emit_line(gen, "Adafruit_SSD1306 _kx_oled(128, 64, &Wire, -1);");
+  }
+  if (ast_uses_feature(program, FEATURE_CAMERA)) {
+    codegen_emit_line(gen, "#include <HUSKYLENS.h>\n");
+    codegen_emit_line(gen, "HUSKYLENS _kx_huskylens;");
+  }
+  if (ast_uses_feature(program, FEATURE_AUDIO)) {
+    codegen_emit_line(gen, "int _kx_audio_pin = 25;");
+    codegen_emit_line(gen, "int _kx_volume = 100;\n");
+  }
   /* Wave 6 Includes & Globals */
-  codegen_emit_line(gen, "int _kx_mec_fl = -1, _kx_mec_fr = -1, _kx_mec_bl = -1, _kx_mec_br = -1;\n");
-  codegen_emit_line(gen, "float _kx_kalman_q = 0.01;");
-  codegen_emit_line(gen, "float _kx_kalman_r = 0.1;");
-  codegen_emit_line(gen, "float _kx_kalman_x = 0.0;");
-  codegen_emit_line(gen, "float _kx_kalman_p = 1.0;");
-  codegen_emit_line(gen, "float _kx_kalman_k = 0.0;\n");
+  if (ast_uses_feature(program, FEATURE_MECANUM))
+    codegen_emit_line(gen, "int _kx_mec_fl = -1, _kx_mec_fr = -1, _kx_mec_bl = -1, _kx_mec_br = -1;\n");
+  if (ast_uses_feature(program, FEATURE_KALMAN)) {
+    codegen_emit_line(gen, "float _kx_kalman_q = 0.01;");
+    codegen_emit_line(gen, "float _kx_kalman_r = 0.1;");
+    codegen_emit_line(gen, "float _kx_kalman_x = 0.0;");
+    codegen_emit_line(gen, "float _kx_kalman_p = 1.0;");
+    codegen_emit_line(gen, "float _kx_kalman_k = 0.0;\n");
+  }
 
   /* Wave 6 AI Helpers */
-  codegen_emit_line(gen, "float _kx_ai_invoke(float input) {");
-  codegen_emit_line(gen, "  return 0.0; // TFLite Micro omitted for generic target");
-  codegen_emit_line(gen, "}");
-  codegen_emit_line(gen, "float _kx_ai_invoke(float* input_array) {");
-  codegen_emit_line(gen, "  return 0.0;");
-  codegen_emit_line(gen, "}\n");
+  if (ast_uses_feature(program, FEATURE_AI)) {
+    codegen_emit_line(gen, "float _kx_ai_invoke(float input) {");
+    codegen_emit_line(gen, "  return 0.0; // TFLite Micro omitted for generic target");
+    codegen_emit_line(gen, "}");
+    codegen_emit_line(gen, "float _kx_ai_invoke(float* input_array) {");
+    codegen_emit_line(gen, "  return 0.0;");
+    codegen_emit_line(gen, "}\n");
+  }
 
   /* Wave 7 Globals & Helpers */
-  codegen_emit_line(gen, "// Wave 7: Robotic Arm IK");
-  codegen_emit_line(gen, "int _kx_arm_dof = 3;");
-  codegen_emit_line(gen, "float _kx_arm_len[4] = {0, 0, 0, 0};");
-  codegen_emit_line(gen, "float _kx_arm_angles[4] = {0, 0, 0, 0};");
-  codegen_emit_line(gen, "void _kx_arm_ik(float tx, float ty, float tz) {");
-  codegen_emit_line(gen, "  float r = sqrt(tx*tx + ty*ty);");
-  codegen_emit_line(gen, "  float d = sqrt(r*r + tz*tz);");
-  codegen_emit_line(gen, "  float L1 = _kx_arm_len[0], L2 = _kx_arm_len[1];");
-  codegen_emit_line(gen, "  float cos_a2 = (d*d - L1*L1 - L2*L2) / (2.0*L1*L2);");
-  codegen_emit_line(gen, "  if (cos_a2 < -1) cos_a2 = -1; if (cos_a2 > 1) cos_a2 = 1;");
-  codegen_emit_line(gen, "  _kx_arm_angles[1] = acos(cos_a2);");
-  codegen_emit_line(gen, "  _kx_arm_angles[0] = atan2(tz, r) - atan2(L2*sin(_kx_arm_angles[1]), L1 + L2*cos_a2);");
-  codegen_emit_line(gen, "  _kx_arm_angles[2] = atan2(ty, tx);");
-  codegen_emit_line(gen, "}\n");
+  if (ast_uses_feature(program, FEATURE_ARM)) {
+    codegen_emit_line(gen, "// Wave 7: Robotic Arm IK");
+    codegen_emit_line(gen, "int _kx_arm_dof = 3;");
+    codegen_emit_line(gen, "float _kx_arm_len[4] = {0, 0, 0, 0};");
+    codegen_emit_line(gen, "float _kx_arm_angles[4] = {0, 0, 0, 0};");
+    codegen_emit_line(gen, "void _kx_arm_ik(float tx, float ty, float tz) {");
+    codegen_emit_line(gen, "  float r = sqrt(tx*tx + ty*ty);");
+    codegen_emit_line(gen, "  float d = sqrt(r*r + tz*tz);");
+    codegen_emit_line(gen, "  float L1 = _kx_arm_len[0], L2 = _kx_arm_len[1];");
+    codegen_emit_line(gen, "  float cos_a2 = (d*d - L1*L1 - L2*L2) / (2.0*L1*L2);");
+    codegen_emit_line(gen, "  if (cos_a2 < -1) cos_a2 = -1; if (cos_a2 > 1) cos_a2 = 1;");
+    codegen_emit_line(gen, "  _kx_arm_angles[1] = acos(cos_a2);");
+    codegen_emit_line(gen, "  _kx_arm_angles[0] = atan2(tz, r) - atan2(L2*sin(_kx_arm_angles[1]), L1 + L2*cos_a2);");
+    codegen_emit_line(gen, "  _kx_arm_angles[2] = atan2(ty, tx);");
+    codegen_emit_line(gen, "}\n");
+  }
 
-  codegen_emit_line(gen, "// Wave 7: Pathfinding (A*)");
-  /* AVR-safe grid/BFS: 16x16 grid + 256-entry queue = ~1KB total */
-  codegen_emit_line(gen, "int _kx_grid_w = 0, _kx_grid_h = 0;");
-  codegen_emit_line(gen, "static int _kx_grid[16][16];");
-  codegen_emit_line(gen, "int _kx_path_result[128];");
-  codegen_emit_line(gen, "int _kx_path_len = 0;");
-  codegen_emit_line(gen, "int _kx_path_compute(int sx, int sy, int gx, int gy) {");
-  codegen_emit_line(gen, "  _kx_path_len = 0;");
-  codegen_emit_line(gen, "  if (sx == gx && sy == gy) return 0;");
-  codegen_emit_line(gen, "  static int visited[16][16]; memset(visited, 0, sizeof(visited));");
-  codegen_emit_line(gen, "  static int qx[256], qy[256], qp[256]; int qf=0, qb=0;");
-  codegen_emit_line(gen, "  qx[qb]=sx; qy[qb]=sy; qp[qb]=-1; qb++; visited[sy][sx]=1;");
-  codegen_emit_line(gen, "  int dx[]={1,-1,0,0}, dy[]={0,0,1,-1};");
-  codegen_emit_line(gen, "  while(qf<qb) {");
-  codegen_emit_line(gen, "    int cx=qx[qf],cy=qy[qf],cp=qf; qf++;");
-  codegen_emit_line(gen, "    if(cx==gx && cy==gy) {");
-  codegen_emit_line(gen, "      int t=cp; while(t!=-1){_kx_path_result[_kx_path_len++]=qx[t]*100+qy[t];t=qp[t];}");
-  codegen_emit_line(gen, "      return _kx_path_len;");
-  codegen_emit_line(gen, "    }");
-  codegen_emit_line(gen, "    for(int i=0;i<4;i++){");
-  codegen_emit_line(gen, "      int nx=cx+dx[i],ny=cy+dy[i];");
-  codegen_emit_line(gen, "      if(nx>=0&&nx<_kx_grid_w&&ny>=0&&ny<_kx_grid_h&&!visited[ny][nx]&&!_kx_grid[ny][nx]){");
-  codegen_emit_line(gen, "        visited[ny][nx]=1; qx[qb]=nx; qy[qb]=ny; qp[qb]=cp; if(qb<255) qb++;");
-  codegen_emit_line(gen, "      }");
-  codegen_emit_line(gen, "    }");
-  codegen_emit_line(gen, "  }");
-  codegen_emit_line(gen, "  return 0;");
-  codegen_emit_line(gen, "}\n");
+  if (ast_uses_feature(program, FEATURE_PATH)) {
+    codegen_emit_line(gen, "// Wave 7: Pathfinding (A*)");
+    /* AVR-safe grid/BFS: 16x16 grid + 256-entry queue = ~1KB total */
+    codegen_emit_line(gen, "int _kx_grid_w = 0, _kx_grid_h = 0;");
+    codegen_emit_line(gen, "static int _kx_grid[16][16];");
+    codegen_emit_line(gen, "int _kx_path_result[128];");
+    codegen_emit_line(gen, "int _kx_path_len = 0;");
+    codegen_emit_line(gen, "int _kx_path_compute(int sx, int sy, int gx, int gy) {");
+    codegen_emit_line(gen, "  _kx_path_len = 0;");
+    codegen_emit_line(gen, "  if (sx == gx && sy == gy) return 0;");
+    codegen_emit_line(gen, "  static int visited[16][16]; memset(visited, 0, sizeof(visited));");
+    codegen_emit_line(gen, "  static int qx[256], qy[256], qp[256]; int qf=0, qb=0;");
+    codegen_emit_line(gen, "  qx[qb]=sx; qy[qb]=sy; qp[qb]=-1; qb++; visited[sy][sx]=1;");
+    codegen_emit_line(gen, "  int dx[]={1,-1,0,0}, dy[]={0,0,1,-1};");
+    codegen_emit_line(gen, "  while(qf<qb) {");
+    codegen_emit_line(gen, "    int cx=qx[qf],cy=qy[qf],cp=qf; qf++;");
+    codegen_emit_line(gen, "    if(cx==gx && cy==gy) {");
+    codegen_emit_line(gen, "      int t=cp; while(t!=-1){_kx_path_result[_kx_path_len++]=qx[t]*100+qy[t];t=qp[t];}");
+    codegen_emit_line(gen, "      return _kx_path_len;");
+    codegen_emit_line(gen, "    }");
+    codegen_emit_line(gen, "    for(int i=0;i<4;i++){");
+    codegen_emit_line(gen, "      int nx=cx+dx[i],ny=cy+dy[i];");
+    codegen_emit_line(gen, "      if(nx>=0&&nx<_kx_grid_w&&ny>=0&&ny<_kx_grid_h&&!visited[ny][nx]&&!_kx_grid[ny][nx]){");
+    codegen_emit_line(gen, "        visited[ny][nx]=1; qx[qb]=nx; qy[qb]=ny; qp[qb]=cp; if(qb<255) qb++;");
+    codegen_emit_line(gen, "      }");
+    codegen_emit_line(gen, "    }");
+    codegen_emit_line(gen, "  }");
+    codegen_emit_line(gen, "  return 0;");
+    codegen_emit_line(gen, "}\n");
+  }
 
-  codegen_emit_line(gen, "// Wave 7: Drone Flight Stabilization");
-  codegen_emit_line(gen, "int _kx_drone_fl=-1,_kx_drone_fr=-1,_kx_drone_bl=-1,_kx_drone_br=-1;");
-  codegen_emit_line(gen, "void _kx_drone_mix(float pitch, float roll, float yaw, float throttle) {");
-  codegen_emit_line(gen, "  int fl = (int)(throttle + pitch + roll - yaw);");
-  codegen_emit_line(gen, "  int fr = (int)(throttle + pitch - roll + yaw);");
-  codegen_emit_line(gen, "  int bl = (int)(throttle - pitch + roll + yaw);");
-  codegen_emit_line(gen, "  int br = (int)(throttle - pitch - roll - yaw);");
-  codegen_emit_line(gen, "  if(fl<0)fl=0; if(fl>255)fl=255;");
-  codegen_emit_line(gen, "  if(fr<0)fr=0; if(fr>255)fr=255;");
-  codegen_emit_line(gen, "  if(bl<0)bl=0; if(bl>255)bl=255;");
-  codegen_emit_line(gen, "  if(br<0)br=0; if(br>255)br=255;");
-  codegen_emit_line(gen, "  analogWrite(_kx_drone_fl, fl);");
-  codegen_emit_line(gen, "  analogWrite(_kx_drone_fr, fr);");
-  codegen_emit_line(gen, "  analogWrite(_kx_drone_bl, bl);");
-  codegen_emit_line(gen, "  analogWrite(_kx_drone_br, br);");
-  codegen_emit_line(gen, "}\n");
+  if (ast_uses_feature(program, FEATURE_DRONE)) {
+    codegen_emit_line(gen, "// Wave 7: Drone Flight Stabilization");
+    codegen_emit_line(gen, "int _kx_drone_fl=-1,_kx_drone_fr=-1,_kx_drone_bl=-1,_kx_drone_br=-1;");
+    codegen_emit_line(gen, "void _kx_drone_mix(float pitch, float roll, float yaw, float throttle) {");
+    codegen_emit_line(gen, "  int fl = (int)(throttle + pitch + roll - yaw);");
+    codegen_emit_line(gen, "  int fr = (int)(throttle + pitch - roll + yaw);");
+    codegen_emit_line(gen, "  int bl = (int)(throttle - pitch + roll + yaw);");
+    codegen_emit_line(gen, "  int br = (int)(throttle - pitch - roll - yaw);");
+    codegen_emit_line(gen, "  if(fl<0)fl=0; if(fl>255)fl=255;");
+    codegen_emit_line(gen, "  if(fr<0)fr=0; if(fr>255)fr=255;");
+    codegen_emit_line(gen, "  if(bl<0)bl=0; if(bl>255)bl=255;");
+    codegen_emit_line(gen, "  if(br<0)br=0; if(br>255)br=255;");
+    codegen_emit_line(gen, "  analogWrite(_kx_drone_fl, fl);");
+    codegen_emit_line(gen, "  analogWrite(_kx_drone_fr, fr);");
+    codegen_emit_line(gen, "  analogWrite(_kx_drone_bl, bl);");
+    codegen_emit_line(gen, "  analogWrite(_kx_drone_br, br);");
+    codegen_emit_line(gen, "}\n");
+  }
 
   /* Wave 4 Helpers */
-  codegen_emit_line(gen, "float _kx_imu_get_heading() {");
-  codegen_emit_line(gen, "  if(!_kx_imu) return 0.0;");
-  codegen_emit_line(gen, "  float q0 = _kx_imu->getQuatI();");
-  codegen_emit_line(gen, "  float q1 = _kx_imu->getQuatJ();");
-  codegen_emit_line(gen, "  float q2 = _kx_imu->getQuatK();");
-  codegen_emit_line(gen, "  float q3 = _kx_imu->getQuatReal();");
-  codegen_emit_line(gen, "  return atan2(2.0*(q0*q1 + q2*q3), 1.0 - 2.0*(q1*q1 "
-                         "+ q2*q2)) * 180.0/M_PI;");
-  codegen_emit_line(gen, "}");
+  if (ast_uses_feature(program, FEATURE_IMU)) {
+    codegen_emit_line(gen, "float _kx_imu_get_heading() {");
+    codegen_emit_line(gen, "  if(!_kx_imu) return 0.0;");
+    codegen_emit_line(gen, "  float q0 = _kx_imu->getQuatI();");
+    codegen_emit_line(gen, "  float q1 = _kx_imu->getQuatJ();");
+    codegen_emit_line(gen, "  float q2 = _kx_imu->getQuatK();");
+    codegen_emit_line(gen, "  float q3 = _kx_imu->getQuatReal();");
+    codegen_emit_line(gen, "  return atan2(2.0*(q0*q1 + q2*q3), 1.0 - 2.0*(q1*q1 "
+                           "+ q2*q2)) * 180.0/M_PI;");
+    codegen_emit_line(gen, "}");
+  }
+
+  /* x / y where y has side effects: y is evaluated once */
+  if (ast_uses_feature(program, FEATURE_DIV)) {
+    codegen_emit_line(gen, "template <typename A, typename B>");
+    codegen_emit_line(gen, "static inline auto _kx_div(A a, B b) -> decltype(a / b) {");
+    codegen_emit_line(gen, "  return b == 0 ? 0 : a / b;");
+    codegen_emit_line(gen, "}\n");
+  }
 
   /* Wave 6 Helpers */
-  codegen_emit_line(gen, "float _kx_kalman_update(float mea) {");
-  codegen_emit_line(gen, "  _kx_kalman_p = _kx_kalman_p + _kx_kalman_q;");
-  codegen_emit_line(gen, "  _kx_kalman_k = _kx_kalman_p / (_kx_kalman_p + _kx_kalman_r);");
-  codegen_emit_line(gen, "  _kx_kalman_x = _kx_kalman_x + _kx_kalman_k * (mea - _kx_kalman_x);");
-  codegen_emit_line(gen, "  _kx_kalman_p = (1.0 - _kx_kalman_k) * _kx_kalman_p;");
-  codegen_emit_line(gen, "  return _kx_kalman_x;");
-  codegen_emit_line(gen, "}\n");
-  codegen_emit_line(gen, "const char* _kx_file_read_string() {");
-  codegen_emit_line(gen, "  if (!_kx_file) return \"\";");
-  codegen_emit_line(gen, "  static char buf[256];");
-  codegen_emit_line(gen, "  int i=0; while(_kx_file.available() && i<255) "
-                         "buf[i++] = _kx_file.read();");
-  codegen_emit_line(gen, "  buf[i] = 0;");
-  codegen_emit_line(gen, "  return buf;");
-  codegen_emit_line(gen, "}\n");
+  if (ast_uses_feature(program, FEATURE_KALMAN)) {
+    codegen_emit_line(gen, "float _kx_kalman_update(float mea) {");
+    codegen_emit_line(gen, "  _kx_kalman_p = _kx_kalman_p + _kx_kalman_q;");
+    codegen_emit_line(gen, "  _kx_kalman_k = _kx_kalman_p / (_kx_kalman_p + _kx_kalman_r);");
+    codegen_emit_line(gen, "  _kx_kalman_x = _kx_kalman_x + _kx_kalman_k * (mea - _kx_kalman_x);");
+    codegen_emit_line(gen, "  _kx_kalman_p = (1.0 - _kx_kalman_k) * _kx_kalman_p;");
+    codegen_emit_line(gen, "  return _kx_kalman_x;");
+    codegen_emit_line(gen, "}\n");
+  }
+  if (ast_uses_feature(program, FEATURE_SD)) {
+    codegen_emit_line(gen, "const char* _kx_file_read_string() {");
+    codegen_emit_line(gen, "  if (!_kx_file) return \"\";");
+    codegen_emit_line(gen, "  static char buf[256];");
+    codegen_emit_line(gen, "  int i=0; while(_kx_file.available() && i<255) "
+                           "buf[i++] = _kx_file.read();");
+    codegen_emit_line(gen, "  buf[i] = 0;");
+    codegen_emit_line(gen, "  return buf;");
+    codegen_emit_line(gen, "}\n");
+  }
 
   /* --- Hoist struct definitions --- */
   if (block && block->type == NODE_BLOCK) {
@@ -1865,8 +1959,6 @@ void codegen_generate_arduino(CodeGen *gen, ASTNode *program) {
   }
   codegen_emit(gen, "\n");
   // Recursively hoist timer/pin interrupt bodies globally
-  int timer_id_counter = 0;
-  codegen_assign_timer_ids(program, &timer_id_counter);
   codegen_hoist_isrs(gen, program);
 
   /* --- Hoist task functions with run-flags --- */
@@ -6,6 +6,7 @@
 #define KINETRIX_CODEGEN_H
 
 #include "ast.h"
+#include "outbuf.h"
 #include <stdio.h>
 
 // Supported compilation targets
@@ -14,12 +15,14 @@ typedef enum {
     TARGET_ESP32,         // ESP32 / ESP8266 (.cpp)
     TARGET_RPI,           // Raspberry Pi Python/RPi.GPIO (.py)
     TARGET_PICO,          // Raspberry Pi Pico MicroPython (.py)
-    TARGET_ROS2           // ROS2 C++ node (.cpp)
+    TARGET_ROS2,          // ROS2 C++ node (.cpp)
+    TARGET_COUNT
 } Target;
 
 // Code generator context
 typedef struct {
-    FILE    *output;
+    OutBuf   out;              // Generated code, formatted in memory
+    FILE    *output;           // Where codegen_generate() writes it, or NULL
     int      indent_level;
     int      temp_var_counter;
     int      loop_counter;
@@ -27,7 +30,8 @@ typedef struct {
     int      inside_task;      // 1 if currently generating inside a task block
 } CodeGen;
 
-// Create/destroy code generator
+// Create/destroy code generator. With a NULL output the generated code is
+// left in gen->out for the caller to flush or use.
 CodeGen* codegen_create(FILE *output);
 CodeGen* codegen_create_for_target(FILE *output, Target target);
 void     codegen_free(CodeGen *gen);
@@ -47,10 +51,16 @@ void codegen_generate_ros2(CodeGen *gen, ASTNode *program);
 void codegen_emit_indent(CodeGen *gen);
 void codegen_emit(CodeGen *gen, const char *format, ...);
 void codegen_emit_line(CodeGen *gen, const char *format, ...);
+// Shortest literal that reads back as the same double; float-typed whole
+// numbers keep a ".0" on the C++ targets so C does not divide them as ints
+void codegen_emit_number(CodeGen *gen, const ASTNode *number);
+// C type of a for loop's counter: "int" unless type inference narrowed it
+const char *codegen_counter_type(const ASTNode *for_loop);
 
 // Target name helper
 const char* target_name(Target t);
 const char* target_extension(Target t);
+const char* target_key(Target t);   // Name used on the command line
 
 #endif // KINETRIX_CODEGEN_H
 
@@ -6,6 +6,8 @@
 
 #include "ast.h"
 #include "codegen.h"
+#include "feature_usage.h"
+#include "value_range.h"
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,7 +27,7 @@ static void esp32_emit_escaped_string(CodeGen *gen, const char *s) {
     case '\n': codegen_emit(gen, "\\n"); break;
     case '\r': codegen_emit(gen, "\\r"); break;
     case '\t': codegen_emit(gen, "\\t"); break;
-    default:   fputc(*p, gen->output); break;
+    default:   outbuf_putc(&gen->out, *p); break;
     }
   }
   codegen_emit(gen, "\"");
@@ -41,7 +43,7 @@ static void esp32_expression(CodeGen *gen, ASTNode *node) {
 
   switch (node->type) {
   case NODE_NUMBER:
-    codegen_emit(gen, "%g", node->data.number.value);
+    codegen_emit_number(gen, node);
     break;
   case NODE_STRING:
     esp32_emit_escaped_string(gen, node->data.string.value);
@@ -115,7 +117,15 @@ static void esp32_expression(CodeGen *gen, ASTNode *node) {
       codegen_emit(gen, ") + String(");
       esp32_expression(gen, node->data.binary_op.right);
       codegen_emit(gen, "))");
-    } else if (node->data.binary_op.op == OP_DIV) {
+    } else if (node->data.binary_op.op == OP_DIV &&
+               ast_divisor_nonzero(node, RANGE_INT_BITS)) {
+      codegen_emit(gen, "((");
+      esp32_expression(gen, node->data.binary_op.left);
+      codegen_emit(gen, ") / (");
+      esp32_expression(gen, node->data.binary_op.right);
+      codegen_emit(gen, "))");
+    } else if (node->data.binary_op.op == OP_DIV &&
+               ast_expr_is_pure(node->data.binary_op.right)) {
       codegen_emit(gen, "((");
       esp32_expression(gen, node->data.binary_op.right);
       codegen_emit(gen, ") == 0 ? 0 : ((");
@@ -123,6 +133,13 @@ static void esp32_expression(CodeGen *gen, ASTNode *node) {
       codegen_emit(gen, ") / (");
       esp32_expression(gen, node->data.binary_op.right);
       codegen_emit(gen, ")))");
+    } else if (node->data.binary_op.op == OP_DIV) {
+      // Evaluate a divisor with side effects (a pin read, a call) once
+      codegen_emit(gen, "_kx_div(");
+      esp32_expression(gen, node->data.binary_op.left);
+      codegen_emit(gen, ", ");
+      esp32_expression(gen, node->data.binary_op.right);
+      codegen_emit(gen, ")");
     } else {
       codegen_emit(gen, "(");
       esp32_expression(gen, node->data.binary_op.left);
@@ -1063,9 +1080,11 @@ static void esp32_statement(CodeGen *gen, ASTNode *node) {
                    loop_id, loop_id, loop_id);
     }
 
+    // ast_infer_types() may have picked a narrower counter
     codegen_emit_line(gen,
-                      "for (int %s = _start_%d; _step_%d > 0 ? %s <= _end_%d : "
+                      "for (%s %s = _start_%d; _step_%d > 0 ? %s <= _end_%d : "
                       "%s >= _end_%d; %s += _step_%d) {\n",
+                      codegen_counter_type(node),
                       node->data.for_loop.var_name, loop_id, loop_id,
                       node->data.for_loop.var_name, loop_id,
                       node->data.for_loop.var_name, loop_id,
@@ -1206,8 +1225,8 @@ static void esp32_statement(CodeGen *gen, ASTNode *node) {
     codegen_emit_line(gen, "  uint32_t _h = 0x4fafc201;");
     codegen_emit_line(gen, "  for (int i = 0; i < _ble_name.length(); i++) _h = _h * 31 + _ble_name[i];");
     codegen_emit_line(gen, "  char _svc_uuid[48], _chr_uuid[48];");
-    codegen_emit_line(gen, "  snprintf(_svc_uuid, sizeof(_svc_uuid), \"%08x-1fb5-459e-8fcc-c5c9c331914b\", _h);");
-    codegen_emit_line(gen, "  snprintf(_chr_uuid, sizeof(_chr_uuid), \"%08x-36e1-4688-b7f5-ea07361b26a8\", _h ^ 0xBEB5483E);");
+    codegen_emit_line(gen, "  snprintf(_svc_uuid, sizeof(_svc_uuid), \"%%08x-1fb5-459e-8fcc-c5c9c331914b\", _h);");
+    codegen_emit_line(gen, "  snprintf(_chr_uuid, sizeof(_chr_uuid), \"%%08x-36e1-4688-b7f5-ea07361b26a8\", _h ^ 0xBEB5483E);");
     codegen_emit_line(gen, "  BLEService *pService = pServer->createService(_svc_uuid);");
     codegen_emit_line(gen,
                       "  _kx_ble_char = "
@@ -1444,50 +1463,6 @@ static void esp32_statement(CodeGen *gen, ASTNode *node) {
 // RECURSIVE PRE-PASSES (ISR HOISTING)
 // ============================================================
 
-static void esp32_assign_timer_ids(ASTNode *node, int *counter) {
-  if (!node)
-    return;
-  switch (node->type) {
-  case NODE_PROGRAM:
-    for (int i = 0; i < node->data.program.function_count; i++)
-      esp32_assign_timer_ids(node->data.program.functions[i], counter);
-    esp32_assign_timer_ids(node->data.program.main_block, counter);
-    break;
-  case NODE_BLOCK:
-    for (int i = 0; i < node->data.block.statement_count; i++)
-      esp32_assign_timer_ids(node->data.block.statements[i], counter);
-    break;
-  case NODE_FUNCTION_DEF:
-    esp32_assign_timer_ids(node->data.function_def.body, counter);
-    break;
-  case NODE_TASK_DEF:
-    esp32_assign_timer_ids(node->data.task_def.body, counter);
-    break;
-  case NODE_IF:
-    esp32_assign_timer_ids(node->data.if_stmt.then_block, counter);
-    esp32_assign_timer_ids(node->data.if_stmt.else_block, counter);
-    break;
-  case NODE_WHILE:
-    esp32_assign_timer_ids(node->data.while_loop.body, counter);
-    break;
-  case NODE_FOR:
-    esp32_assign_timer_ids(node->data.for_loop.body, counter);
-    break;
-  case NODE_REPEAT:
-    esp32_assign_timer_ids(node->data.repeat_loop.body, counter);
-    break;
-  case NODE_INTERRUPT_PIN:
-    esp32_assign_timer_ids(node->data.interrupt_pin.body, counter);
-    break;
-  case NODE_INTERRUPT_TIMER:
-    node->data.interrupt_timer.timer_id = (*counter)++;
-    esp32_assign_timer_ids(node->data.interrupt_timer.body, counter);
-    break;
-  default:
-    break;
-  }
-}
-
 static void esp32_hoist_isrs(CodeGen *gen, ASTNode *node) {
   if (!node)
     return;
@@ -1557,208 +1532,310 @@ void codegen_generate_esp32(CodeGen *gen, ASTNode *program) {
   codegen_emit_line(gen,
                     "// Upload via: Arduino IDE with ESP32 board package\n");
   codegen_emit_line(gen, "#include <Arduino.h>\n");
-  codegen_emit_line(gen, "#include <WiFi.h>");
-  codegen_emit_line(gen, "#include <ArduinoOTA.h>");
-  codegen_emit_line(gen, "#include <esp_now.h>");
-  codegen_emit_line(gen, "#include <esp_task_wdt.h>");
-  codegen_emit_line(gen, "#include <esp32-hal-ledc.h>");
-  codegen_emit_line(gen, "#include <ESP32Servo.h>");
-  codegen_emit_line(gen, "#include <DHT.h>");
-  codegen_emit_line(gen, "#include <Adafruit_NeoPixel.h>");
-  codegen_emit_line(gen, "#include <LiquidCrystal_I2C.h>");
+  int uses_wifi = ast_uses_feature(program, FEATURE_WIFI) ||
+                  ast_uses_feature(program, FEATURE_RADIO) ||
+                  ast_uses_feature(program, FEATURE_MQTT) ||
+                  ast_uses_feature(program, FEATURE_HTTP) ||
+                  ast_uses_feature(program, FEATURE_WEBSOCKET) ||
+                  ast_uses_feature(program, FEATURE_OTA);
+  int uses_pwm = ast_uses_feature(program, FEATURE_PWM) ||
+                 ast_uses_feature(program, FEATURE_MOTOR) ||
+                 ast_uses_feature(program, FEATURE_MECANUM) ||
+                 ast_uses_feature(program, FEATURE_DRONE);
+  int uses_wire = ast_uses_feature(program, FEATURE_I2C) ||
+                  ast_uses_feature(program, FEATURE_DEVICE) ||
+                  ast_uses_feature(program, FEATURE_LCD) ||
+                  ast_uses_feature(program, FEATURE_IMU) ||
+                  ast_uses_feature(program, FEATURE_LIDAR) ||
+                  ast_uses_feature(program, FEATURE_OLED) ||
+                  ast_uses_feature(program, FEATURE_CAMERA);
+  int uses_spi = ast_uses_feature(program, FEATURE_SPI) ||
+                 ast_uses_feature(program, FEATURE_DEVICE) ||
+                 ast_uses_feature(program, FEATURE_SD);
+  if (uses_wire)
+    codegen_emit_line(gen, "#include <Wire.h>");
+  if (uses_spi)
+    codegen_emit_line(gen, "#include <SPI.h>");
+  if (uses_wifi)
+    codegen_emit_line(gen, "#include <WiFi.h>");
+  if (ast_uses_feature(program, FEATURE_OTA))
+    codegen_emit_line(gen, "#include <ArduinoOTA.h>");
+  if (ast_uses_feature(program, FEATURE_RADIO))
+    codegen_emit_line(gen, "#include <esp_now.h>");
+  if (ast_uses_feature(program, FEATURE_WATCHDOG))
+    codegen_emit_line(gen, "#include <esp_task_wdt.h>");
+  if (uses_pwm)
+    codegen_emit_line(gen, "#include <esp32-hal-ledc.h>");
+  if (ast_uses_feature(program, FEATURE_SERVO) ||
+      ast_uses_feature(program, FEATURE_ESC))
+    codegen_emit_line(gen, "#include <ESP32Servo.h>");
+  if (ast_uses_feature(program, FEATURE_DHT))
+    codegen_emit_line(gen, "#include <DHT.h>");
+  if (ast_uses_feature(program, FEATURE_NEOPIXEL))
+    codegen_emit_line(gen, "#include <Adafruit_NeoPixel.h>");
+  if (ast_uses_feature(program, FEATURE_LCD))
+    codegen_emit_line(gen, "#include <LiquidCrystal_I2C.h>");
   /* Wave 2 Includes */
-  codegen_emit_line(gen, "#include <Stepper.h>");
-  codegen_emit_line(gen, "#include <Encoder.h>");
-  codegen_emit_line(gen, "#include <PID_v1.h>");
+  if (ast_uses_feature(program, FEATURE_STEPPER))
+    codegen_emit_line(gen, "#include <Stepper.h>");
+  if (ast_uses_feature(program, FEATURE_ENCODER))
+    codegen_emit_line(gen, "#include <Encoder.h>");
+  if (ast_uses_feature(program, FEATURE_PID))
+    codegen_emit_line(gen, "#include <PID_v1.h>");
 
   /* Wave 3 Includes */
-  codegen_emit_line(gen, "#include <BLEDevice.h>");
-  codegen_emit_line(gen, "#include <BLEServer.h>");
-  codegen_emit_line(gen, "#include <BLEUtils.h>");
-  codegen_emit_line(gen, "#include <PubSubClient.h>");
-  codegen_emit_line(gen, "#include <HTTPClient.h>");
-  codegen_emit_line(gen, "#include <WebSocketsClient.h>");
+  if (ast_uses_feature(program, FEATURE_BLE)) {
+    codegen_emit_line(gen, "#include <BLEDevice.h>");
+    codegen_emit_line(gen, "#include <BLEServer.h>");
+    codegen_emit_line(gen, "#include <BLEUtils.h>");
+  }
+  if (ast_uses_feature(program, FEATURE_MQTT))
+    codegen_emit_line(gen, "#include <PubSubClient.h>");
+  if (ast_uses_feature(program, FEATURE_HTTP))
+    codegen_emit_line(gen, "#include <HTTPClient.h>");
+  if (ast_uses_feature(program, FEATURE_WEBSOCKET))
+    codegen_emit_line(gen, "#include <WebSocketsClient.h>");
 
   codegen_emit_line(gen, "\n/* ESP32-specific declarations */");
 
   /* Wave 1 Globals */
-  codegen_emit_line(gen, "Servo _kx_servo;\n");
-  codegen_emit_line(gen, "DHT *_kx_dht = NULL;\n");
-  codegen_emit_line(gen, "Adafruit_NeoPixel *_kx_strip = NULL;\n");
-  codegen_emit_line(gen, "LiquidCrystal_I2C *_kx_lcd = NULL;\n");
+  if (ast_uses_feature(program, FEATURE_SERVO))
+    codegen_emit_line(gen, "Servo _kx_servo;\n");
+  if (ast_uses_feature(program, FEATURE_DHT))
+    codegen_emit_line(gen, "DHT *_kx_dht = NULL;\n");
+  if (ast_uses_feature(program, FEATURE_NEOPIXEL))
+    codegen_emit_line(gen, "Adafruit_NeoPixel *_kx_strip = NULL;\n");
+  if (ast_uses_feature(program, FEATURE_LCD))
+    codegen_emit_line(gen, "LiquidCrystal_I2C *_kx_lcd = NULL;\n");
 
   /* Wave 2 Globals */
-  codegen_emit_line(gen, "Stepper *_kx_stepper = NULL;\n");
-  codegen_emit_line(
-      gen, "int _kx_motor_en = -1, _kx_motor_fwd = -1, _kx_motor_rev = -1;\n");
-  codegen_emit_line(gen, "Encoder *_kx_encoder = NULL;\n");
-  codegen_emit_line(gen, "Servo _kx_esc;\n");
-  codegen_emit_line(
-      gen,
-      "double _kx_pid_setpoint = 0, _kx_pid_input = 0, _kx_pid_output = 0;\n");
-  codegen_emit_line(gen, "PID *_kx_pid = NULL;\n");
+  if (ast_uses_feature(program, FEATURE_STEPPER))
+    codegen_emit_line(gen, "Stepper *_kx_stepper = NULL;\n");
+  if (ast_uses_feature(program, FEATURE_MOTOR))
+    codegen_emit_line(
+        gen, "int _kx_motor_en = -1, _kx_motor_fwd = -1, _kx_motor_rev = -1;\n");
+  if (ast_uses_feature(program, FEATURE_ENCODER))
+    codegen_emit_line(gen, "Encoder *_kx_encoder = NULL;\n");
+  if (ast_uses_feature(program, FEATURE_ESC))
+    codegen_emit_line(gen, "Servo _kx_esc;\n");
+  if (ast_uses_feature(program, FEATURE_PID)) {
+    codegen_emit_line(
+        gen,
+        "double _kx_pid_setpoint = 0, _kx_pid_input = 0, _kx_pid_output = 0;\n");
+    codegen_emit_line(gen, "PID *_kx_pid = NULL;\n");
+  }
 
   /* Wave 3 Globals */
-  codegen_emit_line(gen, "WiFiClient _kx_wifiClient;");
-  codegen_emit_line(gen, "PubSubClient _kx_mqttClient(_kx_wifiClient);");
-  codegen_emit_line(gen, "WebSocketsClient _kx_wsClient;");
-  codegen_emit_line(gen, "String _kx_ble_msg = \"\";");
-  codegen_emit_line(gen, "String _kx_mqtt_msg = \"\";");
-  codegen_emit_line(gen, "String _kx_ws_msg = \"\";");
-  codegen_emit_line(
-      gen, "class _kx_BLECallbacks: public BLECharacteristicCallbacks {");
-  codegen_emit_line(gen,
-                    "  void onWrite(BLECharacteristic *pCharacteristic) {");
-  codegen_emit_line(gen,
-                    "    _kx_ble_msg = pCharacteristic->getValue().c_str();");
-  codegen_emit_line(gen, "  }");
-  codegen_emit_line(gen, "};");
-  codegen_emit_line(gen, "BLECharacteristic *_kx_ble_char = NULL;\n");
+  if (ast_uses_feature(program, FEATURE_MQTT)) {
+    codegen_emit_line(gen, "WiFiClient _kx_wifiClient;");
+    codegen_emit_line(gen, "PubSubClient _kx_mqttClient(_kx_wifiClient);");
+  }
+  if (ast_uses_feature(program, FEATURE_WEBSOCKET))
+    codegen_emit_line(gen, "WebSocketsClient _kx_wsClient;");
+  if (ast_uses_feature(program, FEATURE_BLE))
+    codegen_emit_line(gen, "String _kx_ble_msg = \"\";");
+  if (ast_uses_feature(program, FEATURE_MQTT))
+    codegen_emit_line(gen, "String _kx_mqtt_msg = \"\";");
+  if (ast_uses_feature(program, FEATURE_WEBSOCKET))
+    codegen_emit_line(gen, "String _kx_ws_msg = \"\";");
+  if (ast_uses_feature(program, FEATURE_BLE)) {
+    codegen_emit_line(
+        gen, "class _kx_BLECallbacks: public BLECharacteristicCallbacks {");
+    codegen_emit_line(gen,
+                      "  void onWrite(BLECharacteristic *pCharacteristic) {");
+    codegen_emit_line(gen,
+                      "    _kx_ble_msg = pCharacteristic->getValue().c_str();");
+    codegen_emit_line(gen, "  }");
+    codegen_emit_line(gen, "};");
+    codegen_emit_line(gen, "BLECharacteristic *_kx_ble_char = NULL;\n");
+  }
 
   /* Wave 6 Kalman Globals */
-  codegen_emit_line(gen, "float _kx_kalman_q = 0.01;");
-  codegen_emit_line(gen, "float _kx_kalman_r = 0.1;");
-  codegen_emit_line(gen, "float _kx_kalman_x = 0.0;");
-  codegen_emit_line(gen, "float _kx_kalman_p = 1.0;");
-  codegen_emit_line(gen, "float _kx_kalman_k = 0.0;\n");
+  if (ast_uses_feature(program, FEATURE_KALMAN)) {
+    codegen_emit_line(gen, "float _kx_kalman_q = 0.01;");
+    codegen_emit_line(gen, "float _kx_kalman_r = 0.1;");
+    codegen_emit_line(gen, "float _kx_kalman_x = 0.0;");
+    codegen_emit_line(gen, "float _kx_kalman_p = 1.0;");
+    codegen_emit_line(gen, "float _kx_kalman_k = 0.0;\n");
+  }
 
   /* Wave 4 Includes & Globals */
-  codegen_emit_line(gen, "#include <SparkFun_BNO080_Arduino_Library.h>");
-  codegen_emit_line(gen, "#include <TinyGPSPlus.h>");
-  codegen_emit_line(gen, "#include <VL53L0X.h>");
-  codegen_emit_line(gen, "#include <SD.h>");
-
-  codegen_emit_line(gen, "SparkFun_BNO080 *_kx_imu = NULL;");
-  codegen_emit_line(gen, "TinyGPSPlus _kx_gps;");
-  codegen_emit_line(gen,
-                    "HardwareSerial _kx_gps_serial(2); // UART2 for ESP32");
-  codegen_emit_line(gen, "VL53L0X *_kx_lidar = NULL;");
-  codegen_emit_line(gen, "File _kx_file;\n");
+  if (ast_uses_feature(program, FEATURE_IMU)) {
+    codegen_emit_line(gen, "#include <SparkFun_BNO080_Arduino_Library.h>");
+    codegen_emit_line(gen, "SparkFun_BNO080 *_kx_imu = NULL;");
+  }
+  if (ast_uses_feature(program, FEATURE_GPS)) {
+    codegen_emit_line(gen, "#include <TinyGPSPlus.h>");
+    codegen_emit_line(gen, "TinyGPSPlus _kx_gps;");
+    codegen_emit_line(gen,
+                      "HardwareSerial _kx_gps_serial(2); // UART2 for ESP32");
+  }
+  if (ast_uses_feature(program, FEATURE_LIDAR)) {
+    codegen_emit_line(gen, "#include <VL53L0X.h>");
+    codegen_emit_line(gen, "VL53L0X *_kx_lidar = NULL;");
+  }
+  if (ast_uses_feature(program, FEATURE_SD)) {
+    codegen_emit_line(gen, "#include <SD.h>");
+    codegen_emit_line(gen, "File _kx_file;\n");
+  }
 
   /* Wave 5 Includes & Globals */
-  codegen_emit_line(gen, "#include <Adafruit_GFX.h>");
-  codegen_emit_line(gen, "#include <Adafruit_SSD1306.h>");
-  codegen_emit_line(gen, "#include <HUSKYLENS.h>\n");
-  codegen_emit_line(gen, "Adafruit_SSD1306 _kx_oled(128, 64, &Wire, -1);");
-  codegen_emit_line(gen, "HUSKYLENS _kx_huskylens;");
-  codegen_emit_line(gen, "int _kx_audio_pin = 25;");
-  codegen_emit_line(gen, "int _kx_volume = 100;\n");
+  if (ast_uses_feature(program, FEATURE_OLED)) {
+    codegen_emit_line(gen, "#include <Adafruit_GFX.h>");
+    codegen_emit_line(gen, "#include <Adafruit_SSD1306.h>");
+    codegen_emit_line(gen, "Adafruit_SSD1306 _kx_oled(128, 64, &Wire, -1);");
+  }
+  if (ast_uses_feature(program, FEATURE_CAMERA)) {
+    codegen_emit_line(gen, "#include <HUSKYLENS.h>\n");
+    codegen_emit_line(gen, "HUSKYLENS _kx_huskylens;");
+  }
+  if (ast_uses_feature(program, FEATURE_AUDIO)) {
+    codegen_emit_line(gen, "int _kx_audio_pin = 25;");
+    codegen_emit_line(gen, "int _kx_volume = 100;\n");
+  }
 
   /* Wave 4 Helpers */
-  codegen_emit_line(gen, "float _kx_imu_get_heading() {");
-  codegen_emit_line(gen, "  if(!_kx_imu) return 0.0;");
-  codegen_emit_line(gen, "  float q0 = _kx_imu->getQuatI();");
-  codegen_emit_line(gen, "  float q1 = _kx_imu->getQuatJ();");
-  codegen_emit_line(gen, "  float q2 = _kx_imu->getQuatK();");
-  codegen_emit_line(gen, "  float q3 = _kx_imu->getQuatReal();");
-  codegen_emit_line(gen, "  return atan2(2.0*(q0*q1 + q2*q3), 1.0 - 2.0*(q1*q1 "
-                         "+ q2*q2)) * 180.0/M_PI;");
-  codegen_emit_line(gen, "}\n");
+  if (ast_uses_feature(program, FEATURE_IMU)) {
+    codegen_emit_line(gen, "float _kx_imu_get_heading() {");
+    codegen_emit_line(gen, "  if(!_kx_imu) return 0.0;");
+    codegen_emit_line(gen, "  float q0 = _kx_imu->getQuatI();");
+    codegen_emit_line(gen, "  float q1 = _kx_imu->getQuatJ();");
+    codegen_emit_line(gen, "  float q2 = _kx_imu->getQuatK();");
+    codegen_emit_line(gen, "  float q3 = _kx_imu->getQuatReal();");
+    codegen_emit_line(gen, "  return atan2(2.0*(q0*q1 + q2*q3), 1.0 - 2.0*(q1*q1 "
+                           "+ q2*q2)) * 180.0/M_PI;");
+    codegen_emit_line(gen, "}\n");
+  }
+
+  /* x / y where y has side effects: y is evaluated once */
+  if (ast_uses_feature(program, FEATURE_DIV)) {
+    codegen_emit_line(gen, "template <typename A, typename B>");
+    codegen_emit_line(gen, "static inline auto _kx_div(A a, B b) -> decltype(a / b) {");
+    codegen_emit_line(gen, "  return b == 0 ? 0 : a / b;");
+    codegen_emit_line(gen, "}\n");
+  }
 
   /* Wave 6 Helpers */
-  codegen_emit_line(gen, "float _kx_kalman_update(float mea) {");
-  codegen_emit_line(gen, "  _kx_kalman_p = _kx_kalman_p + _kx_kalman_q;");
-  codegen_emit_line(gen, "  _kx_kalman_k = _kx_kalman_p / (_kx_kalman_p + _kx_kalman_r);");
-  codegen_emit_line(gen, "  _kx_kalman_x = _kx_kalman_x + _kx_kalman_k * (mea - _kx_kalman_x);");
-  codegen_emit_line(gen, "  _kx_kalman_p = (1.0 - _kx_kalman_k) * _kx_kalman_p;");
-  codegen_emit_line(gen, "  return _kx_kalman_x;");
-  codegen_emit_line(gen, "}\n");
+  if (ast_uses_feature(program, FEATURE_KALMAN)) {
+    codegen_emit_line(gen, "float _kx_kalman_update(float mea) {");
+    codegen_emit_line(gen, "  _kx_kalman_p = _kx_kalman_p + _kx_kalman_q;");
+    codegen_emit_line(gen, "  _kx_kalman_k = _kx_kalman_p / (_kx_kalman_p + _kx_kalman_r);");
+    codegen_emit_line(gen, "  _kx_kalman_x = _kx_kalman_x + _kx_kalman_k * (mea - _kx_kalman_x);");
+    codegen_emit_line(gen, "  _kx_kalman_p = (1.0 - _kx_kalman_k) * _kx_kalman_p;");
+    codegen_emit_line(gen, "  return _kx_kalman_x;");
+    codegen_emit_line(gen, "}\n");
+  }
 
   /* Wave 6 AI Helpers */
-  codegen_emit_line(gen, "float _kx_ai_invoke(float input) {");
-  codegen_emit_line(gen, "  return 0.0; // TFLite Micro omitted for generic target");
-  codegen_emit_line(gen, "}");
-  codegen_emit_line(gen, "float _kx_ai_invoke(float* input_array) {");
-  codegen_emit_line(gen, "  return 0.0;");
-  codegen_emit_line(gen, "}\n");
+  if (ast_uses_feature(program, FEATURE_AI)) {
+    codegen_emit_line(gen, "float _kx_ai_invoke(float input) {");
+    codegen_emit_line(gen, "  return 0.0; // TFLite Micro omitted for generic target");
+    codegen_emit_line(gen, "}");
+    codegen_emit_line(gen, "float _kx_ai_invoke(float* input_array) {");
+    codegen_emit_line(gen, "  return 0.0;");
+    codegen_emit_line(gen, "}\n");
+  }
 
   /* Wave 7 Globals & Helpers */
-  codegen_emit_line(gen, "int _kx_arm_dof = 3; float _kx_arm_len[4] = {0,0,0,0}; float _kx_arm_angles[4] = {0,0,0,0};");
-  codegen_emit_line(gen, "void _kx_arm_ik(float tx, float ty, float tz) {");
-  codegen_emit_line(gen, "  float r=sqrt(tx*tx+ty*ty), d=sqrt(r*r+tz*tz), L1=_kx_arm_len[0], L2=_kx_arm_len[1];");
-  codegen_emit_line(gen, "  float ca=(d*d-L1*L1-L2*L2)/(2.0*L1*L2); if(ca<-1)ca=-1; if(ca>1)ca=1;");
-  codegen_emit_line(gen, "  _kx_arm_angles[1]=acos(ca); _kx_arm_angles[0]=atan2(tz,r)-atan2(L2*sin(_kx_arm_angles[1]),L1+L2*ca);");
-  codegen_emit_line(gen, "  _kx_arm_angles[2]=atan2(ty,tx);");
-  codegen_emit_line(gen, "}\n");
-  codegen_emit_line(gen, "int _kx_grid_w=0,_kx_grid_h=0; int _kx_grid[64][64]; int _kx_path_result[256]; int _kx_path_len=0;");
-  codegen_emit_line(gen, "int _kx_path_compute(int sx,int sy,int gx,int gy) {");
-  codegen_emit_line(gen, "  _kx_path_len=0; if(sx==gx&&sy==gy)return 0;");
-  codegen_emit_line(gen, "  int v[64][64]; memset(v,0,sizeof(v)); int qx[4096],qy[4096],qp[4096]; int qf=0,qb=0;");
-  codegen_emit_line(gen, "  qx[qb]=sx;qy[qb]=sy;qp[qb]=-1;qb++;v[sy][sx]=1; int dx[]={1,-1,0,0},dy[]={0,0,1,-1};");
-  codegen_emit_line(gen, "  while(qf<qb){int cx=qx[qf],cy=qy[qf],cp=qf;qf++;");
-  codegen_emit_line(gen, "    if(cx==gx&&cy==gy){int t=cp;while(t!=-1){_kx_path_result[_kx_path_len++]=qx[t]*100+qy[t];t=qp[t];}return _kx_path_len;}");
-  codegen_emit_line(gen, "    for(int i=0;i<4;i++){int nx=cx+dx[i],ny=cy+dy[i];");
-  codegen_emit_line(gen, "      if(nx>=0&&nx<_kx_grid_w&&ny>=0&&ny<_kx_grid_h&&!v[ny][nx]&&!_kx_grid[ny][nx]){v[ny][nx]=1;qx[qb]=nx;qy[qb]=ny;qp[qb]=cp;qb++;}}}");
-  codegen_emit_line(gen, "  return 0;");
-  codegen_emit_line(gen, "}\n");
-  codegen_emit_line(gen, "int _kx_drone_fl=-1,_kx_drone_fr=-1,_kx_drone_bl=-1,_kx_drone_br=-1;");
-  codegen_emit_line(gen, "void _kx_drone_mix(float p,float r,float y,float t) {");
-  codegen_emit_line(gen, "  int fl=(int)(t+p+r-y),fr=(int)(t+p-r+y),bl=(int)(t-p+r+y),br=(int)(t-p-r-y);");
-  codegen_emit_line(gen, "  fl=constrain(fl,0,255);fr=constrain(fr,0,255);bl=constrain(bl,0,255);br=constrain(br,0,255);");
-  codegen_emit_line(gen, "  _ledc_analogWrite(_kx_drone_fl,fl);_ledc_analogWrite(_kx_drone_fr,fr);");
-  codegen_emit_line(gen, "  _ledc_analogWrite(_kx_drone_bl,bl);_ledc_analogWrite(_kx_drone_br,br);");
-  codegen_emit_line(gen, "}\n");
+  if (ast_uses_feature(program, FEATURE_ARM)) {
+    codegen_emit_line(gen, "int _kx_arm_dof = 3; float _kx_arm_len[4] = {0,0,0,0}; float _kx_arm_angles[4] = {0,0,0,0};");
+    codegen_emit_line(gen, "void _kx_arm_ik(float tx, float ty, float tz) {");
+    codegen_emit_line(gen, "  float r=sqrt(tx*tx+ty*ty), d=sqrt(r*r+tz*tz), L1=_kx_arm_len[0], L2=_kx_arm_len[1];");
+    codegen_emit_line(gen, "  float ca=(d*d-L1*L1-L2*L2)/(2.0*L1*L2); if(ca<-1)ca=-1; if(ca>1)ca=1;");
+    codegen_emit_line(gen, "  _kx_arm_angles[1]=acos(ca); _kx_arm_angles[0]=atan2(tz,r)-atan2(L2*sin(_kx_arm_angles[1]),L1+L2*ca);");
+    codegen_emit_line(gen, "  _kx_arm_angles[2]=atan2(ty,tx);");
+    codegen_emit_line(gen, "}\n");
+  }
+  if (ast_uses_feature(program, FEATURE_PATH)) {
+    codegen_emit_line(gen, "int _kx_grid_w=0,_kx_grid_h=0; int _kx_grid[64][64]; int _kx_path_result[256]; int _kx_path_len=0;");
+    codegen_emit_line(gen, "int _kx_path_compute(int sx,int sy,int gx,int gy) {");
+    codegen_emit_line(gen, "  _kx_path_len=0; if(sx==gx&&sy==gy)return 0;");
+    codegen_emit_line(gen, "  int v[64][64]; memset(v,0,sizeof(v)); int qx[4096],qy[4096],qp[4096]; int qf=0,qb=0;");
+    codegen_emit_line(gen, "  qx[qb]=sx;qy[qb]=sy;qp[qb]=-1;qb++;v[sy][sx]=1; int dx[]={1,-1,0,0},dy[]={0,0,1,-1};");
+    codegen_emit_line(gen, "  while(qf<qb){int cx=qx[qf],cy=qy[qf],cp=qf;qf++;");
+    codegen_emit_line(gen, "    if(cx==gx&&cy==gy){int t=cp;while(t!=-1){_kx_path_result[_kx_path_len++]=qx[t]*100+qy[t];t=qp[t];}return _kx_path_len;}");
+    codegen_emit_line(gen, "    for(int i=0;i<4;i++){int nx=cx+dx[i],ny=cy+dy[i];");
+    codegen_emit_line(gen, "      if(nx>=0&&nx<_kx_grid_w&&ny>=0&&ny<_kx_grid_h&&!v[ny][nx]&&!_kx_grid[ny][nx]){v[ny][nx]=1;qx[qb]=nx;qy[qb]=ny;qp[qb]=cp;qb++;}}}");
+    codegen_emit_line(gen, "  return 0;");
+    codegen_emit_line(gen, "}\n");
+  }
+  if (ast_uses_feature(program, FEATURE_DRONE)) {
+    codegen_emit_line(gen, "int _kx_drone_fl=-1,_kx_drone_fr=-1,_kx_drone_bl=-1,_kx_drone_br=-1;");
+    codegen_emit_line(gen, "void _kx_drone_mix(float p,float r,float y,float t) {");
+    codegen_emit_line(gen, "  int fl=(int)(t+p+r-y),fr=(int)(t+p-r+y),bl=(int)(t-p+r+y),br=(int)(t-p-r-y);");
+    codegen_emit_line(gen, "  fl=constrain(fl,0,255);fr=constrain(fr,0,255);bl=constrain(bl,0,255);br=constrain(br,0,255);");
+    codegen_emit_line(gen, "  _ledc_analogWrite(_kx_drone_fl,fl);_ledc_analogWrite(_kx_drone_fr,fr);");
+    codegen_emit_line(gen, "  _ledc_analogWrite(_kx_drone_bl,bl);_ledc_analogWrite(_kx_drone_br,br);");
+    codegen_emit_line(gen, "}\n");
+  }
 
-  codegen_emit_line(gen, "const char* _kx_file_read_string() {");
-  codegen_emit_line(gen, "  if (!_kx_file) return \"\";");
-  codegen_emit_line(gen, "  static char buf[256];");
-  codegen_emit_line(gen, "  int i=0; while(_kx_file.available() && i<255) "
-                         "buf[i++] = _kx_file.read();");
-  codegen_emit_line(gen, "  buf[i] = 0;");
-  codegen_emit_line(gen, "  return buf;");
-  codegen_emit_line(gen, "}\n");
+  if (ast_uses_feature(program, FEATURE_SD)) {
+    codegen_emit_line(gen, "const char* _kx_file_read_string() {");
+    codegen_emit_line(gen, "  if (!_kx_file) return \"\";");
+    codegen_emit_line(gen, "  static char buf[256];");
+    codegen_emit_line(gen, "  int i=0; while(_kx_file.available() && i<255) "
+                           "buf[i++] = _kx_file.read();");
+    codegen_emit_line(gen, "  buf[i] = 0;");
+    codegen_emit_line(gen, "  return buf;");
+    codegen_emit_line(gen, "}\n");
+  }
 
   /* PWM Tracker map for dynamic LEDC channels */
-  codegen_emit_line(gen, "int _esp32_pwm_channels[40] = {0};");
-  codegen_emit_line(gen, "int _esp32_next_pwm_channel = 0;");
-
-  codegen_emit_line(gen, "void _ledc_analogWrite(uint8_t pin, int value) {");
-  codegen_emit_line(gen, "  if (_esp32_next_pwm_channel >= 16) return; /* ESP32 has 16 LEDC channels max */");
-  codegen_emit_line(gen, "  if (_esp32_pwm_channels[pin] == 0) {");
-  codegen_emit_line(
-      gen, "    _esp32_pwm_channels[pin] = _esp32_next_pwm_channel + 1;");
-  codegen_emit_line(
-      gen, "    ledcSetup(_esp32_next_pwm_channel, 5000, 8); // 5kHz, 8-bit");
-  codegen_emit_line(gen, "    ledcAttachPin(pin, _esp32_next_pwm_channel);");
-  codegen_emit_line(gen, "    _esp32_next_pwm_channel++;");
-  codegen_emit_line(gen, "  }");
-  codegen_emit_line(gen, "  ledcWrite(_esp32_pwm_channels[pin] - 1, value);");
-  codegen_emit_line(gen, "}\n");
+  if (uses_pwm) {
+    codegen_emit_line(gen, "int _esp32_pwm_channels[40] = {0};");
+    codegen_emit_line(gen, "int _esp32_next_pwm_channel = 0;");
+
+    codegen_emit_line(gen, "void _ledc_analogWrite(uint8_t pin, int value) {");
+    codegen_emit_line(gen, "  if (_esp32_next_pwm_channel >= 16) return; /* ESP32 has 16 LEDC channels max */");
+    codegen_emit_line(gen, "  if (_esp32_pwm_channels[pin] == 0) {");
+    codegen_emit_line(
+        gen, "    _esp32_pwm_channels[pin] = _esp32_next_pwm_channel + 1;");
+    codegen_emit_line(
+        gen, "    ledcSetup(_esp32_next_pwm_channel, 5000, 8); // 5kHz, 8-bit");
+    codegen_emit_line(gen, "    ledcAttachPin(pin, _esp32_next_pwm_channel);");
+    codegen_emit_line(gen, "    _esp32_next_pwm_channel++;");
+    codegen_emit_line(gen, "  }");
+    codegen_emit_line(gen, "  ledcWrite(_esp32_pwm_channels[pin] - 1, value);");
+    codegen_emit_line(gen, "}\n");
+  }
 
   /* Wave 6 Includes & Globals */
-  codegen_emit_line(gen, "int _kx_mec_fl = -1, _kx_mec_fr = -1, _kx_mec_bl = -1, _kx_mec_br = -1;\n");
-
-  codegen_emit_line(gen, "/* ESP-NOW state */");
-  codegen_emit_line(gen, "volatile float _esp_now_last_val = 0.0;");
-  codegen_emit_line(gen, "volatile bool _esp_now_has_data = false;");
-  codegen_emit_line(gen, "void _esp_now_recv_cb(const uint8_t *mac_addr, const "
-                         "uint8_t *data, int data_len) {");
-  codegen_emit_line(gen, "  if (data_len == sizeof(float)) {");
-  codegen_emit_line(
-      gen, "    memcpy((void*)&_esp_now_last_val, data, sizeof(float));");
-  codegen_emit_line(gen, "    _esp_now_has_data = true;");
-  codegen_emit_line(gen, "  }");
-  codegen_emit_line(gen, "}");
-  codegen_emit_line(gen, "void radio_send_peer(int peer_id, float value) {");
-  codegen_emit_line(
-      gen, "  uint8_t mac_addr[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};");
-  codegen_emit_line(gen, "  esp_now_peer_info_t peerInfo = {};");
-  codegen_emit_line(gen, "  memcpy(peerInfo.peer_addr, mac_addr, 6);");
-  codegen_emit_line(gen, "  peerInfo.channel = 0;");
-  codegen_emit_line(gen, "  peerInfo.encrypt = false;");
-  codegen_emit_line(
-      gen,
-      "  if (!esp_now_is_peer_exist(mac_addr)) esp_now_add_peer(&peerInfo);");
-  codegen_emit_line(
-      gen, "  esp_now_send(mac_addr, (uint8_t*)&value, sizeof(float));");
-  codegen_emit_line(gen, "}");
-  codegen_emit_line(gen, "float radio_read() {");
-  codegen_emit_line(gen, "  _esp_now_has_data = false;");
-  codegen_emit_line(gen, "  return _esp_now_last_val;");
-  codegen_emit_line(gen, "}");
-  codegen_emit_line(gen, "bool radio_available() {");
-  codegen_emit_line(gen, "  return _esp_now_has_data;");
-  codegen_emit_line(gen, "}\n");
+  if (ast_uses_feature(program, FEATURE_MECANUM))
+    codegen_emit_line(gen, "int _kx_mec_fl = -1, _kx_mec_fr = -1, _kx_mec_bl = -1, _kx_mec_br = -1;\n");
+
+  if (ast_uses_feature(program, FEATURE_RADIO)) {
+    codegen_emit_line(gen, "/* ESP-NOW state */");
+    codegen_emit_line(gen, "volatile float _esp_now_last_val = 0.0;");
+    codegen_emit_line(gen, "volatile bool _esp_now_has_data = false;");
+    codegen_emit_line(gen, "void _esp_now_recv_cb(const uint8_t *mac_addr, const "
+                           "uint8_t *data, int data_len) {");
+    codegen_emit_line(gen, "  if (data_len == sizeof(float)) {");
+    codegen_emit_line(
+        gen, "    memcpy((void*)&_esp_now_last_val, data, sizeof(float));");
+    codegen_emit_line(gen, "    _esp_now_has_data = true;");
+    codegen_emit_line(gen, "  }");
+    codegen_emit_line(gen, "}");
+    codegen_emit_line(gen, "void radio_send_peer(int peer_id, float value) {");
+    codegen_emit_line(
+        gen, "  uint8_t mac_addr[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};");
+    codegen_emit_line(gen, "  esp_now_peer_info_t peerInfo = {};");
+    codegen_emit_line(gen, "  memcpy(peerInfo.peer_addr, mac_addr, 6);");
+    codegen_emit_line(gen, "  peerInfo.channel = 0;");
+    codegen_emit_line(gen, "  peerInfo.encrypt = false;");
+    codegen_emit_line(
+        gen,
+        "  if (!esp_now_is_peer_exist(mac_addr)) esp_now_add_peer(&peerInfo);");
+    codegen_emit_line(
+        gen, "  esp_now_send(mac_addr, (uint8_t*)&value, sizeof(float));");
+    codegen_emit_line(gen, "}");
+    codegen_emit_line(gen, "float radio_read() {");
+    codegen_emit_line(gen, "  _esp_now_has_data = false;");
+    codegen_emit_line(gen, "  return _esp_now_last_val;");
+    codegen_emit_line(gen, "}");
+    codegen_emit_line(gen, "bool radio_available() {");
+    codegen_emit_line(gen, "  return _esp_now_has_data;");
+    codegen_emit_line(gen, "}\n");
+  }
 
   // Hoist tasks as FreeRTOS functions
   if (program->data.program.main_block &&
@@ -1836,8 +1913,6 @@ void codegen_generate_esp32(CodeGen *gen, ASTNode *program) {
   }
 
   // Hoist all deep ISRs recursively
-  int timer_id_counter = 0;
-  esp32_assign_timer_ids(program, &timer_id_counter);
   esp32_hoist_isrs(gen, program);
 
   // Hoist global variables
@@ -1859,9 +1934,11 @@ void codegen_generate_esp32(CodeGen *gen, ASTNode *program) {
   codegen_emit_line(gen, "Serial.begin(115200);  // ESP32 default baud");
   codegen_emit_line(gen,
                     "analogReadResolution(12);  // ESP32 12-bit ADC (0-4095)");
-  codegen_emit_line(gen, "WiFi.mode(WIFI_STA);");
-  codegen_emit_line(gen, "esp_now_init();");
-  codegen_emit_line(gen, "esp_now_register_recv_cb(_esp_now_recv_cb);");
+  if (ast_uses_feature(program, FEATURE_RADIO)) {
+    codegen_emit_line(gen, "WiFi.mode(WIFI_STA);");
+    codegen_emit_line(gen, "esp_now_init();");
+    codegen_emit_line(gen, "esp_now_register_recv_cb(_esp_now_recv_cb);");
+  }
   if (program->data.program.pins_used) {
     for (int i = 0; i < program->data.program.pin_count; i++) {
       codegen_emit_line(gen, "pinMode(%d, OUTPUT);",
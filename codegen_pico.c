@@ -2,28 +2,29 @@
 
 #include "ast.h"
 #include "codegen.h"
+#include "feature_usage.h"
+#include "value_range.h"
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 static void pico_indent(CodeGen *gen) {
-  for (int i = 0; i < gen->indent_level; i++)
-    fprintf(gen->output, "    ");
+  outbuf_spaces(&gen->out, gen->indent_level * 4);
 }
 static void pico_emit(CodeGen *gen, const char *fmt, ...) {
   va_list a;
   va_start(a, fmt);
-  vfprintf(gen->output, fmt, a);
+  outbuf_vprintf(&gen->out, fmt, a);
   va_end(a);
 }
 static void pico_emit_line(CodeGen *gen, const char *fmt, ...) {
   pico_indent(gen);
   va_list a;
   va_start(a, fmt);
-  vfprintf(gen->output, fmt, a);
+  outbuf_vprintf(&gen->out, fmt, a);
   va_end(a);
-  fprintf(gen->output, "\n");
+  outbuf_putc(&gen->out, '\n');
 }
 
 static void pico_expr(CodeGen *gen, ASTNode *node);
@@ -34,7 +35,7 @@ static void pico_expr(CodeGen *gen, ASTNode *node) {
     return;
   switch (node->type) {
   case NODE_NUMBER:
-    pico_emit(gen, "%g", node->data.number.value);
+    codegen_emit_number(gen, node);
     break;
   case NODE_STRING: {
     /* Escape backslashes and quotes for MicroPython string literal */
@@ -45,7 +46,7 @@ static void pico_expr(CodeGen *gen, ASTNode *node) {
       else if (*p == '\n') pico_emit(gen, "\\n");
       else if (*p == '\r') pico_emit(gen, "\\r");
       else if (*p == '\t') pico_emit(gen, "\\t");
-      else fputc(*p, gen->output);
+      else outbuf_putc(&gen->out, *p);
     }
     pico_emit(gen, "\"");
     break;
@@ -111,7 +112,15 @@ static void pico_expr(CodeGen *gen, ASTNode *node) {
       pico_emit(gen, ") + str(");
       pico_expr(gen, node->data.binary_op.right);
       pico_emit(gen, "))");
-    } else if (node->data.binary_op.op == OP_DIV) {
+    } else if (node->data.binary_op.op == OP_DIV &&
+               ast_divisor_nonzero(node, RANGE_INT_BITS)) {
+      pico_emit(gen, "((");
+      pico_expr(gen, node->data.binary_op.left);
+      pico_emit(gen, ") / (");
+      pico_expr(gen, node->data.binary_op.right);
+      pico_emit(gen, "))");
+    } else if (node->data.binary_op.op == OP_DIV &&
+               ast_expr_is_pure(node->data.binary_op.right)) {
       pico_emit(gen, "(0 if (");
       pico_expr(gen, node->data.binary_op.right);
       pico_emit(gen, ") == 0 else (");
@@ -119,6 +128,13 @@ static void pico_expr(CodeGen *gen, ASTNode *node) {
       pico_emit(gen, ") / (");
       pico_expr(gen, node->data.binary_op.right);
       pico_emit(gen, "))");
+    } else if (node->data.binary_op.op == OP_DIV) {
+      // _kx_div evaluates a divisor with side effects (a pin read) once
+      pico_emit(gen, "_kx_div(");
+      pico_expr(gen, node->data.binary_op.left);
+      pico_emit(gen, ", ");
+      pico_expr(gen, node->data.binary_op.right);
+      pico_emit(gen, ")");
     } else {
       pico_emit(gen, "(");
       pico_expr(gen, node->data.binary_op.left);
@@ -135,7 +151,7 @@ static void pico_expr(CodeGen *gen, ASTNode *node) {
     break;
   case NODE_CALL: {
     const char *nm = node->data.call.name;
-    if (strcmp(nm, "map") == 0 && node->data.call.arg_count == 5) {
+    if (nm == intern_builtin(ATOM_MAP) && node->data.call.arg_count == 5) {
       pico_emit(gen, "int((");
       pico_expr(gen, node->data.call.args[0]);
       pico_emit(gen, " - ");
@@ -151,7 +167,7 @@ static void pico_expr(CodeGen *gen, ASTNode *node) {
       pico_emit(gen, ") + ");
       pico_expr(gen, node->data.call.args[3]);
       pico_emit(gen, ")");
-    } else if (strcmp(nm, "constrain") == 0) {
+    } else if (nm == intern_builtin(ATOM_CONSTRAIN)) {
       pico_emit(gen, "max(");
       pico_expr(gen, node->data.call.args[1]);
       pico_emit(gen, ", min(");
@@ -159,7 +175,7 @@ static void pico_expr(CodeGen *gen, ASTNode *node) {
       pico_emit(gen, ", ");
       pico_expr(gen, node->data.call.args[0]);
       pico_emit(gen, "))");
-    } else if (strcmp(nm, "delayMicroseconds") == 0) {
+    } else if (nm == intern_builtin(ATOM_DELAY_MICROSECONDS)) {
       pico_emit(gen, "utime.sleep_us(int(");
       pico_expr(gen, node->data.call.args[0]);
       pico_emit(gen, "))");
@@ -504,6 +520,9 @@ static void pico_stmt(CodeGen *gen, ASTNode *node) {
     gen->indent_level--;
     break;
   case NODE_BLOCK:
+    // Python needs a statement in every suite, and DCE can empty one
+    if (node->data.block.statement_count == 0)
+      pico_emit_line(gen, "pass");
     for (int i = 0; i < node->data.block.statement_count; i++)
       pico_stmt(gen, node->data.block.statements[i]);
     break;
@@ -1449,6 +1468,12 @@ void codegen_generate_pico(CodeGen *gen, ASTNode *program) {
   pico_emit_line(gen, "_kx_kalman_q = 0.01; _kx_kalman_r = 0.1");
   pico_emit_line(gen, "_kx_kalman_x = 0.0; _kx_kalman_p = 1.0; _kx_kalman_k = 0.0\n");
 
+  /* x / y where y has side effects: y is evaluated once */
+  if (ast_uses_feature(program, FEATURE_DIV)) {
+    pico_emit_line(gen, "def _kx_div(a, b):");
+    pico_emit_line(gen, "    return 0 if b == 0 else a / b\n");
+  }
+
   pico_emit_line(gen, "def _kx_kalman_update(mea):");
   pico_emit_line(gen, "    global _kx_kalman_q, _kx_kalman_r, _kx_kalman_x, _kx_kalman_p, _kx_kalman_k");
   pico_emit_line(gen, "    _kx_kalman_p = _kx_kalman_p + _kx_kalman_q");
@@ -7,6 +7,8 @@
 
 #include "ast.h"
 #include "codegen.h"
+#include "feature_usage.h"
+#include "value_range.h"
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,7 +22,7 @@ static void ros2_expr(CodeGen *gen, ASTNode *node) {
     return;
   switch (node->type) {
   case NODE_NUMBER:
-    codegen_emit(gen, "%g", node->data.number.value);
+    codegen_emit_number(gen, node);
     break;
   case NODE_STRING: {
     /* Escape for C++ string literal */
@@ -32,7 +34,7 @@ static void ros2_expr(CodeGen *gen, ASTNode *node) {
       case '\n': codegen_emit(gen, "\\n"); break;
       case '\r': codegen_emit(gen, "\\r"); break;
       case '\t': codegen_emit(gen, "\\t"); break;
-      default:   fputc(*p, gen->output); break;
+      default:   outbuf_putc(&gen->out, *p); break;
       }
     }
     codegen_emit(gen, "\")");
@@ -119,6 +121,24 @@ static void ros2_expr(CodeGen *gen, ASTNode *node) {
       if (!r_string)
         codegen_emit(gen, ")");
       codegen_emit(gen, ")");
+    } else if (node->data.binary_op.op == OP_DIV &&
+               !ast_divisor_nonzero(node, RANGE_INT_BITS) &&
+               ast_expr_is_pure(node->data.binary_op.right)) {
+      codegen_emit(gen, "((");
+      ros2_expr(gen, node->data.binary_op.right);
+      codegen_emit(gen, ") == 0 ? 0 : ((");
+      ros2_expr(gen, node->data.binary_op.left);
+      codegen_emit(gen, ") / (");
+      ros2_expr(gen, node->data.binary_op.right);
+      codegen_emit(gen, ")))");
+    } else if (node->data.binary_op.op == OP_DIV &&
+               !ast_divisor_nonzero(node, RANGE_INT_BITS)) {
+      // Evaluate a divisor with side effects (a topic read, a call) once
+      codegen_emit(gen, "_kx_div(");
+      ros2_expr(gen, node->data.binary_op.left);
+      codegen_emit(gen, ", ");
+      ros2_expr(gen, node->data.binary_op.right);
+      codegen_emit(gen, ")");
     } else {
       codegen_emit(gen, "(");
       ros2_expr(gen, node->data.binary_op.left);
@@ -135,7 +155,7 @@ static void ros2_expr(CodeGen *gen, ASTNode *node) {
     break;
   case NODE_CALL: {
     const char *nm = node->data.call.name;
-    if (strcmp(nm, "map") == 0 && node->data.call.arg_count == 5) {
+    if (nm == intern_builtin(ATOM_MAP) && node->data.call.arg_count == 5) {
       codegen_emit(gen, "(int)((");
       ros2_expr(gen, node->data.call.args[0]);
       codegen_emit(gen, " - ");
@@ -151,7 +171,7 @@ static void ros2_expr(CodeGen *gen, ASTNode *node) {
       codegen_emit(gen, ") + ");
       ros2_expr(gen, node->data.call.args[3]);
       codegen_emit(gen, ")");
-    } else if (strcmp(nm, "constrain") == 0) {
+    } else if (nm == intern_builtin(ATOM_CONSTRAIN)) {
       codegen_emit(gen, "std::max(");
       ros2_expr(gen, node->data.call.args[1]);
       codegen_emit(gen, ", std::min(");
@@ -366,9 +386,11 @@ static void ros2_stmt(CodeGen *gen, ASTNode *node) {
                    loop_id, loop_id, loop_id);
     }
 
+    // ast_infer_types() may have picked a narrower counter
     codegen_emit_line(gen,
-                      "for (int %s_ = _start_%d; _step_%d > 0 ? %s_ <= _end_%d "
+                      "for (%s %s_ = _start_%d; _step_%d > 0 ? %s_ <= _end_%d "
                       ": %s_ >= _end_%d; %s_ += _step_%d) {\n",
+                      codegen_counter_type(node),
                       node->data.for_loop.var_name, loop_id, loop_id,
                       node->data.for_loop.var_name, loop_id,
                       node->data.for_loop.var_name, loop_id,
@@ -817,7 +839,7 @@ static void ros2_stmt(CodeGen *gen, ASTNode *node) {
     codegen_emit_indent(gen);
     codegen_emit(
         gen,
-        "RCLCPP_INFO(this->get_logger(), \"GPS Attach (Baud: %d)\", (int)(");
+        "RCLCPP_INFO(this->get_logger(), \"GPS Attach (Baud: %%d)\", (int)(");
     ros2_expr(gen, node->data.gps_attach.baud);
     codegen_emit(gen, "));\n");
     break;
@@ -831,7 +853,7 @@ static void ros2_stmt(CodeGen *gen, ASTNode *node) {
   case NODE_SD_MOUNT:
     codegen_emit_indent(gen);
     codegen_emit(
-        gen, "RCLCPP_INFO(this->get_logger(), \"SD Mount (CS: %d)\", (int)(");
+        gen, "RCLCPP_INFO(this->get_logger(), \"SD Mount (CS: %%d)\", (int)(");
     ros2_expr(gen, node->data.sd_mount.cs_pin);
     codegen_emit(gen, "));\n");
     break;
@@ -839,7 +861,7 @@ static void ros2_stmt(CodeGen *gen, ASTNode *node) {
   case NODE_FILE_OPEN:
     codegen_emit_indent(gen);
     codegen_emit(
-        gen, "RCLCPP_INFO(this->get_logger(), \"File Open: %s\", std::string(");
+        gen, "RCLCPP_INFO(this->get_logger(), \"File Open: %%s\", std::string(");
     ros2_expr(gen, node->data.file_open.filename);
     codegen_emit(gen, ").c_str());\n");
     break;
@@ -848,7 +870,7 @@ static void ros2_stmt(CodeGen *gen, ASTNode *node) {
     codegen_emit_indent(gen);
     codegen_emit(
         gen,
-        "RCLCPP_INFO(this->get_logger(), \"File Write: %s\", std::string(");
+        "RCLCPP_INFO(this->get_logger(), \"File Write: %%s\", std::string(");
     ros2_expr(gen, node->data.file_write.data);
     codegen_emit(gen, ").c_str());\n");
     break;
@@ -924,6 +946,14 @@ void codegen_generate_ros2(CodeGen *gen, ASTNode *program) {
   codegen_emit_line(gen, "#include <cmath>\n");
   codegen_emit_line(gen, "using namespace std::chrono_literals;\n");
 
+  /* x / y where y has side effects: y is evaluated once */
+  if (ast_uses_feature(program, FEATURE_DIV)) {
+    codegen_emit_line(gen, "template <typename A, typename B>");
+    codegen_emit_line(gen, "static inline auto _kx_div(A a, B b) -> decltype(a / b) {");
+    codegen_emit_line(gen, "  return b == 0 ? 0 : a / b;");
+    codegen_emit_line(gen, "}\n");
+  }
+
   /* Standalone helper functions before the class */
   ASTNode *block = program->data.program.main_block;
   if (block && block->type == NODE_BLOCK) {
@@ -1093,7 +1123,7 @@ void codegen_generate_ros2(CodeGen *gen, ASTNode *program) {
   codegen_emit_line(gen, "  }\n");
   codegen_emit_line(gen, "  int _kx_drone_pins[4] = {-1,-1,-1,-1};");
   codegen_emit_line(gen, "  void _kx_drone_mix(double pitch,double roll,double yaw,double throttle) {");
-  codegen_emit_line(gen, "    RCLCPP_INFO(this->get_logger(), \"Drone mix: p=%.1f r=%.1f y=%.1f t=%.1f\", pitch, roll, yaw, throttle);");
+  codegen_emit_line(gen, "    RCLCPP_INFO(this->get_logger(), \"Drone mix: p=%%.1f r=%%.1f y=%%.1f t=%%.1f\", pitch, roll, yaw, throttle);");
   codegen_emit_line(gen, "  }\n");
 
   /* Hoist variable declarations as class member initializations (not in loop) */
@@ -7,6 +7,8 @@
 
 #include "ast.h"
 #include "codegen.h"
+#include "feature_usage.h"
+#include "value_range.h"
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,14 +16,13 @@
 
 // Python uses spaces-only indentation (4 spaces)
 static void rpi_indent(CodeGen *gen) {
-  for (int i = 0; i < gen->indent_level; i++)
-    fprintf(gen->output, "    ");
+  outbuf_spaces(&gen->out, gen->indent_level * 4);
 }
 
 static void rpi_emit(CodeGen *gen, const char *fmt, ...) {
   va_list args;
   va_start(args, fmt);
-  vfprintf(gen->output, fmt, args);
+  outbuf_vprintf(&gen->out, fmt, args);
   va_end(args);
 }
 
@@ -29,9 +30,9 @@ static void rpi_emit_line(CodeGen *gen, const char *fmt, ...) {
   rpi_indent(gen);
   va_list args;
   va_start(args, fmt);
-  vfprintf(gen->output, fmt, args);
+  outbuf_vprintf(&gen->out, fmt, args);
   va_end(args);
-  fprintf(gen->output, "\n");
+  outbuf_putc(&gen->out, '\n');
 }
 
 // Forward declarations
@@ -48,7 +49,7 @@ static void rpi_expression(CodeGen *gen, ASTNode *node) {
 
   switch (node->type) {
   case NODE_NUMBER:
-    rpi_emit(gen, "%g", node->data.number.value);
+    codegen_emit_number(gen, node);
     break;
   case NODE_STRING: {
     /* Escape backslashes and quotes for Python string literal */
@@ -59,7 +60,7 @@ static void rpi_expression(CodeGen *gen, ASTNode *node) {
       else if (*p == '\n') rpi_emit(gen, "\\n");
       else if (*p == '\r') rpi_emit(gen, "\\r");
       else if (*p == '\t') rpi_emit(gen, "\\t");
-      else fputc(*p, gen->output);
+      else outbuf_putc(&gen->out, *p);
     }
     rpi_emit(gen, "\"");
     break;
@@ -126,7 +127,15 @@ static void rpi_expression(CodeGen *gen, ASTNode *node) {
       rpi_emit(gen, ") + str(");
       rpi_expression(gen, node->data.binary_op.right);
       rpi_emit(gen, "))");
-    } else if (node->data.binary_op.op == OP_DIV) {
+    } else if (node->data.binary_op.op == OP_DIV &&
+               ast_divisor_nonzero(node, RANGE_INT_BITS)) {
+      rpi_emit(gen, "((");
+      rpi_expression(gen, node->data.binary_op.left);
+      rpi_emit(gen, ") / (");
+      rpi_expression(gen, node->data.binary_op.right);
+      rpi_emit(gen, "))");
+    } else if (node->data.binary_op.op == OP_DIV &&
+               ast_expr_is_pure(node->data.binary_op.right)) {
       rpi_emit(gen, "(0 if (");
       rpi_expression(gen, node->data.binary_op.right);
       rpi_emit(gen, ") == 0 else (");
@@ -134,6 +143,13 @@ static void rpi_expression(CodeGen *gen, ASTNode *node) {
       rpi_emit(gen, ") / (");
       rpi_expression(gen, node->data.binary_op.right);
       rpi_emit(gen, "))");
+    } else if (node->data.binary_op.op == OP_DIV) {
+      // _kx_div evaluates a divisor with side effects (a pin read) once
+      rpi_emit(gen, "_kx_div(");
+      rpi_expression(gen, node->data.binary_op.left);
+      rpi_emit(gen, ", ");
+      rpi_expression(gen, node->data.binary_op.right);
+      rpi_emit(gen, ")");
     } else {
       rpi_emit(gen, "(");
       rpi_expression(gen, node->data.binary_op.left);
@@ -159,7 +175,7 @@ static void rpi_expression(CodeGen *gen, ASTNode *node) {
   case NODE_CALL: {
     // Remap built-in functions to Python equivalents
     const char *name = node->data.call.name;
-    if (strcmp(name, "map") == 0 && node->data.call.arg_count == 5) {
+    if (name == intern_builtin(ATOM_MAP) && node->data.call.arg_count == 5) {
       // map(v, fl, fh, tl, th) → int((v - fl) * (th - tl) / (fh - fl) + tl)
       rpi_emit(gen, "int((");
       rpi_expression(gen, node->data.call.args[0]);
@@ -176,7 +192,7 @@ static void rpi_expression(CodeGen *gen, ASTNode *node) {
       rpi_emit(gen, ") + ");
       rpi_expression(gen, node->data.call.args[3]);
       rpi_emit(gen, ")");
-    } else if (strcmp(name, "constrain") == 0) {
+    } else if (name == intern_builtin(ATOM_CONSTRAIN)) {
       rpi_emit(gen, "max(");
       rpi_expression(gen, node->data.call.args[1]);
       rpi_emit(gen, ", min(");
@@ -184,13 +200,13 @@ static void rpi_expression(CodeGen *gen, ASTNode *node) {
       rpi_emit(gen, ", ");
       rpi_expression(gen, node->data.call.args[0]);
       rpi_emit(gen, "))");
-    } else if (strcmp(name, "random") == 0) {
+    } else if (name == intern_builtin(ATOM_RANDOM)) {
       rpi_emit(gen, "random.randint(");
       rpi_expression(gen, node->data.call.args[0]);
       rpi_emit(gen, ", ");
       rpi_expression(gen, node->data.call.args[1]);
       rpi_emit(gen, ")");
-    } else if (strcmp(name, "delayMicroseconds") == 0) {
+    } else if (name == intern_builtin(ATOM_DELAY_MICROSECONDS)) {
       rpi_emit(gen, "time.sleep(");
       rpi_expression(gen, node->data.call.args[0]);
       rpi_emit(gen, " / 1000000.0)");
@@ -562,6 +578,9 @@ static void rpi_statement(CodeGen *gen, ASTNode *node) {
     break;
 
   case NODE_BLOCK:
+    // Python needs a statement in every suite, and DCE can empty one
+    if (node->data.block.statement_count == 0)
+      rpi_emit_line(gen, "pass");
     for (int i = 0; i < node->data.block.statement_count; i++)
       rpi_statement(gen, node->data.block.statements[i]);
     break;
@@ -1618,6 +1637,12 @@ void codegen_generate_rpi(CodeGen *gen, ASTNode *program) {
   rpi_emit_line(gen, "_kx_kalman_q = 0.01; _kx_kalman_r = 0.1");
   rpi_emit_line(gen, "_kx_kalman_x = 0.0; _kx_kalman_p = 1.0; _kx_kalman_k = 0.0\n");
 
+  /* x / y where y has side effects: y is evaluated once */
+  if (ast_uses_feature(program, FEATURE_DIV)) {
+    rpi_emit_line(gen, "def _kx_div(a, b):");
+    rpi_emit_line(gen, "    return 0 if b == 0 else a / b\n");
+  }
+
   rpi_emit_line(gen, "def _kx_kalman_update(mea):");
   rpi_emit_line(gen, "    global _kx_kalman_q, _kx_kalman_r, _kx_kalman_x, _kx_kalman_p, _kx_kalman_k");
   rpi_emit_line(gen, "    _kx_kalman_p = _kx_kalman_p + _kx_kalman_q");
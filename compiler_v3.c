@@ -2,36 +2,349 @@
  * Supports: Arduino, ESP32, Raspberry Pi, Pico (MicroPython), ROS2
  */
 
+#define _XOPEN_SOURCE 700 /* realpath */
 #include "ast.h"
 #include "codegen.h"
 #include "error.h"
+#include "ir.h"
+#include "module_index.h"
+#include "parallel.h"
 #include "parser.h"
-#include "pin_tracker.h"
+#include "pass_manager.h"
+#include "pass_timer.h"
+#include "server.h"
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// Platform-independent directory & process APIs
+// Platform-independent directory APIs
 #ifdef _WIN32
-#include <process.h>
-#include <windows.h>
-#define getpid _getpid
+#include <direct.h>
+#define make_dir(path) _mkdir(path)
 #else
-#include <dirent.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#define make_dir(path) mkdir(path, 0755)
 #endif
 
+/* Files to compile, in the order they are parsed */
+typedef struct {
+  SourceFile *files;
+  int count;
+  int capacity;
+} SourceList;
+
+static void source_list_push(SourceList *list, FILE *file, const char *path,
+                             const char *text, size_t length) {
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity ? list->capacity * 2 : 8;
+    list->files = realloc(list->files, list->capacity * sizeof(SourceFile));
+  }
+  size_t path_length = strlen(path) + 1;
+  char *copy = malloc(path_length);
+  memcpy(copy, path, path_length);
+  SourceFile *source = &list->files[list->count++];
+  source->file = file;
+  source->path = copy;
+  source->text = text;
+  source->length = length;
+}
+
+static void source_list_close(SourceList *list) {
+  for (int i = 0; i < list->count; i++) {
+    if (list->files[i].file)
+      fclose(list->files[i].file);
+    free((char *)list->files[i].path);
+  }
+  free(list->files);
+}
+
+/* One backend run; backends only read the tree and format into their own
+ * buffer, so these run in parallel */
+typedef struct {
+  Target target;
+  CodeGen *gen;
+  double wall_ms;   /* time spent in this backend, for --time-passes */
+  long peak_rss_kb; /* process high-water mark when it finished */
+} BackendJob;
+
+typedef struct {
+  BackendJob *jobs;
+  ASTNode *program;
+} BackendBatch;
+
+static void run_backend(void *context, int index) {
+  BackendBatch *batch = context;
+  BackendJob *job = &batch->jobs[index];
+  double start = pass_clock_ms();
+  job->gen = codegen_create_for_target(NULL, job->target);
+  codegen_generate(job->gen, batch->program);
+  job->wall_ms = pass_clock_ms() - start;
+  job->peak_rss_kb = pass_peak_rss_kb();
+}
+
+/* Arena allocations and bytes since `*mark`, which is then moved up */
+static void arena_delta(const Arena *arena, Arena *mark, size_t *allocations,
+                        size_t *bytes) {
+  *allocations = arena->alloc_count - mark->alloc_count;
+  *bytes = arena->bytes_allocated - mark->bytes_allocated;
+  *mark = *arena;
+}
+
+// ============================================================================
+// COMPILE PIPELINE (shared by the command line and --serve)
+// ============================================================================
+
+typedef struct {
+  const char *input_file; /* main file; names it in errors, anchors includes */
+  const char *source;     /* its text, or NULL to read input_file */
+  size_t source_length;
+  const char *module_dir; /* holds kinetrix_modules/, NULL for cwd */
+  const Target *targets;
+  int target_count;
+  int jobs;               /* backend threads, 0 for one per CPU */
+  int diagnostics;        /* report GPIO pin usage */
+  ModuleCache *cache;     /* or NULL */
+  PassTimes *times;       /* or NULL */
+  FILE *log;              /* progress messages, or NULL for none */
+  int quiet;              /* log warnings in errors->warnings only */
+  int keep_ir;            /* keep the IR after the passes, for --emit-ir */
+  const PassOptions *passes; /* -O level and -f flags, or NULL for defaults */
+} CompileRequest;
+
+typedef enum { COMPILE_OK, COMPILE_NO_INPUT, COMPILE_ERRORS } CompileStatus;
+
+/* What a compile leaves behind; the generated code is in each backend's
+ * buffer. Release with compilation_free(). */
+typedef struct {
+  ErrorList *errors;
+  Parser *parser; /* owns the AST arena */
+  ASTNode *program;
+  IrModule *ir; /* with keep_ir, else NULL */
+  PassStats pass_stats;
+  BackendJob backends[TARGET_COUNT];
+} Compilation;
+
+static void progress(const CompileRequest *request, const char *format, ...) {
+  if (request->log == NULL)
+    return;
+  va_list args;
+  va_start(args, format);
+  vfprintf(request->log, format, args);
+  va_end(args);
+}
+
+static CompileStatus compile_program(const CompileRequest *request,
+                                     Compilation *c) {
+  PassTimes *times = request->times;
+  double pass_start = pass_clock_ms();
+  memset(c, 0, sizeof(*c));
+  c->errors = error_list_create(10);
+  c->errors->quiet = request->quiet;
+
+  SourceFile program = {NULL, request->input_file, request->source,
+                        request->source_length};
+  if (!request->source &&
+      (program.file = fopen(request->input_file, "r")) == NULL)
+    return COMPILE_NO_INPUT;
+
+  // Installed packages are parsed ahead of the main file, which comes last;
+  // only the ones the program reaches are taken in
+  ModuleIndex *modules = module_index_create(request->module_dir);
+  module_index_select(modules, &program);
+  SourceList sources = {NULL, 0, 0};
+  for (int i = 0; i < modules->count; i++) {
+    const ModuleEntry *module = &modules->modules[i];
+    if (module->used)
+      source_list_push(&sources, NULL, module->path, module->text,
+                       module->length);
+  }
+  source_list_push(&sources, program.file, program.path, program.text,
+                   program.length);
+  if (times)
+    pass_times_add(times, "module index", pass_clock_ms() - pass_start,
+                   (size_t)modules->count, 0);
+  if (modules->count > 0)
+    progress(request, "Using %d of %d installed modules\n",
+             modules->used_count, modules->count);
+
+  // Parse and build AST
+  pass_start = pass_clock_ms();
+  progress(request, "Parsing...\n");
+  c->parser = parser_create_multi(sources.files, sources.count, c->errors);
+  module_index_free(modules); // The lexer has its own copy of each text
+  parser_set_cache(c->parser, request->cache);
+  size_t source_bytes = 0;
+  for (int i = 0; i < c->parser->lexer->source_count; i++)
+    source_bytes += c->parser->lexer->sources[i].length;
+  Arena mark = *c->parser->arena;
+  // The lexer reads each file into one buffer
+  if (times)
+    pass_times_add(times, "merge/lex", pass_clock_ms() - pass_start,
+                   (size_t)sources.count, source_bytes);
+
+  pass_start = pass_clock_ms();
+  c->program = parser_parse(c->parser);
+  source_list_close(&sources);
+  size_t allocations, bytes;
+  arena_delta(c->parser->arena, &mark, &allocations, &bytes);
+  if (times)
+    pass_times_add(times, "parse", pass_clock_ms() - pass_start, allocations,
+                   bytes);
+  if (c->errors->count > 0)
+    return COMPILE_ERRORS;
+  progress(request, "✓ Parsing successful\n");
+
+  // Every backend reads the same tree, so the middle end runs once
+  c->ir = pass_pipeline_run(c->program, request->passes, times,
+                            &c->pass_stats);
+  if (!request->keep_ir) {
+    ir_free(c->ir); // Backends read the tree
+    c->ir = NULL;
+  }
+  if (request->diagnostics && c->program->data.program.pin_count > 0)
+    progress(request, "Found %d GPIO pins\n",
+             c->program->data.program.pin_count);
+
+  for (int t = 0; t < request->target_count; t++) {
+    c->backends[t].target = request->targets[t];
+    progress(request, "Generating %s code...\n",
+             target_name(request->targets[t]));
+  }
+  BackendBatch batch = {c->backends, c->program};
+  pass_start = pass_clock_ms();
+  parallel_for(request->target_count,
+               request->jobs > 0 ? request->jobs : parallel_cpu_count(),
+               run_backend, &batch);
+  double codegen_ms = pass_clock_ms() - pass_start;
+
+  // Backends overlap, so each reports its own time and the batch its span
+  if (times) {
+    size_t generated = 0;
+    for (int t = 0; t < request->target_count; t++) {
+      char name[32];
+      OutBuf *out = &c->backends[t].gen->out;
+      snprintf(name, sizeof(name), "codegen %s",
+               target_key(request->targets[t]));
+      pass_times_add_sampled(times, name, c->backends[t].wall_ms,
+                             c->backends[t].peak_rss_kb, out->allocations,
+                             out->length);
+      generated += out->length;
+    }
+    if (request->target_count > 1)
+      pass_times_add(times, "codegen (all)", codegen_ms, 0, generated);
+  }
+  return COMPILE_OK;
+}
+
+static void compilation_free(Compilation *c) {
+  ir_free(c->ir);
+  for (int t = 0; t < TARGET_COUNT; t++)
+    if (c->backends[t].gen)
+      codegen_free(c->backends[t].gen);
+  // The AST lives in the parser's arena and is released with it
+  if (c->parser)
+    parser_free(c->parser);
+  error_list_free(c->errors);
+}
+
+/* "Compilation failed" and one line per error, as printed on stderr */
+static void format_errors(OutBuf *out, const ErrorList *errors,
+                          const char *input_file) {
+  outbuf_printf(out, "\nCompilation failed with %d error(s):\n",
+                errors->count);
+  for (Error *err = errors->head; err; err = err->next) {
+    if (err->file && strcmp(err->file, input_file) != 0)
+      outbuf_printf(out, "  %s: Line %d, Col %d: %s\n", err->file, err->line,
+                    err->column, err->message);
+    else
+      outbuf_printf(out, "  Line %d, Col %d: %s\n", err->line, err->column,
+                    err->message);
+  }
+}
+
+/* Release the tree and collect what a local run prints on stderr: the
+ * warnings, then any errors. Unused globals are only reported as the
+ * parser's symbol table is torn down, so this frees the parser first. */
+static void compilation_diagnostics(Compilation *c, CompileStatus status,
+                                    const char *input_file, OutBuf *out) {
+  if (c->parser) {
+    parser_free(c->parser);
+    c->parser = NULL;
+  }
+  outbuf_write(out, c->errors->warnings, c->errors->warnings_length);
+  if (status == COMPILE_ERRORS)
+    format_errors(out, c->errors, input_file);
+}
+
+/* Write each backend's code to its file; failures are added to `report` */
+static int write_outputs(Compilation *c, int target_count,
+                         char outputs[][512], OutBuf *report) {
+  int ok = 1;
+  for (int t = 0; t < target_count; t++) {
+    FILE *file = fopen(outputs[t], "w");
+    if (!file) {
+      outbuf_printf(report, "Error: Could not open output '%s'\n",
+                    outputs[t]);
+      ok = 0;
+      continue;
+    }
+    if (!outbuf_flush(&c->backends[t].gen->out, file)) {
+      outbuf_printf(report, "Error: Could not write '%s'\n", outputs[t]);
+      ok = 0;
+    }
+    if (fclose(file) != 0)
+      ok = 0;
+  }
+  return ok;
+}
+
 static void print_usage(const char *prog) {
   fprintf(stderr, "Kinetrix V3.1 Multi-Target Compiler\n");
   fprintf(stderr, "=====================================\n");
-  fprintf(stderr, "Usage: %s <source.kx> [-o output] [--target <target>]\n\n",
+  fprintf(stderr, "Usage: %s <source.kx> [-o output] [--target <target>]\n",
+          prog);
+  fprintf(stderr, "       %s <a.kx> <b.kx>... [-o dir] [--target <target>]"
+                  "\n\n",
           prog);
   fprintf(stderr, "Targets:\n");
   fprintf(stderr, "  arduino  (default)  Arduino Uno/Mega/Nano    → .ino\n");
   fprintf(stderr, "  esp32               ESP32 / ESP8266          → .cpp\n");
   fprintf(stderr, "  rpi                 Raspberry Pi (Python)    → .py\n");
   fprintf(stderr, "  pico                Raspberry Pi Pico        → .py\n");
-  fprintf(stderr, "  ros2                ROS2 C++ Node            → .cpp\n\n");
+  fprintf(stderr, "  ros2                ROS2 C++ Node            → .cpp\n");
+  fprintf(stderr, "  all                 All five, parsed once    → "
+                  "<output>_<target>.*\n");
+  fprintf(stderr, "  <t>,<t>...          Several, e.g. esp32,rpi  → "
+                  "<output>_<target>.*\n\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --diagnostics       Report GPIO pin usage\n");
+  fprintf(stderr, "  --stats             Print AST memory statistics\n");
+  fprintf(stderr, "  --emit-ir           Print the program lowered to the "
+                  "shared IR\n");
+  fprintf(stderr, "  -O0 / -O1 / -O2     No optimizations / cheap ones / all "
+                  "(default: -O2;\n"
+                  "                      -O0 for a literal translation)\n");
+  fprintf(stderr, "  -f<pass>, -fno-<pass>  Switch one pass on or off: "
+                  "fold-constants, dce,\n"
+                  "                      strip-runtime, elide-div-guards, "
+                  "narrow-ints\n");
+  fprintf(stderr, "  --pass-stats        Report what each pass changed\n");
+  fprintf(stderr, "  --no-cache          Reparse modules instead of using " KX_CACHE_DIR
+                  "/\n");
+  fprintf(stderr, "  -j <n>              Generate up to n targets, or "
+                  "compile n programs, at once\n"
+                  "                      (default: CPUs)\n");
+  fprintf(stderr, "  --time-passes       Report time, peak memory and "
+                  "allocations per pass\n");
+  fprintf(stderr, "  --time-passes=json  Same report as JSON on stderr\n");
+  fprintf(stderr, "  --manifest <file>   Compile every program listed in file "
+                  "(one per line)\n");
+  fprintf(stderr, "  --serve <socket>    Run as a compile server on a Unix "
+                  "socket\n");
+  fprintf(stderr, "  --server <socket>   Compile through that server if it "
+                  "is running\n\n");
   fprintf(stderr, "Examples:\n");
   fprintf(stderr,
           "  %s robot.kx                           # Arduino (default)\n",
@@ -40,22 +353,472 @@ static void print_usage(const char *prog) {
   fprintf(stderr, "  %s robot.kx --target rpi   -o out.py\n", prog);
   fprintf(stderr, "  %s robot.kx --target pico  -o out.py\n", prog);
   fprintf(stderr, "  %s robot.kx --target ros2  -o node.cpp\n", prog);
+  fprintf(stderr, "  %s robot.kx --target all   -o robot\n", prog);
+}
+
+/* Target named `name`, or -1 */
+static int parse_target(const char *name) {
+  for (int t = 0; t < TARGET_COUNT; t++)
+    if (strcmp(name, target_key((Target)t)) == 0)
+      return t;
+  return -1;
+}
+
+/* "all", one target, or a comma-separated list; returns how many, or 0 with
+ * the reason in `error` */
+static int parse_targets(const char *spec, Target *targets, char *error,
+                         size_t error_size) {
+  int count = 0;
+  if (strcmp(spec, "all") == 0) {
+    for (int t = 0; t < TARGET_COUNT; t++)
+      targets[count++] = (Target)t;
+    return count;
+  }
+  char name[32];
+  const char *p = spec;
+  while (*p) {
+    size_t n = strcspn(p, ",");
+    if (n == 0 || n >= sizeof(name)) {
+      snprintf(error, error_size, "Bad target list '%s'", spec);
+      return 0;
+    }
+    memcpy(name, p, n);
+    name[n] = '\0';
+    int target = parse_target(name);
+    if (target < 0) {
+      snprintf(error, error_size,
+               "Unknown target '%s'\nValid targets: arduino, esp32, rpi, "
+               "pico, ros2, all",
+               name);
+      return 0;
+    }
+    int seen = 0;
+    for (int i = 0; i < count; i++)
+      seen |= targets[i] == (Target)target;
+    if (!seen)
+      targets[count++] = (Target)target;
+    p += n;
+    if (*p == ',')
+      p++;
+  }
+  if (count == 0)
+    snprintf(error, error_size, "Bad target list '%s'", spec);
+  return count;
+}
+
+/* With several targets each gets its own file: <base>_<target><ext>, where
+ * <base> is the -o path minus its extension */
+static void multi_target_path(const char *output_file, Target target,
+                              char *out, size_t size) {
+  const char *base = output_file ? output_file : "Kinetrix_Output";
+  const char *slash = strrchr(base, '/');
+  const char *dot = strrchr(slash ? slash : base, '.');
+  int base_length = dot && dot != base && dot[-1] != '/' ? (int)(dot - base)
+                                                         : (int)strlen(base);
+  snprintf(out, size, "%.*s_%s%s", base_length, base, target_key(target),
+           target_extension(target));
+}
+
+// Target-specific upload instructions
+static void print_next_steps(Target target, const char *output_file) {
+  switch (target) {
+  case TARGET_ARDUINO:
+    printf("Next steps:\n");
+    printf("  Open %s in Arduino IDE → select board → Upload\n", output_file);
+    printf("  OR: arduino-cli compile --fqbn arduino:avr:uno .\n");
+    break;
+  case TARGET_ESP32:
+    printf("Next steps:\n");
+    printf("  Open %s in Arduino IDE with ESP32 board package\n", output_file);
+    printf("  Select: Tools → Board → ESP32 Dev Module → Upload\n");
+    break;
+  case TARGET_RPI:
+    printf("Next steps:\n");
+    printf("  pip install RPi.GPIO Adafruit-MCP3008\n");
+    printf("  python3 %s\n", output_file);
+    break;
+  case TARGET_PICO:
+    printf("Next steps:\n");
+    printf("  Install MicroPython on your Pico first\n");
+    printf("  Then: mpremote copy %s :main.py\n", output_file);
+    printf("  OR:   Open in Thonny IDE → Run\n");
+    break;
+  case TARGET_ROS2:
+    printf("Next steps:\n");
+    printf("  Place %s in your ROS2 package src/\n", output_file);
+    printf("  colcon build && ros2 run <pkg> kinetrix_node\n");
+    break;
+  default:
+    break;
+  }
+}
+
+// ============================================================================
+// COMPILE SERVER (--serve) AND CLIENT (--server)
+// ============================================================================
+
+/* Lives as long as the server; the module cache is what stays warm */
+typedef struct {
+  ModuleCache *cache;
+  int jobs;
+  int served;
+} ServeState;
+
+static int serve_compile(void *context, const ServeRequest *request,
+                         OutBuf *reply) {
+  ServeState *state = context;
+  double start = pass_clock_ms();
+  Target targets[TARGET_COUNT] = {TARGET_ARDUINO};
+  int target_count = 1;
+  char error[160];
+  if (request->targets) {
+    target_count = parse_targets(request->targets, targets, error,
+                                 sizeof(error));
+    if (target_count == 0) {
+      char message[200];
+      snprintf(message, sizeof(message), "Error: %s\n", error);
+      serve_section(reply, "diagnostics", message, strlen(message));
+      return 0;
+    }
+  }
+  // The client's -O/-f arguments, one word at a time
+  PassOptions passes;
+  pass_options_init(&passes);
+  for (const char *word = request->passes; word && *word;) {
+    size_t length = strcspn(word, " ");
+    char arg[64];
+    snprintf(arg, sizeof(arg), "%.*s", (int)length, word);
+    word += length + strspn(word + length, " ");
+    int parsed = pass_options_parse(&passes, arg, error, sizeof(error));
+    if (parsed == 0)
+      snprintf(error, sizeof(error), "'%s' is not a pass option", arg);
+    if (parsed <= 0) {
+      char message[200];
+      snprintf(message, sizeof(message), "Error: %s\n", error);
+      serve_section(reply, "diagnostics", message, strlen(message));
+      return 0;
+    }
+  }
+
+  const char *input_file = request->path ? request->path : "<request>";
+  CompileRequest compile = {input_file, request->source,
+                            request->source_length, request->dir, targets,
+                            target_count, state->jobs, 0, state->cache,
+                            NULL, NULL, 1, 0, &passes};
+  Compilation c;
+  CompileStatus status = compile_program(&compile, &c);
+
+  if (status == COMPILE_OK) {
+    for (int t = 0; t < target_count; t++) {
+      char header[32];
+      OutBuf *out = &c.backends[t].gen->out;
+      snprintf(header, sizeof(header), "output %s", target_key(targets[t]));
+      serve_section(reply, header, out->data, out->length);
+    }
+  }
+
+  OutBuf diagnostics;
+  outbuf_init(&diagnostics);
+  compilation_diagnostics(&c, status, input_file, &diagnostics);
+  serve_section(reply, "diagnostics", diagnostics.data, diagnostics.length);
+  outbuf_free(&diagnostics);
+  compilation_free(&c);
+
+  state->served++;
+  printf("[%d] %s %s: %s in %.1f ms\n", state->served, input_file,
+         request->targets ? request->targets : target_key(TARGET_ARDUINO),
+         status == COMPILE_OK ? "ok" : "failed", pass_clock_ms() - start);
+  fflush(stdout);
+  return status == COMPILE_OK;
 }
 
-static Target parse_target(const char *name) {
-  if (strcmp(name, "arduino") == 0)
-    return TARGET_ARDUINO;
-  if (strcmp(name, "esp32") == 0)
-    return TARGET_ESP32;
-  if (strcmp(name, "rpi") == 0)
-    return TARGET_RPI;
-  if (strcmp(name, "pico") == 0)
-    return TARGET_PICO;
-  if (strcmp(name, "ros2") == 0)
-    return TARGET_ROS2;
-  fprintf(stderr, "Error: Unknown target '%s'\n", name);
-  fprintf(stderr, "Valid targets: arduino, esp32, rpi, pico, ros2\n");
-  exit(1);
+static char *read_whole_file(const char *path, size_t *out_length) {
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return NULL;
+  OutBuf text;
+  outbuf_init(&text);
+  char chunk[8192];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    outbuf_write(&text, chunk, n);
+  fclose(file);
+  outbuf_putc(&text, '\0');
+  *out_length = text.length - 1;
+  return text.data;
+}
+
+/* Have the server at `socket_path` compile `input_file` and write what it
+ * returns to `outputs`. Returns 0 (and touches nothing) if no server
+ * answers, otherwise 1 with the exit status in `*exit_status`. */
+static int compile_remotely(const char *socket_path, const char *input_file,
+                            const char *target_spec, const Target *targets,
+                            int target_count, const PassOptions *passes,
+                            char outputs[][512], int *exit_status) {
+#ifdef _WIN32
+  (void)socket_path;
+  (void)input_file;
+  (void)target_spec;
+  (void)targets;
+  (void)target_count;
+  (void)passes;
+  (void)outputs;
+  (void)exit_status;
+  return 0;
+#else
+  // Paths go over absolute: the server has its own working directory
+  ServeRequest request = {NULL, NULL, NULL, NULL, NULL, 0};
+  char path[4096];
+  char dir[4096];
+  char pass_args[256];
+  request.targets = (char *)target_spec;
+  if (pass_options_format(passes, pass_args, sizeof(pass_args)))
+    request.passes = pass_args;
+  request.path = realpath(input_file, path) ? path : (char *)input_file;
+  request.dir = getcwd(dir, sizeof(dir));
+  request.source = read_whole_file(input_file, &request.source_length);
+  if (request.source == NULL) {
+    fprintf(stderr, "Error: Could not open '%s'\n", input_file);
+    *exit_status = 1;
+    return 1;
+  }
+
+  OutBuf reply;
+  outbuf_init(&reply);
+  int reached = serve_request(socket_path, &request, &reply);
+  free(request.source);
+  if (!reached) {
+    outbuf_free(&reply);
+    return 0;
+  }
+
+  const char *cursor = reply.data;
+  const char *end = reply.data + reply.length;
+  const char *status = SERVE_PROTOCOL " ok\n";
+  int ok = reply.length > strlen(status) &&
+           memcmp(cursor, status, strlen(status)) == 0;
+  const char *newline = memchr(cursor, '\n', reply.length);
+  cursor = newline ? newline + 1 : end;
+
+  char header[64];
+  const char *data;
+  size_t length;
+  int written = 0;
+  while (serve_next_section(&cursor, end, header, sizeof(header), &data,
+                            &length)) {
+    if (strcmp(header, "diagnostics") == 0) {
+      fwrite(data, 1, length, stderr);
+      continue;
+    }
+    for (int t = 0; ok && t < target_count; t++) {
+      if (strncmp(header, "output ", 7) != 0 ||
+          strcmp(header + 7, target_key(targets[t])) != 0)
+        continue;
+      FILE *file = fopen(outputs[t], "w");
+      int good = file && fwrite(data, 1, length, file) == length;
+      if (file && fclose(file) != 0)
+        good = 0;
+      if (!good) {
+        fprintf(stderr, "Error: Could not write '%s'\n", outputs[t]);
+        ok = 0;
+      } else {
+        written++;
+      }
+    }
+  }
+  outbuf_free(&reply);
+  *exit_status = ok && written == target_count ? 0 : 1;
+  return 1;
+#endif
+}
+
+// ============================================================================
+// BATCH COMPILES (several inputs, or --manifest)
+// ============================================================================
+
+typedef struct {
+  char **paths;
+  int count;
+  int capacity;
+  char **owned; /* paths read from a manifest, freed with the list */
+  int owned_count;
+} InputList;
+
+static void input_list_add(InputList *list, char *path) {
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity ? list->capacity * 2 : 8;
+    list->paths = realloc(list->paths, list->capacity * sizeof(char *));
+  }
+  list->paths[list->count++] = path;
+}
+
+static void input_list_free(InputList *list) {
+  for (int i = 0; i < list->owned_count; i++)
+    free(list->owned[i]);
+  free(list->owned);
+  free(list->paths);
+}
+
+/* Queue the programs a manifest lists: one path per line, blank lines and
+ * # comments skipped, relative paths taken from the manifest's directory.
+ * Returns 0 if the manifest cannot be read. */
+static int read_manifest(const char *manifest, InputList *list) {
+  FILE *file = fopen(manifest, "r");
+  if (!file)
+    return 0;
+  const char *slash = strrchr(manifest, '/');
+#ifdef _WIN32
+  const char *backslash = strrchr(manifest, '\\');
+  if (backslash && (!slash || backslash > slash))
+    slash = backslash;
+#endif
+  int dir_length = slash ? (int)(slash - manifest) + 1 : 0;
+  char line[1024];
+  while (fgets(line, sizeof(line), file)) {
+    char *start = line;
+    while (*start == ' ' || *start == '\t')
+      start++;
+    size_t length = strcspn(start, "\r\n");
+    while (length > 0 &&
+           (start[length - 1] == ' ' || start[length - 1] == '\t'))
+      length--;
+    if (length == 0 || *start == '#')
+      continue;
+    int absolute = start[0] == '/' || (length > 1 && start[1] == ':');
+    size_t size = (absolute ? 0 : (size_t)dir_length) + length + 1;
+    char *path = malloc(size);
+    snprintf(path, size, "%.*s%.*s", absolute ? 0 : dir_length, manifest,
+             (int)length, start);
+    list->owned =
+        realloc(list->owned, (list->owned_count + 1) * sizeof(char *));
+    list->owned[list->owned_count++] = path;
+    input_list_add(list, path);
+  }
+  fclose(file);
+  return 1;
+}
+
+/* Where a batch input's code goes: beside it, or in `dir`, named after the
+ * input with the target's extension (and key, when there are several) */
+static void batch_output_path(const char *input, const char *dir,
+                              Target target, int multi, char *out,
+                              size_t size) {
+  const char *name = input;
+  const char *slash = strrchr(input, '/');
+  if (dir && slash)
+    name = slash + 1;
+  const char *file = slash && !dir ? slash + 1 : name;
+  const char *dot = strrchr(file, '.');
+  int length = dot && dot != file ? (int)(dot - name) : (int)strlen(name);
+  snprintf(out, size, "%s%s%.*s%s%s%s", dir ? dir : "", dir ? "/" : "",
+           length, name, multi ? "_" : "", multi ? target_key(target) : "",
+           target_extension(target));
+}
+
+/* One program of a batch; its report is printed once the batch is done, so
+ * the output reads in input order whatever order the workers finish in */
+typedef struct {
+  const char *input_file;
+  char outputs[TARGET_COUNT][512];
+  OutBuf report;
+  int failed;
+} BatchItem;
+
+typedef struct {
+  BatchItem *items;
+  int first; /* item that parallel_for's index 0 stands for */
+  const Target *targets;
+  int target_count;
+  ModuleCache *cache;
+  const PassOptions *passes;
+} Batch;
+
+static void run_batch_item(void *context, int index) {
+  Batch *batch = context;
+  BatchItem *item = &batch->items[batch->first + index];
+  // Programs are the parallel unit; each one runs its backends in turn
+  CompileRequest request = {item->input_file, NULL, 0, NULL, batch->targets,
+                            batch->target_count, 1, 0, batch->cache, NULL,
+                            NULL, 1, 0, batch->passes};
+  Compilation c;
+  CompileStatus status = compile_program(&request, &c);
+  OutBuf problems;
+  outbuf_init(&problems);
+  if (status == COMPILE_NO_INPUT)
+    outbuf_printf(&problems, "Error: Could not open '%s'\n",
+                  item->input_file);
+  int ok = status == COMPILE_OK &&
+           write_outputs(&c, batch->target_count, item->outputs, &problems);
+  compilation_diagnostics(&c, status, item->input_file, &problems);
+  compilation_free(&c);
+
+  item->failed = !ok;
+  outbuf_printf(&item->report, "%s %s", ok ? "✓" : "✗", item->input_file);
+  for (int t = 0; ok && t < batch->target_count; t++)
+    outbuf_printf(&item->report, "%s%s", t ? ", " : " → ", item->outputs[t]);
+  outbuf_putc(&item->report, '\n');
+  outbuf_write(&item->report, problems.data, problems.length);
+  outbuf_free(&problems);
+}
+
+static int run_batch(char **inputs, int count, const char *output_dir,
+                     const Target *targets, int target_count, int jobs,
+                     int use_cache, int stats, const PassOptions *passes) {
+  BatchItem *items = calloc(count, sizeof(BatchItem));
+  for (int i = 0; i < count; i++) {
+    items[i].input_file = inputs[i];
+    outbuf_init(&items[i].report);
+    for (int t = 0; t < target_count; t++)
+      batch_output_path(inputs[i], output_dir, targets[t], target_count > 1,
+                        items[i].outputs[t], sizeof(items[i].outputs[t]));
+  }
+  for (int i = 0; i < count; i++)
+    for (int j = i + 1; j < count; j++)
+      if (strcmp(items[i].outputs[0], items[j].outputs[0]) == 0) {
+        fprintf(stderr, "Error: '%s' and '%s' would both write '%s'\n",
+                inputs[i], inputs[j], items[i].outputs[0]);
+        free(items);
+        return 1;
+      }
+  if (output_dir)
+    make_dir(output_dir);
+
+  int workers = jobs > 0 ? jobs : parallel_cpu_count();
+  printf("Kinetrix V3.1 Multi-Target Compiler\n");
+  printf("=====================================\n");
+  printf("Batch:  %d programs on %d thread(s)\n", count,
+         workers < count ? workers : count);
+  for (int t = 0; t < target_count; t++)
+    printf("Target: %s\n", target_name(targets[t]));
+  printf("\n");
+
+  // Modules and includes are parsed once into a cache every worker reads;
+  // with --no-cache it lives in memory only. The first program runs alone
+  // so the installed modules are in the cache before the others start.
+  ModuleCache *cache = module_cache_create(use_cache ? KX_CACHE_DIR : NULL);
+  module_cache_keep_resident(cache);
+  module_cache_share(cache);
+  double start = pass_clock_ms();
+  Batch batch = {items, 0, targets, target_count, cache, passes};
+  run_batch_item(&batch, 0);
+  batch.first = 1;
+  parallel_for(count - 1, workers, run_batch_item, &batch);
+  double elapsed = pass_clock_ms() - start;
+
+  int failed = 0;
+  for (int i = 0; i < count; i++) {
+    fwrite(items[i].report.data, 1, items[i].report.length, stdout);
+    failed += items[i].failed;
+    outbuf_free(&items[i].report);
+  }
+  printf("\n%s %d of %d program(s) compiled in %.1f ms\n",
+         failed ? "✗" : "✓", count - failed, count, elapsed);
+  if (stats)
+    printf("Module cache: %d hit(s), %d miss(es), %d stored\n", cache->hits,
+           cache->misses, cache->stores);
+  module_cache_free(cache);
+  free(items);
+  return failed ? 1 : 0;
 }
 
 int main(int argc, char **argv) {
@@ -75,10 +838,23 @@ int main(int argc, char **argv) {
     }
   }
 
-  const char *input_file = NULL;
+  InputList inputs = {NULL, 0, 0, NULL, 0};
+  int batch = 0;
   const char *output_file = NULL;
-  Target target = TARGET_ARDUINO;
+  Target targets[TARGET_COUNT] = {TARGET_ARDUINO};
+  int target_count = 1;
   int diagnostics = 0;
+  int stats = 0;
+  int use_cache = 1;
+  int jobs = 0;
+  int time_passes = 0; /* 1: text report, 2: JSON */
+  int emit_ir = 0;
+  int pass_stats = 0;
+  PassOptions passes;
+  pass_options_init(&passes);
+  const char *target_spec = NULL;
+  const char *serve_socket = NULL;
+  const char *server_socket = NULL;
 
   // Parse command-line arguments
   for (int i = 1; i < argc; i++) {
@@ -87,197 +863,204 @@ int main(int argc, char **argv) {
     } else if ((strcmp(argv[i], "--target") == 0 ||
                 strcmp(argv[i], "-t") == 0) &&
                i + 1 < argc) {
-      target = parse_target(argv[++i]);
+      char error[160];
+      target_spec = argv[++i];
+      target_count = parse_targets(target_spec, targets, error, sizeof(error));
+      if (target_count == 0) {
+        fprintf(stderr, "Error: %s\n", error);
+        return 1;
+      }
     } else if (strcmp(argv[i], "--diagnostics") == 0) {
       diagnostics = 1;
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      stats = 1;
+    } else if (strcmp(argv[i], "--no-cache") == 0) {
+      use_cache = 0;
+    } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      jobs = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--emit-ir") == 0) {
+      emit_ir = 1;
+    } else if (strcmp(argv[i], "--pass-stats") == 0) {
+      pass_stats = 1;
+    } else if (strcmp(argv[i], "--time-passes") == 0) {
+      time_passes = 1;
+    } else if (strcmp(argv[i], "--time-passes=json") == 0) {
+      time_passes = 2;
+    } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+      serve_socket = argv[++i];
+    } else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+      server_socket = argv[++i];
+    } else if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc) {
+      batch = 1;
+      if (!read_manifest(argv[++i], &inputs)) {
+        fprintf(stderr, "Error: Could not read manifest '%s'\n", argv[i]);
+        input_list_free(&inputs);
+        return 1;
+      }
     } else if (argv[i][0] != '-') {
-      input_file = argv[i];
+      input_list_add(&inputs, argv[i]);
+    } else {
+      char error[256];
+      int parsed = pass_options_parse(&passes, argv[i], error,
+                                      sizeof(error));
+      if (parsed == 0)
+        snprintf(error, sizeof(error), "Unknown option '%s'", argv[i]);
+      if (parsed <= 0) {
+        fprintf(stderr, "Error: %s\n", error);
+        input_list_free(&inputs);
+        return 1;
+      }
+    }
+  }
+
+  // Daemon mode: installed modules stay parsed between requests
+  if (serve_socket) {
+    ServeState state = {NULL, jobs, 0};
+    if (use_cache) {
+      state.cache = module_cache_create(KX_CACHE_DIR);
+      module_cache_keep_resident(state.cache);
     }
+    int status = serve_unix_socket(serve_socket, serve_compile, &state);
+    module_cache_free(state.cache);
+    return status;
   }
 
-  if (!input_file) {
+  if (inputs.count == 0) {
     fprintf(stderr, "Error: No input file specified\n");
     print_usage(argv[0]);
+    input_list_free(&inputs);
     return 1;
   }
 
-  // Default output filename based on target
-  char default_out[256];
-  if (!output_file) {
-    const char *ext = target_extension(target);
-    snprintf(default_out, sizeof(default_out), "Kinetrix_Output%s", ext);
-    output_file = default_out;
+  // Several programs: one per worker thread, -o names the output directory
+  if (batch || inputs.count > 1) {
+    int status = run_batch(inputs.paths, inputs.count, output_file, targets,
+                           target_count, jobs, use_cache, stats, &passes);
+    input_list_free(&inputs);
+    return status;
+  }
+  const char *input_file = inputs.paths[0];
+  input_list_free(&inputs);
+
+  // Output filenames: -o (or a default) for one target, one file per
+  // target otherwise
+  char outputs[TARGET_COUNT][512];
+  if (target_count == 1) {
+    if (output_file)
+      snprintf(outputs[0], sizeof(outputs[0]), "%s", output_file);
+    else
+      snprintf(outputs[0], sizeof(outputs[0]), "Kinetrix_Output%s",
+               target_extension(targets[0]));
+  } else {
+    for (int t = 0; t < target_count; t++)
+      multi_target_path(output_file, targets[t], outputs[t],
+                        sizeof(outputs[t]));
   }
 
   printf("Kinetrix V3.1 Multi-Target Compiler\n");
   printf("=====================================\n");
   printf("Input:  %s\n", input_file);
-  printf("Output: %s\n", output_file);
-  printf("Target: %s\n\n", target_name(target));
-
-  // Pre-process: merge kpm dependencies and main file
-  char merged_path[256];
-  snprintf(merged_path, sizeof(merged_path), "/tmp/kinetrix_build_%d.kx",
-           getpid());
-  FILE *merged_file = fopen(merged_path, "w");
-  if (!merged_file) {
-    fprintf(stderr, "Error: Could not create temp build file\n");
-    return 1;
+  if (target_count == 1) {
+    printf("Output: %s\n", outputs[0]);
+    printf("Target: %s\n\n", target_name(targets[0]));
+  } else {
+    for (int t = 0; t < target_count; t++)
+      printf("Target: %-32s → %s\n", target_name(targets[t]), outputs[t]);
+    printf("\n");
   }
 
-  // Auto-include installed packages if they exist
-#ifdef _WIN32
-  WIN32_FIND_DATA fd;
-  HANDLE hFind = FindFirstFile("kinetrix_modules\\*.*", &fd);
-  if (hFind != INVALID_HANDLE_VALUE) {
-    do {
-      if (fd.cFileName[0] == '.')
-        continue;
-      char mod_path[512];
-      snprintf(mod_path, sizeof(mod_path), "kinetrix_modules\\%s\\index.kx",
-               fd.cFileName);
-      FILE *mod_file = fopen(mod_path, "r");
-      if (mod_file) {
-        char ch;
-        while ((ch = fgetc(mod_file)) != EOF)
-          fputc(ch, merged_file);
-        fputc('\n', merged_file);
-        fclose(mod_file);
-      }
-    } while (FindNextFile(hFind, &fd));
-    FindClose(hFind);
-  }
-#else
-  DIR *dir = opendir("kinetrix_modules");
-  if (dir) {
-    struct dirent *ent;
-    while ((ent = readdir(dir)) != NULL) {
-      if (ent->d_name[0] == '.')
-        continue;
-      char mod_path[512];
-      snprintf(mod_path, sizeof(mod_path), "kinetrix_modules/%s/index.kx",
-               ent->d_name);
-      FILE *mod_file = fopen(mod_path, "r");
-      if (mod_file) {
-        char ch;
-        while ((ch = fgetc(mod_file)) != EOF)
-          fputc(ch, merged_file);
-        fputc('\n', merged_file);
-        fclose(mod_file);
-      }
+  // A running server does the work if there is one; otherwise compile here
+  if (server_socket) {
+    int status;
+    if (compile_remotely(server_socket, input_file, target_spec, targets,
+                         target_count, &passes, outputs, &status)) {
+      if (status != 0)
+        return status;
+      printf("✓ Compilation successful!\n");
+      for (int t = 0; t < target_count; t++)
+        printf("Generated: %s\n", outputs[t]);
+      return 0;
     }
-    closedir(dir);
+    fprintf(stderr, "Note: No compile server on '%s', compiling locally\n",
+            server_socket);
   }
-#endif
 
-  // Append the main user file
-  FILE *main_file = fopen(input_file, "r");
-  if (!main_file) {
-    fprintf(stderr, "Error: Could not open '%s'\n", input_file);
-    fclose(merged_file);
-    remove(merged_path);
-    return 1;
-  }
-  char ch;
-  while ((ch = fgetc(main_file)) != EOF)
-    fputc(ch, merged_file);
-  fclose(main_file);
-  fclose(merged_file);
-
-  // Open merged source file for Lexer/Parser
-  FILE *source = fopen(merged_path, "r");
-  if (!source) {
-    fprintf(stderr, "Error: Could not read merged build file\n");
-    remove(merged_path);
+  PassTimes times;
+  pass_times_init(&times);
+  ModuleCache *cache = use_cache ? module_cache_create(KX_CACHE_DIR) : NULL;
+  CompileRequest request = {input_file, NULL, 0, NULL, targets, target_count,
+                            jobs, diagnostics, cache,
+                            time_passes ? &times : NULL, stdout, 0, emit_ir,
+                            &passes};
+  Compilation c;
+  CompileStatus status = compile_program(&request, &c);
+  if (status != COMPILE_OK) {
+    if (status == COMPILE_NO_INPUT) {
+      fprintf(stderr, "Error: Could not open '%s'\n", input_file);
+    } else {
+      OutBuf report;
+      outbuf_init(&report);
+      format_errors(&report, c.errors, input_file);
+      outbuf_flush(&report, stderr);
+      outbuf_free(&report);
+    }
+    compilation_free(&c);
+    module_cache_free(cache);
     return 1;
   }
 
-  // Parse and build AST
-  ErrorList *errors = error_list_create(10);
-  printf("Parsing...\n");
-  Parser *parser = parser_create(source, input_file, errors);
-  ASTNode *program = parser_parse(parser);
-  fclose(source);
-
-  if (errors->count > 0) {
-    fprintf(stderr, "\nCompilation failed with %d error(s):\n", errors->count);
-    Error *err = errors->head;
-    while (err) {
-      fprintf(stderr, "  Line %d, Col %d: %s\n", err->line, err->column,
-              err->message);
-      err = err->next;
-    }
-    parser_free(parser);
-    error_list_free(errors);
-    remove(merged_path);
+  double pass_start = pass_clock_ms();
+  size_t written = 0;
+  for (int t = 0; t < target_count; t++)
+    written += c.backends[t].gen->out.length;
+  OutBuf report;
+  outbuf_init(&report);
+  int ok = write_outputs(&c, target_count, outputs, &report);
+  outbuf_flush(&report, stderr);
+  outbuf_free(&report);
+  if (!ok) {
+    compilation_free(&c);
+    module_cache_free(cache);
     return 1;
   }
-  printf("✓ Parsing successful\n");
+  pass_times_add(&times, "write", pass_clock_ms() - pass_start, 0, written);
 
-  if (diagnostics) {
-    ast_track_pins(program);
-    if (program->data.program.pin_count > 0)
-      printf("Found %d GPIO pins\n", program->data.program.pin_count);
-  }
+  printf("✓ Code generation successful\n\n");
 
-  // Open output file
-  FILE *output = fopen(output_file, "w");
-  if (!output) {
-    fprintf(stderr, "Error: Could not open output '%s'\n", output_file);
-    parser_free(parser);
-    error_list_free(errors);
-    remove(merged_path);
-    return 1;
+  if (c.ir)
+    ir_print(c.ir, stdout);
+
+  if (stats) {
+    Arena *arena = c.parser->arena;
+    printf("AST memory:\n");
+    printf("  Nodes:        %zu\n", arena->node_count);
+    printf("  Allocations:  %zu\n", arena->alloc_count);
+    printf("  Bytes used:   %zu\n", arena->bytes_allocated);
+    printf("  Bytes held:   %zu in %zu chunk(s)\n\n", arena->bytes_reserved,
+           arena->chunk_count);
+    if (cache)
+      printf("Module cache: %d hit(s), %d miss(es), %d stored\n\n",
+             cache->hits, cache->misses, cache->stores);
   }
 
-  // Generate code for target
-  printf("Generating %s code...\n", target_name(target));
-  ast_track_pins(program);
-  CodeGen *gen = codegen_create_for_target(output, target);
-  codegen_generate(gen, program);
-  codegen_free(gen);
-  fclose(output);
+  if (pass_stats)
+    pass_stats_print(&c.pass_stats, stdout);
 
-  printf("✓ Code generation successful\n\n");
+  if (time_passes == 1)
+    pass_times_print(&times, stdout);
+  else if (time_passes == 2)
+    pass_times_print_json(&times, stderr);
 
-  ast_free(program);
-  parser_free(parser);
-  error_list_free(errors);
+  compilation_free(&c);
+  module_cache_free(cache);
 
   printf("✓ Compilation successful!\n");
-  printf("Generated: %s\n\n", output_file);
-
-  // Cleanup Temp File
-  remove(merged_path);
-
-  // Target-specific upload instructions
-  switch (target) {
-  case TARGET_ARDUINO:
-    printf("Next steps:\n");
-    printf("  Open %s in Arduino IDE → select board → Upload\n", output_file);
-    printf("  OR: arduino-cli compile --fqbn arduino:avr:uno .\n");
-    break;
-  case TARGET_ESP32:
-    printf("Next steps:\n");
-    printf("  Open %s in Arduino IDE with ESP32 board package\n", output_file);
-    printf("  Select: Tools → Board → ESP32 Dev Module → Upload\n");
-    break;
-  case TARGET_RPI:
-    printf("Next steps:\n");
-    printf("  pip install RPi.GPIO Adafruit-MCP3008\n");
-    printf("  python3 %s\n", output_file);
-    break;
-  case TARGET_PICO:
-    printf("Next steps:\n");
-    printf("  Install MicroPython on your Pico first\n");
-    printf("  Then: mpremote copy %s :main.py\n", output_file);
-    printf("  OR:   Open in Thonny IDE → Run\n");
-    break;
-  case TARGET_ROS2:
-    printf("Next steps:\n");
-    printf("  Place %s in your ROS2 package src/\n", output_file);
-    printf("  colcon build && ros2 run <pkg> kinetrix_node\n");
-    break;
+  if (target_count == 1) {
+    printf("Generated: %s\n\n", outputs[0]);
+    print_next_steps(targets[0], outputs[0]);
+  } else {
+    for (int t = 0; t < target_count; t++)
+      printf("Generated: %s\n", outputs[t]);
   }
   return 0;
 }
@@ -0,0 +1,445 @@
+/* Dead Code Elimination Implementation
+ *
+ * Names are matched by spelling, not by scope: a variable or function is
+ * used if anything reachable reads that name anywhere, which can keep dead
+ * code but never removes live code. Declarations are never dropped for
+ * being unreachable, since the C backends hoist them to globals that other
+ * functions may read.
+ */
+
+#include "dce.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// NAME TABLE
+// ============================================================================
+
+/* How each name is used by the reachable part of the program */
+typedef struct {
+  const char *name;
+  int reads;       /* Any use but declaring or assigning it */
+  int kept_writes; /* Declarations or assignments with side effects */
+} NameUse;
+
+typedef struct {
+  NameUse *slots;
+  size_t capacity; /* power of 2 */
+  size_t count;
+} NameTable;
+
+static size_t name_hash(const char *name) {
+  size_t hash = 2166136261u;
+  for (const unsigned char *p = (const unsigned char *)name; *p; p++)
+    hash = (hash ^ *p) * 16777619u;
+  return hash;
+}
+
+static NameUse *name_lookup(const NameTable *table, const char *name) {
+  if (table->count == 0 || !name)
+    return NULL;
+  size_t mask = table->capacity - 1;
+  for (size_t i = name_hash(name) & mask; table->slots[i].name;
+       i = (i + 1) & mask)
+    if (strcmp(table->slots[i].name, name) == 0)
+      return &table->slots[i];
+  return NULL;
+}
+
+static NameUse *name_insert(NameTable *table, const char *name) {
+  NameUse *use = name_lookup(table, name);
+  if (use)
+    return use;
+  if ((table->count + 1) * 2 > table->capacity) {
+    NameTable grown = {NULL, table->capacity ? table->capacity * 2 : 64, 0};
+    grown.slots = calloc(grown.capacity, sizeof(NameUse));
+    for (size_t i = 0; i < table->capacity; i++)
+      if (table->slots[i].name)
+        *name_insert(&grown, table->slots[i].name) = table->slots[i];
+    free(table->slots);
+    *table = grown;
+  }
+  size_t mask = table->capacity - 1;
+  size_t i = name_hash(name) & mask;
+  while (table->slots[i].name)
+    i = (i + 1) & mask;
+  table->slots[i].name = name;
+  table->count++;
+  return &table->slots[i];
+}
+
+static int is_read(const NameTable *table, const char *name) {
+  const NameUse *use = name_lookup(table, name);
+  return use && use->reads > 0;
+}
+
+// ============================================================================
+// STATEMENT KINDS
+// ============================================================================
+
+static int is_terminator(const ASTNode *node) {
+  return node->type == NODE_RETURN || node->type == NODE_BREAK ||
+         node->type == NODE_CONTINUE;
+}
+
+/* Statements that name something for code outside their block */
+static int is_declaration(const ASTNode *node) {
+  switch (node->type) {
+  case NODE_VAR_DECL:
+  case NODE_ARRAY_DECL:
+  case NODE_BUFFER_DECL:
+  case NODE_SHARED_DECL:
+  case NODE_STRUCT_DEF:
+  case NODE_STRUCT_INSTANCE:
+  case NODE_DEVICE_DEF:
+  case NODE_FUNCTION_DEF:
+  case NODE_TASK_DEF:
+  case NODE_INTERRUPT_PIN:
+  case NODE_INTERRUPT_TIMER:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/* 1 or 0 for a condition folding left constant, -1 otherwise */
+static int constant_truth(const ASTNode *condition) {
+  if (condition && condition->type == NODE_BOOL)
+    return condition->data.boolean.value != 0;
+  if (condition && condition->type == NODE_NUMBER)
+    return condition->data.number.value != 0;
+  return -1;
+}
+
+/* An expression that can be dropped without anything else changing */
+static int is_pure(const ASTNode *node) {
+  if (!node)
+    return 1;
+  switch (node->type) {
+  case NODE_NUMBER:
+  case NODE_STRING:
+  case NODE_BOOL:
+  case NODE_IDENTIFIER:
+  case NODE_BINARY_OP:
+  case NODE_UNARY_OP:
+  case NODE_CAST:
+  case NODE_ARRAY_ACCESS:
+  case NODE_ARRAY_LITERAL:
+  case NODE_STRUCT_ACCESS:
+  case NODE_MATH_FUNC:
+    break;
+  default:
+    return 0;
+  }
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    const char *base = (const char *)node + field->offset;
+    if (field->kind == AST_FIELD_NODE) {
+      if (!is_pure(*(ASTNode *const *)base))
+        return 0;
+    } else if (field->kind == AST_FIELD_NODE_LIST) {
+      int count = *(const int *)((const char *)node + field->count_offset);
+      for (int i = 0; i < count; i++)
+        if (!is_pure((*(ASTNode **const *)base)[i]))
+          return 0;
+    }
+  }
+  return 1;
+}
+
+static int is_local_function(const ASTNode *node) {
+  return node->type == NODE_FUNCTION_DEF && !node->data.function_def.is_extern;
+}
+
+// ============================================================================
+// UNREACHABLE STATEMENTS AND CONSTANT BRANCHES
+// ============================================================================
+
+typedef struct {
+  ASTNode **items;
+  int count;
+  int capacity;
+} StatementList;
+
+static void statement_push(StatementList *list, ASTNode *statement) {
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity ? list->capacity * 2 : 8;
+    list->items = realloc(list->items, list->capacity * sizeof(ASTNode *));
+  }
+  list->items[list->count++] = statement;
+}
+
+static int sweep(ASTNode *node);
+
+/* Append `statement` unless a terminator before it made it unreachable;
+ * returns 1 if it was dropped */
+static int keep_reachable(StatementList *kept, ASTNode *statement,
+                          int *unreachable) {
+  if (*unreachable && !is_declaration(statement))
+    return 1;
+  statement_push(kept, statement);
+  if (is_terminator(statement))
+    *unreachable = 1;
+  return 0;
+}
+
+/* An if whose condition is constant leaves only the branch that runs. Its
+ * statements move into the enclosing block unless they declare something,
+ * which keeps them in a scope of their own. */
+static int resolve_if(StatementList *kept, ASTNode *statement,
+                      int *unreachable) {
+  int truth = constant_truth(statement->data.if_stmt.condition);
+  ASTNode *live = truth ? statement->data.if_stmt.then_block
+                        : statement->data.if_stmt.else_block;
+  if (!live)
+    return 1;
+  int splice = live->type == NODE_BLOCK;
+  for (int i = 0; splice && i < live->data.block.statement_count; i++)
+    splice = !is_declaration(live->data.block.statements[i]);
+  if (!splice) {
+    if (truth && !statement->data.if_stmt.else_block)
+      return keep_reachable(kept, statement, unreachable);
+    statement->data.if_stmt.condition = ast_bool(1);
+    statement->data.if_stmt.then_block = live;
+    statement->data.if_stmt.else_block = NULL;
+    keep_reachable(kept, statement, unreachable);
+    return 1;
+  }
+  int removed = 1;
+  for (int i = 0; i < live->data.block.statement_count; i++)
+    removed += keep_reachable(kept, live->data.block.statements[i],
+                              unreachable);
+  return removed;
+}
+
+static int sweep_block(ASTNode *block) {
+  int removed = 0;
+  int changed = 0;
+  int unreachable = 0;
+  StatementList kept = {NULL, 0, 0};
+  for (int i = 0; i < block->data.block.statement_count; i++) {
+    ASTNode *statement = block->data.block.statements[i];
+    if (!statement)
+      continue;
+    removed += sweep(statement);
+    if (statement->type == NODE_IF &&
+        constant_truth(statement->data.if_stmt.condition) >= 0) {
+      removed += resolve_if(&kept, statement, &unreachable);
+      changed = 1;
+    } else if (statement->type == NODE_WHILE &&
+               constant_truth(statement->data.while_loop.condition) == 0) {
+      removed++;
+      changed = 1;
+    } else if (keep_reachable(&kept, statement, &unreachable)) {
+      removed++;
+      changed = 1;
+    }
+  }
+  if (changed) {
+    ASTNode **statements = ast_alloc(sizeof(ASTNode *) *
+                                     (kept.count ? kept.count : 1));
+    if (kept.count)
+      memcpy(statements, kept.items, sizeof(ASTNode *) * kept.count);
+    block->data.block.statements = statements;
+    block->data.block.statement_count = kept.count;
+  }
+  free(kept.items);
+  return removed;
+}
+
+/* Sweep every block under `node`; returns the statements removed */
+static int sweep(ASTNode *node) {
+  if (!node)
+    return 0;
+  if (node->type == NODE_BLOCK)
+    return sweep_block(node);
+  int removed = 0;
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    char *base = (char *)node + field->offset;
+    if (field->kind == AST_FIELD_NODE) {
+      removed += sweep(*(ASTNode **)base);
+    } else if (field->kind == AST_FIELD_NODE_LIST) {
+      int count = *(int *)((char *)node + field->count_offset);
+      for (int i = 0; i < count; i++)
+        removed += sweep((*(ASTNode ***)base)[i]);
+    }
+  }
+  return removed;
+}
+
+// ============================================================================
+// UNUSED FUNCTIONS AND VARIABLES
+// ============================================================================
+
+typedef struct {
+  ASTNode **items;
+  int count;
+  int capacity;
+} FunctionList;
+
+/* Count the names `node` uses, without entering local functions: those
+ * are counted once something reachable calls them */
+static void census(NameTable *table, FunctionList *functions, ASTNode *node) {
+  if (!node)
+    return;
+  switch (node->type) {
+  case NODE_FUNCTION_DEF:
+    if (!is_local_function(node))
+      break;
+    if (functions->count == functions->capacity) {
+      functions->capacity = functions->capacity ? functions->capacity * 2 : 8;
+      functions->items = realloc(functions->items,
+                                 functions->capacity * sizeof(ASTNode *));
+    }
+    functions->items[functions->count++] = node;
+    return;
+  case NODE_VAR_DECL: {
+    NameUse *use = name_insert(table, node->data.var_decl.name);
+    if (!is_pure(node->data.var_decl.initializer) ||
+        node->data.var_decl.is_shared)
+      use->kept_writes++;
+    census(table, functions, node->data.var_decl.initializer);
+    return;
+  }
+  case NODE_ASSIGNMENT: {
+    ASTNode *target = node->data.assignment.target;
+    if (!target || target->type != NODE_IDENTIFIER)
+      break;
+    NameUse *use = name_insert(table, target->data.identifier.name);
+    if (!is_pure(node->data.assignment.value))
+      use->kept_writes++;
+    census(table, functions, node->data.assignment.value);
+    return;
+  }
+  case NODE_STRING:
+    // A handler may be named in a string
+    if (node->data.string.value)
+      name_insert(table, node->data.string.value)->reads++;
+    return;
+  default:
+    break;
+  }
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    char *base = (char *)node + field->offset;
+    int count = field->count_offset
+                    ? *(int *)((char *)node + field->count_offset)
+                    : 0;
+    switch (field->kind) {
+    case AST_FIELD_NAME:
+      if (*(char **)base)
+        name_insert(table, *(char **)base)->reads++;
+      break;
+    case AST_FIELD_NAME_LIST:
+      for (int i = 0; i < count; i++)
+        if ((*(char ***)base)[i])
+          name_insert(table, (*(char ***)base)[i])->reads++;
+      break;
+    case AST_FIELD_NODE:
+      census(table, functions, *(ASTNode **)base);
+      break;
+    case AST_FIELD_NODE_LIST:
+      for (int i = 0; i < count; i++)
+        census(table, functions, (*(ASTNode ***)base)[i]);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+/* Count everything reachable from the program body: each local function
+ * another reachable one calls is counted in turn, so functions only dead
+ * code calls stay unread */
+static void census_reachable(NameTable *table, ASTNode *program) {
+  FunctionList functions = {NULL, 0, 0};
+  census(table, &functions, program);
+  for (int changed = 1; changed;) {
+    changed = 0;
+    for (int i = 0; i < functions.count; i++) {
+      ASTNode *function = functions.items[i];
+      if (!function || !is_read(table, function->data.function_def.name))
+        continue;
+      functions.items[i] = NULL;
+      changed = 1;
+      for (int p = 0; p < function->data.function_def.param_count; p++)
+        name_insert(table, function->data.function_def.param_names[p])
+            ->reads++;
+      // Nested functions found here join the end of the list
+      census(table, &functions, function->data.function_def.body);
+    }
+  }
+  free(functions.items);
+}
+
+static int is_dead_write(const NameTable *table, const char *name) {
+  const NameUse *use = name_lookup(table, name);
+  return use && use->reads == 0 && use->kept_writes == 0;
+}
+
+static int is_dead(const NameTable *table, const ASTNode *statement) {
+  switch (statement->type) {
+  case NODE_FUNCTION_DEF:
+    return is_local_function(statement) &&
+           !is_read(table, statement->data.function_def.name);
+  case NODE_VAR_DECL:
+    return is_dead_write(table, statement->data.var_decl.name);
+  case NODE_ASSIGNMENT: {
+    const ASTNode *target = statement->data.assignment.target;
+    return target && target->type == NODE_IDENTIFIER &&
+           is_dead_write(table, target->data.identifier.name);
+  }
+  default:
+    return 0;
+  }
+}
+
+/* Drop dead functions, declarations and assignments from every block
+ * under `node`; returns how many */
+static int prune(const NameTable *table, ASTNode *node) {
+  if (!node)
+    return 0;
+  int removed = 0;
+  if (node->type == NODE_BLOCK) {
+    int kept = 0;
+    for (int i = 0; i < node->data.block.statement_count; i++) {
+      ASTNode *statement = node->data.block.statements[i];
+      if (statement && is_dead(table, statement)) {
+        removed++;
+        continue;
+      }
+      node->data.block.statements[kept++] = statement;
+    }
+    node->data.block.statement_count = kept;
+  }
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    char *base = (char *)node + field->offset;
+    if (field->kind == AST_FIELD_NODE) {
+      removed += prune(table, *(ASTNode **)base);
+    } else if (field->kind == AST_FIELD_NODE_LIST) {
+      int count = *(int *)((char *)node + field->count_offset);
+      for (int i = 0; i < count; i++)
+        removed += prune(table, (*(ASTNode ***)base)[i]);
+    }
+  }
+  return removed;
+}
+
+int ast_eliminate_dead_code(ASTNode *program) {
+  int removed = sweep(program);
+  // Dropping `y = x` can leave x unread in turn, so repeat until stable
+  for (int pruned = 1; pruned > 0;) {
+    NameTable table = {NULL, 0, 0};
+    census_reachable(&table, program);
+    pruned = prune(&table, program);
+    removed += pruned;
+    free(table.slots);
+  }
+  return removed;
+}
@@ -0,0 +1,22 @@
+/* Dead Code Elimination
+ * Middle-end pass run after constant folding. Removes what no run of the
+ * program can reach or observe: statements after a return, break or
+ * continue, the branch of an if (or a whole while) whose condition folded
+ * to a constant, `def`s nothing calls, and variables nothing reads along
+ * with the assignments to them. Every backend then emits less code and
+ * fewer globals, which matters on boards with 32 KB of flash and 2 KB of
+ * SRAM, and the runtime features only dead code used are no longer
+ * linked in.
+ */
+
+#ifndef KINETRIX_DCE_H
+#define KINETRIX_DCE_H
+
+#include "ast.h"
+
+/* Remove dead code from `program` in place; returns how many statements
+ * and functions were removed. Needs the program's AST arena installed
+ * (see ast_set_arena). */
+int ast_eliminate_dead_code(ASTNode *program);
+
+#endif
@@ -17,6 +17,11 @@ ErrorList *error_list_create(int max_errors) {
   list->tail = NULL;
   list->count = 0;
   list->max_errors = max_errors;
+  list->file = NULL;
+  list->warnings = NULL;
+  list->warnings_length = 0;
+  list->warnings_capacity = 0;
+  list->quiet = 0;
   return list;
 }
 
@@ -27,14 +32,21 @@ void error_list_free(ErrorList *list) {
   Error *err = list->head;
   while (err != NULL) {
     Error *next = err->next;
+    free(err->file);
     free(err->message);
     free(err);
     err = next;
   }
 
+  free(list->warnings);
   free(list);
 }
 
+void error_list_set_file(ErrorList *list, const char *file) {
+  if (list != NULL)
+    list->file = file;
+}
+
 void error_report(ErrorList *list, ErrorType type, int line, int column,
                   const char *format, ...) {
   if (list == NULL)
@@ -64,6 +76,8 @@ void error_report(ErrorList *list, ErrorType type, int line, int column,
     free(err);
     return;
   }
+  // The list's file may be a caller's buffer, so keep a copy
+  err->file = list->file ? strdup(list->file) : NULL;
 
   // Add to list
   if (list->tail == NULL) {
@@ -85,6 +99,8 @@ void error_print_all(ErrorList *list, FILE *output) {
 
   Error *err = list->head;
   while (err != NULL) {
+    if (err->file)
+      fprintf(output, "%s: ", err->file);
     fprintf(output, "%s at line %d, column %d: %s\n", type_names[err->type],
             err->line, err->column, err->message);
     err = err->next;
@@ -98,3 +114,44 @@ void error_print_all(ErrorList *list, FILE *output) {
 int error_has_errors(ErrorList *list) {
   return list != NULL && list->count > 0;
 }
+
+// ============================================================================
+// WARNINGS
+// ============================================================================
+
+void error_emit_warnings(ErrorList *list, const char *text) {
+  if (text == NULL || *text == '\0')
+    return;
+  if (list == NULL || !list->quiet)
+    fputs(text, stderr);
+  if (list == NULL)
+    return;
+  size_t length = strlen(text);
+  if (list->warnings_length + length + 1 > list->warnings_capacity) {
+    size_t capacity = list->warnings_capacity ? list->warnings_capacity : 256;
+    while (list->warnings_length + length + 1 > capacity)
+      capacity *= 2;
+    char *grown = realloc(list->warnings, capacity);
+    if (!grown)
+      return;
+    list->warnings = grown;
+    list->warnings_capacity = capacity;
+  }
+  memcpy(list->warnings + list->warnings_length, text, length + 1);
+  list->warnings_length += length;
+}
+
+void error_warning(ErrorList *list, const char *format, ...) {
+  char buffer[1024];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(buffer, sizeof(buffer) - 1, format, args);
+  va_end(args);
+  if (n < 0)
+    return;
+  if ((size_t)n > sizeof(buffer) - 2)
+    n = sizeof(buffer) - 2;
+  buffer[n] = '\n';
+  buffer[n + 1] = '\0';
+  error_emit_warnings(list, buffer);
+}
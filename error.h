@@ -24,6 +24,7 @@ typedef struct Error {
     ErrorType type;
     int line;
     int column;
+    char *file;      // Source file the error was reported in, or NULL
     char *message;
     struct Error *next;
 } Error;
@@ -33,6 +34,11 @@ typedef struct ErrorList {
     Error *tail;
     int count;
     int max_errors;  // Stop after this many errors
+    const char *file;  // File being read; stamped on new errors
+    char *warnings;    // Every warning printed so far, one per line
+    size_t warnings_length;
+    size_t warnings_capacity;
+    int quiet;         // Only log warnings; the caller prints them later
 } ErrorList;
 
 // ============================================================================
@@ -41,11 +47,18 @@ typedef struct ErrorList {
 
 ErrorList* error_list_create(int max_errors);
 void error_list_free(ErrorList *list);
+void error_list_set_file(ErrorList *list, const char *file);
 
 void error_report(ErrorList *list, ErrorType type, int line, int column, const char *format, ...);
 void error_print_all(ErrorList *list, FILE *output);
 int error_has_errors(ErrorList *list);
 
+// Warnings do not fail the build: they are printed to stderr at once (unless
+// the list is quiet) and logged, so whatever printed them can be replayed
+// from the module cache.
+void error_warning(ErrorList *list, const char *format, ...);
+void error_emit_warnings(ErrorList *list, const char *text);
+
 // Convenience macros
 #define LEXICAL_ERROR(list, line, col, ...) \
     error_report(list, ERROR_LEXICAL, line, col, __VA_ARGS__)
@@ -0,0 +1,162 @@
+/* Feature Usage Implementation */
+
+#include "feature_usage.h"
+#include "value_range.h"
+
+/* The feature each node type needs; FEATURE_NONE for core language */
+static const unsigned char node_features[NODE_PROGRAM + 1] = {
+    [NODE_I2C_BEGIN] = FEATURE_I2C,
+    [NODE_I2C_START] = FEATURE_I2C,
+    [NODE_I2C_SEND] = FEATURE_I2C,
+    [NODE_I2C_STOP] = FEATURE_I2C,
+    [NODE_I2C_READ] = FEATURE_I2C,
+    [NODE_I2C_OPEN] = FEATURE_I2C,
+    [NODE_I2C_DEVICE_READ] = FEATURE_I2C,
+    [NODE_I2C_DEVICE_READ_ARRAY] = FEATURE_I2C,
+    [NODE_I2C_DEVICE_WRITE] = FEATURE_I2C,
+    [NODE_SPI_OPEN] = FEATURE_SPI,
+    [NODE_SPI_TRANSFER] = FEATURE_SPI,
+    [NODE_DEVICE_DEF] = FEATURE_DEVICE,
+    [NODE_DEVICE_READ] = FEATURE_DEVICE,
+    [NODE_DEVICE_READ_REG] = FEATURE_DEVICE,
+    [NODE_DEVICE_WRITE] = FEATURE_DEVICE,
+    [NODE_WATCHDOG_ENABLE] = FEATURE_WATCHDOG,
+    [NODE_WATCHDOG_FEED] = FEATURE_WATCHDOG,
+    [NODE_SERVO_ATTACH] = FEATURE_SERVO,
+    [NODE_SERVO_MOVE] = FEATURE_SERVO,
+    [NODE_SERVO_DETACH] = FEATURE_SERVO,
+    [NODE_DHT_ATTACH] = FEATURE_DHT,
+    [NODE_DHT_READ_TEMP] = FEATURE_DHT,
+    [NODE_DHT_READ_HUMID] = FEATURE_DHT,
+    [NODE_NEOPIXEL_INIT] = FEATURE_NEOPIXEL,
+    [NODE_NEOPIXEL_SET] = FEATURE_NEOPIXEL,
+    [NODE_NEOPIXEL_SHOW] = FEATURE_NEOPIXEL,
+    [NODE_NEOPIXEL_CLEAR] = FEATURE_NEOPIXEL,
+    [NODE_LCD_INIT] = FEATURE_LCD,
+    [NODE_LCD_PRINT] = FEATURE_LCD,
+    [NODE_LCD_CLEAR] = FEATURE_LCD,
+    [NODE_STEPPER_ATTACH] = FEATURE_STEPPER,
+    [NODE_STEPPER_SPEED] = FEATURE_STEPPER,
+    [NODE_STEPPER_MOVE] = FEATURE_STEPPER,
+    [NODE_MOTOR_ATTACH] = FEATURE_MOTOR,
+    [NODE_MOTOR_MOVE] = FEATURE_MOTOR,
+    [NODE_MOTOR_STOP] = FEATURE_MOTOR,
+    [NODE_ENCODER_ATTACH] = FEATURE_ENCODER,
+    [NODE_ENCODER_READ] = FEATURE_ENCODER,
+    [NODE_ENCODER_RESET] = FEATURE_ENCODER,
+    [NODE_ESC_ATTACH] = FEATURE_ESC,
+    [NODE_ESC_THROTTLE] = FEATURE_ESC,
+    [NODE_PID_ATTACH] = FEATURE_PID,
+    [NODE_PID_TARGET] = FEATURE_PID,
+    [NODE_PID_COMPUTE] = FEATURE_PID,
+    [NODE_IMU_ATTACH] = FEATURE_IMU,
+    [NODE_IMU_READ_X] = FEATURE_IMU,
+    [NODE_IMU_READ_Y] = FEATURE_IMU,
+    [NODE_IMU_READ_Z] = FEATURE_IMU,
+    [NODE_IMU_ORIENT] = FEATURE_IMU,
+    [NODE_GPS_ATTACH] = FEATURE_GPS,
+    [NODE_GPS_READ_LAT] = FEATURE_GPS,
+    [NODE_GPS_READ_LON] = FEATURE_GPS,
+    [NODE_GPS_READ_ALT] = FEATURE_GPS,
+    [NODE_GPS_READ_SPD] = FEATURE_GPS,
+    [NODE_LIDAR_ATTACH] = FEATURE_LIDAR,
+    [NODE_LIDAR_READ] = FEATURE_LIDAR,
+    [NODE_SD_MOUNT] = FEATURE_SD,
+    [NODE_FILE_OPEN] = FEATURE_SD,
+    [NODE_FILE_WRITE] = FEATURE_SD,
+    [NODE_FILE_READ] = FEATURE_SD,
+    [NODE_FILE_CLOSE] = FEATURE_SD,
+    [NODE_OLED_ATTACH] = FEATURE_OLED,
+    [NODE_OLED_PRINT] = FEATURE_OLED,
+    [NODE_OLED_DRAW] = FEATURE_OLED,
+    [NODE_OLED_SHOW] = FEATURE_OLED,
+    [NODE_OLED_CLEAR] = FEATURE_OLED,
+    [NODE_AUDIO_ATTACH] = FEATURE_AUDIO,
+    [NODE_PLAY_FREQ] = FEATURE_AUDIO,
+    [NODE_PLAY_SOUND] = FEATURE_AUDIO,
+    [NODE_SET_VOLUME] = FEATURE_AUDIO,
+    [NODE_CAM_ATTACH] = FEATURE_CAMERA,
+    [NODE_CAM_DETECT] = FEATURE_CAMERA,
+    [NODE_CAM_OBJ_X] = FEATURE_CAMERA,
+    [NODE_CAM_OBJ_Y] = FEATURE_CAMERA,
+    [NODE_MECANUM_ATTACH] = FEATURE_MECANUM,
+    [NODE_MECANUM_MOVE] = FEATURE_MECANUM,
+    [NODE_MECANUM_STOP] = FEATURE_MECANUM,
+    [NODE_KALMAN_ATTACH] = FEATURE_KALMAN,
+    [NODE_KALMAN_COMPUTE] = FEATURE_KALMAN,
+    [NODE_AI_LOAD] = FEATURE_AI,
+    [NODE_AI_COMPUTE] = FEATURE_AI,
+    [NODE_ARM_ATTACH] = FEATURE_ARM,
+    [NODE_ARM_MOVE] = FEATURE_ARM,
+    [NODE_GRID_CREATE] = FEATURE_PATH,
+    [NODE_GRID_OBSTACLE] = FEATURE_PATH,
+    [NODE_PATH_COMPUTE] = FEATURE_PATH,
+    [NODE_DRONE_ATTACH] = FEATURE_DRONE,
+    [NODE_DRONE_SET] = FEATURE_DRONE,
+    [NODE_ANALOG_WRITE] = FEATURE_PWM,
+    [NODE_RADIO_SEND] = FEATURE_RADIO,
+    [NODE_RADIO_AVAILABLE] = FEATURE_RADIO,
+    [NODE_RADIO_READ] = FEATURE_RADIO,
+    [NODE_WIFI_CONNECT] = FEATURE_WIFI,
+    [NODE_WIFI_IP] = FEATURE_WIFI,
+    [NODE_BLE_ENABLE] = FEATURE_BLE,
+    [NODE_BLE_ADVERTISE] = FEATURE_BLE,
+    [NODE_BLE_SEND] = FEATURE_BLE,
+    [NODE_BLE_RECEIVE] = FEATURE_BLE,
+    [NODE_MQTT_CONNECT] = FEATURE_MQTT,
+    [NODE_MQTT_SUBSCRIBE] = FEATURE_MQTT,
+    [NODE_MQTT_PUBLISH] = FEATURE_MQTT,
+    [NODE_MQTT_READ] = FEATURE_MQTT,
+    [NODE_HTTP_GET] = FEATURE_HTTP,
+    [NODE_HTTP_POST] = FEATURE_HTTP,
+    [NODE_WS_CONNECT] = FEATURE_WEBSOCKET,
+    [NODE_WS_SEND] = FEATURE_WEBSOCKET,
+    [NODE_WS_RECEIVE] = FEATURE_WEBSOCKET,
+    [NODE_WS_CLOSE] = FEATURE_WEBSOCKET,
+    [NODE_OTA_ENABLE] = FEATURE_OTA,
+};
+
+static unsigned long long scan_features(const ASTNode *node) {
+  if (!node)
+    return 0;
+  unsigned long long features = 1ull << node_features[node->type];
+  // The backends guard such a division through a helper (see value_range.h)
+  if (node->type == NODE_BINARY_OP && node->data.binary_op.op == OP_DIV &&
+      !ast_expr_is_pure(node->data.binary_op.right))
+    features |= 1ull << FEATURE_DIV;
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    const char *base = (const char *)node + field->offset;
+    if (field->kind == AST_FIELD_NODE) {
+      features |= scan_features(*(ASTNode *const *)base);
+    } else if (field->kind == AST_FIELD_NODE_LIST) {
+      int count = *(const int *)((const char *)node + field->count_offset);
+      for (int i = 0; i < count; i++)
+        features |= scan_features((*(ASTNode **const *)base)[i]);
+    }
+  }
+  return features;
+}
+
+int ast_track_features(ASTNode *program) {
+  if (!program || program->type != NODE_PROGRAM)
+    return 0;
+  program->data.program.features =
+      scan_features(program) & ~(1ull << FEATURE_NONE);
+  int used = 0;
+  for (int f = FEATURE_NONE + 1; f < FEATURE_COUNT; f++)
+    used += ast_uses_feature(program, (Feature)f);
+  return used;
+}
+
+void ast_use_all_features(ASTNode *program) {
+  if (!program || program->type != NODE_PROGRAM)
+    return;
+  program->data.program.features =
+      ((1ull << FEATURE_COUNT) - 1) & ~(1ull << FEATURE_NONE);
+}
+
+int ast_uses_feature(const ASTNode *program, Feature feature) {
+  return (program->data.program.features >> feature) & 1;
+}
@@ -0,0 +1,63 @@
+/* Feature Usage
+ * Records which runtime features (library wrappers, helpers, buses) a
+ * program uses anywhere in its tree, so a backend emits only the headers,
+ * globals, helpers and setup code of those instead of all of them. On an
+ * Uno the unused globals alone would take most of its 2 KB of SRAM.
+ */
+
+#ifndef KINETRIX_FEATURE_USAGE_H
+#define KINETRIX_FEATURE_USAGE_H
+
+#include "ast.h"
+
+typedef enum {
+  FEATURE_NONE,
+  FEATURE_I2C,      /* Wire: raw i2c, i2c devices */
+  FEATURE_SPI,      /* SPI bus */
+  FEATURE_DEVICE,   /* Named devices, over any bus */
+  FEATURE_WATCHDOG,
+  FEATURE_SERVO,
+  FEATURE_DHT,
+  FEATURE_NEOPIXEL,
+  FEATURE_LCD,
+  FEATURE_STEPPER,
+  FEATURE_MOTOR,
+  FEATURE_ENCODER,
+  FEATURE_ESC,
+  FEATURE_PID,
+  FEATURE_IMU,
+  FEATURE_GPS,
+  FEATURE_LIDAR,
+  FEATURE_SD,       /* SD card and files */
+  FEATURE_OLED,
+  FEATURE_AUDIO,
+  FEATURE_CAMERA,   /* HuskyLens */
+  FEATURE_MECANUM,
+  FEATURE_KALMAN,
+  FEATURE_AI,
+  FEATURE_ARM,
+  FEATURE_PATH,     /* Grid and path search */
+  FEATURE_DRONE,
+  FEATURE_PWM,      /* analogWrite; LEDC channels on the ESP32 */
+  FEATURE_RADIO,    /* ESP-NOW peer radio */
+  FEATURE_WIFI,
+  FEATURE_BLE,
+  FEATURE_MQTT,
+  FEATURE_HTTP,
+  FEATURE_WEBSOCKET,
+  FEATURE_OTA,      /* Over-the-air updates */
+  FEATURE_DIV,      /* _kx_div: a division by an impure divisor */
+  FEATURE_COUNT
+} Feature;
+
+/* Set program.features from every node of `program`; returns how many
+ * features are used */
+int ast_track_features(ASTNode *program);
+
+/* Mark every feature as used, so a backend emits its full runtime */
+void ast_use_all_features(ASTNode *program);
+
+/* 1 if `program` uses `feature`; needs ast_track_features() first */
+int ast_uses_feature(const ASTNode *program, Feature feature);
+
+#endif
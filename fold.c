@@ -0,0 +1,370 @@
+/* Constant Folding Implementation
+ *
+ * Folding must give the value every backend would have computed at run
+ * time, and the backends disagree on some operations: C divides integers
+ * and Python does not, C's % truncates and Python's floors. Such cases are
+ * only folded where both agree (exact integer division, % on non-negative
+ * integers). A folded number is typed float when C would have computed it
+ * in floating point, so the C backends keep that type in the literal.
+ */
+
+#include "fold.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INT32_LIMIT 2147483647.0
+
+// ============================================================================
+// NAME TABLE
+// ============================================================================
+
+/* How often each name is declared or assigned, and the value of the
+ * `const` declarations that can be substituted */
+typedef struct {
+  const char *name;
+  int writes;
+  ASTNode *value; /* NODE_NUMBER or NODE_BOOL, or NULL */
+} NameInfo;
+
+typedef struct {
+  NameInfo *slots;
+  size_t capacity; /* power of 2 */
+  size_t count;
+} NameTable;
+
+static size_t name_hash(const char *name) {
+  size_t hash = 2166136261u;
+  for (const unsigned char *p = (const unsigned char *)name; *p; p++)
+    hash = (hash ^ *p) * 16777619u;
+  return hash;
+}
+
+static NameInfo *name_lookup(NameTable *table, const char *name) {
+  if (table->count == 0)
+    return NULL;
+  size_t mask = table->capacity - 1;
+  for (size_t i = name_hash(name) & mask; table->slots[i].name;
+       i = (i + 1) & mask)
+    if (strcmp(table->slots[i].name, name) == 0)
+      return &table->slots[i];
+  return NULL;
+}
+
+static NameInfo *name_insert(NameTable *table, const char *name) {
+  NameInfo *info = name_lookup(table, name);
+  if (info)
+    return info;
+  if ((table->count + 1) * 2 > table->capacity) {
+    NameTable grown = {NULL, table->capacity ? table->capacity * 2 : 64, 0};
+    grown.slots = calloc(grown.capacity, sizeof(NameInfo));
+    for (size_t i = 0; i < table->capacity; i++)
+      if (table->slots[i].name)
+        *name_insert(&grown, table->slots[i].name) = table->slots[i];
+    free(table->slots);
+    *table = grown;
+  }
+  size_t mask = table->capacity - 1;
+  size_t i = name_hash(name) & mask;
+  while (table->slots[i].name)
+    i = (i + 1) & mask;
+  table->slots[i].name = name;
+  table->count++;
+  return &table->slots[i];
+}
+
+/* Count every name a node declares or writes. Names held by anything but
+ * an identifier read count, which errs on the side of not substituting. */
+static void census(NameTable *table, ASTNode *node) {
+  if (!node)
+    return;
+  if (node->type == NODE_ASSIGNMENT && node->data.assignment.target &&
+      node->data.assignment.target->type == NODE_IDENTIFIER)
+    name_insert(table, node->data.assignment.target->data.identifier.name)
+        ->writes++;
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    char *base = (char *)node + field->offset;
+    int count = field->count_offset
+                    ? *(int *)((char *)node + field->count_offset)
+                    : 0;
+    switch (field->kind) {
+    case AST_FIELD_NAME:
+      if (node->type != NODE_IDENTIFIER && *(char **)base)
+        name_insert(table, *(char **)base)->writes++;
+      break;
+    case AST_FIELD_NAME_LIST:
+      for (int i = 0; i < count; i++)
+        if ((*(char ***)base)[i])
+          name_insert(table, (*(char ***)base)[i])->writes++;
+      break;
+    case AST_FIELD_NODE:
+      census(table, *(ASTNode **)base);
+      break;
+    case AST_FIELD_NODE_LIST:
+      for (int i = 0; i < count; i++)
+        census(table, (*(ASTNode ***)base)[i]);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+// ============================================================================
+// FOLDING
+// ============================================================================
+
+static int is_float(const ASTNode *node) {
+  return node->value_type && node->value_type->kind == TYPE_FLOAT;
+}
+
+static int is_whole(double value) { return value == floor(value); }
+
+/* Turn `node` into a number in place; its old children stay in the arena */
+static void make_number(ASTNode *node, double value, int floating) {
+  node->type = NODE_NUMBER;
+  memset(&node->data, 0, sizeof(node->data));
+  node->data.number.value = value;
+  node->value_type = floating || !is_whole(value) ? type_float() : type_int();
+}
+
+static void make_bool(ASTNode *node, int value) {
+  node->type = NODE_BOOL;
+  memset(&node->data, 0, sizeof(node->data));
+  node->data.boolean.value = value != 0;
+  node->value_type = type_bool();
+}
+
+/* Returns 1 if the operation was folded */
+static int fold_binary(ASTNode *node) {
+  ASTNode *left = node->data.binary_op.left;
+  ASTNode *right = node->data.binary_op.right;
+  if (!left || !right)
+    return 0;
+  Operator op = node->data.binary_op.op;
+  if (left->type == NODE_BOOL && right->type == NODE_BOOL &&
+      (op == OP_AND || op == OP_OR)) {
+    int l = left->data.boolean.value;
+    int r = right->data.boolean.value;
+    make_bool(node, op == OP_AND ? l && r : l || r);
+    return 1;
+  }
+  if (left->type != NODE_NUMBER || right->type != NODE_NUMBER)
+    return 0;
+
+  double l = left->data.number.value;
+  double r = right->data.number.value;
+  int floating = is_float(left) || is_float(right);
+  double value;
+  switch (op) {
+  case OP_ADD:
+    value = l + r;
+    break;
+  case OP_SUB:
+    value = l - r;
+    break;
+  case OP_MUL:
+    value = l * r;
+    break;
+  case OP_DIV:
+    // Every backend guards division: x / 0 is 0
+    if (r == 0) {
+      make_number(node, 0, 0);
+      return 1;
+    }
+    value = l / r;
+    if (!floating && !is_whole(value))
+      return 0; // C truncates, Python does not
+    break;
+  case OP_MOD:
+    if (floating || l < 0 || r <= 0)
+      return 0;
+    value = fmod(l, r);
+    break;
+  case OP_EQ:
+    make_bool(node, l == r);
+    return 1;
+  case OP_NEQ:
+    make_bool(node, l != r);
+    return 1;
+  case OP_LT:
+    make_bool(node, l < r);
+    return 1;
+  case OP_GT:
+    make_bool(node, l > r);
+    return 1;
+  case OP_LTE:
+    make_bool(node, l <= r);
+    return 1;
+  case OP_GTE:
+    make_bool(node, l >= r);
+    return 1;
+  default:
+    return 0;
+  }
+  if (!isfinite(value) || (!floating && fabs(value) > INT32_LIMIT))
+    return 0;
+  make_number(node, value, floating);
+  return 1;
+}
+
+static int fold_unary(ASTNode *node) {
+  ASTNode *operand = node->data.unary_op.operand;
+  if (!operand)
+    return 0;
+  if (node->data.unary_op.op == OP_NOT && operand->type == NODE_BOOL) {
+    make_bool(node, !operand->data.boolean.value);
+    return 1;
+  }
+  if (node->data.unary_op.op == OP_NEG && operand->type == NODE_NUMBER) {
+    make_number(node, -operand->data.number.value, is_float(operand));
+    return 1;
+  }
+  return 0;
+}
+
+static int fold_cast(ASTNode *node) {
+  ASTNode *operand = node->data.cast_op.operand;
+  Type *target = node->data.cast_op.target_type;
+  if (!operand || operand->type != NODE_NUMBER || !target)
+    return 0;
+  double value = operand->data.number.value;
+  if (target->kind == TYPE_INT && fabs(value) <= INT32_LIMIT) {
+    make_number(node, trunc(value), 0);
+    return 1;
+  }
+  if (target->kind == TYPE_FLOAT) {
+    make_number(node, value, 1);
+    return 1;
+  }
+  return 0; // byte and bool conversions differ between targets
+}
+
+static int fold_math(ASTNode *node) {
+  ASTNode *arg1 = node->data.math_func.arg1;
+  ASTNode *arg2 = node->data.math_func.arg2;
+  if (!arg1 || arg1->type != NODE_NUMBER)
+    return 0;
+  double x = arg1->data.number.value;
+  double value;
+  switch (node->data.math_func.func) {
+  case MATH_SIN:
+    value = sin(x);
+    break;
+  case MATH_COS:
+    value = cos(x);
+    break;
+  case MATH_TAN:
+    value = tan(x);
+    break;
+  case MATH_SQRT:
+    value = sqrt(x);
+    break;
+  case MATH_ASIN:
+    value = asin(x);
+    break;
+  case MATH_ACOS:
+    value = acos(x);
+    break;
+  case MATH_ATAN:
+    value = atan(x);
+    break;
+  case MATH_ATAN2:
+    if (!arg2 || arg2->type != NODE_NUMBER)
+      return 0;
+    value = atan2(x, arg2->data.number.value);
+    break;
+  default:
+    return 0;
+  }
+  if (!isfinite(value))
+    return 0;
+  make_number(node, value, 1);
+  return 1;
+}
+
+/* Fold the children of `node`, then `node` itself; returns the number of
+ * nodes replaced */
+static int fold(NameTable *table, ASTNode *node) {
+  if (!node)
+    return 0;
+  int folded = 0;
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    char *base = (char *)node + field->offset;
+    if (field->kind == AST_FIELD_NODE) {
+      folded += fold(table, *(ASTNode **)base);
+    } else if (field->kind == AST_FIELD_NODE_LIST) {
+      int count = *(int *)((char *)node + field->count_offset);
+      for (int i = 0; i < count; i++)
+        folded += fold(table, (*(ASTNode ***)base)[i]);
+    }
+  }
+
+  switch (node->type) {
+  case NODE_IDENTIFIER: {
+    NameInfo *info = name_lookup(table, node->data.identifier.name);
+    if (!info || !info->value)
+      return folded;
+    ASTNode *value = info->value;
+    if (value->type == NODE_BOOL)
+      make_bool(node, value->data.boolean.value);
+    else
+      make_number(node, value->data.number.value, is_float(value));
+    return folded + 1;
+  }
+  case NODE_BINARY_OP:
+    return folded + fold_binary(node);
+  case NODE_UNARY_OP:
+    return folded + fold_unary(node);
+  case NODE_CAST:
+    return folded + fold_cast(node);
+  case NODE_MATH_FUNC:
+    return folded + fold_math(node);
+  case NODE_GPIO_WRITE:
+  case NODE_ANALOG_WRITE:
+  case NODE_SERVO_WRITE:
+  case NODE_TONE:
+  case NODE_NOTONE:
+  case NODE_GPIO_READ:
+  case NODE_ANALOG_READ:
+  case NODE_PULSE_READ: {
+    // A pin is a whole number whatever the const it came from was declared
+    ASTNode *pin = node->data.gpio.pin;
+    if (pin && pin->type == NODE_NUMBER && is_whole(pin->data.number.value))
+      pin->value_type = type_int();
+    return folded;
+  }
+  case NODE_VAR_DECL: {
+    ASTNode *init = node->data.var_decl.initializer;
+    if (!node->data.var_decl.is_const || !init ||
+        (init->type != NODE_NUMBER && init->type != NODE_BOOL))
+      return folded;
+    // Only a const nothing else declares or writes can be substituted
+    NameInfo *info = name_lookup(table, node->data.var_decl.name);
+    if (info && info->writes == 1 && !info->value) {
+      info->value = init;
+      /* The C backends declare an untyped const as float */
+      if (init->type == NODE_NUMBER && !node->data.var_decl.declared_type)
+        init->value_type = type_float();
+    }
+    return folded;
+  }
+  default:
+    return folded;
+  }
+}
+
+int ast_fold_constants(ASTNode *program) {
+  NameTable table = {NULL, 0, 0};
+  census(&table, program);
+  int folded = fold(&table, program);
+  // A const read before its declaration is substituted on a second walk
+  if (folded > 0)
+    folded += fold(&table, program);
+  free(table.slots);
+  return folded;
+}
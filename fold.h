@@ -0,0 +1,19 @@
+/* Constant Folding
+ * Middle-end pass run between parsing and code generation. Arithmetic,
+ * comparisons, casts and math functions whose operands are known are
+ * replaced by their value, and `const` declarations with a known value are
+ * substituted where they are read, so every backend emits literals instead
+ * of runtime (often soft-float) math and the pin tracker sees more
+ * constant pins.
+ */
+
+#ifndef KINETRIX_FOLD_H
+#define KINETRIX_FOLD_H
+
+#include "ast.h"
+
+/* Fold `program` in place; returns how many nodes were replaced. Needs the
+ * program's AST arena installed (see ast_set_arena). */
+int ast_fold_constants(ASTNode *program);
+
+#endif
@@ -0,0 +1,168 @@
+/* Kinetrix String Interning Implementation */
+
+#include "intern.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_INITIAL_CAPACITY 256
+#define POOL_CHUNK_SIZE (16 * 1024)
+
+// ============================================================================
+// BUILTIN ATOMS
+// ============================================================================
+
+/* One static block so ownership is a single range check */
+static const char builtin_text[] = "map\0"
+                                   "constrain\0"
+                                   "abs\0"
+                                   "random\0"
+                                   "min\0"
+                                   "max\0"
+                                   "delayMicroseconds";
+
+static const unsigned short builtin_offsets[ATOM_COUNT] = {
+    0,  /* map */
+    4,  /* constrain */
+    14, /* abs */
+    18, /* random */
+    25, /* min */
+    29, /* max */
+    33, /* delayMicroseconds */
+};
+
+const char *intern_builtin(BuiltinAtom atom) {
+  return builtin_text + builtin_offsets[atom];
+}
+
+// ============================================================================
+// HASH FUNCTION
+// ============================================================================
+
+static unsigned int hash_bytes(const char *text, size_t length) {
+  /* djb2, as the symbol table has always used */
+  unsigned int hash = 5381;
+  for (size_t i = 0; i < length; i++) {
+    hash = ((hash << 5) + hash) + (unsigned char)text[i];
+  }
+  return hash;
+}
+
+static int is_builtin(const char *s) {
+  return s >= builtin_text && s < builtin_text + sizeof(builtin_text);
+}
+
+unsigned int intern_hash(const char *atom) {
+  if (is_builtin(atom))
+    return hash_bytes(atom, strlen(atom));
+  /* Pool strings are stored right after their hash */
+  unsigned int hash;
+  memcpy(&hash, atom - sizeof(unsigned int), sizeof(unsigned int));
+  return hash;
+}
+
+// ============================================================================
+// STRING POOL
+// ============================================================================
+
+static void pool_insert_entry(StringPool *pool, InternEntry entry) {
+  size_t mask = pool->capacity - 1;
+  size_t i = entry.hash & mask;
+  while (pool->entries[i].text != NULL)
+    i = (i + 1) & mask;
+  pool->entries[i] = entry;
+  pool->count++;
+}
+
+static void pool_grow(StringPool *pool) {
+  InternEntry *old = pool->entries;
+  size_t old_capacity = pool->capacity;
+  pool->capacity *= 2;
+  pool->entries = calloc(pool->capacity, sizeof(InternEntry));
+  pool->count = 0;
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old[i].text != NULL)
+      pool_insert_entry(pool, old[i]);
+  }
+  free(old);
+}
+
+StringPool *string_pool_create(void) {
+  StringPool *pool = malloc(sizeof(StringPool));
+  if (!pool)
+    return NULL;
+  pool->arena = arena_create(POOL_CHUNK_SIZE);
+  pool->capacity = POOL_INITIAL_CAPACITY;
+  pool->entries = calloc(pool->capacity, sizeof(InternEntry));
+  pool->count = 0;
+
+  /* Seed the builtins so interning "map" yields intern_builtin(ATOM_MAP) */
+  for (int a = 0; a < ATOM_COUNT; a++) {
+    InternEntry entry;
+    entry.text = intern_builtin((BuiltinAtom)a);
+    entry.length = (unsigned int)strlen(entry.text);
+    entry.hash = hash_bytes(entry.text, entry.length);
+    pool_insert_entry(pool, entry);
+  }
+  return pool;
+}
+
+void string_pool_free(StringPool *pool) {
+  if (pool == NULL)
+    return;
+  arena_destroy(pool->arena);
+  free(pool->entries);
+  free(pool);
+}
+
+const char *string_pool_intern(StringPool *pool, const char *text,
+                               size_t length) {
+  unsigned int hash = hash_bytes(text, length);
+  size_t mask = pool->capacity - 1;
+  size_t i = hash & mask;
+
+  while (pool->entries[i].text != NULL) {
+    InternEntry *e = &pool->entries[i];
+    if (e->hash == hash && e->length == length &&
+        memcmp(e->text, text, length) == 0)
+      return e->text;
+    i = (i + 1) & mask;
+  }
+
+  /* Keep the load factor under 1/2 */
+  if ((pool->count + 1) * 2 > pool->capacity) {
+    pool_grow(pool);
+    return string_pool_intern(pool, text, length);
+  }
+
+  /* Layout: [hash][text...\0] so intern_hash() is a single load */
+  char *storage = arena_alloc(pool->arena, sizeof(unsigned int) + length + 1);
+  memcpy(storage, &hash, sizeof(unsigned int));
+  memcpy(storage + sizeof(unsigned int), text, length);
+  storage[sizeof(unsigned int) + length] = '\0';
+
+  InternEntry entry;
+  entry.text = storage + sizeof(unsigned int);
+  entry.hash = hash;
+  entry.length = (unsigned int)length;
+  pool->entries[i] = entry;
+  pool->count++;
+  return entry.text;
+}
+
+int string_pool_owns(const StringPool *pool, const char *s) {
+  if (is_builtin(s))
+    return 1;
+  for (const ArenaChunk *c = pool->arena->head; c != NULL; c = c->next) {
+    if (s >= c->data && s < c->data + c->used)
+      return 1;
+  }
+  return 0;
+}
+
+const char *string_pool_intern_str(StringPool *pool, const char *s) {
+  if (s == NULL)
+    return NULL;
+  if (string_pool_owns(pool, s))
+    return s;
+  return string_pool_intern(pool, s, strlen(s));
+}
@@ -0,0 +1,63 @@
+/* Kinetrix String Interning
+ * Every distinct identifier is stored once; equal names share one pointer,
+ * so the symbol table, AST and backends can compare names with ==
+ */
+
+#ifndef KINETRIX_INTERN_H
+#define KINETRIX_INTERN_H
+
+#include "arena.h"
+#include <stddef.h>
+
+// ============================================================================
+// BUILTIN ATOMS
+// ============================================================================
+
+/* Names the compiler itself looks for. Every pool hands out the same
+ * static pointer for these, so backends can test them without a pool. */
+typedef enum {
+    ATOM_MAP,
+    ATOM_CONSTRAIN,
+    ATOM_ABS,
+    ATOM_RANDOM,
+    ATOM_MIN,
+    ATOM_MAX,
+    ATOM_DELAY_MICROSECONDS,
+    ATOM_COUNT
+} BuiltinAtom;
+
+const char *intern_builtin(BuiltinAtom atom);
+
+// ============================================================================
+// STRING POOL
+// ============================================================================
+
+typedef struct {
+    const char *text;
+    unsigned int hash;
+    unsigned int length;
+} InternEntry;
+
+typedef struct StringPool {
+    Arena *arena;          // Storage for interned text
+    InternEntry *entries;  // Open-addressing table, capacity is a power of 2
+    size_t capacity;
+    size_t count;
+} StringPool;
+
+StringPool *string_pool_create(void);
+void string_pool_free(StringPool *pool);
+
+/* Returns the canonical copy of text[0..length) */
+const char *string_pool_intern(StringPool *pool, const char *text,
+                               size_t length);
+/* Same for a NUL-terminated string; strings that are already interned in
+ * this pool are returned without hashing */
+const char *string_pool_intern_str(StringPool *pool, const char *s);
+/* Non-zero if s is a canonical pointer from this pool or a builtin atom */
+int string_pool_owns(const StringPool *pool, const char *s);
+
+/* Hash of an interned string, computed once when it entered the pool */
+unsigned int intern_hash(const char *atom);
+
+#endif /* KINETRIX_INTERN_H */
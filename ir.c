@@ -0,0 +1,880 @@
+/* Kinetrix IR Implementation
+ *
+ * Lowering keeps the evaluation order the backends use: operands left to
+ * right, `and` / `or` short-circuiting when the right side has effects, a
+ * for loop's bounds and a repeat count evaluated once. Loops whose
+ * direction is only known at run time keep the backends' runtime test.
+ */
+
+#include "ir.h"
+#include "value_range.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// BUILDING
+// ============================================================================
+
+typedef struct {
+  IrFunction *fn;
+  int block;       /* receives new instructions */
+  int break_to;    /* -1 outside loops */
+  int continue_to;
+  int *hidden;     /* counter for compiler-made variable names */
+  Type *int_type;
+} Lowering;
+
+static int new_block(IrFunction *fn) {
+  if (fn->block_count == fn->block_capacity) {
+    fn->block_capacity = fn->block_capacity ? fn->block_capacity * 2 : 8;
+    fn->blocks = realloc(fn->blocks, sizeof(IrBlock) * fn->block_capacity);
+  }
+  memset(&fn->blocks[fn->block_count], 0, sizeof(IrBlock));
+  return fn->block_count++;
+}
+
+static int is_terminator(IrOp op) {
+  return op == IR_JUMP || op == IR_BRANCH || op == IR_RETURN;
+}
+
+static int block_terminated(const IrBlock *block) {
+  return block->count > 0 && is_terminator(block->instrs[block->count - 1].op);
+}
+
+/* Append an instruction to the current block. Code after a jump or return
+ * opens a block of its own, which nothing reaches. */
+static IrInstr *emit(Lowering *lw, IrOp op, const ASTNode *node) {
+  if (block_terminated(&lw->fn->blocks[lw->block]))
+    lw->block = new_block(lw->fn);
+  IrBlock *block = &lw->fn->blocks[lw->block];
+  if (block->count == block->capacity) {
+    block->capacity = block->capacity ? block->capacity * 2 : 4;
+    block->instrs = realloc(block->instrs, sizeof(IrInstr) * block->capacity);
+  }
+  IrInstr *instr = &block->instrs[block->count++];
+  memset(instr, 0, sizeof(*instr));
+  instr->op = op;
+  instr->dst = instr->a = instr->b = -1;
+  instr->target = instr->target_else = -1;
+  instr->node = node;
+  return instr;
+}
+
+static int new_temp(Lowering *lw) { return lw->fn->temp_count++; }
+
+static void emit_jump(Lowering *lw, int target) {
+  if (!block_terminated(&lw->fn->blocks[lw->block]))
+    emit(lw, IR_JUMP, NULL)->target = target;
+}
+
+static void emit_branch(Lowering *lw, int condition, int if_true,
+                        int if_false) {
+  IrInstr *branch = emit(lw, IR_BRANCH, NULL);
+  branch->a = condition;
+  branch->target = if_true;
+  branch->target_else = if_false;
+}
+
+static int emit_const(Lowering *lw, double value, Type *type) {
+  IrInstr *instr = emit(lw, IR_CONST, NULL);
+  instr->dst = new_temp(lw);
+  instr->number = value;
+  instr->type = type;
+  return instr->dst;
+}
+
+static int emit_load(Lowering *lw, const char *name, Type *type) {
+  IrInstr *instr = emit(lw, IR_LOAD, NULL);
+  instr->dst = new_temp(lw);
+  instr->name = name;
+  instr->type = type;
+  return instr->dst;
+}
+
+static void emit_store(Lowering *lw, const char *name, int value,
+                       Type *type) {
+  IrInstr *instr = emit(lw, IR_STORE, NULL);
+  instr->name = name;
+  instr->a = value;
+  instr->type = type;
+}
+
+static int emit_binary(Lowering *lw, Operator oper, int a, int b,
+                       Type *type) {
+  IrInstr *instr = emit(lw, IR_BINARY, NULL);
+  instr->dst = new_temp(lw);
+  instr->oper = oper;
+  instr->a = a;
+  instr->b = b;
+  instr->type = type;
+  return instr->dst;
+}
+
+/* A variable of the compiler's own, named like the backends' helpers */
+static const char *hidden_name(Lowering *lw, const char *kind) {
+  char name[32];
+  snprintf(name, sizeof(name), "_kx_%s%d", kind, (*lw->hidden)++);
+  return ast_intern(name);
+}
+
+// ============================================================================
+// EXPRESSIONS
+// ============================================================================
+
+static int lower_expr(Lowering *lw, const ASTNode *node);
+
+/* Operations the IR leaves to the backends. Operands are lowered here when
+ * they are plain expressions that are always evaluated; an operation with a
+ * body, a list or a conditional operand is kept whole. */
+static int lower_native(Lowering *lw, const ASTNode *node, int want_value) {
+  const AstLayout *layout = ast_layout(node->type);
+  int opaque = node->type == NODE_ASSERT;
+  for (int f = 0; f < layout->field_count && !opaque; f++) {
+    const AstField *field = &layout->fields[f];
+    if (field->kind == AST_FIELD_NODE_LIST)
+      opaque = 1;
+    else if (field->kind == AST_FIELD_NODE) {
+      const ASTNode *child =
+          *(ASTNode *const *)((const char *)node + field->offset);
+      opaque = child && child->type == NODE_BLOCK;
+    }
+  }
+
+  int *args = NULL, arg_count = 0;
+  if (!opaque) {
+    for (int f = 0; f < layout->field_count; f++)
+      if (layout->fields[f].kind == AST_FIELD_NODE)
+        arg_count++;
+    args = arg_count ? malloc(sizeof(int) * arg_count) : NULL;
+    int arg = 0;
+    for (int f = 0; f < layout->field_count; f++) {
+      const AstField *field = &layout->fields[f];
+      if (field->kind != AST_FIELD_NODE)
+        continue;
+      const ASTNode *child =
+          *(ASTNode *const *)((const char *)node + field->offset);
+      args[arg++] = child ? lower_expr(lw, child) : -1;
+    }
+  }
+  IrInstr *instr = emit(lw, IR_NATIVE, node);
+  instr->args = args;
+  instr->arg_count = arg_count;
+  if (want_value) {
+    instr->dst = new_temp(lw);
+    instr->type = node->value_type;
+  }
+  return instr->dst;
+}
+
+static int lower_call(Lowering *lw, const ASTNode *node, int want_value) {
+  int count = node->data.call.arg_count;
+  int *args = count ? malloc(sizeof(int) * count) : NULL;
+  for (int i = 0; i < count; i++)
+    args[i] = lower_expr(lw, node->data.call.args[i]);
+  IrInstr *instr = emit(lw, IR_CALL, node);
+  instr->name = node->data.call.name;
+  instr->args = args;
+  instr->arg_count = count;
+  if (want_value) {
+    instr->dst = new_temp(lw);
+    instr->type = node->value_type;
+  }
+  return instr->dst;
+}
+
+/* `and` / `or` whose right side has effects: only run it when the left
+ * side does not already decide the result */
+static int lower_short_circuit(Lowering *lw, const ASTNode *node) {
+  const char *result = hidden_name(lw, "cond");
+  Type *type = node->value_type;
+  int left = lower_expr(lw, node->data.binary_op.left);
+  IrInstr *declare = emit(lw, IR_DECLARE, node);
+  declare->name = result;
+  declare->a = left;
+  declare->type = type;
+  int right_block = new_block(lw->fn);
+  int join = new_block(lw->fn);
+  if (node->data.binary_op.op == OP_AND)
+    emit_branch(lw, left, right_block, join);
+  else
+    emit_branch(lw, left, join, right_block);
+  lw->block = right_block;
+  int right = lower_expr(lw, node->data.binary_op.right);
+  emit_store(lw, result, right, type);
+  emit_jump(lw, join);
+  lw->block = join;
+  return emit_load(lw, result, type);
+}
+
+static int lower_expr(Lowering *lw, const ASTNode *node) {
+  IrInstr *instr;
+  switch (node->type) {
+  case NODE_NUMBER:
+    return emit_const(lw, node->data.number.value, node->value_type);
+  case NODE_BOOL:
+    return emit_const(lw, node->data.boolean.value, node->value_type);
+  case NODE_STRING:
+    instr = emit(lw, IR_STRING, node);
+    instr->dst = new_temp(lw);
+    instr->name = node->data.string.value;
+    instr->type = node->value_type;
+    return instr->dst;
+  case NODE_IDENTIFIER:
+    return emit_load(lw, node->data.identifier.name, node->value_type);
+  case NODE_BINARY_OP: {
+    Operator op = node->data.binary_op.op;
+    if ((op == OP_AND || op == OP_OR) &&
+        !ast_expr_is_pure(node->data.binary_op.right))
+      return lower_short_circuit(lw, node);
+    int a = lower_expr(lw, node->data.binary_op.left);
+    int b = lower_expr(lw, node->data.binary_op.right);
+    int dst = emit_binary(lw, op, a, b, node->value_type);
+    IrBlock *block = &lw->fn->blocks[lw->block];
+    block->instrs[block->count - 1].node = node;
+    block->instrs[block->count - 1].checked =
+        op == OP_DIV && !ast_divisor_nonzero(node, RANGE_INT_BITS_AVR);
+    return dst;
+  }
+  case NODE_UNARY_OP: {
+    int a = lower_expr(lw, node->data.unary_op.operand);
+    instr = emit(lw, IR_UNARY, node);
+    instr->dst = new_temp(lw);
+    instr->oper = node->data.unary_op.op;
+    instr->a = a;
+    instr->type = node->value_type;
+    return instr->dst;
+  }
+  case NODE_CAST: {
+    int a = lower_expr(lw, node->data.cast_op.operand);
+    instr = emit(lw, IR_CAST, node);
+    instr->dst = new_temp(lw);
+    instr->a = a;
+    instr->type = node->data.cast_op.target_type;
+    return instr->dst;
+  }
+  case NODE_CALL:
+    return lower_call(lw, node, 1);
+  case NODE_ARRAY_ACCESS:
+    if (node->data.array_access.array->type == NODE_IDENTIFIER) {
+      int index = lower_expr(lw, node->data.array_access.index);
+      instr = emit(lw, IR_LOAD_INDEX, node);
+      instr->dst = new_temp(lw);
+      instr->name = node->data.array_access.array->data.identifier.name;
+      instr->a = index;
+      instr->type = node->value_type;
+      return instr->dst;
+    }
+    return lower_native(lw, node, 1);
+  default:
+    return lower_native(lw, node, 1);
+  }
+}
+
+// ============================================================================
+// STATEMENTS
+// ============================================================================
+
+static void lower_stmt(Lowering *lw, const ASTNode *node);
+
+/* Lower `body` as a loop body: break goes to `exit`, continue to `next` */
+static void lower_loop_body(Lowering *lw, const ASTNode *body, int exit,
+                            int next) {
+  int outer_break = lw->break_to, outer_continue = lw->continue_to;
+  lw->break_to = exit;
+  lw->continue_to = next;
+  lower_stmt(lw, body);
+  lw->break_to = outer_break;
+  lw->continue_to = outer_continue;
+}
+
+static void lower_if(Lowering *lw, const ASTNode *node) {
+  int condition = lower_expr(lw, node->data.if_stmt.condition);
+  int then_block = new_block(lw->fn);
+  int else_block = node->data.if_stmt.else_block ? new_block(lw->fn) : -1;
+  int join = new_block(lw->fn);
+  emit_branch(lw, condition, then_block, else_block >= 0 ? else_block : join);
+  lw->block = then_block;
+  lower_stmt(lw, node->data.if_stmt.then_block);
+  emit_jump(lw, join);
+  if (else_block >= 0) {
+    lw->block = else_block;
+    lower_stmt(lw, node->data.if_stmt.else_block);
+    emit_jump(lw, join);
+  }
+  lw->block = join;
+}
+
+static void lower_while(Lowering *lw, const ASTNode *node) {
+  int header = new_block(lw->fn);
+  int body = new_block(lw->fn);
+  int exit = new_block(lw->fn);
+  emit_jump(lw, header);
+  lw->block = header;
+  emit_branch(lw, lower_expr(lw, node->data.while_loop.condition), body,
+              exit);
+  lw->block = body;
+  lower_loop_body(lw, node->data.while_loop.body, exit, header);
+  emit_jump(lw, header);
+  lw->block = exit;
+}
+
+static void lower_forever(Lowering *lw, const ASTNode *node) {
+  int body = new_block(lw->fn);
+  int exit = new_block(lw->fn);
+  emit_jump(lw, body);
+  lw->block = body;
+  lower_loop_body(lw, node->data.forever_loop.body, exit, body);
+  emit_jump(lw, body);
+  lw->block = exit;
+}
+
+static void lower_repeat(Lowering *lw, const ASTNode *node) {
+  const char *counter = hidden_name(lw, "rep");
+  Type *type = lw->int_type;
+  int count = lower_expr(lw, node->data.repeat_loop.count);
+  int zero = emit_const(lw, 0, type);
+  IrInstr *declare = emit(lw, IR_DECLARE, node);
+  declare->name = counter;
+  declare->a = zero;
+  declare->type = type;
+
+  int header = new_block(lw->fn);
+  int body = new_block(lw->fn);
+  int latch = new_block(lw->fn);
+  int exit = new_block(lw->fn);
+  emit_jump(lw, header);
+  lw->block = header;
+  int done = emit_load(lw, counter, type);
+  emit_branch(lw, emit_binary(lw, OP_LT, done, count, NULL), body, exit);
+  lw->block = body;
+  lower_loop_body(lw, node->data.repeat_loop.body, exit, latch);
+  emit_jump(lw, latch);
+  lw->block = latch;
+  int ran = emit_load(lw, counter, type);
+  int next = emit_binary(lw, OP_ADD, ran, emit_const(lw, 1, type), type);
+  emit_store(lw, counter, next, type);
+  emit_jump(lw, header);
+  lw->block = exit;
+}
+
+/* Direction of a for loop known at compile time: 1 up, -1 down, 0 only at
+ * run time */
+static int for_direction(const ASTNode *node) {
+  const ASTNode *step = node->data.for_loop.step_expr;
+  if (step)
+    return step->type == NODE_NUMBER
+               ? (step->data.number.value > 0 ? 1 : -1)
+               : 0;
+  const ASTNode *start = node->data.for_loop.start_expr;
+  const ASTNode *end = node->data.for_loop.end_expr;
+  if (start->type == NODE_NUMBER && end->type == NODE_NUMBER)
+    return start->data.number.value <= end->data.number.value ? 1 : -1;
+  return 0;
+}
+
+static void lower_for(Lowering *lw, const ASTNode *node) {
+  const char *var = node->data.for_loop.var_name;
+  Type *type = node->value_type;
+  int start = lower_expr(lw, node->data.for_loop.start_expr);
+  int end = lower_expr(lw, node->data.for_loop.end_expr);
+  IrInstr *declare = emit(lw, IR_DECLARE, node);
+  declare->name = var;
+  declare->a = start;
+  declare->type = type;
+
+  int direction = for_direction(node);
+  int step = -1;
+  const char *step_var = NULL;
+  if (node->data.for_loop.step_expr)
+    step = lower_expr(lw, node->data.for_loop.step_expr);
+  else if (direction != 0)
+    step = emit_const(lw, direction, lw->int_type);
+  else {
+    // Counts towards the end bound, whichever side of the start it is on
+    step_var = hidden_name(lw, "step");
+    IrInstr *step_decl = emit(lw, IR_DECLARE, node);
+    step_decl->name = step_var;
+    step_decl->type = lw->int_type;
+    int up = new_block(lw->fn);
+    int down = new_block(lw->fn);
+    int chosen = new_block(lw->fn);
+    emit_branch(lw, emit_binary(lw, OP_LTE, start, end, NULL), up, down);
+    lw->block = up;
+    emit_store(lw, step_var, emit_const(lw, 1, lw->int_type), lw->int_type);
+    emit_jump(lw, chosen);
+    lw->block = down;
+    emit_store(lw, step_var, emit_const(lw, -1, lw->int_type), lw->int_type);
+    emit_jump(lw, chosen);
+    lw->block = chosen;
+  }
+
+  int header = new_block(lw->fn);
+  int body = new_block(lw->fn);
+  int latch = new_block(lw->fn);
+  int exit = new_block(lw->fn);
+  emit_jump(lw, header);
+  lw->block = header;
+  int current = emit_load(lw, var, type);
+  if (direction != 0) {
+    emit_branch(lw,
+                emit_binary(lw, direction > 0 ? OP_LTE : OP_GTE, current, end,
+                            NULL),
+                body, exit);
+  } else {
+    int counting_up = new_block(lw->fn);
+    int counting_down = new_block(lw->fn);
+    int delta = step_var ? emit_load(lw, step_var, lw->int_type) : step;
+    emit_branch(lw,
+                emit_binary(lw, OP_GT, delta, emit_const(lw, 0, lw->int_type),
+                            NULL),
+                counting_up, counting_down);
+    lw->block = counting_up;
+    emit_branch(lw, emit_binary(lw, OP_LTE, current, end, NULL), body, exit);
+    lw->block = counting_down;
+    emit_branch(lw, emit_binary(lw, OP_GTE, current, end, NULL), body, exit);
+  }
+  lw->block = body;
+  lower_loop_body(lw, node->data.for_loop.body, exit, latch);
+  emit_jump(lw, latch);
+  lw->block = latch;
+  int delta = step_var ? emit_load(lw, step_var, lw->int_type) : step;
+  emit_store(lw, var,
+             emit_binary(lw, OP_ADD, emit_load(lw, var, type), delta, type),
+             type);
+  emit_jump(lw, header);
+  lw->block = exit;
+}
+
+static void lower_assignment(Lowering *lw, const ASTNode *node) {
+  const ASTNode *target = node->data.assignment.target;
+  if (target->type == NODE_IDENTIFIER) {
+    int value = lower_expr(lw, node->data.assignment.value);
+    emit_store(lw, target->data.identifier.name, value,
+               node->data.assignment.value->value_type);
+  } else if (target->type == NODE_ARRAY_ACCESS &&
+             target->data.array_access.array->type == NODE_IDENTIFIER) {
+    int index = lower_expr(lw, target->data.array_access.index);
+    int value = lower_expr(lw, node->data.assignment.value);
+    IrInstr *instr = emit(lw, IR_STORE_INDEX, node);
+    instr->name = target->data.array_access.array->data.identifier.name;
+    instr->a = index;
+    instr->b = value;
+    instr->type = node->data.assignment.value->value_type;
+  } else {
+    lower_native(lw, node, 0);
+  }
+}
+
+static void lower_stmt(Lowering *lw, const ASTNode *node) {
+  if (!node)
+    return;
+  IrInstr *instr;
+  switch (node->type) {
+  case NODE_BLOCK:
+    for (int i = 0; i < node->data.block.statement_count; i++)
+      lower_stmt(lw, node->data.block.statements[i]);
+    break;
+  case NODE_VAR_DECL: {
+    const ASTNode *init = node->data.var_decl.initializer;
+    int value = init ? lower_expr(lw, init) : -1;
+    instr = emit(lw, IR_DECLARE, node);
+    instr->name = node->data.var_decl.name;
+    instr->a = value;
+    instr->type = node->data.var_decl.declared_type;
+    break;
+  }
+  case NODE_ARRAY_DECL:
+  case NODE_BUFFER_DECL:
+    instr = emit(lw, IR_DECLARE_ARRAY, node);
+    instr->name = node->data.array_decl.name;
+    instr->number = node->data.array_decl.size;
+    instr->type = node->data.array_decl.elem_type;
+    break;
+  case NODE_ASSIGNMENT:
+    lower_assignment(lw, node);
+    break;
+  case NODE_IF:
+    lower_if(lw, node);
+    break;
+  case NODE_WHILE:
+    lower_while(lw, node);
+    break;
+  case NODE_FOREVER:
+    lower_forever(lw, node);
+    break;
+  case NODE_REPEAT:
+    lower_repeat(lw, node);
+    break;
+  case NODE_FOR:
+    lower_for(lw, node);
+    break;
+  case NODE_RETURN: {
+    int value = node->data.return_stmt.value
+                    ? lower_expr(lw, node->data.return_stmt.value)
+                    : -1;
+    instr = emit(lw, IR_RETURN, node);
+    instr->a = value;
+    break;
+  }
+  case NODE_BREAK:
+  case NODE_CONTINUE: {
+    int target = node->type == NODE_BREAK ? lw->break_to : lw->continue_to;
+    if (target >= 0)
+      emit(lw, IR_JUMP, node)->target = target;
+    else
+      lower_native(lw, node, 0);
+    break;
+  }
+  case NODE_CALL:
+    lower_call(lw, node, 0);
+    break;
+  default:
+    lower_native(lw, node, 0);
+    break;
+  }
+}
+
+// ============================================================================
+// MODULE
+// ============================================================================
+
+static IrFunction *add_function(IrModule *module, IrFunctionKind kind,
+                                const char *name, const ASTNode *source) {
+  if (module->count == module->capacity) {
+    module->capacity = module->capacity ? module->capacity * 2 : 8;
+    module->functions =
+        realloc(module->functions, sizeof(IrFunction) * module->capacity);
+  }
+  IrFunction *fn = &module->functions[module->count++];
+  memset(fn, 0, sizeof(*fn));
+  fn->kind = kind;
+  fn->name = name;
+  fn->source = source;
+  new_block(fn);
+  return fn;
+}
+
+/* Give back the room blocks grew into; most hold a handful of
+ * instructions */
+static void shrink_blocks(IrFunction *fn) {
+  for (int b = 0; b < fn->block_count; b++) {
+    IrBlock *block = &fn->blocks[b];
+    if (block->count < block->capacity && block->count > 0) {
+      block->instrs = realloc(block->instrs, sizeof(IrInstr) * block->count);
+      block->capacity = block->count;
+    }
+  }
+}
+
+static void lower_function(IrFunction *fn, const ASTNode *body, int *hidden,
+                           Type *int_type) {
+  Lowering lw = {fn, 0, -1, -1, hidden, int_type};
+  lower_stmt(&lw, body);
+  if (!block_terminated(&fn->blocks[lw.block]))
+    emit(&lw, IR_RETURN, NULL);
+  shrink_blocks(fn);
+}
+
+IrModule *ir_lower(const ASTNode *program) {
+  IrModule *module = calloc(1, sizeof(IrModule));
+  if (!program || program->type != NODE_PROGRAM)
+    return module;
+  const ASTNode *main = program->data.program.main_block;
+  int statement_count = main && main->type == NODE_BLOCK
+                            ? main->data.block.statement_count
+                            : 0;
+  int hidden = 0;
+  Type *int_type = type_int();
+
+  // Globals first, as the backends hoist them, then one function per
+  // def / task / top-level handler, then whatever the loop body is left with
+  IrFunction *setup = add_function(module, IR_FUNC_SETUP, "setup", NULL);
+  Lowering globals = {setup, 0, -1, -1, &hidden, int_type};
+  for (int i = 0; i < statement_count; i++) {
+    const ASTNode *s = main->data.block.statements[i];
+    if (s && (s->type == NODE_VAR_DECL || s->type == NODE_ARRAY_DECL ||
+              s->type == NODE_BUFFER_DECL))
+      lower_stmt(&globals, s);
+  }
+  emit(&globals, IR_RETURN, NULL);
+  shrink_blocks(setup);
+
+  for (int i = 0; i < statement_count; i++) {
+    const ASTNode *s = main->data.block.statements[i];
+    if (!s)
+      continue;
+    if (s->type == NODE_FUNCTION_DEF && !s->data.function_def.is_extern)
+      lower_function(add_function(module, IR_FUNC_DEF,
+                                  s->data.function_def.name, s),
+                     s->data.function_def.body, &hidden, int_type);
+    else if (s->type == NODE_TASK_DEF)
+      lower_function(
+          add_function(module, IR_FUNC_TASK, s->data.task_def.name, s),
+          s->data.task_def.body, &hidden, int_type);
+    else if (s->type == NODE_INTERRUPT_PIN)
+      lower_function(add_function(module, IR_FUNC_ISR, "on_pin", s),
+                     s->data.interrupt_pin.body, &hidden, int_type);
+    else if (s->type == NODE_INTERRUPT_TIMER)
+      lower_function(add_function(module, IR_FUNC_ISR, "on_timer", s),
+                     s->data.interrupt_timer.body, &hidden, int_type);
+  }
+
+  IrFunction *loop = add_function(module, IR_FUNC_LOOP, "loop", NULL);
+  Lowering body = {loop, 0, -1, -1, &hidden, int_type};
+  if (main && main->type != NODE_BLOCK)
+    lower_stmt(&body, main);
+  for (int i = 0; i < statement_count; i++) {
+    const ASTNode *s = main->data.block.statements[i];
+    if (!s || s->type == NODE_VAR_DECL || s->type == NODE_ARRAY_DECL ||
+        s->type == NODE_BUFFER_DECL || s->type == NODE_TASK_DEF ||
+        s->type == NODE_INTERRUPT_PIN || s->type == NODE_INTERRUPT_TIMER ||
+        s->type == NODE_FUNCTION_DEF)
+      continue;
+    lower_stmt(&body, s);
+  }
+  if (!block_terminated(&loop->blocks[body.block]))
+    emit(&body, IR_RETURN, NULL);
+  shrink_blocks(loop);
+  return module;
+}
+
+void ir_free(IrModule *module) {
+  if (!module)
+    return;
+  for (int f = 0; f < module->count; f++) {
+    IrFunction *fn = &module->functions[f];
+    for (int b = 0; b < fn->block_count; b++) {
+      for (int i = 0; i < fn->blocks[b].count; i++)
+        free(fn->blocks[b].instrs[i].args);
+      free(fn->blocks[b].instrs);
+    }
+    free(fn->blocks);
+  }
+  free(module->functions);
+  free(module);
+}
+
+// ============================================================================
+// UNREACHABLE BLOCKS
+// ============================================================================
+
+static int remove_unreachable(IrFunction *fn) {
+  int *order = malloc(sizeof(int) * fn->block_count); // old -> new, or -1
+  int *stack = malloc(sizeof(int) * fn->block_count);
+  for (int b = 0; b < fn->block_count; b++)
+    order[b] = -1;
+  int depth = 0;
+  order[0] = 0;
+  stack[depth++] = 0;
+  while (depth > 0) {
+    const IrBlock *block = &fn->blocks[stack[--depth]];
+    if (block->count == 0)
+      continue;
+    const IrInstr *last = &block->instrs[block->count - 1];
+    int successors[2] = {last->op == IR_RETURN ? -1 : last->target,
+                         last->target_else};
+    for (int s = 0; s < 2; s++)
+      if (successors[s] >= 0 && order[successors[s]] < 0) {
+        order[successors[s]] = 0;
+        stack[depth++] = successors[s];
+      }
+  }
+  // Survivors keep their relative order
+  int kept = 0;
+  for (int b = 0; b < fn->block_count; b++) {
+    if (order[b] < 0) {
+      for (int i = 0; i < fn->blocks[b].count; i++)
+        free(fn->blocks[b].instrs[i].args);
+      free(fn->blocks[b].instrs);
+      continue;
+    }
+    order[b] = kept;
+    fn->blocks[kept++] = fn->blocks[b];
+  }
+  int removed = fn->block_count - kept;
+  fn->block_count = kept;
+  for (int b = 0; b < kept; b++) {
+    IrBlock *block = &fn->blocks[b];
+    if (block->count == 0)
+      continue;
+    IrInstr *last = &block->instrs[block->count - 1];
+    if (last->op != IR_RETURN) {
+      if (last->target >= 0)
+        last->target = order[last->target];
+      if (last->target_else >= 0)
+        last->target_else = order[last->target_else];
+    }
+  }
+  free(order);
+  free(stack);
+  return removed;
+}
+
+int ir_remove_unreachable(IrModule *module) {
+  int removed = 0;
+  for (int f = 0; f < module->count; f++)
+    removed += remove_unreachable(&module->functions[f]);
+  module->removed_blocks += removed;
+  return removed;
+}
+
+// ============================================================================
+// LISTING
+// ============================================================================
+
+static const char *operator_name(Operator op) {
+  static const char *names[] = {"add", "sub", "mul", "div", "mod",
+                                "eq",  "ne",  "lt",  "gt",  "le",
+                                "ge",  "and", "or",  "neg", "not"};
+  return op <= OP_NOT ? names[op] : "?";
+}
+
+/* Name of a native operation; node types without one print their number */
+static const char *native_name(NodeType type, char *buffer, size_t size) {
+  static const char *const names[NODE_PROGRAM + 1] = {
+      [NODE_ARRAY_ACCESS] = "index",
+      [NODE_ARRAY_LITERAL] = "array",
+      [NODE_BUFFER_PUSH] = "buffer_push",
+      [NODE_STRUCT_ACCESS] = "member",
+      [NODE_ASSIGNMENT] = "assign",
+      [NODE_BREAK] = "break",
+      [NODE_CONTINUE] = "continue",
+      [NODE_GPIO_WRITE] = "gpio_write",
+      [NODE_GPIO_READ] = "gpio_read",
+      [NODE_ANALOG_READ] = "analog_read",
+      [NODE_ANALOG_WRITE] = "analog_write",
+      [NODE_PULSE_READ] = "pulse_read",
+      [NODE_SERVO_WRITE] = "servo_write",
+      [NODE_TONE] = "tone",
+      [NODE_NOTONE] = "no_tone",
+      [NODE_WAIT] = "wait",
+      [NODE_PRINT] = "print",
+      [NODE_PRINTLN] = "println",
+      [NODE_MATH_FUNC] = "math",
+      [NODE_FUNCTION_DEF] = "def",
+      [NODE_INTERRUPT_PIN] = "on_pin",
+      [NODE_INTERRUPT_TIMER] = "on_timer",
+      [NODE_SERIAL_SEND] = "serial_send",
+      [NODE_SERIAL_RECV] = "serial_receive",
+      [NODE_TRY] = "try",
+      [NODE_ASSERT] = "assert",
+      [NODE_TASK_DEF] = "task",
+      [NODE_TASK_START] = "task_start",
+  };
+  if (names[type])
+    return names[type];
+  snprintf(buffer, size, "node%d", (int)type);
+  return buffer;
+}
+
+static void print_type(const Type *type, FILE *out) {
+  if (type)
+    fprintf(out, " : %s", type_to_ctype((Type *)type));
+}
+
+static void print_operands(const IrInstr *instr, FILE *out) {
+  fputc('(', out);
+  for (int i = 0; i < instr->arg_count; i++) {
+    if (i > 0)
+      fputs(", ", out);
+    if (instr->args[i] >= 0)
+      fprintf(out, "%%%d", instr->args[i]);
+    else
+      fputc('-', out);
+  }
+  fputc(')', out);
+}
+
+static void print_instr(const IrInstr *instr, FILE *out) {
+  char buffer[16];
+  fputs("    ", out);
+  if (instr->dst >= 0)
+    fprintf(out, "%%%d = ", instr->dst);
+  switch (instr->op) {
+  case IR_CONST:
+    fprintf(out, "const %.17g", instr->number);
+    break;
+  case IR_STRING:
+    fprintf(out, "string \"%s\"", instr->name);
+    break;
+  case IR_LOAD:
+    fprintf(out, "load %s", instr->name);
+    break;
+  case IR_STORE:
+    fprintf(out, "store %s, %%%d", instr->name, instr->a);
+    break;
+  case IR_DECLARE:
+    fprintf(out, "declare %s", instr->name);
+    if (instr->a >= 0)
+      fprintf(out, " = %%%d", instr->a);
+    break;
+  case IR_DECLARE_ARRAY:
+    fprintf(out, "declare %s[%d]", instr->name, (int)instr->number);
+    break;
+  case IR_LOAD_INDEX:
+    fprintf(out, "load %s[%%%d]", instr->name, instr->a);
+    break;
+  case IR_STORE_INDEX:
+    fprintf(out, "store %s[%%%d], %%%d", instr->name, instr->a, instr->b);
+    break;
+  case IR_BINARY:
+    fprintf(out, "%s%s %%%d, %%%d", operator_name(instr->oper),
+            instr->checked ? ".checked" : "", instr->a, instr->b);
+    break;
+  case IR_UNARY:
+    fprintf(out, "%s %%%d", operator_name(instr->oper), instr->a);
+    break;
+  case IR_CAST:
+    fprintf(out, "cast %%%d", instr->a);
+    break;
+  case IR_CALL:
+    fprintf(out, "call %s", instr->name);
+    print_operands(instr, out);
+    break;
+  case IR_NATIVE:
+    fprintf(out, "native %s",
+            native_name(instr->node->type, buffer, sizeof(buffer)));
+    print_operands(instr, out);
+    break;
+  case IR_JUMP:
+    fprintf(out, "jump b%d", instr->target);
+    break;
+  case IR_BRANCH:
+    fprintf(out, "branch %%%d, b%d, b%d", instr->a, instr->target,
+            instr->target_else);
+    break;
+  case IR_RETURN:
+    fputs("return", out);
+    if (instr->a >= 0)
+      fprintf(out, " %%%d", instr->a);
+    break;
+  }
+  if (instr->op != IR_JUMP && instr->op != IR_BRANCH &&
+      instr->op != IR_RETURN)
+    print_type(instr->type, out);
+  if (instr->node && instr->node->line > 0)
+    fprintf(out, "    ; line %d", instr->node->line);
+  fputc('\n', out);
+}
+
+void ir_print(const IrModule *module, FILE *out) {
+  static const char *kinds[] = {"setup", "loop", "def", "task", "isr"};
+  for (int f = 0; f < module->count; f++) {
+    const IrFunction *fn = &module->functions[f];
+    fprintf(out, "%s %s(", kinds[fn->kind], fn->name);
+    if (fn->kind == IR_FUNC_DEF)
+      for (int p = 0; p < fn->source->data.function_def.param_count; p++)
+        fprintf(out, "%s%s", p > 0 ? ", " : "",
+                fn->source->data.function_def.param_names[p]);
+    fprintf(out, ")");
+    if (fn->kind == IR_FUNC_DEF)
+      print_type(fn->source->data.function_def.return_type, out);
+    fprintf(out, " {\n");
+    for (int b = 0; b < fn->block_count; b++) {
+      fprintf(out, "  b%d:\n", b);
+      for (int i = 0; i < fn->blocks[b].count; i++)
+        print_instr(&fn->blocks[b].instrs[i], out);
+    }
+    fprintf(out, "}\n\n");
+  }
+}
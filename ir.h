@@ -0,0 +1,96 @@
+/* Kinetrix IR
+ * A typed three-address form of the program, lowered from the AST once for
+ * every target. Each function is a list of basic blocks ending in a jump,
+ * branch or return; values live in numbered temporaries that are assigned
+ * exactly once, and named variables are read and written through explicit
+ * load and store instructions. Target-specific operations (pins, buses,
+ * library wrappers) stay as IR_NATIVE instructions that keep their AST node
+ * and take their operands as temporaries, so a backend expands them the
+ * way it does today.
+ */
+
+#ifndef KINETRIX_IR_H
+#define KINETRIX_IR_H
+
+#include "ast.h"
+#include <stdio.h>
+
+typedef enum {
+    IR_CONST,         // dst = number (bools are 0 / 1)
+    IR_STRING,        // dst = "name"
+    IR_LOAD,          // dst = name
+    IR_STORE,         // name = a
+    IR_DECLARE,       // declare name of type, = a if a >= 0
+    IR_DECLARE_ARRAY, // declare name[number] of type
+    IR_LOAD_INDEX,    // dst = name[a]
+    IR_STORE_INDEX,   // name[a] = b
+    IR_BINARY,        // dst = a oper b
+    IR_UNARY,         // dst = oper a
+    IR_CAST,          // dst = (type) a
+    IR_CALL,          // dst = name(args), dst -1 for a statement call
+    IR_NATIVE,        // dst = node(args), args in ast_layout() field order
+    IR_JUMP,          // goto target
+    IR_BRANCH,        // if a goto target else target_else
+    IR_RETURN         // return a, or nothing if a is -1
+} IrOp;
+
+typedef struct {
+    IrOp op;
+    Operator oper;       // IR_BINARY, IR_UNARY
+    int checked;         // OP_DIV: divisor may be zero with 16-bit ints
+    int dst;             // Temporary defined here, -1 for none
+    int a, b;            // Operand temporaries, -1 for none
+    int arg_count;
+    int target;          // Block index: IR_JUMP, IR_BRANCH when true
+    int target_else;     // IR_BRANCH when false
+    Type *type;          // Type of dst or of the stored value; NULL unknown
+    double number;       // IR_CONST value, IR_DECLARE_ARRAY size
+    const char *name;    // Variable, callee or string text
+    int *args;           // IR_CALL, IR_NATIVE; -1 for an absent operand
+    const ASTNode *node; // Source node (IR_NATIVE: the operation)
+} IrInstr;
+
+typedef struct {
+    IrInstr *instrs;
+    int count;
+    int capacity;
+} IrBlock;
+
+typedef enum {
+    IR_FUNC_SETUP, // Global declarations, run once
+    IR_FUNC_LOOP,  // The main program body
+    IR_FUNC_DEF,   // def name(params)
+    IR_FUNC_TASK,  // task name
+    IR_FUNC_ISR    // on pin / on timer handler
+} IrFunctionKind;
+
+typedef struct {
+    IrFunctionKind kind;
+    const char *name;
+    const ASTNode *source; // def, task or interrupt node; NULL otherwise
+    IrBlock *blocks;       // blocks[0] is the entry
+    int block_count;
+    int block_capacity;
+    int temp_count;
+} IrFunction;
+
+typedef struct {
+    IrFunction *functions;
+    int count;
+    int capacity;
+    int removed_blocks; // By ir_remove_unreachable()
+} IrModule;
+
+/* Lower `program` (after the AST passes have run). Needs the program's AST
+ * arena installed (see ast_set_arena). */
+IrModule *ir_lower(const ASTNode *program);
+void ir_free(IrModule *module);
+
+/* Drop blocks no path from their function's entry reaches, such as the
+ * statements after a return; returns how many were removed */
+int ir_remove_unreachable(IrModule *module);
+
+/* Textual listing, for --emit-ir */
+void ir_print(const IrModule *module, FILE *out);
+
+#endif
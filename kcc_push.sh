@@ -90,7 +90,11 @@ if [[ -z "$OUTPUT" ]]; then
 fi
 
 echo -e "${YELLOW}Step 1: Compiling $KX_FILE → $TARGET${NC}"
-"$KCC" "$KX_FILE" --target "$TARGET" -o "$OUTPUT" 2>&1
+# With KCC_SERVER set to the socket of a running `kcc --serve`, the build
+# reuses its already-parsed modules (kcc compiles locally if it is down)
+KCC_ARGS=()
+if [[ -n "$KCC_SERVER" ]]; then KCC_ARGS+=(--server "$KCC_SERVER"); fi
+"$KCC" "$KX_FILE" --target "$TARGET" -o "$OUTPUT" "${KCC_ARGS[@]}" 2>&1
 if [[ $? -ne 0 ]]; then
     echo -e "${RED}Compilation failed!${NC}"
     exit 1
@@ -0,0 +1,347 @@
+/* Kinetrix Module Index Implementation */
+
+#define _POSIX_C_SOURCE 200809L
+#include "module_index.h"
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#define MAX_INCLUDE_DEPTH 16 /* include cycles are cut here */
+
+// ============================================================================
+// NAME SETS
+// ============================================================================
+
+/* Interned names, compared by pointer; open addressing on intern_hash() */
+typedef struct {
+  const char **slots;
+  size_t capacity; /* power of 2 */
+  size_t count;
+} NameSet;
+
+static int name_set_has(const NameSet *set, const char *name) {
+  if (set->count == 0)
+    return 0;
+  size_t mask = set->capacity - 1;
+  for (size_t i = intern_hash(name) & mask; set->slots[i]; i = (i + 1) & mask)
+    if (set->slots[i] == name)
+      return 1;
+  return 0;
+}
+
+/* Returns 1 if `name` was not in the set yet */
+static int name_set_add(NameSet *set, const char *name) {
+  if ((set->count + 1) * 2 > set->capacity) {
+    NameSet grown = {NULL, set->capacity ? set->capacity * 2 : 64, 0};
+    grown.slots = calloc(grown.capacity, sizeof(const char *));
+    for (size_t i = 0; i < set->capacity; i++)
+      if (set->slots[i])
+        name_set_add(&grown, set->slots[i]);
+    free(set->slots);
+    *set = grown;
+  }
+  size_t mask = set->capacity - 1;
+  size_t i = intern_hash(name) & mask;
+  for (; set->slots[i]; i = (i + 1) & mask)
+    if (set->slots[i] == name)
+      return 0;
+  set->slots[i] = name;
+  set->count++;
+  return 1;
+}
+
+/* The names of `set` not in `except` (which may be NULL) as an array; the
+ * set is emptied */
+static const char **name_set_take(NameSet *set, const NameSet *except,
+                                  int *count) {
+  const char **names = malloc(sizeof(const char *) * (set->count + 1));
+  *count = 0;
+  for (size_t i = 0; i < set->capacity; i++)
+    if (set->slots[i] && !(except && name_set_has(except, set->slots[i])))
+      names[(*count)++] = set->slots[i];
+  free(set->slots);
+  set->slots = NULL;
+  set->capacity = set->count = 0;
+  return names;
+}
+
+// ============================================================================
+// SCANNING
+// ============================================================================
+
+typedef struct {
+  StringPool *strings;
+  NameSet exports;
+  NameSet uses;
+} Scan;
+
+/* A top-level declaration being read: `const X`, `make int x`, `make Point
+ * p`, `def f(`, `task t {`, `define type T {`, `define device d as` */
+typedef struct {
+  int active;
+  int names;        /* identifiers since the keyword */
+  const char *name; /* the last of them */
+} Declaration;
+
+static void declaration_end(Scan *scan, Declaration *decl) {
+  if (decl->active && decl->name)
+    name_set_add(&scan->exports, decl->name);
+  decl->active = 0;
+  decl->names = 0;
+  decl->name = NULL;
+}
+
+/* Only a name a declaration introduces is an export; one that is merely
+ * mentioned at top level, as in `make int speed = MOTOR_MAX`, is a use */
+static void scan_declaration(Scan *scan, const Token *token,
+                             Declaration *decl) {
+  // `const` is an ordinary identifier to the lexer
+  int is_const = token->type == TOK_ID && strcmp(token->value, "const") == 0;
+  if (is_const || token->type == TOK_MAKE || token->type == TOK_SHARED ||
+      token->type == TOK_DEF || token->type == TOK_TASK ||
+      token->type == TOK_DEFINE || token->type == TOK_EXTERN) {
+    declaration_end(scan, decl);
+    decl->active = 1;
+    return;
+  }
+  switch (token->type) {
+  case TOK_ID:
+    if (!decl->active)
+      break;
+    decl->name = token->value;
+    // A second identifier is the name and the first its type
+    if (++decl->names == 2)
+      declaration_end(scan, decl);
+    break;
+  case TOK_ASSIGN:
+  case TOK_LPAREN:
+  case TOK_LBRACE:
+  case TOK_LBRACKET:
+  case TOK_COLON:
+  case TOK_AS:
+  case TOK_EOF:
+    declaration_end(scan, decl);
+    break;
+  default:
+    break; // Type words: int, array, type, device...
+  }
+}
+
+static void scan_source(Scan *scan, const SourceFile *source, int depth);
+
+/* Scan the file an include names, resolved as the parser resolves it */
+static void scan_include(Scan *scan, const char *from, const char *rel_path,
+                         int depth) {
+  char base_dir[1024] = ".";
+  if (from) {
+    char *path_copy = strdup(from);
+    snprintf(base_dir, sizeof(base_dir), "%s", dirname(path_copy));
+    free(path_copy);
+  }
+  char full_path[2048];
+  snprintf(full_path, sizeof(full_path), "%s/%s", base_dir, rel_path);
+  FILE *file = fopen(full_path, "r");
+  const char *kpath = getenv("KINETRIX_PATH");
+  if (!file && kpath) {
+    snprintf(full_path, sizeof(full_path), "%s/%s", kpath, rel_path);
+    file = fopen(full_path, "r");
+  }
+  if (!file)
+    return; // The parser reports it if the module is used
+  SourceFile included = {file, full_path, NULL, 0};
+  scan_source(scan, &included, depth + 1);
+  fclose(file);
+}
+
+static void scan_source(Scan *scan, const SourceFile *source, int depth) {
+  if (depth > MAX_INCLUDE_DEPTH)
+    return;
+  // Lexical errors are left for the parser to report
+  Lexer *lexer = lexer_create_multi(source, 1, NULL, scan->strings);
+  int braces = 0;
+  int parens = 0;
+  Declaration decl = {0, 0, NULL};
+  while (lexer->current_token.type != TOK_EOF) {
+    Token *token = &lexer->current_token;
+    if (braces == 0 && parens == 0)
+      scan_declaration(scan, token, &decl);
+    switch (token->type) {
+    case TOK_LBRACE:
+      braces++;
+      break;
+    case TOK_RBRACE:
+      if (braces > 0)
+        braces--;
+      break;
+    case TOK_LPAREN:
+      parens++;
+      break;
+    case TOK_RPAREN:
+      if (parens > 0)
+        parens--;
+      break;
+    case TOK_ID:
+      name_set_add(&scan->uses, token->value);
+      break;
+    case TOK_INCLUDE:
+      lexer_next_token(lexer);
+      if (lexer->current_token.type == TOK_STRING_LIT)
+        scan_include(scan, lexer->file_path, lexer->current_token.value,
+                     depth);
+      continue;
+    default:
+      break;
+    }
+    lexer_next_token(lexer);
+  }
+  declaration_end(scan, &decl);
+  lexer_free(lexer);
+}
+
+// ============================================================================
+// INDEX
+// ============================================================================
+
+static char *read_text(const char *path, size_t *out_length) {
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return NULL;
+  size_t capacity = 4096;
+  size_t length = 0;
+  char *text = malloc(capacity);
+  size_t n;
+  while ((n = fread(text + length, 1, capacity - length, file)) > 0) {
+    length += n;
+    if (length == capacity) {
+      capacity *= 2;
+      text = realloc(text, capacity);
+    }
+  }
+  fclose(file);
+  *out_length = length;
+  return text;
+}
+
+static void index_add(ModuleIndex *index, const char *path) {
+  size_t length;
+  char *text = read_text(path, &length);
+  if (text == NULL)
+    return;
+  if (index->count == index->capacity) {
+    index->capacity = index->capacity ? index->capacity * 2 : 8;
+    index->modules =
+        realloc(index->modules, sizeof(ModuleEntry) * index->capacity);
+  }
+  ModuleEntry *module = &index->modules[index->count++];
+  module->path = strdup(path);
+  module->text = text;
+  module->length = length;
+  module->used = 0;
+
+  Scan scan = {index->strings, {NULL, 0, 0}, {NULL, 0, 0}};
+  SourceFile source = {NULL, path, text, length};
+  scan_source(&scan, &source, 0);
+  // What a package declares itself it does not need from the others
+  module->uses = name_set_take(&scan.uses, &scan.exports, &module->use_count);
+  module->exports = name_set_take(&scan.exports, NULL, &module->export_count);
+}
+
+ModuleIndex *module_index_create(const char *dir) {
+  ModuleIndex *index = calloc(1, sizeof(ModuleIndex));
+  index->strings = string_pool_create();
+  char modules[512];
+  char mod_path[1024];
+#ifdef _WIN32
+  snprintf(modules, sizeof(modules), "%s%skinetrix_modules", dir ? dir : "",
+           dir ? "\\" : "");
+  char pattern[600];
+  snprintf(pattern, sizeof(pattern), "%s\\*.*", modules);
+  WIN32_FIND_DATA fd;
+  HANDLE hFind = FindFirstFile(pattern, &fd);
+  if (hFind != INVALID_HANDLE_VALUE) {
+    do {
+      if (fd.cFileName[0] == '.')
+        continue;
+      snprintf(mod_path, sizeof(mod_path), "%s\\%s\\index.kx", modules,
+               fd.cFileName);
+      index_add(index, mod_path);
+    } while (FindNextFile(hFind, &fd));
+    FindClose(hFind);
+  }
+#else
+  snprintf(modules, sizeof(modules), "%s%skinetrix_modules", dir ? dir : "",
+           dir ? "/" : "");
+  DIR *d = opendir(modules);
+  if (d) {
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+      if (ent->d_name[0] == '.')
+        continue;
+      snprintf(mod_path, sizeof(mod_path), "%s/%s/index.kx", modules,
+               ent->d_name);
+      index_add(index, mod_path);
+    }
+    closedir(d);
+  }
+#endif
+  return index;
+}
+
+void module_index_free(ModuleIndex *index) {
+  for (int i = 0; i < index->count; i++) {
+    free(index->modules[i].path);
+    free(index->modules[i].text);
+    free(index->modules[i].exports);
+    free(index->modules[i].uses);
+  }
+  free(index->modules);
+  string_pool_free(index->strings);
+  free(index);
+}
+
+static int module_is_needed(const ModuleEntry *module, const NameSet *needed) {
+  for (int i = 0; i < module->export_count; i++)
+    if (name_set_has(needed, module->exports[i]))
+      return 1;
+  return 0;
+}
+
+void module_index_select(ModuleIndex *index, const SourceFile *program) {
+  if (index->count == 0)
+    return;
+  Scan scan = {index->strings, {NULL, 0, 0}, {NULL, 0, 0}};
+  scan_source(&scan, program, 0);
+  if (program->file && !program->text)
+    rewind(program->file);
+  int use_count;
+  const char **uses = name_set_take(&scan.uses, &scan.exports, &use_count);
+  free(scan.exports.slots);
+  NameSet needed = {NULL, 0, 0};
+  for (int i = 0; i < use_count; i++)
+    name_set_add(&needed, uses[i]);
+  free(uses);
+
+  // Packages can use each other, so repeat until nothing new is reached
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (int i = 0; i < index->count; i++) {
+      ModuleEntry *module = &index->modules[i];
+      if (module->used || !module_is_needed(module, &needed))
+        continue;
+      module->used = 1;
+      index->used_count++;
+      for (int j = 0; j < module->use_count; j++)
+        name_set_add(&needed, module->uses[j]);
+      changed = 1;
+    }
+  }
+  free(needed.slots);
+}
@@ -0,0 +1,50 @@
+/* Kinetrix Module Index
+ * Lists what every installed package (kinetrix_modules/<name>/index.kx)
+ * declares at top level and which names it mentions, from a lexer-only
+ * scan. A compile then takes in just the packages the program reaches,
+ * directly or through other packages, so parse time and firmware size
+ * follow what is used rather than what is installed.
+ *
+ * The scan over-approximates: the name after each top-level const, make,
+ * shared, def, task, define or extern counts as a declaration, and every
+ * other identifier anywhere that the source does not declare itself as a
+ * use. An extra package costs time, never correctness. Files a source
+ * includes are scanned as part of it.
+ */
+
+#ifndef KINETRIX_MODULE_INDEX_H
+#define KINETRIX_MODULE_INDEX_H
+
+#include "intern.h"
+#include "parser.h"
+#include <stddef.h>
+
+typedef struct {
+    char *path;            // kinetrix_modules/<name>/index.kx
+    char *text;            // Its source, read once for the scan
+    size_t length;
+    const char **exports;  // Top-level names, interned in the index's pool
+    int export_count;
+    const char **uses;     // Names it mentions but does not declare
+    int use_count;
+    int used;              // Reached from the program
+} ModuleEntry;
+
+typedef struct {
+    ModuleEntry *modules;  // In directory order
+    int count;
+    int capacity;
+    int used_count;
+    StringPool *strings;
+} ModuleIndex;
+
+/* Read and scan every package under `dir`/kinetrix_modules (`dir` NULL for
+ * the working directory) */
+ModuleIndex *module_index_create(const char *dir);
+void module_index_free(ModuleIndex *index);
+
+/* Mark the packages `program` needs, following uses from package to
+ * package. A program given as a FILE is rewound afterwards. */
+void module_index_select(ModuleIndex *index, const SourceFile *program);
+
+#endif // KINETRIX_MODULE_INDEX_H
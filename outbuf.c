@@ -0,0 +1,97 @@
+/* Kinetrix Output Buffer Implementation */
+
+#include "outbuf.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define OUTBUF_INITIAL 16384
+
+/* Indentation is copied from here instead of printed two spaces at a time */
+static const char spaces[] =
+    "                                                                "
+    "                                                                ";
+
+void outbuf_init(OutBuf *buf) {
+  buf->data = NULL;
+  buf->length = 0;
+  buf->capacity = 0;
+  buf->allocations = 0;
+}
+
+void outbuf_free(OutBuf *buf) {
+  free(buf->data);
+  outbuf_init(buf);
+}
+
+/* Make room for `extra` more bytes */
+static int outbuf_reserve(OutBuf *buf, size_t extra) {
+  if (buf->capacity - buf->length >= extra)
+    return 1;
+  size_t capacity = buf->capacity ? buf->capacity : OUTBUF_INITIAL;
+  while (capacity - buf->length < extra)
+    capacity *= 2;
+  char *grown = realloc(buf->data, capacity);
+  if (!grown)
+    return 0;
+  buf->data = grown;
+  buf->capacity = capacity;
+  buf->allocations++;
+  return 1;
+}
+
+void outbuf_write(OutBuf *buf, const char *bytes, size_t length) {
+  if (length == 0 || !outbuf_reserve(buf, length))
+    return;
+  memcpy(buf->data + buf->length, bytes, length);
+  buf->length += length;
+}
+
+void outbuf_putc(OutBuf *buf, char c) {
+  if (buf->length == buf->capacity && !outbuf_reserve(buf, 1))
+    return;
+  buf->data[buf->length++] = c;
+}
+
+void outbuf_puts(OutBuf *buf, const char *s) {
+  outbuf_write(buf, s, strlen(s));
+}
+
+void outbuf_vprintf(OutBuf *buf, const char *format, va_list args) {
+  /* Most fragments are plain text: copy them without going through printf */
+  if (strchr(format, '%') == NULL) {
+    outbuf_puts(buf, format);
+    return;
+  }
+  va_list retry;
+  va_copy(retry, args);
+  size_t room = buf->capacity - buf->length;
+  int n = vsnprintf(room ? buf->data + buf->length : NULL, room, format, args);
+  if (n >= 0 && (size_t)n >= room && outbuf_reserve(buf, (size_t)n + 1))
+    n = vsnprintf(buf->data + buf->length, (size_t)n + 1, format, retry);
+  va_end(retry);
+  if (n >= 0 && (size_t)n < buf->capacity - buf->length)
+    buf->length += (size_t)n;
+}
+
+void outbuf_printf(OutBuf *buf, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  outbuf_vprintf(buf, format, args);
+  va_end(args);
+}
+
+void outbuf_spaces(OutBuf *buf, int count) {
+  while (count > 0) {
+    int n = count < (int)sizeof(spaces) - 1 ? count : (int)sizeof(spaces) - 1;
+    outbuf_write(buf, spaces, (size_t)n);
+    count -= n;
+  }
+}
+
+int outbuf_flush(OutBuf *buf, FILE *file) {
+  if (buf->length == 0)
+    return 1;
+  int ok = fwrite(buf->data, 1, buf->length, file) == buf->length;
+  buf->length = 0;
+  return ok;
+}
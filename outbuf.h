@@ -0,0 +1,35 @@
+/* Kinetrix Output Buffer
+ * Growable in-memory text buffer the backends format into. Generated code
+ * is written out with a single fwrite once a backend is done, so backends
+ * never touch a FILE and can run side by side.
+ */
+
+#ifndef KINETRIX_OUTBUF_H
+#define KINETRIX_OUTBUF_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+
+typedef struct {
+    char *data;      // Not NUL-terminated
+    size_t length;
+    size_t capacity;
+    size_t allocations; // Times the storage was (re)allocated
+} OutBuf;
+
+void outbuf_init(OutBuf *buf);
+void outbuf_free(OutBuf *buf);
+
+void outbuf_write(OutBuf *buf, const char *bytes, size_t length);
+void outbuf_putc(OutBuf *buf, char c);
+void outbuf_puts(OutBuf *buf, const char *s);
+void outbuf_vprintf(OutBuf *buf, const char *format, va_list args);
+void outbuf_printf(OutBuf *buf, const char *format, ...);
+/* Append `count` spaces */
+void outbuf_spaces(OutBuf *buf, int count);
+
+/* Write the contents to `file` and empty the buffer; returns 0 on error */
+int outbuf_flush(OutBuf *buf, FILE *file);
+
+#endif // KINETRIX_OUTBUF_H
@@ -0,0 +1,136 @@
+/* Kinetrix Worker Pool Implementation */
+
+#define _POSIX_C_SOURCE 200809L
+#include "parallel.h"
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Lock;
+#define lock_init(l) InitializeCriticalSection(l)
+#define lock_destroy(l) DeleteCriticalSection(l)
+#define lock_acquire(l) EnterCriticalSection(l)
+#define lock_release(l) LeaveCriticalSection(l)
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_t Thread;
+typedef pthread_mutex_t Lock;
+#define lock_init(l) pthread_mutex_init(l, NULL)
+#define lock_destroy(l) pthread_mutex_destroy(l)
+#define lock_acquire(l) pthread_mutex_lock(l)
+#define lock_release(l) pthread_mutex_unlock(l)
+#endif
+
+typedef struct {
+  ParallelJob job;
+  void *context;
+  int count;
+  int next; /* first index not yet handed out, guarded by lock */
+  Lock lock;
+} Pool;
+
+struct ParallelLock {
+  Lock lock;
+};
+
+ParallelLock *parallel_lock_create(void) {
+  ParallelLock *lock = malloc(sizeof(ParallelLock));
+  if (lock)
+    lock_init(&lock->lock);
+  return lock;
+}
+
+void parallel_lock_free(ParallelLock *lock) {
+  if (lock == NULL)
+    return;
+  lock_destroy(&lock->lock);
+  free(lock);
+}
+
+void parallel_lock_acquire(ParallelLock *lock) {
+  lock_acquire(&lock->lock);
+}
+
+void parallel_lock_release(ParallelLock *lock) {
+  lock_release(&lock->lock);
+}
+
+int parallel_cpu_count(void) {
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  int n = (int)info.dwNumberOfProcessors;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  return n > 0 ? (int)n : 1;
+}
+
+static void run_jobs(Pool *pool) {
+  for (;;) {
+    lock_acquire(&pool->lock);
+    int index = pool->next < pool->count ? pool->next++ : -1;
+    lock_release(&pool->lock);
+    if (index < 0)
+      return;
+    pool->job(pool->context, index);
+  }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker_main(LPVOID arg) {
+  run_jobs(arg);
+  return 0;
+}
+#else
+static void *worker_main(void *arg) {
+  run_jobs(arg);
+  return NULL;
+}
+#endif
+
+void parallel_for(int count, int workers, ParallelJob job, void *context) {
+  if (workers > count)
+    workers = count;
+  if (workers <= 1) {
+    for (int i = 0; i < count; i++)
+      job(context, i);
+    return;
+  }
+
+  Pool pool;
+  pool.job = job;
+  pool.context = context;
+  pool.count = count;
+  pool.next = 0;
+  lock_init(&pool.lock);
+  Thread *threads = malloc(sizeof(Thread) * (workers - 1));
+  int started = 0;
+  for (int i = 0; threads && i < workers - 1; i++) {
+#ifdef _WIN32
+    threads[i] = CreateThread(NULL, 0, worker_main, &pool, 0, NULL);
+    if (threads[i] == NULL)
+      break;
+#else
+    if (pthread_create(&threads[i], NULL, worker_main, &pool) != 0)
+      break;
+#endif
+    started++;
+  }
+
+  // The calling thread works too; if no thread could start it does it all
+  run_jobs(&pool);
+
+  for (int i = 0; i < started; i++) {
+#ifdef _WIN32
+    WaitForSingleObject(threads[i], INFINITE);
+    CloseHandle(threads[i]);
+#else
+    pthread_join(threads[i], NULL);
+#endif
+  }
+  free(threads);
+  lock_destroy(&pool.lock);
+}
@@ -0,0 +1,27 @@
+/* Kinetrix Worker Pool
+ * Runs independent jobs (one backend, one program) on a few threads.
+ * POSIX builds use pthreads, Windows builds use Win32 threads.
+ */
+
+#ifndef KINETRIX_PARALLEL_H
+#define KINETRIX_PARALLEL_H
+
+typedef void (*ParallelJob)(void *context, int index);
+
+/* Number of online CPUs, at least 1 */
+int parallel_cpu_count(void);
+
+/* Call job(context, i) for every i in [0, count) on up to `workers`
+ * threads, the calling thread included, and return once all are done.
+ * Jobs are handed out in index order as workers become free. */
+void parallel_for(int count, int workers, ParallelJob job, void *context);
+
+/* A mutex, for state several jobs share (the module cache) */
+typedef struct ParallelLock ParallelLock;
+
+ParallelLock *parallel_lock_create(void);
+void parallel_lock_free(ParallelLock *lock);
+void parallel_lock_acquire(ParallelLock *lock);
+void parallel_lock_release(ParallelLock *lock);
+
+#endif // KINETRIX_PARALLEL_H
@@ -2,30 +2,90 @@
  * Lexer + Recursive Descent Parser → AST
  */
 
-#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700 /* realpath */
 #include "parser.h"
 #include <ctype.h>
 #include <libgen.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/stat.h>
 
 // ============================================================================
 // LEXER IMPLEMENTATION
 // ============================================================================
 
-Lexer *lexer_create(FILE *file, const char *file_path, ErrorList *errors) {
-  Lexer *lexer = malloc(sizeof(Lexer));
-  lexer->file = file;
-  lexer->file_path = file_path;
-  lexer->current_char = fgetc(file);
+/* Each source file is read into one buffer up front and scanned by
+ * position; tokens are slices of that buffer rather than copies. A lexer
+ * may chain several sources (installed modules, then the main file); the
+ * buffers are scanned one after another and all stay alive until
+ * lexer_free(), so earlier tokens remain valid. To keep Token.value usable
+ * as a C string, the character just past the current token is temporarily
+ * overwritten with '\0' and restored on the next call to
+ * lexer_next_token(). */
+
+static char *lexer_read_file(FILE *file, size_t *out_length) {
+  size_t capacity = 4096;
+  size_t length = 0;
+  char *buffer = malloc(capacity);
+  size_t n;
+  while ((n = fread(buffer + length, 1, capacity - length - 1, file)) > 0) {
+    length += n;
+    if (capacity - length - 1 == 0) {
+      capacity *= 2;
+      buffer = realloc(buffer, capacity);
+    }
+  }
+  buffer[length] = '\0';
+  *out_length = length;
+  return buffer;
+}
+
+/* Make sources[index] the buffer being scanned. Lines restart at 1 and new
+ * errors are attributed to that file. */
+static void lexer_enter_source(Lexer *lexer, int index) {
+  LexerSource *src = &lexer->sources[index];
+  lexer->source_index = index;
+  lexer->source = src->text;
+  lexer->length = src->length;
+  lexer->file_path = src->path;
+  lexer->pos = 0;
+  lexer->current_char =
+      src->length > 0 ? (unsigned char)src->text[0] : EOF;
   lexer->line = 1;
   lexer->column = 1;
+  lexer->saved_pos = src->length;
+  lexer->saved_char = '\0';
+  error_list_set_file(lexer->errors, src->path);
+}
+
+Lexer *lexer_create_multi(const SourceFile *files, int count,
+                          ErrorList *errors, StringPool *strings) {
+  Lexer *lexer = malloc(sizeof(Lexer));
+  lexer->strings = strings;
   lexer->errors = errors;
-  lexer->current_token.value = malloc(256);
-  lexer->current_token.capacity = 256;
-  lexer->current_token.value[0] = '\0';
+  lexer->source_count = count > 0 ? count : 1;
+  lexer->sources = calloc(lexer->source_count, sizeof(LexerSource));
+  for (int i = 0; i < count; i++) {
+    if (files[i].text) {
+      lexer->sources[i].text = malloc(files[i].length + 1);
+      memcpy(lexer->sources[i].text, files[i].text, files[i].length);
+      lexer->sources[i].text[files[i].length] = '\0';
+      lexer->sources[i].length = files[i].length;
+    } else {
+      lexer->sources[i].text =
+          lexer_read_file(files[i].file, &lexer->sources[i].length);
+    }
+    lexer->sources[i].path = files[i].path ? strdup(files[i].path) : NULL;
+  }
+  if (count == 0)
+    lexer->sources[0].text = calloc(1, 1);
+  lexer_enter_source(lexer, 0);
+  lexer->current_token.value = lexer->source + lexer->length;
+  lexer->current_token.start = lexer->current_token.value;
+  lexer->current_token.length = 0;
 
   // Read first token
   lexer_next_token(lexer);
@@ -33,9 +93,18 @@ Lexer *lexer_create(FILE *file, const char *file_path, ErrorList *errors) {
   return lexer;
 }
 
+Lexer *lexer_create(FILE *file, const char *file_path, ErrorList *errors,
+                    StringPool *strings) {
+  SourceFile only = {file, file_path, NULL, 0};
+  return lexer_create_multi(&only, 1, errors, strings);
+}
+
 void lexer_free(Lexer *lexer) {
-  if (lexer->current_token.value)
-    free(lexer->current_token.value);
+  for (int i = 0; i < lexer->source_count; i++) {
+    free(lexer->sources[i].text);
+    free(lexer->sources[i].path);
+  }
+  free(lexer->sources);
   free(lexer);
 }
 
@@ -46,7 +115,40 @@ static void lexer_advance(Lexer *lexer) {
   } else {
     lexer->column++;
   }
-  lexer->current_char = fgetc(lexer->file);
+  if (lexer->pos < lexer->length)
+    lexer->pos++;
+  lexer->current_char = lexer->pos < lexer->length
+                            ? (unsigned char)lexer->source[lexer->pos]
+                            : EOF;
+}
+
+/* Character after current_char, without consuming anything */
+static int lexer_lookahead(Lexer *lexer) {
+  return lexer->pos + 1 < lexer->length
+             ? (unsigned char)lexer->source[lexer->pos + 1]
+             : EOF;
+}
+
+/* Finish the current token as the slice [start, pos) of the source buffer */
+static void lexer_finish_token(Lexer *lexer, TokenType type, size_t start) {
+  lexer->current_token.type = type;
+  lexer->current_token.start = lexer->source + start;
+  lexer->current_token.length = lexer->pos - start;
+  lexer->current_token.value = lexer->source + start;
+  lexer->saved_pos = lexer->pos;
+  lexer->saved_char = lexer->source[lexer->pos];
+  lexer->source[lexer->pos] = '\0';
+  /* Identifiers get their stable interned handle here, once */
+  if (type == TOK_ID && lexer->strings)
+    lexer->current_token.value = (char *)string_pool_intern(
+        lexer->strings, lexer->source + start, lexer->pos - start);
+}
+
+/* Single-character token at the current position */
+static void lexer_single_token(Lexer *lexer, TokenType type) {
+  size_t start = lexer->pos;
+  lexer_advance(lexer);
+  lexer_finish_token(lexer, type, start);
 }
 
 static void lexer_skip_whitespace(Lexer *lexer) {
@@ -64,658 +166,432 @@ static void lexer_skip_comment(Lexer *lexer) {
     return;
   }
   /* // single-line comment — peek at next char to distinguish from divide */
-  if (lexer->current_char == '/') {
-    int next = fgetc(lexer->file);
-    if (next == '/') {
-      /* Confirmed comment: consume to end of line */
-      while (lexer->current_char != '\n' && lexer->current_char != EOF) {
-        lexer_advance(lexer);
-      }
-    } else {
-      /* Not a comment — put the char back */
-      if (next != EOF)
-        ungetc(next, lexer->file);
+  if (lexer->current_char == '/' && lexer_lookahead(lexer) == '/') {
+    while (lexer->current_char != '\n' && lexer->current_char != EOF) {
+      lexer_advance(lexer);
     }
   }
 }
 
+/* Keyword recognition: switch on the first character, then compare length
+ * before bytes, so an ordinary identifier is rejected after a handful of
+ * integer comparisons instead of walking every keyword with strcmp.
+ * size, index, count, into, value, at, as, const, map, constrain and abs are
+ * context-sensitive and stay TOK_ID. */
+#define KEYWORD(word, tok)                                                     \
+  if (length == sizeof(word) - 1 && memcmp(text, word, sizeof(word) - 1) == 0) \
+  return tok
+
+static TokenType lexer_keyword_type(const char *text, size_t length) {
+  switch (text[0]) {
+  case 'a':
+    KEYWORD("ai", TOK_AI);
+    KEYWORD("and", TOK_AND);
+    KEYWORD("arm", TOK_ARM);
+    KEYWORD("acos", TOK_ACOS);
+    KEYWORD("asin", TOK_ASIN);
+    KEYWORD("atan", TOK_ATAN);
+    KEYWORD("accel", TOK_ACCEL);
+    KEYWORD("array", TOK_ARRAY);
+    KEYWORD("atan2", TOK_ATAN2);
+    KEYWORD("audio", TOK_AUDIO);
+    KEYWORD("analog", TOK_ANALOG);
+    KEYWORD("assert", TOK_ASSERT);
+    KEYWORD("altitude", TOK_ALTITUDE);
+    break;
+  case 'b':
+    KEYWORD("by", TOK_BY);
+    KEYWORD("ble", TOK_BLE);
+    KEYWORD("baud", TOK_BAUD);
+    KEYWORD("bool", TOK_BOOL_KW);
+    KEYWORD("byte", TOK_BYTE_KW);
+    KEYWORD("begin", TOK_BEGIN);
+    KEYWORD("break", TOK_BREAK);
+    KEYWORD("buffer", TOK_BUFFER);
+    break;
+  case 'c':
+    KEYWORD("cos", TOK_COS);
+    KEYWORD("cast", TOK_CAST);
+    KEYWORD("clear", TOK_CLEAR);
+    KEYWORD("camera", TOK_CAMERA);
+    KEYWORD("change", TOK_CHANGE);
+    KEYWORD("circle", TOK_CIRCLE);
+    KEYWORD("compute", TOK_COMPUTE_KW);
+    KEYWORD("connect", TOK_CONNECT);
+    KEYWORD("changing", TOK_CHANGING);
+    KEYWORD("continue", TOK_CONTINUE);
+    break;
+  case 'd':
+    KEYWORD("def", TOK_DEF);
+    KEYWORD("draw", TOK_DRAW);
+    KEYWORD("drone", TOK_DRONE);
+    KEYWORD("define", TOK_DEFINE);
+    KEYWORD("detect", TOK_DETECT);
+    KEYWORD("device", TOK_DEVICE);
+    KEYWORD("disable", TOK_DISABLE);
+    KEYWORD("duration", TOK_DURATION);
+    break;
+  case 'e':
+    KEYWORD("esc", TOK_ESC);
+    KEYWORD("else", TOK_ELSE);
+    KEYWORD("every", TOK_EVERY);
+    KEYWORD("enable", TOK_ENABLE);
+    KEYWORD("extern", TOK_EXTERN);
+    KEYWORD("encoder", TOK_ENCODER);
+    break;
+  case 'f':
+    KEYWORD("for", TOK_FOR);
+    KEYWORD("feed", TOK_FEED);
+    KEYWORD("file", TOK_FILE);
+    KEYWORD("from", TOK_FROM);
+    KEYWORD("false", TOK_FALSE);
+    KEYWORD("float", TOK_FLOAT_KW);
+    KEYWORD("falling", TOK_FALLING);
+    KEYWORD("forever", TOK_FOREVER);
+    KEYWORD("frequency", TOK_FREQUENCY);
+    break;
+  case 'g':
+    KEYWORD("gps", TOK_GPS);
+    KEYWORD("grid", TOK_GRID);
+    KEYWORD("gyro", TOK_GYRO);
+    break;
+  case 'h':
+    KEYWORD("hz", TOK_HZ);
+    KEYWORD("high", TOK_HIGH);
+    KEYWORD("http", TOK_HTTP);
+    break;
+  case 'i':
+    KEYWORD("if", TOK_IF);
+    KEYWORD("is", TOK_IS);
+    KEYWORD("i2c", TOK_I2C);
+    KEYWORD("imu", TOK_IMU);
+    KEYWORD("int", TOK_INT_KW);
+    KEYWORD("import", TOK_INCLUDE);
+    KEYWORD("include", TOK_INCLUDE);
+    KEYWORD("interrupts", TOK_INTERRUPTS);
+    break;
+  case 'k':
+    KEYWORD("kalman", TOK_KALMAN);
+    break;
+  case 'l':
+    KEYWORD("low", TOK_LOW);
+    KEYWORD("line", TOK_LINE);
+    KEYWORD("load", TOK_LOAD);
+    KEYWORD("loop", TOK_LOOP);
+    KEYWORD("lidar", TOK_LIDAR);
+    KEYWORD("latitude", TOK_LATITUDE);
+    KEYWORD("longitude", TOK_LONGITUDE);
+    break;
+  case 'm':
+    KEYWORD("ms", TOK_MS_TOK);
+    KEYWORD("make", TOK_MAKE);
+    KEYWORD("mqtt", TOK_MQTT);
+    KEYWORD("model", TOK_MODEL);
+    KEYWORD("motor", TOK_MOTOR);
+    KEYWORD("mecanum", TOK_MECANUM);
+    break;
+  case 'n':
+    KEYWORD("not", TOK_NOT);
+    KEYWORD("notone", TOK_NOTONE);
+    break;
+  case 'o':
+    KEYWORD("of", TOK_OF);
+    KEYWORD("on", TOK_ON);
+    KEYWORD("or", TOK_OR);
+    KEYWORD("off", TOK_OFF);
+    KEYWORD("oled", TOK_OLED);
+    KEYWORD("open", TOK_OPEN);
+    KEYWORD("object", TOK_OBJECT);
+    KEYWORD("orientation", TOK_ORIENTATION);
+    break;
+  case 'p':
+    KEYWORD("pid", TOK_PID);
+    KEYWORD("pin", TOK_PIN);
+    KEYWORD("path", TOK_PATH);
+    KEYWORD("play", TOK_PLAY);
+    KEYWORD("push", TOK_PUSH);
+    KEYWORD("print", TOK_PRINT);
+    KEYWORD("pulse", TOK_PULSE);
+    KEYWORD("precise", TOK_PRECISE);
+    KEYWORD("println", TOK_PRINTLN);
+    KEYWORD("program", TOK_PROGRAM);
+    KEYWORD("publish", TOK_PUBLISH);
+    break;
+  case 'q':
+    KEYWORD("quadcopter", TOK_QUADCOPTER);
+    break;
+  case 'r':
+    KEYWORD("raw", TOK_RAW);
+    KEYWORD("read", TOK_READ);
+    KEYWORD("rect", TOK_RECT);
+    KEYWORD("repeat", TOK_REPEAT);
+    KEYWORD("return", TOK_RETURN);
+    KEYWORD("rising", TOK_RISING);
+    KEYWORD("receive", TOK_RECEIVE);
+    KEYWORD("register", TOK_REGISTER);
+    KEYWORD("radio_read", TOK_RADIO_READ);
+    KEYWORD("radio_available", TOK_RADIO_AVAILABLE);
+    KEYWORD("radio_send_peer", TOK_RADIO_SEND);
+    break;
+  case 's':
+    KEYWORD("sd", TOK_SD);
+    KEYWORD("set", TOK_SET);
+    KEYWORD("sin", TOK_SIN);
+    KEYWORD("spi", TOK_SPI);
+    KEYWORD("send", TOK_SEND);
+    KEYWORD("show", TOK_SHOW);
+    KEYWORD("sqrt", TOK_SQRT);
+    KEYWORD("stop", TOK_STOP);
+    KEYWORD("servo", TOK_SERVO);
+    KEYWORD("sound", TOK_SOUND);
+    KEYWORD("start", TOK_START);
+    KEYWORD("serial", TOK_SERIAL);
+    KEYWORD("shared", TOK_SHARED);
+    KEYWORD("stepper", TOK_STEPPER);
+    KEYWORD("subscribe", TOK_SUBSCRIBE);
+    break;
+  case 't':
+    KEYWORD("to", TOK_TO);
+    KEYWORD("tan", TOK_TAN);
+    KEYWORD("try", TOK_TRY);
+    KEYWORD("task", TOK_TASK);
+    KEYWORD("tone", TOK_TONE);
+    KEYWORD("true", TOK_TRUE);
+    KEYWORD("turn", TOK_TURN);
+    KEYWORD("type", TOK_TYPE_KW);
+    KEYWORD("timer", TOK_TIMER);
+    KEYWORD("timeout", TOK_TIMEOUT);
+    KEYWORD("transfer", TOK_TRANSFER);
+    break;
+  case 'u':
+    KEYWORD("us", TOK_US_TOK);
+    break;
+  case 'v':
+    KEYWORD("var", TOK_VAR);
+    KEYWORD("volume", TOK_VOLUME);
+    break;
+  case 'w':
+    KEYWORD("ws", TOK_WEBSOCKET);
+    KEYWORD("wait", TOK_WAIT);
+    KEYWORD("wifi", TOK_WIFI);
+    KEYWORD("while", TOK_WHILE);
+    KEYWORD("write", TOK_WRITE_KW);
+    KEYWORD("wait_us", TOK_WAIT_US);
+    KEYWORD("watchdog", TOK_WATCHDOG);
+    KEYWORD("websocket", TOK_WEBSOCKET);
+    break;
+  }
+  return TOK_ID;
+}
+
+#undef KEYWORD
+
 void lexer_next_token(Lexer *lexer) {
-  // Skip whitespace and comments FIRST
-  do {
-    lexer_skip_whitespace(lexer);
-    lexer_skip_comment(lexer);
-  } while (isspace(lexer->current_char) || lexer->current_char == '#');
+  /* Restore the character hidden behind the previous token's terminator */
+  lexer->source[lexer->saved_pos] = lexer->saved_char;
+
+  // Skip whitespace and comments FIRST; the end of one source runs
+  // straight on into the next, so nothing spans a file boundary
+  for (;;) {
+    do {
+      lexer_skip_whitespace(lexer);
+      lexer_skip_comment(lexer);
+    } while (isspace(lexer->current_char) || lexer->current_char == '#');
+    if (lexer->current_char != EOF ||
+        lexer->source_index + 1 >= lexer->source_count)
+      break;
+    lexer_enter_source(lexer, lexer->source_index + 1);
+  }
 
   lexer->current_token.line = lexer->line;
   lexer->current_token.column = lexer->column;
 
   if (lexer->current_char == EOF) {
-    lexer->current_token.type = TOK_EOF;
-    strcpy(lexer->current_token.value, "");
+    lexer_finish_token(lexer, TOK_EOF, lexer->pos);
     return;
   }
 
   // String literals
   if (lexer->current_char == '"') {
-    int i = 0;
+    size_t start;
     lexer_advance(lexer);
+    start = lexer->pos;
     while (lexer->current_char != '"' && lexer->current_char != EOF) {
-      if (i >= lexer->current_token.capacity - 2) {
-        lexer->current_token.capacity *= 2;
-        lexer->current_token.value =
-            realloc(lexer->current_token.value, lexer->current_token.capacity);
-      }
-      lexer->current_token.value[i++] = lexer->current_char;
       lexer_advance(lexer);
     }
-    lexer->current_token.value[i] = '\0';
+    /* The closing quote (or the end of the buffer) becomes the terminator */
+    lexer->current_token.type = TOK_STRING_LIT;
+    lexer->current_token.start = lexer->source + start;
+    lexer->current_token.length = lexer->pos - start;
+    lexer->current_token.value = lexer->source + start;
+    lexer->saved_pos = lexer->pos;
+    lexer->saved_char = lexer->source[lexer->pos];
+    lexer->source[lexer->pos] = '\0';
     if (lexer->current_char == '"')
       lexer_advance(lexer);
-    lexer->current_token.type = TOK_STRING_LIT;
     return;
   }
 
   // Single-character tokens
-  if (lexer->current_char == '{') {
-    lexer->current_token.type = TOK_LBRACE;
-    strcpy(lexer->current_token.value, "{");
-    lexer_advance(lexer);
+  switch (lexer->current_char) {
+  case '{':
+    lexer_single_token(lexer, TOK_LBRACE);
     return;
-  }
-  if (lexer->current_char == '}') {
-    lexer->current_token.type = TOK_RBRACE;
-    strcpy(lexer->current_token.value, "}");
-    lexer_advance(lexer);
+  case '}':
+    lexer_single_token(lexer, TOK_RBRACE);
     return;
-  }
-  if (lexer->current_char == '(') {
-    lexer->current_token.type = TOK_LPAREN;
-    strcpy(lexer->current_token.value, "(");
-    lexer_advance(lexer);
+  case '(':
+    lexer_single_token(lexer, TOK_LPAREN);
     return;
-  }
-  if (lexer->current_char == ')') {
-    lexer->current_token.type = TOK_RPAREN;
-    strcpy(lexer->current_token.value, ")");
-    lexer_advance(lexer);
+  case ')':
+    lexer_single_token(lexer, TOK_RPAREN);
     return;
-  }
-  if (lexer->current_char == '[') {
-    lexer->current_token.type = TOK_LBRACKET;
-    strcpy(lexer->current_token.value, "[");
-    lexer_advance(lexer);
+  case '[':
+    lexer_single_token(lexer, TOK_LBRACKET);
     return;
-  }
-  if (lexer->current_char == ']') {
-    lexer->current_token.type = TOK_RBRACKET;
-    strcpy(lexer->current_token.value, "]");
-    lexer_advance(lexer);
+  case ']':
+    lexer_single_token(lexer, TOK_RBRACKET);
     return;
-  }
-  if (lexer->current_char == ',') {
-    lexer->current_token.type = TOK_COMMA;
-    strcpy(lexer->current_token.value, ",");
-    lexer_advance(lexer);
+  case ',':
+    lexer_single_token(lexer, TOK_COMMA);
     return;
-  }
-  if (lexer->current_char == '+') {
-    lexer->current_token.type = TOK_PLUS;
-    strcpy(lexer->current_token.value, "+");
-    lexer_advance(lexer);
+  case '+':
+    lexer_single_token(lexer, TOK_PLUS);
     return;
-  }
-  if (lexer->current_char == ':') {
-    lexer->current_token.type = TOK_COLON;
-    strcpy(lexer->current_token.value, ":");
-    lexer_advance(lexer);
+  case ':':
+    lexer_single_token(lexer, TOK_COLON);
+    return;
+  case '*':
+    lexer_single_token(lexer, TOK_STAR);
+    return;
+  case '/':
+    lexer_single_token(lexer, TOK_SLASH);
+    return;
+  case '%':
+    lexer_single_token(lexer, TOK_MOD);
+    return;
+  /* Dot operator */
+  case '.':
+    lexer_single_token(lexer, TOK_DOT);
     return;
   }
+
   if (lexer->current_char == '-') {
+    size_t start = lexer->pos;
     lexer_advance(lexer);
     if (lexer->current_char == '>') {
-      lexer->current_token.type = TOK_ARROW;
-      strcpy(lexer->current_token.value, "->");
       lexer_advance(lexer);
+      lexer_finish_token(lexer, TOK_ARROW, start);
     } else {
-      lexer->current_token.type = TOK_MINUS;
-      strcpy(lexer->current_token.value, "-");
+      lexer_finish_token(lexer, TOK_MINUS, start);
     }
     return;
   }
-  if (lexer->current_char == '*') {
-    lexer->current_token.type = TOK_STAR;
-    strcpy(lexer->current_token.value, "*");
-    lexer_advance(lexer);
-    return;
-  }
-  if (lexer->current_char == '/') {
-    lexer->current_token.type = TOK_SLASH;
-    strcpy(lexer->current_token.value, "/");
-    lexer_advance(lexer);
-    return;
-  }
-  if (lexer->current_char == '%') {
-    lexer->current_token.type = TOK_MOD;
-    strcpy(lexer->current_token.value, "%");
-    lexer_advance(lexer);
-    return;
-  }
   if (lexer->current_char == '=') {
+    size_t start = lexer->pos;
     lexer_advance(lexer);
     if (lexer->current_char == '=') {
-      lexer->current_token.type = TOK_EQ;
-      strcpy(lexer->current_token.value, "==");
       lexer_advance(lexer);
+      lexer_finish_token(lexer, TOK_EQ, start);
     } else {
-      lexer->current_token.type = TOK_ASSIGN;
-      strcpy(lexer->current_token.value, "=");
+      lexer_finish_token(lexer, TOK_ASSIGN, start);
     }
     return;
   }
   // != operator
   if (lexer->current_char == '!') {
+    size_t start = lexer->pos;
     lexer_advance(lexer);
     if (lexer->current_char == '=') {
-      lexer->current_token.type = TOK_NEQ;
-      strcpy(lexer->current_token.value, "!=");
       lexer_advance(lexer);
+      lexer_finish_token(lexer, TOK_NEQ, start);
     } else {
       /* Lone '!' is not a valid operator — report a lexical error */
       error_report(lexer->errors, ERROR_LEXICAL, lexer->line, lexer->column,
                    "Unexpected character '!' (did you mean '!='?)");
-      lexer->current_token.type = TOK_ID;
-      strcpy(lexer->current_token.value, "!");
+      lexer_finish_token(lexer, TOK_ID, start);
     }
     return;
   }
   if (lexer->current_char == '<') {
+    size_t start = lexer->pos;
     lexer_advance(lexer);
     if (lexer->current_char == '=') {
-      lexer->current_token.type = TOK_LTE;
-      strcpy(lexer->current_token.value, "<=");
       lexer_advance(lexer);
+      lexer_finish_token(lexer, TOK_LTE, start);
     } else {
-      lexer->current_token.type = TOK_LT;
-      strcpy(lexer->current_token.value, "<");
+      lexer_finish_token(lexer, TOK_LT, start);
     }
     return;
   }
   if (lexer->current_char == '>') {
+    size_t start = lexer->pos;
     lexer_advance(lexer);
     if (lexer->current_char == '=') {
-      lexer->current_token.type = TOK_GTE;
-      strcpy(lexer->current_token.value, ">=");
       lexer_advance(lexer);
-    } else if (lexer->current_char == '-') {
-      /* Check for >-> (unlikely but guard) */
-      int peeked = fgetc(lexer->file);
-      if (peeked == '>') {
-        lexer_advance(lexer); /* consume the '-' */
-        lexer->current_token.type = TOK_ARROW;
-        strcpy(lexer->current_token.value, "->");
-        lexer_advance(lexer); /* consume the '>' */
-      } else {
-        /* It was a lone > followed by - : emit > and put '-' back */
-        if (peeked != EOF)
-          ungetc(peeked, lexer->file);
-        /* Do NOT consume the '-'; leave it for the next token */
-        lexer->current_token.type = TOK_GT;
-        strcpy(lexer->current_token.value, ">");
-      }
+      lexer_finish_token(lexer, TOK_GTE, start);
+    } else if (lexer->current_char == '-' && lexer_lookahead(lexer) == '>') {
+      /* >-> (unlikely but guard): the token is the trailing "->" */
+      start = lexer->pos;
+      lexer_advance(lexer); /* consume the '-' */
+      lexer_advance(lexer); /* consume the '>' */
+      lexer_finish_token(lexer, TOK_ARROW, start);
     } else {
-      lexer->current_token.type = TOK_GT;
-      strcpy(lexer->current_token.value, ">");
+      /* A '-' after a lone '>' is left for the next token */
+      lexer_finish_token(lexer, TOK_GT, start);
     }
     return;
   }
-  /* Dot operator */
-  if (lexer->current_char == '.') {
-    lexer->current_token.type = TOK_DOT;
-    strcpy(lexer->current_token.value, ".");
-    lexer_advance(lexer);
-    return;
-  }
-  /* Colon operator */
-  if (lexer->current_char == ':') {
-    lexer->current_token.type = TOK_COLON;
-    strcpy(lexer->current_token.value, ":");
-    lexer_advance(lexer);
-    return;
-  }
 
   // Hex literals: 0x...
   if (lexer->current_char == '0') {
-    int i = 0;
-    lexer->current_token.value[i++] = lexer->current_char;
+    size_t start = lexer->pos;
     lexer_advance(lexer);
-    if (lexer->current_char == 'x' || lexer->current_char == 'X') {
-      lexer->current_token.value[i++] = lexer->current_char;
+    if (lexer->current_char == 'x' || lexer->current_char == 'X' ||
+        lexer->current_char == 'b' || lexer->current_char == 'B') {
+      int base = (lexer->current_char == 'x' || lexer->current_char == 'X')
+                     ? 16
+                     : 2;
       lexer_advance(lexer);
-      while (isxdigit(lexer->current_char)) {
-        if (i >= lexer->current_token.capacity - 1) {
-          lexer->current_token.capacity *= 2;
-          lexer->current_token.value = realloc(lexer->current_token.value,
-                                               lexer->current_token.capacity);
-        }
-        lexer->current_token.value[i++] = lexer->current_char;
+      while (base == 16 ? isxdigit(lexer->current_char)
+                        : (lexer->current_char == '0' ||
+                           lexer->current_char == '1')) {
         lexer_advance(lexer);
       }
-      lexer->current_token.value[i] = '\0';
-      lexer->current_token.type = TOK_NUMBER;
-      // Convert hex string to decimal value in-place
-      long val = strtol(lexer->current_token.value, NULL, 16);
-
-      // Dynamic allocation for string conversion instead of fixed size 256
-      int needed_size = snprintf(NULL, 0, "%ld", val) + 1;
-      if (lexer->current_token.capacity < needed_size) {
-        lexer->current_token.capacity = needed_size;
-        lexer->current_token.value =
-            realloc(lexer->current_token.value, lexer->current_token.capacity);
-      }
-      snprintf(lexer->current_token.value, lexer->current_token.capacity, "%ld",
-               val);
+      lexer_finish_token(lexer, TOK_NUMBER, start);
+      // Convert hex/binary string to a decimal value
+      long val = strtol(lexer->current_token.start + 2, NULL, base);
+      snprintf(lexer->number_text, sizeof(lexer->number_text), "%ld", val);
+      lexer->current_token.value = lexer->number_text;
       return;
-    } else if (lexer->current_char == 'b' || lexer->current_char == 'B') {
-      lexer->current_token.value[i++] = lexer->current_char;
+    }
+    // Regular number starting with 0
+    while (isdigit(lexer->current_char) || lexer->current_char == '.') {
       lexer_advance(lexer);
-      while (lexer->current_char == '0' || lexer->current_char == '1') {
-        if (i >= lexer->current_token.capacity - 1) {
-          lexer->current_token.capacity *= 2;
-          lexer->current_token.value = realloc(lexer->current_token.value,
-                                               lexer->current_token.capacity);
-        }
-        lexer->current_token.value[i++] = lexer->current_char;
-        lexer_advance(lexer);
-      }
-      lexer->current_token.value[i] = '\0';
-      lexer->current_token.type = TOK_NUMBER;
-      long val = strtol(lexer->current_token.value + 2, NULL, 2);
-
-      int needed_size = snprintf(NULL, 0, "%ld", val) + 1;
-      if (lexer->current_token.capacity < needed_size) {
-        lexer->current_token.capacity = needed_size;
-        lexer->current_token.value =
-            realloc(lexer->current_token.value, lexer->current_token.capacity);
-      }
-      snprintf(lexer->current_token.value, lexer->current_token.capacity, "%ld",
-               val);
-      return;
-    } else {
-      // Regular number starting with 0
-      while (isdigit(lexer->current_char) || lexer->current_char == '.') {
-        if (i >= lexer->current_token.capacity - 1) {
-          lexer->current_token.capacity *= 2;
-          lexer->current_token.value = realloc(lexer->current_token.value,
-                                               lexer->current_token.capacity);
-        }
-        lexer->current_token.value[i++] = lexer->current_char;
-        lexer_advance(lexer);
-      }
-      lexer->current_token.value[i] = '\0';
-      lexer->current_token.type = TOK_NUMBER;
-      return;
     }
+    lexer_finish_token(lexer, TOK_NUMBER, start);
+    return;
   }
 
   /* Decimal numbers starting with 1-9 */
   if (isdigit(lexer->current_char)) {
-    int i = 0;
+    size_t start = lexer->pos;
     while (isdigit(lexer->current_char) || lexer->current_char == '.') {
-      if (i >= lexer->current_token.capacity - 1) {
-        lexer->current_token.capacity *= 2;
-        lexer->current_token.value =
-            realloc(lexer->current_token.value, lexer->current_token.capacity);
-      }
-      lexer->current_token.value[i++] = lexer->current_char;
       lexer_advance(lexer);
     }
-    lexer->current_token.value[i] = '\0';
-    lexer->current_token.type = TOK_NUMBER;
+    lexer_finish_token(lexer, TOK_NUMBER, start);
     return;
   }
 
   if (isalpha(lexer->current_char) || lexer->current_char == '_') {
-    int i = 0;
+    size_t start = lexer->pos;
     while (isalnum(lexer->current_char) || lexer->current_char == '_') {
-      if (i >= lexer->current_token.capacity - 2) {
-        lexer->current_token.capacity *= 2;
-        lexer->current_token.value =
-            realloc(lexer->current_token.value, lexer->current_token.capacity);
-      }
-      lexer->current_token.value[i++] = lexer->current_char;
       lexer_advance(lexer);
     }
-    lexer->current_token.value[i] = '\0';
-
-    // ---- keyword table ----
-    const char *v = lexer->current_token.value;
-    if (!strcmp(v, "program"))
-      lexer->current_token.type = TOK_PROGRAM;
-    else if (!strcmp(v, "extern"))
-      lexer->current_token.type = TOK_EXTERN;
-    else if (!strcmp(v, "def"))
-      lexer->current_token.type = TOK_DEF;
-    else if (!strcmp(v, "repeat"))
-      lexer->current_token.type = TOK_REPEAT;
-    else if (!strcmp(v, "loop"))
-      lexer->current_token.type = TOK_LOOP;
-    else if (!strcmp(v, "turn"))
-      lexer->current_token.type = TOK_TURN;
-    else if (!strcmp(v, "on"))
-      lexer->current_token.type = TOK_ON;
-    else if (!strcmp(v, "off"))
-      lexer->current_token.type = TOK_OFF;
-    else if (!strcmp(v, "wait"))
-      lexer->current_token.type = TOK_WAIT;
-    else if (!strcmp(v, "wait_us"))
-      lexer->current_token.type = TOK_WAIT_US;
-    else if (!strcmp(v, "forever"))
-      lexer->current_token.type = TOK_FOREVER;
-    else if (!strcmp(v, "if"))
-      lexer->current_token.type = TOK_IF;
-    else if (!strcmp(v, "else"))
-      lexer->current_token.type = TOK_ELSE;
-    else if (!strcmp(v, "make"))
-      lexer->current_token.type = TOK_MAKE;
-    else if (!strcmp(v, "var"))
-      lexer->current_token.type = TOK_VAR;
-    else if (!strcmp(v, "set"))
-      lexer->current_token.type = TOK_SET;
-    else if (!strcmp(v, "change"))
-      lexer->current_token.type = TOK_CHANGE;
-    else if (!strcmp(v, "to"))
-      lexer->current_token.type = TOK_TO;
-    else if (!strcmp(v, "by"))
-      lexer->current_token.type = TOK_BY;
-    else if (!strcmp(v, "read"))
-      lexer->current_token.type = TOK_READ;
-    else if (!strcmp(v, "write"))
-      lexer->current_token.type = TOK_WRITE_KW;
-    else if (!strcmp(v, "analog"))
-      lexer->current_token.type = TOK_ANALOG;
-    else if (!strcmp(v, "pulse"))
-      lexer->current_token.type = TOK_PULSE;
-    else if (!strcmp(v, "serial"))
-      lexer->current_token.type = TOK_SERIAL;
-    else if (!strcmp(v, "servo"))
-      lexer->current_token.type = TOK_SERVO;
-    else if (!strcmp(v, "print"))
-      lexer->current_token.type = TOK_PRINT;
-    else if (!strcmp(v, "println"))
-      lexer->current_token.type = TOK_PRINTLN;
-    else if (!strcmp(v, "tone"))
-      lexer->current_token.type = TOK_TONE;
-    else if (!strcmp(v, "notone"))
-      lexer->current_token.type = TOK_NOTONE;
-    else if (!strcmp(v, "return"))
-      lexer->current_token.type = TOK_RETURN;
-    else if (!strcmp(v, "while"))
-      lexer->current_token.type = TOK_WHILE;
-    else if (!strcmp(v, "for"))
-      lexer->current_token.type = TOK_FOR;
-    else if (!strcmp(v, "from"))
-      lexer->current_token.type = TOK_FROM;
-    else if (!strcmp(v, "break"))
-      lexer->current_token.type = TOK_BREAK;
-    else if (!strcmp(v, "array"))
-      lexer->current_token.type = TOK_ARRAY;
-    else if (!strcmp(v, "buffer"))
-      lexer->current_token.type = TOK_BUFFER;
-    else if (!strcmp(v, "push"))
-      lexer->current_token.type = TOK_PUSH;
-    /* size, index, count, into, value, start, stop, at, as — context-sensitive,
-     * kept as TOK_ID */
-    else if (!strcmp(v, "of"))
-      lexer->current_token.type = TOK_OF;
-    else if (!strcmp(v, "i2c"))
-      lexer->current_token.type = TOK_I2C;
-    else if (!strcmp(v, "spi"))
-      lexer->current_token.type = TOK_SPI;
-    else if (!strcmp(v, "begin"))
-      lexer->current_token.type = TOK_BEGIN;
-    else if (!strcmp(v, "start"))
-      lexer->current_token.type = TOK_START;
-    else if (!strcmp(v, "send"))
-      lexer->current_token.type = TOK_SEND;
-    else if (!strcmp(v, "stop"))
-      lexer->current_token.type = TOK_STOP;
-    else if (!strcmp(v, "open"))
-      lexer->current_token.type = TOK_OPEN;
-    else if (!strcmp(v, "baud"))
-      lexer->current_token.type = TOK_BAUD;
-    else if (!strcmp(v, "hz"))
-      lexer->current_token.type = TOK_HZ;
-    else if (!strcmp(v, "transfer"))
-      lexer->current_token.type = TOK_TRANSFER;
-    else if (!strcmp(v, "receive"))
-      lexer->current_token.type = TOK_RECEIVE;
-    else if (!strcmp(v, "device"))
-      lexer->current_token.type = TOK_DEVICE;
-    else if (!strcmp(v, "register"))
-      lexer->current_token.type = TOK_REGISTER;
-    else if (!strcmp(v, "pin"))
-      lexer->current_token.type = TOK_PIN;
-    else if (!strcmp(v, "is"))
-      lexer->current_token.type = TOK_IS;
-    else if (!strcmp(v, "high"))
-      lexer->current_token.type = TOK_HIGH;
-    else if (!strcmp(v, "low"))
-      lexer->current_token.type = TOK_LOW;
-    else if (!strcmp(v, "sin"))
-      lexer->current_token.type = TOK_SIN;
-    else if (!strcmp(v, "cos"))
-      lexer->current_token.type = TOK_COS;
-    else if (!strcmp(v, "tan"))
-      lexer->current_token.type = TOK_TAN;
-    else if (!strcmp(v, "and"))
-      lexer->current_token.type = TOK_AND;
-    else if (!strcmp(v, "or"))
-      lexer->current_token.type = TOK_OR;
-    else if (!strcmp(v, "sqrt"))
-      lexer->current_token.type = TOK_SQRT;
-    else if (!strcmp(v, "asin"))
-      lexer->current_token.type = TOK_ASIN;
-    else if (!strcmp(v, "acos"))
-      lexer->current_token.type = TOK_ACOS;
-    else if (!strcmp(v, "atan"))
-      lexer->current_token.type = TOK_ATAN;
-    else if (!strcmp(v, "atan2"))
-      lexer->current_token.type = TOK_ATAN2;
-    else if (!strcmp(v, "include"))
-      lexer->current_token.type = TOK_INCLUDE;
-    else if (!strcmp(v, "import"))
-      lexer->current_token.type = TOK_INCLUDE;
-    /* V3.0 explicit types */
-    else if (!strcmp(v, "int"))
-      lexer->current_token.type = TOK_INT_KW;
-    else if (!strcmp(v, "float"))
-      lexer->current_token.type = TOK_FLOAT_KW;
-    else if (!strcmp(v, "bool"))
-      lexer->current_token.type = TOK_BOOL_KW;
-    else if (!strcmp(v, "byte"))
-      lexer->current_token.type = TOK_BYTE_KW;
-    else if (!strcmp(v, "cast"))
-      lexer->current_token.type = TOK_CAST;
-    else if (!strcmp(v, "true"))
-      lexer->current_token.type = TOK_TRUE;
-    else if (!strcmp(v, "false"))
-      lexer->current_token.type = TOK_FALSE;
-    /* V3.0 interrupt */
-    else if (!strcmp(v, "rising"))
-      lexer->current_token.type = TOK_RISING;
-    else if (!strcmp(v, "falling"))
-      lexer->current_token.type = TOK_FALLING;
-    else if (!strcmp(v, "changing"))
-      lexer->current_token.type = TOK_CHANGING;
-    else if (!strcmp(v, "timer"))
-      lexer->current_token.type = TOK_TIMER;
-    else if (!strcmp(v, "every"))
-      lexer->current_token.type = TOK_EVERY;
-    else if (!strcmp(v, "us"))
-      lexer->current_token.type = TOK_US_TOK;
-    else if (!strcmp(v, "ms"))
-      lexer->current_token.type = TOK_MS_TOK;
-    /* V3.0 error handling */
-    else if (!strcmp(v, "try"))
-      lexer->current_token.type = TOK_TRY;
-    else if (!strcmp(v, "enable"))
-      lexer->current_token.type = TOK_ENABLE;
-    else if (!strcmp(v, "watchdog"))
-      lexer->current_token.type = TOK_WATCHDOG;
-    else if (!strcmp(v, "feed"))
-      lexer->current_token.type = TOK_FEED;
-    else if (!strcmp(v, "assert"))
-      lexer->current_token.type = TOK_ASSERT;
-    else if (!strcmp(v, "timeout"))
-      lexer->current_token.type = TOK_TIMEOUT;
-    else if (!strcmp(v, "disable"))
-      lexer->current_token.type = TOK_DISABLE;
-    else if (!strcmp(v, "interrupts"))
-      lexer->current_token.type = TOK_INTERRUPTS;
-    /* V3.0 structs/define */
-    else if (!strcmp(v, "define"))
-      lexer->current_token.type = TOK_DEFINE;
-    else if (!strcmp(v, "type"))
-      lexer->current_token.type = TOK_TYPE_KW;
-    /* V3.0 concurrency */
-    else if (!strcmp(v, "task"))
-      lexer->current_token.type = TOK_TASK;
-    else if (!strcmp(v, "shared"))
-      lexer->current_token.type = TOK_SHARED;
-    /* V3.0 explicit types */
-    else if (!strcmp(v, "continue"))
-      lexer->current_token.type = TOK_CONTINUE;
-    else if (!strcmp(v, "radio_send_peer"))
-      lexer->current_token.type = TOK_RADIO_SEND;
-    else if (!strcmp(v, "radio_available"))
-      lexer->current_token.type = TOK_RADIO_AVAILABLE;
-    else if (!strcmp(v, "radio_read"))
-      lexer->current_token.type = TOK_RADIO_READ;
-    /* Wave 2 Wrappers */
-    else if (!strcmp(v, "stepper"))
-      lexer->current_token.type = TOK_STEPPER;
-    else if (!strcmp(v, "motor"))
-      lexer->current_token.type = TOK_MOTOR;
-    else if (!strcmp(v, "encoder"))
-      lexer->current_token.type = TOK_ENCODER;
-    else if (!strcmp(v, "esc"))
-      lexer->current_token.type = TOK_ESC;
-    else if (!strcmp(v, "pid"))
-      lexer->current_token.type = TOK_PID;
-    /* Wave 3 Wrappers */
-    else if (!strcmp(v, "connect"))
-      lexer->current_token.type = TOK_CONNECT;
-    else if (!strcmp(v, "ble"))
-      lexer->current_token.type = TOK_BLE;
-    else if (!strcmp(v, "wifi"))
-      lexer->current_token.type = TOK_WIFI;
-    else if (!strcmp(v, "mqtt"))
-      lexer->current_token.type = TOK_MQTT;
-    else if (!strcmp(v, "http"))
-      lexer->current_token.type = TOK_HTTP;
-    else if (!strcmp(v, "websocket") || !strcmp(v, "ws"))
-      lexer->current_token.type = TOK_WEBSOCKET;
-    else if (!strcmp(v, "subscribe"))
-      lexer->current_token.type = TOK_SUBSCRIBE;
-    else if (!strcmp(v, "publish"))
-      lexer->current_token.type = TOK_PUBLISH;
-    /* Wave 4 Navigation/Storage */
-    else if (!strcmp(v, "imu"))
-      lexer->current_token.type = TOK_IMU;
-    else if (!strcmp(v, "accel"))
-      lexer->current_token.type = TOK_ACCEL;
-    else if (!strcmp(v, "gyro"))
-      lexer->current_token.type = TOK_GYRO;
-    else if (!strcmp(v, "orientation"))
-      lexer->current_token.type = TOK_ORIENTATION;
-    else if (!strcmp(v, "gps"))
-      lexer->current_token.type = TOK_GPS;
-    else if (!strcmp(v, "latitude"))
-      lexer->current_token.type = TOK_LATITUDE;
-    else if (!strcmp(v, "longitude"))
-      lexer->current_token.type = TOK_LONGITUDE;
-    else if (!strcmp(v, "altitude"))
-      lexer->current_token.type = TOK_ALTITUDE;
-    else if (!strcmp(v, "lidar"))
-      lexer->current_token.type = TOK_LIDAR;
-    else if (!strcmp(v, "precise"))
-      lexer->current_token.type = TOK_PRECISE;
-    else if (!strcmp(v, "sd"))
-      lexer->current_token.type = TOK_SD;
-    else if (!strcmp(v, "file"))
-      lexer->current_token.type = TOK_FILE;
-    /* Wave 5: Output Systems & Edge AI Vision */
-    else if (!strcmp(v, "oled"))
-      lexer->current_token.type = TOK_OLED;
-    else if (!strcmp(v, "draw"))
-      lexer->current_token.type = TOK_DRAW;
-    else if (!strcmp(v, "circle"))
-      lexer->current_token.type = TOK_CIRCLE;
-    else if (!strcmp(v, "rect"))
-      lexer->current_token.type = TOK_RECT;
-    else if (!strcmp(v, "line"))
-      lexer->current_token.type = TOK_LINE;
-    else if (!strcmp(v, "show"))
-      lexer->current_token.type = TOK_SHOW;
-    else if (!strcmp(v, "clear"))
-      lexer->current_token.type = TOK_CLEAR;
-    else if (!strcmp(v, "audio"))
-      lexer->current_token.type = TOK_AUDIO;
-    else if (!strcmp(v, "play"))
-      lexer->current_token.type = TOK_PLAY;
-    else if (!strcmp(v, "frequency"))
-      lexer->current_token.type = TOK_FREQUENCY;
-    else if (!strcmp(v, "duration"))
-      lexer->current_token.type = TOK_DURATION;
-    else if (!strcmp(v, "sound"))
-      lexer->current_token.type = TOK_SOUND;
-    else if (!strcmp(v, "volume"))
-      lexer->current_token.type = TOK_VOLUME;
-    else if (!strcmp(v, "camera"))
-      lexer->current_token.type = TOK_CAMERA;
-    else if (!strcmp(v, "detect"))
-      lexer->current_token.type = TOK_DETECT;
-    else if (!strcmp(v, "object"))
-      lexer->current_token.type = TOK_OBJECT;
-    /* Wave 6 Keywords */
-    else if (!strcmp(v, "mecanum"))
-      lexer->current_token.type = TOK_MECANUM;
-    else if (!strcmp(v, "kalman"))
-      lexer->current_token.type = TOK_KALMAN;
-    else if (!strcmp(v, "ai"))
-      lexer->current_token.type = TOK_AI;
-    else if (!strcmp(v, "model"))
-      lexer->current_token.type = TOK_MODEL;
-    else if (!strcmp(v, "raw"))
-      lexer->current_token.type = TOK_RAW;
-    else if (!strcmp(v, "compute"))
-      lexer->current_token.type = TOK_COMPUTE_KW;
-    else if (!strcmp(v, "load"))
-      lexer->current_token.type = TOK_LOAD;
-    /* Wave 7: The Master Automaton */
-    else if (!strcmp(v, "arm"))
-      lexer->current_token.type = TOK_ARM;
-    else if (!strcmp(v, "quadcopter"))
-      lexer->current_token.type = TOK_QUADCOPTER;
-    else if (!strcmp(v, "drone"))
-      lexer->current_token.type = TOK_DRONE;
-    else if (!strcmp(v, "grid"))
-      lexer->current_token.type = TOK_GRID;
-    else if (!strcmp(v, "path"))
-      lexer->current_token.type = TOK_PATH;
-    /* V3.0 handled as TOK_ID in parser */
-    else if (!strcmp(v, "not"))
-      lexer->current_token.type = TOK_NOT;
-    else if (!strcmp(v, "const"))
-      lexer->current_token.type = TOK_ID;
-    else if (!strcmp(v, "map"))
-      lexer->current_token.type = TOK_ID;
-    else if (!strcmp(v, "constrain"))
-      lexer->current_token.type = TOK_ID;
-    else if (!strcmp(v, "abs"))
-      lexer->current_token.type = TOK_ID;
-    else
-      lexer->current_token.type = TOK_ID;
+    lexer_finish_token(lexer,
+                       lexer_keyword_type(lexer->source + start,
+                                          lexer->pos - start),
+                       start);
 
     return;
   }
@@ -731,26 +607,208 @@ void lexer_next_token(Lexer *lexer) {
 
 Token lexer_peek(Lexer *lexer) { return lexer->current_token; }
 
+void lexer_skip_source(Lexer *lexer) {
+  lexer->source[lexer->saved_pos] = lexer->saved_char;
+  lexer->saved_pos = lexer->pos = lexer->length;
+  lexer->saved_char = '\0';
+  lexer->current_char = EOF;
+  lexer_next_token(lexer);
+}
+
+uint64_t lexer_source_hash(Lexer *lexer, int index) {
+  LexerSource *src = &lexer->sources[index];
+  if (index != lexer->source_index)
+    return module_cache_hash(src->text, src->length);
+  /* Put back the byte hidden by the current token's terminator meanwhile */
+  char terminator = src->text[lexer->saved_pos];
+  src->text[lexer->saved_pos] = lexer->saved_char;
+  uint64_t hash = module_cache_hash(src->text, src->length);
+  src->text[lexer->saved_pos] = terminator;
+  return hash;
+}
+
 // ============================================================================
 // PARSER IMPLEMENTATION
 // ============================================================================
 
-Parser *parser_create(FILE *file, const char *file_path, ErrorList *errors) {
+// ============================================================================
+// INCLUDE-ONCE
+// ============================================================================
+
+/* A file taken into the compilation. It is known by canonical path and,
+ * where the platform has them, by device and inode, so a library reached
+ * through different relative paths, symlinks or hard links is one file. */
+typedef struct {
+  char *path;
+  unsigned long long device;
+  unsigned long long inode; /* 0 where there are no inode numbers */
+} IncludedFile;
+
+typedef struct IncludeSet {
+  IncludedFile *files;
+  int count;
+  int capacity;
+} IncludeSet;
+
+/* Resolve `path`; returns 0 if it does not name an existing file */
+static int identify_file(const char *path, IncludedFile *id) {
+#ifdef _WIN32
+  id->path = _fullpath(NULL, path, 0);
+  id->device = 0;
+  id->inode = 0;
+  return id->path != NULL;
+#else
+  struct stat info;
+  id->path = realpath(path, NULL);
+  if (id->path == NULL || stat(id->path, &info) != 0) {
+    free(id->path);
+    return 0;
+  }
+  id->device = (unsigned long long)info.st_dev;
+  id->inode = (unsigned long long)info.st_ino;
+  return 1;
+#endif
+}
+
+/* Index of `id` in the set, or -1 */
+static int include_set_find(const IncludeSet *set, const IncludedFile *id) {
+  for (int i = 0; i < set->count; i++) {
+    const IncludedFile *seen = &set->files[i];
+    if (id->inode ? seen->device == id->device && seen->inode == id->inode
+                  : strcmp(seen->path, id->path) == 0)
+      return i;
+  }
+  return -1;
+}
+
+/* Add `id` (which must not be in the set yet), taking its path; returns
+ * its index */
+static int include_set_add(IncludeSet *set, IncludedFile *id) {
+  if (set->count == set->capacity) {
+    set->capacity = set->capacity ? set->capacity * 2 : 16;
+    set->files = realloc(set->files, sizeof(IncludedFile) * set->capacity);
+  }
+  set->files[set->count] = *id;
+  id->path = NULL;
+  return set->count++;
+}
+
+static void include_set_free(IncludeSet *set) {
+  if (set == NULL)
+    return;
+  for (int i = 0; i < set->count; i++)
+    free(set->files[i].path);
+  free(set->files);
+  free(set);
+}
+
+/* Take the files a cached block was built from into the set. Returns 0,
+ * adding nothing, if one of them is already there: the block would repeat
+ * its statements. */
+static int claim_included(Parser *parser, const CacheDeps *deps) {
+  IncludeSet *set = parser->included;
+  int start = set->count;
+  for (int i = 0; i < deps->count; i++) {
+    IncludedFile id;
+    if (!identify_file(deps->items[i].path, &id))
+      continue;
+    int index = include_set_find(set, &id);
+    if (index >= 0 && index < start) {
+      free(id.path);
+      for (int j = start; j < set->count; j++)
+        free(set->files[j].path);
+      set->count = start;
+      return 0;
+    }
+    if (index < 0)
+      include_set_add(set, &id);
+    else
+      free(id.path);
+  }
+  return 1;
+}
+
+static Parser *parser_create_in(const SourceFile *files, int count,
+                                ErrorList *errors, Arena *arena,
+                                StringPool *strings, int owns_arena) {
   Parser *parser = malloc(sizeof(Parser));
-  parser->lexer = lexer_create(file, file_path, errors);
-  parser->symbols = symbol_table_create();
+  parser->arena = arena;
+  parser->strings = strings;
+  parser->owns_arena = owns_arena;
+  parser->cache = NULL;
+  parser->deps = NULL;
+  parser->included = owns_arena ? calloc(1, sizeof(IncludeSet)) : NULL;
+  parser->skipped_from = INT_MAX;
+  ast_set_arena(arena);
+  ast_set_string_pool(strings);
+  parser->lexer = lexer_create_multi(files, count, errors, strings);
+  parser->symbols = symbol_table_create(strings);
+  parser->symbols->errors = errors;
   parser->errors = errors;
   parser->in_loop = 0;
   parser->in_function = 0;
   return parser;
 }
 
+Parser *parser_create(FILE *file, const char *file_path, ErrorList *errors) {
+  SourceFile only = {file, file_path, NULL, 0};
+  return parser_create_multi(&only, 1, errors);
+}
+
+Parser *parser_create_multi(const SourceFile *files, int count,
+                            ErrorList *errors) {
+  return parser_create_in(files, count, errors, arena_create(0),
+                          string_pool_create(), 1);
+}
+
+Parser *parser_create_child(FILE *file, const char *file_path,
+                            Parser *parent) {
+  SourceFile only = {file, file_path, NULL, 0};
+  Parser *child = parser_create_in(&only, 1, parent->errors, parent->arena,
+                                   parent->strings, 0);
+  child->cache = parent->cache;
+  child->included = parent->included;
+  return child;
+}
+
+void parser_set_cache(Parser *parser, ModuleCache *cache) {
+  parser->cache = cache;
+}
+
 void parser_free(Parser *parser) {
   lexer_free(parser->lexer);
+  /* Symbol types were cloned into the arena; keep it installed while the
+   * table is torn down so type_free() leaves them alone. */
+  Arena *previous = ast_get_arena();
+  ast_set_arena(parser->arena);
   symbol_table_free(parser->symbols);
+  ast_set_arena(previous);
+  if (parser->owns_arena) {
+    if (previous == parser->arena) {
+      ast_set_arena(NULL);
+      ast_set_string_pool(NULL);
+    }
+    arena_destroy(parser->arena);
+    string_pool_free(parser->strings);
+    include_set_free(parser->included);
+  }
   free(parser);
 }
 
+/* Double an arena-backed array currently holding `capacity` elements */
+static void *parser_grow_array(void *array, size_t elem_size, int capacity) {
+  return ast_realloc(array, elem_size * capacity, elem_size * capacity * 2);
+}
+
+/* Stable copy of a token's text. Identifiers are already interned by the
+ * lexer; anything else is a slice of the source buffer that is only
+ * terminated until the next token, so it is copied into the arena. */
+static char *token_text(const Token *tok) {
+  if (tok->type == TOK_ID)
+    return tok->value;
+  return ast_strdup(tok->value);
+}
+
 int parser_match(Parser *parser, TokenType type) {
   return parser->lexer->current_token.type == type;
 }
@@ -1089,7 +1147,7 @@ static ASTNode *clone_target(ASTNode *node);
 // Parse primary expression
 static ASTNode *parse_primary(Parser *parser) {
   Token tok = parser->lexer->current_token;
-  tok.value = strdup(tok.value);
+  tok.value = token_text(&tok);
 
   // Unary Minus
   if (parser_match(parser, TOK_MINUS)) {
@@ -1162,14 +1220,14 @@ static ASTNode *parse_primary(Parser *parser) {
   }
 
   if (parser_match(parser, TOK_ID)) {
-    char *name = strdup(tok.value);
+    char *name = tok.value;
     lexer_next_token(parser->lexer);
 
     /* Mark variable as used semantic */
     symbol_table_lookup(parser->symbols, name);
 
     // map(value, fromLow, fromHigh, toLow, toHigh)
-    if (strcmp(name, "map") == 0) {
+    if (name == intern_builtin(ATOM_MAP)) {
       parser_expect(parser, TOK_LPAREN);
       ASTNode *v = parse_expression(parser);
       parser_expect(parser, TOK_COMMA);
@@ -1181,18 +1239,17 @@ static ASTNode *parse_primary(Parser *parser) {
       parser_expect(parser, TOK_COMMA);
       ASTNode *th = parse_expression(parser);
       parser_expect(parser, TOK_RPAREN);
-      ASTNode **args = malloc(sizeof(ASTNode *) * 5);
+      ASTNode **args = ast_alloc(sizeof(ASTNode *) * 5);
       args[0] = v;
       args[1] = fl;
       args[2] = fh;
       args[3] = tl;
       args[4] = th;
-      free(name);
-      return ast_call("map", args, 5);
+      return ast_call(intern_builtin(ATOM_MAP), args, 5);
     }
 
     // constrain(value, min, max)
-    if (strcmp(name, "constrain") == 0) {
+    if (name == intern_builtin(ATOM_CONSTRAIN)) {
       parser_expect(parser, TOK_LPAREN);
       ASTNode *v = parse_expression(parser);
       parser_expect(parser, TOK_COMMA);
@@ -1200,41 +1257,39 @@ static ASTNode *parse_primary(Parser *parser) {
       parser_expect(parser, TOK_COMMA);
       ASTNode *mx = parse_expression(parser);
       parser_expect(parser, TOK_RPAREN);
-      ASTNode **args = malloc(sizeof(ASTNode *) * 3);
+      ASTNode **args = ast_alloc(sizeof(ASTNode *) * 3);
       args[0] = v;
       args[1] = mn;
       args[2] = mx;
-      free(name);
-      return ast_call("constrain", args, 3);
+      return ast_call(intern_builtin(ATOM_CONSTRAIN), args, 3);
     }
 
     // abs(value)
-    if (strcmp(name, "abs") == 0) {
+    if (name == intern_builtin(ATOM_ABS)) {
       parser_expect(parser, TOK_LPAREN);
       ASTNode *v = parse_expression(parser);
       parser_expect(parser, TOK_RPAREN);
-      ASTNode **args = malloc(sizeof(ASTNode *) * 1);
+      ASTNode **args = ast_alloc(sizeof(ASTNode *) * 1);
       args[0] = v;
-      free(name);
-      return ast_call("abs", args, 1);
+      return ast_call(intern_builtin(ATOM_ABS), args, 1);
     }
 
     // random(min, max)
-    if (strcmp(name, "random") == 0) {
+    if (name == intern_builtin(ATOM_RANDOM)) {
       parser_expect(parser, TOK_LPAREN);
       ASTNode *mn = parse_expression(parser);
       parser_expect(parser, TOK_COMMA);
       ASTNode *mx = parse_expression(parser);
       parser_expect(parser, TOK_RPAREN);
-      ASTNode **args = malloc(sizeof(ASTNode *) * 2);
+      ASTNode **args = ast_alloc(sizeof(ASTNode *) * 2);
       args[0] = mn;
       args[1] = mx;
-      free(name);
-      return ast_call("random", args, 2);
+      return ast_call(intern_builtin(ATOM_RANDOM), args, 2);
     }
 
     // min(a, b) and max(a, b)
-    if (strcmp(name, "min") == 0 || strcmp(name, "max") == 0) {
+    if (name == intern_builtin(ATOM_MIN) ||
+        name == intern_builtin(ATOM_MAX)) {
       char fname[8];
       strcpy(fname, name);
       parser_expect(parser, TOK_LPAREN);
@@ -1242,10 +1297,9 @@ static ASTNode *parse_primary(Parser *parser) {
       parser_expect(parser, TOK_COMMA);
       ASTNode *b = parse_expression(parser);
       parser_expect(parser, TOK_RPAREN);
-      ASTNode **args = malloc(sizeof(ASTNode *) * 2);
+      ASTNode **args = ast_alloc(sizeof(ASTNode *) * 2);
       args[0] = a;
       args[1] = b;
-      free(name);
       return ast_call(fname, args, 2);
     }
 
@@ -1256,13 +1310,13 @@ static ASTNode *parse_primary(Parser *parser) {
       int arg_count = 0;
       if (!parser_match(parser, TOK_RPAREN)) {
         int args_capacity = 4;
-        args = malloc(sizeof(ASTNode *) * args_capacity);
+        args = ast_alloc(sizeof(ASTNode *) * args_capacity);
         args[arg_count++] = parse_expression(parser);
         while (parser_match(parser, TOK_COMMA)) {
           lexer_next_token(parser->lexer);
           if (arg_count >= args_capacity) {
+            args = parser_grow_array(args, sizeof(ASTNode *), args_capacity);
             args_capacity *= 2;
-            args = realloc(args, sizeof(ASTNode *) * args_capacity);
           }
           args[arg_count++] = parse_expression(parser);
         }
@@ -1286,7 +1340,7 @@ static ASTNode *parse_primary(Parser *parser) {
     while (parser_match(parser, TOK_DOT)) {
       lexer_next_token(parser->lexer);
       Token member_tok = parser->lexer->current_token;
-      member_tok.value = strdup(member_tok.value);
+      member_tok.value = token_text(&member_tok);
       /* consume member name (may be any token with a string value) */
       lexer_next_token(parser->lexer);
       base = ast_struct_access(base, member_tok.value);
@@ -1403,7 +1457,7 @@ static ASTNode *parse_primary(Parser *parser) {
           lexer_next_token(parser->lexer);
         }
         Token arr_tok = parser->lexer->current_token;
-        arr_tok.value = strdup(arr_tok.value);
+        arr_tok.value = token_text(&arr_tok);
         parser_expect(parser, TOK_ID);
         return ast_i2c_device_read_array(addr, reg, count, arr_tok.value);
       }
@@ -1549,7 +1603,7 @@ static ASTNode *parse_primary(Parser *parser) {
     if (parser_match(parser, TOK_ID)) {
       /* read <devicename>  OR  read <devicename> register <reg> */
       Token dev_tok = parser->lexer->current_token;
-      dev_tok.value = strdup(dev_tok.value);
+      dev_tok.value = token_text(&dev_tok);
       lexer_next_token(parser->lexer);
       ASTNode *reg = NULL;
       if (parser_match(parser, TOK_REGISTER)) {
@@ -1734,34 +1788,71 @@ static ASTNode *parse_expression(Parser *parser) {
   return left;
 }
 
-// Parse statement
-static ASTNode *parse_statement(Parser *parser) {
-  /* ---- make … (all forms) ---- */
-  if (parser_match(parser, TOK_MAKE)) {
-    lexer_next_token(parser->lexer);
+// Statement parsers: each is entered with its leading token current and
+// returns the parsed node, or NULL when the statement is not recognised.
 
-    /* Wave 7: make grid name size WxH */
-    if (parser_match(parser, TOK_GRID)) {
+/* ---- make … (all forms) ---- */
+static ASTNode *parse_make_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+
+  /* Wave 7: make grid name size WxH */
+  if (parser_match(parser, TOK_GRID)) {
+    lexer_next_token(parser->lexer);
+    Token name_tok = parser->lexer->current_token;
+    name_tok.value = token_text(&name_tok);
+    parser_expect(parser, TOK_ID);
+    parser_expect_id(parser, "size");
+    ASTNode *width = parse_expression(parser);
+    /* Accept optional 'x' separator: size 10x10 or size 10 10 */
+    if (parser_match_id(parser, "x")) {
       lexer_next_token(parser->lexer);
-      Token name_tok = parser->lexer->current_token;
-      name_tok.value = strdup(name_tok.value);
-      parser_expect(parser, TOK_ID);
-      parser_expect_id(parser, "size");
-      ASTNode *width = parse_expression(parser);
-      /* Accept optional 'x' separator: size 10x10 or size 10 10 */
-      if (parser_match_id(parser, "x")) {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *height = parse_expression(parser);
-      return ast_grid_create(name_tok.value, width, height);
     }
+    ASTNode *height = parse_expression(parser);
+    return ast_grid_create(name_tok.value, width, height);
+  }
 
-    /* make array <type> <name>[<size>]    OR
-       make array <name>[<size>] of <type> */
-    if (parser_match(parser, TOK_ARRAY)) {
+  /* make array <type> <name>[<size>]    OR
+     make array <name>[<size>] of <type> */
+  if (parser_match(parser, TOK_ARRAY)) {
+    lexer_next_token(parser->lexer);
+    /* optional type keyword */
+    Type *elem_type = type_float();
+    if (parser_match(parser, TOK_INT_KW)) {
+      elem_type = type_int();
+      lexer_next_token(parser->lexer);
+    } else if (parser_match(parser, TOK_FLOAT_KW)) {
+      elem_type = type_float();
+      lexer_next_token(parser->lexer);
+    } else if (parser_match(parser, TOK_BOOL_KW)) {
+      elem_type = type_bool();
+      lexer_next_token(parser->lexer);
+    } else if (parser_match(parser, TOK_BYTE_KW)) {
+      elem_type = type_byte();
+      lexer_next_token(parser->lexer);
+    }
+    Token name_tok = parser->lexer->current_token;
+    name_tok.value = token_text(&name_tok);
+    parser_expect(parser, TOK_ID);
+    int sz = 0;
+    if (parser_match(parser, TOK_LBRACKET)) {
+      /* make array name[N] syntax */
+      lexer_next_token(parser->lexer);
+      Token sz_tok = parser->lexer->current_token;
+      sz_tok.value = token_text(&sz_tok);
+      sz = (int)atof(sz_tok.value);
+      lexer_next_token(parser->lexer);
+      parser_expect(parser, TOK_RBRACKET);
+    } else if (parser_match_id(parser, "size")) {
+      /* make array name size N syntax */
+      lexer_next_token(parser->lexer);
+      Token sz_tok = parser->lexer->current_token;
+      sz_tok.value = token_text(&sz_tok);
+      sz = (int)atof(sz_tok.value);
+      lexer_next_token(parser->lexer);
+    }
+    /* optional "of <type>" */
+    if (parser_match(parser, TOK_OF)) {
       lexer_next_token(parser->lexer);
-      /* optional type keyword */
-      Type *elem_type = type_float();
       if (parser_match(parser, TOK_INT_KW)) {
         elem_type = type_int();
         lexer_next_token(parser->lexer);
@@ -1775,51 +1866,39 @@ static ASTNode *parse_statement(Parser *parser) {
         elem_type = type_byte();
         lexer_next_token(parser->lexer);
       }
-      Token name_tok = parser->lexer->current_token;
-      name_tok.value = strdup(name_tok.value);
-      parser_expect(parser, TOK_ID);
-      int sz = 0;
-      if (parser_match(parser, TOK_LBRACKET)) {
-        /* make array name[N] syntax */
-        lexer_next_token(parser->lexer);
-        Token sz_tok = parser->lexer->current_token;
-        sz_tok.value = strdup(sz_tok.value);
-        sz = (int)atof(sz_tok.value);
-        lexer_next_token(parser->lexer);
-        parser_expect(parser, TOK_RBRACKET);
-      } else if (parser_match_id(parser, "size")) {
-        /* make array name size N syntax */
-        lexer_next_token(parser->lexer);
-        Token sz_tok = parser->lexer->current_token;
-        sz_tok.value = strdup(sz_tok.value);
-        sz = (int)atof(sz_tok.value);
-        lexer_next_token(parser->lexer);
-      }
-      /* optional "of <type>" */
-      if (parser_match(parser, TOK_OF)) {
-        lexer_next_token(parser->lexer);
-        if (parser_match(parser, TOK_INT_KW)) {
-          elem_type = type_int();
-          lexer_next_token(parser->lexer);
-        } else if (parser_match(parser, TOK_FLOAT_KW)) {
-          elem_type = type_float();
-          lexer_next_token(parser->lexer);
-        } else if (parser_match(parser, TOK_BOOL_KW)) {
-          elem_type = type_bool();
-          lexer_next_token(parser->lexer);
-        } else if (parser_match(parser, TOK_BYTE_KW)) {
-          elem_type = type_byte();
-          lexer_next_token(parser->lexer);
-        }
-      }
-      return ast_array_decl(name_tok.value, elem_type, sz);
     }
+    return ast_array_decl(name_tok.value, elem_type, sz);
+  }
 
-    /* make buffer <type> <name>[<size>]   OR
-       make buffer <name>[<size>] of <type> */
-    if (parser_match(parser, TOK_BUFFER)) {
+  /* make buffer <type> <name>[<size>]   OR
+     make buffer <name>[<size>] of <type> */
+  if (parser_match(parser, TOK_BUFFER)) {
+    lexer_next_token(parser->lexer);
+    Type *elem_type = type_float();
+    if (parser_match(parser, TOK_INT_KW)) {
+      elem_type = type_int();
+      lexer_next_token(parser->lexer);
+    } else if (parser_match(parser, TOK_FLOAT_KW)) {
+      elem_type = type_float();
+      lexer_next_token(parser->lexer);
+    } else if (parser_match(parser, TOK_BOOL_KW)) {
+      elem_type = type_bool();
+      lexer_next_token(parser->lexer);
+    } else if (parser_match(parser, TOK_BYTE_KW)) {
+      elem_type = type_byte();
+      lexer_next_token(parser->lexer);
+    }
+    Token name_tok = parser->lexer->current_token;
+    name_tok.value = token_text(&name_tok);
+    parser_expect(parser, TOK_ID);
+    parser_expect(parser, TOK_LBRACKET);
+    Token sz_tok = parser->lexer->current_token;
+    sz_tok.value = token_text(&sz_tok);
+    int sz = (int)atof(sz_tok.value);
+    lexer_next_token(parser->lexer);
+    parser_expect(parser, TOK_RBRACKET);
+    if (parser_match(parser, TOK_OF)) {
       lexer_next_token(parser->lexer);
-      Type *elem_type = type_float();
       if (parser_match(parser, TOK_INT_KW)) {
         elem_type = type_int();
         lexer_next_token(parser->lexer);
@@ -1833,491 +1912,424 @@ static ASTNode *parse_statement(Parser *parser) {
         elem_type = type_byte();
         lexer_next_token(parser->lexer);
       }
-      Token name_tok = parser->lexer->current_token;
-      name_tok.value = strdup(name_tok.value);
-      parser_expect(parser, TOK_ID);
-      parser_expect(parser, TOK_LBRACKET);
-      Token sz_tok = parser->lexer->current_token;
-      sz_tok.value = strdup(sz_tok.value);
-      int sz = (int)atof(sz_tok.value);
-      lexer_next_token(parser->lexer);
-      parser_expect(parser, TOK_RBRACKET);
-      if (parser_match(parser, TOK_OF)) {
-        lexer_next_token(parser->lexer);
-        if (parser_match(parser, TOK_INT_KW)) {
-          elem_type = type_int();
-          lexer_next_token(parser->lexer);
-        } else if (parser_match(parser, TOK_FLOAT_KW)) {
-          elem_type = type_float();
-          lexer_next_token(parser->lexer);
-        } else if (parser_match(parser, TOK_BOOL_KW)) {
-          elem_type = type_bool();
-          lexer_next_token(parser->lexer);
-        } else if (parser_match(parser, TOK_BYTE_KW)) {
-          elem_type = type_byte();
-          lexer_next_token(parser->lexer);
-        }
-      }
-      return ast_buffer_decl(name_tok.value, elem_type, sz);
     }
+    return ast_buffer_decl(name_tok.value, elem_type, sz);
+  }
 
-    /* make var <name> = <expr>   (legacy) */
-    if (parser_match(parser, TOK_VAR)) {
+  /* make var <name> = <expr>   (legacy) */
+  if (parser_match(parser, TOK_VAR)) {
+    lexer_next_token(parser->lexer);
+    Token name_tok = parser->lexer->current_token;
+    name_tok.value = token_text(&name_tok);
+    parser_expect(parser, TOK_ID);
+    ASTNode *init = NULL;
+    if (parser_match(parser, TOK_ASSIGN)) {
       lexer_next_token(parser->lexer);
-      Token name_tok = parser->lexer->current_token;
-      name_tok.value = strdup(name_tok.value);
-      parser_expect(parser, TOK_ID);
-      ASTNode *init = NULL;
-      if (parser_match(parser, TOK_ASSIGN)) {
-        lexer_next_token(parser->lexer);
-        init = parse_expression(parser);
-      }
-      symbol_table_add(parser->symbols, name_tok.value, SYMBOL_VARIABLE,
-                       type_inferred(), name_tok.line);
-      return ast_var_decl(name_tok.value, NULL, init);
+      init = parse_expression(parser);
     }
+    symbol_table_add(parser->symbols, name_tok.value, SYMBOL_VARIABLE,
+                     type_inferred(), name_tok.line);
+    return ast_var_decl(name_tok.value, NULL, init);
+  }
 
-    /* make int|float|bool|byte <name> = <expr>   (V3.0 explicit type) */
-    Type *decl_type = NULL;
-    if (parser_match(parser, TOK_INT_KW)) {
-      decl_type = type_int();
-      lexer_next_token(parser->lexer);
-    } else if (parser_match(parser, TOK_FLOAT_KW)) {
-      decl_type = type_float();
-      lexer_next_token(parser->lexer);
-    } else if (parser_match(parser, TOK_BOOL_KW)) {
-      decl_type = type_bool();
-      lexer_next_token(parser->lexer);
-    } else if (parser_match(parser, TOK_BYTE_KW)) {
-      decl_type = type_byte();
-      lexer_next_token(parser->lexer);
-    } else if (parser_match_id(parser, "string")) {
-      decl_type = type_string();
-      lexer_next_token(parser->lexer);
-    }
+  /* make int|float|bool|byte <name> = <expr>   (V3.0 explicit type) */
+  Type *decl_type = NULL;
+  if (parser_match(parser, TOK_INT_KW)) {
+    decl_type = type_int();
+    lexer_next_token(parser->lexer);
+  } else if (parser_match(parser, TOK_FLOAT_KW)) {
+    decl_type = type_float();
+    lexer_next_token(parser->lexer);
+  } else if (parser_match(parser, TOK_BOOL_KW)) {
+    decl_type = type_bool();
+    lexer_next_token(parser->lexer);
+  } else if (parser_match(parser, TOK_BYTE_KW)) {
+    decl_type = type_byte();
+    lexer_next_token(parser->lexer);
+  } else if (parser_match_id(parser, "string")) {
+    decl_type = type_string();
+    lexer_next_token(parser->lexer);
+  }
 
-    if (decl_type != NULL) {
-      /* might be: make float name = expr   OR   make float ratio = cast float
-       * speed/255 */
-      Token name_tok = parser->lexer->current_token;
-      name_tok.value = strdup(name_tok.value);
-      parser_expect(parser, TOK_ID);
-      ASTNode *init = NULL;
-      if (parser_match(parser, TOK_ASSIGN)) {
-        lexer_next_token(parser->lexer);
-        init = parse_expression(parser);
-      }
-      symbol_table_add(parser->symbols, name_tok.value, SYMBOL_VARIABLE,
-                       decl_type, name_tok.line);
-      return ast_var_decl(name_tok.value, decl_type, init);
+  if (decl_type != NULL) {
+    /* might be: make float name = expr   OR   make float ratio = cast float
+     * speed/255 */
+    Token name_tok = parser->lexer->current_token;
+    name_tok.value = token_text(&name_tok);
+    parser_expect(parser, TOK_ID);
+    ASTNode *init = NULL;
+    if (parser_match(parser, TOK_ASSIGN)) {
+      lexer_next_token(parser->lexer);
+      init = parse_expression(parser);
     }
+    symbol_table_add(parser->symbols, name_tok.value, SYMBOL_VARIABLE,
+                     decl_type, name_tok.line);
+    return ast_var_decl(name_tok.value, decl_type, init);
+  }
 
-    /* make <StructTypeName> <varname>  (struct instantiation) */
+  /* make <StructTypeName> <varname>  (struct instantiation) */
+  if (parser_match(parser, TOK_ID)) {
+    Token type_tok = parser->lexer->current_token;
+    type_tok.value = token_text(&type_tok);
+    lexer_next_token(parser->lexer);
+    /* If next token is also an ID, it's a struct instance */
     if (parser_match(parser, TOK_ID)) {
-      Token type_tok = parser->lexer->current_token;
-      type_tok.value = strdup(type_tok.value);
+      Token var_tok = parser->lexer->current_token;
+      var_tok.value = token_text(&var_tok);
       lexer_next_token(parser->lexer);
-      /* If next token is also an ID, it's a struct instance */
-      if (parser_match(parser, TOK_ID)) {
-        Token var_tok = parser->lexer->current_token;
-        var_tok.value = strdup(var_tok.value);
-        lexer_next_token(parser->lexer);
-        return ast_struct_instance(type_tok.value, var_tok.value);
-      }
-      /* Otherwise it was make <name> = expr (no type) — legacy compat */
-      ASTNode *init = NULL;
-      if (parser_match(parser, TOK_ASSIGN)) {
-        lexer_next_token(parser->lexer);
-        init = parse_expression(parser);
-      }
-      return ast_var_decl(type_tok.value, NULL, init);
+      return ast_struct_instance(type_tok.value, var_tok.value);
     }
-
-    error_report(parser->errors, ERROR_SYNTAX,
-                 parser->lexer->current_token.line,
-                 parser->lexer->current_token.column,
-                 "Expected var/int/float/bool/byte/array/buffer or identifier "
-                 "after 'make'");
-    return NULL;
+    /* Otherwise it was make <name> = expr (no type) — legacy compat */
+    ASTNode *init = NULL;
+    if (parser_match(parser, TOK_ASSIGN)) {
+      lexer_next_token(parser->lexer);
+      init = parse_expression(parser);
+    }
+    return ast_var_decl(type_tok.value, NULL, init);
   }
 
-  // Assignment: set x to 5  / set x[i] to 5  / set x.field to 5
-  if (parser_match(parser, TOK_SET)) {
+  error_report(parser->errors, ERROR_SYNTAX,
+               parser->lexer->current_token.line,
+               parser->lexer->current_token.column,
+               "Expected var/int/float/bool/byte/array/buffer or identifier "
+               "after 'make'");
+  return NULL;
+}
+
+// Assignment: set x to 5  / set x[i] to 5  / set x.field to 5
+static ASTNode *parse_set_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+
+  ASTNode *target;
+  /* set pixel N to R G B */
+  if (parser_match_id(parser, "pixel")) {
     lexer_next_token(parser->lexer);
+    ASTNode *index = parse_expression(parser);
+    parser_expect(parser, TOK_TO);
+    ASTNode *r = parse_expression(parser);
+    ASTNode *g = parse_expression(parser);
+    ASTNode *b = parse_expression(parser);
+    return ast_neopixel_set(index, r, g, b);
+  }
 
-    ASTNode *target;
-    /* set pixel N to R G B */
-    if (parser_match_id(parser, "pixel")) {
+  /* --- Wave 2 Wrappers --- */
+  if (parser_match(parser, TOK_STEPPER)) {
+    lexer_next_token(parser->lexer);
+    if (!parser_match_id(parser, "speed")) {
+      error_report(parser->errors, ERROR_SYNTAX,
+                   parser->lexer->current_token.line,
+                   parser->lexer->current_token.column, "Expected 'speed'");
+    } else
       lexer_next_token(parser->lexer);
-      ASTNode *index = parse_expression(parser);
-      parser_expect(parser, TOK_TO);
-      ASTNode *r = parse_expression(parser);
-      ASTNode *g = parse_expression(parser);
-      ASTNode *b = parse_expression(parser);
-      return ast_neopixel_set(index, r, g, b);
-    }
-
-    /* --- Wave 2 Wrappers --- */
-    if (parser_match(parser, TOK_STEPPER)) {
+    ASTNode *speed = parse_expression(parser);
+    return ast_stepper_speed(speed);
+  }
+  if (parser_match(parser, TOK_ESC)) {
+    lexer_next_token(parser->lexer);
+    if (!parser_match_id(parser, "throttle")) {
+      error_report(
+          parser->errors, ERROR_SYNTAX, parser->lexer->current_token.line,
+          parser->lexer->current_token.column, "Expected 'throttle'");
+    } else
+      lexer_next_token(parser->lexer);
+    ASTNode *throttle = parse_expression(parser);
+    return ast_esc_throttle(throttle);
+  }
+  if (parser_match(parser, TOK_PID)) {
+    lexer_next_token(parser->lexer);
+    if (!parser_match_id(parser, "target")) {
+      error_report(parser->errors, ERROR_SYNTAX,
+                   parser->lexer->current_token.line,
+                   parser->lexer->current_token.column, "Expected 'target'");
+    } else
       lexer_next_token(parser->lexer);
-      if (!parser_match_id(parser, "speed")) {
-        error_report(parser->errors, ERROR_SYNTAX,
-                     parser->lexer->current_token.line,
-                     parser->lexer->current_token.column, "Expected 'speed'");
-      } else
-        lexer_next_token(parser->lexer);
-      ASTNode *speed = parse_expression(parser);
-      return ast_stepper_speed(speed);
-    }
-    if (parser_match(parser, TOK_ESC)) {
+    ASTNode *t = parse_expression(parser);
+    return ast_pid_target(t);
+  }
+  /* Wave 5: set volume N */
+  if (parser_match(parser, TOK_VOLUME)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *level = parse_expression(parser);
+    return ast_set_volume(level);
+  }
+  /* Wave 7: set drone target pitch N roll N yaw N throttle N */
+  if (parser_match(parser, TOK_DRONE)) {
+    lexer_next_token(parser->lexer);
+    if (parser_match_id(parser, "target")) {
       lexer_next_token(parser->lexer);
-      if (!parser_match_id(parser, "throttle")) {
-        error_report(
-            parser->errors, ERROR_SYNTAX, parser->lexer->current_token.line,
-            parser->lexer->current_token.column, "Expected 'throttle'");
-      } else
-        lexer_next_token(parser->lexer);
-      ASTNode *throttle = parse_expression(parser);
-      return ast_esc_throttle(throttle);
     }
-    if (parser_match(parser, TOK_PID)) {
+    ASTNode *pitch = ast_number(0), *roll = ast_number(0), *yaw = ast_number(0), *throttle = ast_number(1500);
+    if (parser_match_id(parser, "pitch")) {
       lexer_next_token(parser->lexer);
-      if (!parser_match_id(parser, "target")) {
-        error_report(parser->errors, ERROR_SYNTAX,
-                     parser->lexer->current_token.line,
-                     parser->lexer->current_token.column, "Expected 'target'");
-      } else
-        lexer_next_token(parser->lexer);
-      ASTNode *t = parse_expression(parser);
-      return ast_pid_target(t);
+      pitch = parse_expression(parser);
     }
-    /* Wave 5: set volume N */
-    if (parser_match(parser, TOK_VOLUME)) {
+    if (parser_match_id(parser, "roll")) {
       lexer_next_token(parser->lexer);
-      ASTNode *level = parse_expression(parser);
-      return ast_set_volume(level);
+      roll = parse_expression(parser);
     }
-    /* Wave 7: set drone target pitch N roll N yaw N throttle N */
-    if (parser_match(parser, TOK_DRONE)) {
+    if (parser_match_id(parser, "yaw")) {
       lexer_next_token(parser->lexer);
-      if (parser_match_id(parser, "target")) {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *pitch = ast_number(0), *roll = ast_number(0), *yaw = ast_number(0), *throttle = ast_number(1500);
-      if (parser_match_id(parser, "pitch")) {
-        lexer_next_token(parser->lexer);
-        pitch = parse_expression(parser);
-      }
-      if (parser_match_id(parser, "roll")) {
-        lexer_next_token(parser->lexer);
-        roll = parse_expression(parser);
-      }
-      if (parser_match_id(parser, "yaw")) {
-        lexer_next_token(parser->lexer);
-        yaw = parse_expression(parser);
-      }
-      if (parser_match_id(parser, "throttle")) {
-        lexer_next_token(parser->lexer);
-        throttle = parse_expression(parser);
-      }
-      return ast_drone_set(pitch, roll, yaw, throttle);
+      yaw = parse_expression(parser);
     }
-    /* Wave 7: set grid name obstacle at x N y N */
-    if (parser_match(parser, TOK_GRID)) {
+    if (parser_match_id(parser, "throttle")) {
       lexer_next_token(parser->lexer);
-      Token name_tok = parser->lexer->current_token;
-      name_tok.value = strdup(name_tok.value);
-      parser_expect(parser, TOK_ID);
-      parser_expect_id(parser, "obstacle");
-      if (parser_match_id(parser, "at")) {
-        lexer_next_token(parser->lexer);
-      }
-      parser_expect_id(parser, "x");
-      ASTNode *x = parse_expression(parser);
-      parser_expect_id(parser, "y");
-      ASTNode *y = parse_expression(parser);
-      return ast_grid_obstacle(name_tok.value, x, y);
+      throttle = parse_expression(parser);
     }
-
-    if (parser_match(parser, TOK_PIN)) {
+    return ast_drone_set(pitch, roll, yaw, throttle);
+  }
+  /* Wave 7: set grid name obstacle at x N y N */
+  if (parser_match(parser, TOK_GRID)) {
+    lexer_next_token(parser->lexer);
+    Token name_tok = parser->lexer->current_token;
+    name_tok.value = token_text(&name_tok);
+    parser_expect(parser, TOK_ID);
+    parser_expect_id(parser, "obstacle");
+    if (parser_match_id(parser, "at")) {
       lexer_next_token(parser->lexer);
-      ASTNode *pin = parse_expression(parser);
-      parser_expect(parser, TOK_TO);
-      ASTNode *value = parse_expression(parser);
-      return ast_analog_write(pin, value);
-    } else if (parser_match_id(parser, "index")) {
-      /* legacy: set index N of arrname to val */
-      lexer_next_token(parser->lexer);
-      Token arr_tok = parser->lexer->current_token;
-      arr_tok.value = strdup(arr_tok.value);
-      parser_expect(parser, TOK_ID);
-      parser_expect(parser, TOK_OF);
-      ASTNode *index = parse_expression(parser);
-      target = ast_array_access(ast_identifier(arr_tok.value), index);
-    } else {
-      /* Common case: consume identifier name */
-      Token var_tok = parser->lexer->current_token;
-      var_tok.value = strdup(var_tok.value);
-      parser_expect(parser, TOK_ID);
-      target = ast_identifier(var_tok.value);
-
-      /* V3.0: set name[i] to val  — array element */
-      if (parser_match(parser, TOK_LBRACKET)) {
-        lexer_next_token(parser->lexer);
-        ASTNode *idx = parse_expression(parser);
-
-        parser_expect(parser, TOK_RBRACKET);
-        target = ast_array_access(target, idx);
-      }
-
-      /* V3.0: set name.field to val  — struct member (possibly chained) */
-      while (parser_match(parser, TOK_DOT)) {
-        lexer_next_token(parser->lexer);
-        Token member_tok = parser->lexer->current_token;
-        member_tok.value = strdup(member_tok.value);
-        lexer_next_token(parser->lexer);
-        target = ast_struct_access(target, member_tok.value);
-      }
     }
+    parser_expect_id(parser, "x");
+    ASTNode *x = parse_expression(parser);
+    parser_expect_id(parser, "y");
+    ASTNode *y = parse_expression(parser);
+    return ast_grid_obstacle(name_tok.value, x, y);
+  }
 
+  if (parser_match(parser, TOK_PIN)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *pin = parse_expression(parser);
     parser_expect(parser, TOK_TO);
     ASTNode *value = parse_expression(parser);
-    return ast_assignment(target, value);
-  }
-
-  // Change statement: change x by 5  /  change x.field by 5  /  change x[i] by
-  // 5
-  if (parser_match(parser, TOK_CHANGE)) {
+    return ast_analog_write(pin, value);
+  } else if (parser_match_id(parser, "index")) {
+    /* legacy: set index N of arrname to val */
     lexer_next_token(parser->lexer);
-
+    Token arr_tok = parser->lexer->current_token;
+    arr_tok.value = token_text(&arr_tok);
+    parser_expect(parser, TOK_ID);
+    parser_expect(parser, TOK_OF);
+    ASTNode *index = parse_expression(parser);
+    target = ast_array_access(ast_identifier(arr_tok.value), index);
+  } else {
+    /* Common case: consume identifier name */
     Token var_tok = parser->lexer->current_token;
-    var_tok.value = strdup(var_tok.value);
+    var_tok.value = token_text(&var_tok);
     parser_expect(parser, TOK_ID);
-    ASTNode *target = ast_identifier(var_tok.value);
+    target = ast_identifier(var_tok.value);
 
-    /* V3.0: change name[i] by delta */
+    /* V3.0: set name[i] to val  — array element */
     if (parser_match(parser, TOK_LBRACKET)) {
       lexer_next_token(parser->lexer);
       ASTNode *idx = parse_expression(parser);
+
       parser_expect(parser, TOK_RBRACKET);
       target = ast_array_access(target, idx);
     }
-    /* V3.0: change name.field by delta */
+
+    /* V3.0: set name.field to val  — struct member (possibly chained) */
     while (parser_match(parser, TOK_DOT)) {
       lexer_next_token(parser->lexer);
       Token member_tok = parser->lexer->current_token;
-      member_tok.value = strdup(member_tok.value);
+      member_tok.value = token_text(&member_tok);
       lexer_next_token(parser->lexer);
       target = ast_struct_access(target, member_tok.value);
     }
+  }
 
-    parser_expect(parser, TOK_BY);
-    ASTNode *delta = parse_expression(parser);
+  parser_expect(parser, TOK_TO);
+  ASTNode *value = parse_expression(parser);
+  return ast_assignment(target, value);
+}
 
-    /* Clone target manually for the right side of OP_ADD to prevent double-free
-     * in AST destruction */
-    ASTNode *target_clone = clone_target(target);
+// Change statement: change x by 5  /  change x.field by 5  /  change x[i] by
+// 5
+static ASTNode *parse_change_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
 
-    /* Generate: target = target + delta */
-    ASTNode *add_expr = ast_binary_op(OP_ADD, target_clone, delta);
-    return ast_assignment(target, add_expr);
-  }
+  Token var_tok = parser->lexer->current_token;
+  var_tok.value = token_text(&var_tok);
+  parser_expect(parser, TOK_ID);
+  ASTNode *target = ast_identifier(var_tok.value);
 
-  // GPIO: turn on/off pin X
-  if (parser_match(parser, TOK_TURN)) {
+  /* V3.0: change name[i] by delta */
+  if (parser_match(parser, TOK_LBRACKET)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *idx = parse_expression(parser);
+    parser_expect(parser, TOK_RBRACKET);
+    target = ast_array_access(target, idx);
+  }
+  /* V3.0: change name.field by delta */
+  while (parser_match(parser, TOK_DOT)) {
     lexer_next_token(parser->lexer);
-    int is_on = parser_match(parser, TOK_ON);
+    Token member_tok = parser->lexer->current_token;
+    member_tok.value = token_text(&member_tok);
     lexer_next_token(parser->lexer);
-    parser_expect(parser, TOK_PIN);
-    ASTNode *pin = parse_expression(parser);
-    return ast_gpio_write(pin, ast_number(is_on ? 1 : 0));
+    target = ast_struct_access(target, member_tok.value);
   }
 
-  // Wait
-  if (parser_match(parser, TOK_WAIT)) {
-    lexer_next_token(parser->lexer);
-    ASTNode *duration = parse_expression(parser);
+  parser_expect(parser, TOK_BY);
+  ASTNode *delta = parse_expression(parser);
 
-    if (parser_match(parser, TOK_MS_TOK)) {
-      lexer_next_token(parser->lexer);
-    } else if (parser_match(parser, TOK_US_TOK)) {
-      lexer_next_token(parser->lexer);
-      ASTNode **args = malloc(sizeof(ASTNode *));
-      args[0] = duration;
-      return ast_call("delayMicroseconds", args, 1);
-    } else if (parser_match(parser, TOK_ID)) {
-      const char *unit = parser->lexer->current_token.value;
-      if (strcmp(unit, "seconds") == 0 || strcmp(unit, "s") == 0 ||
-          strcmp(unit, "sec") == 0 || strcmp(unit, "second") == 0) {
-        duration = ast_binary_op(OP_MUL, duration, ast_number(1000));
-        lexer_next_token(parser->lexer);
-      } else if (strcmp(unit, "milliseconds") == 0 || strcmp(unit, "ms") == 0 ||
-                 strcasecmp(unit, "millisecond") == 0) {
-        lexer_next_token(parser->lexer);
-      } else if (strcmp(unit, "microseconds") == 0 || strcmp(unit, "us") == 0 ||
-                 strcasecmp(unit, "microsecond") == 0) {
-        lexer_next_token(parser->lexer);
-        ASTNode **args = malloc(sizeof(ASTNode *));
-        args[0] = duration;
-        return ast_call("delayMicroseconds", args, 1);
-      }
-    }
-    return ast_wait(duration);
-  }
+  /* Clone target manually for the right side of OP_ADD to prevent double-free
+   * in AST destruction */
+  ASTNode *target_clone = clone_target(target);
 
-  // Wait Microseconds
-  if (parser_match(parser, TOK_WAIT_US)) {
-    lexer_next_token(parser->lexer);
-    ASTNode *duration = parse_expression(parser);
-    ASTNode **args = malloc(sizeof(ASTNode *));
-    args[0] = duration;
-    return ast_call("delayMicroseconds", args, 1);
-  }
+  /* Generate: target = target + delta */
+  ASTNode *add_expr = ast_binary_op(OP_ADD, target_clone, delta);
+  return ast_assignment(target, add_expr);
+}
 
-  // Print / Println
-  if (parser->lexer->current_token.type == TOK_PRINT ||
-      parser->lexer->current_token.type == TOK_PRINTLN) {
-    int is_ln = parser->lexer->current_token.type == TOK_PRINTLN;
-    lexer_next_token(parser->lexer);
-    ASTNode *value = parse_expression(parser);
-    return is_ln ? ast_println_stmt(value) : ast_print_stmt(value);
-  }
+// GPIO: turn on/off pin X
+static ASTNode *parse_turn_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  int is_on = parser_match(parser, TOK_ON);
+  lexer_next_token(parser->lexer);
+  parser_expect(parser, TOK_PIN);
+  ASTNode *pin = parse_expression(parser);
+  return ast_gpio_write(pin, ast_number(is_on ? 1 : 0));
+}
 
-  // I2C operations
-  if (parser_match(parser, TOK_I2C)) {
-    lexer_next_token(parser->lexer);
+// Wait
+static ASTNode *parse_wait_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  ASTNode *duration = parse_expression(parser);
 
-    if (parser_match(parser, TOK_BEGIN)) {
-      lexer_next_token(parser->lexer);
-      return ast_i2c_begin();
-    }
-    if (parser_match(parser, TOK_START)) {
+  if (parser_match(parser, TOK_MS_TOK)) {
+    lexer_next_token(parser->lexer);
+  } else if (parser_match(parser, TOK_US_TOK)) {
+    lexer_next_token(parser->lexer);
+    ASTNode **args = ast_alloc(sizeof(ASTNode *));
+    args[0] = duration;
+    return ast_call(intern_builtin(ATOM_DELAY_MICROSECONDS), args, 1);
+  } else if (parser_match(parser, TOK_ID)) {
+    const char *unit = parser->lexer->current_token.value;
+    if (strcmp(unit, "seconds") == 0 || strcmp(unit, "s") == 0 ||
+        strcmp(unit, "sec") == 0 || strcmp(unit, "second") == 0) {
+      duration = ast_binary_op(OP_MUL, duration, ast_number(1000));
       lexer_next_token(parser->lexer);
-      ASTNode *addr = parse_expression(parser);
-      return ast_i2c_start(addr);
-    }
-    if (parser_match(parser, TOK_SEND)) {
+    } else if (strcmp(unit, "milliseconds") == 0 || strcmp(unit, "ms") == 0 ||
+               strcasecmp(unit, "millisecond") == 0) {
       lexer_next_token(parser->lexer);
-      ASTNode *data = parse_expression(parser);
-      return ast_i2c_send(data);
-    }
-    if (parser_match(parser, TOK_STOP)) {
+    } else if (strcmp(unit, "microseconds") == 0 || strcmp(unit, "us") == 0 ||
+               strcasecmp(unit, "microsecond") == 0) {
       lexer_next_token(parser->lexer);
-      return ast_i2c_stop();
+      ASTNode **args = ast_alloc(sizeof(ASTNode *));
+      args[0] = duration;
+      return ast_call(intern_builtin(ATOM_DELAY_MICROSECONDS), args, 1);
     }
   }
+  return ast_wait(duration);
+}
 
-  // If statement (with else-if support)
-  if (parser_match(parser, TOK_IF)) {
-    lexer_next_token(parser->lexer);
-    ASTNode *condition = parse_expression(parser);
-    parser_expect(parser, TOK_LBRACE);
-    ASTNode *then_block = parse_block(parser);
-    parser_expect(parser, TOK_RBRACE);
+// Wait Microseconds
+static ASTNode *parse_wait_us_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  ASTNode *duration = parse_expression(parser);
+  ASTNode **args = ast_alloc(sizeof(ASTNode *));
+  args[0] = duration;
+  return ast_call(intern_builtin(ATOM_DELAY_MICROSECONDS), args, 1);
+}
 
-    ASTNode *else_block = NULL;
-    if (parser_match(parser, TOK_ELSE)) {
-      lexer_next_token(parser->lexer);
-      // else if: parse the next if as the else block
-      if (parser_match(parser, TOK_IF)) {
-        // Recursively parse the else-if as a nested if statement
-        ASTNode *elif_stmt = parse_statement(parser);
-        // Wrap it in a block
-        ASTNode **stmts = malloc(sizeof(ASTNode *));
-        stmts[0] = elif_stmt;
-        else_block = ast_block(stmts, 1);
-      } else {
-        parser_expect(parser, TOK_LBRACE);
-        else_block = parse_block(parser);
-        parser_expect(parser, TOK_RBRACE);
-      }
-    }
+// Print / Println
+static ASTNode *parse_print_statement(Parser *parser) {
+  int is_ln = parser->lexer->current_token.type == TOK_PRINTLN;
+  lexer_next_token(parser->lexer);
+  ASTNode *value = parse_expression(parser);
+  return is_ln ? ast_println_stmt(value) : ast_print_stmt(value);
+}
 
-    return ast_if(condition, then_block, else_block);
-  }
+// I2C operations
+static ASTNode *parse_i2c_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
 
-  // While loop
-  if (parser_match(parser, TOK_WHILE)) {
+  if (parser_match(parser, TOK_BEGIN)) {
     lexer_next_token(parser->lexer);
-    ASTNode *condition = parse_expression(parser);
-    parser_expect(parser, TOK_LBRACE);
-    parser->in_loop++;
-    ASTNode *body = parse_block(parser);
-    parser->in_loop--;
-    parser_expect(parser, TOK_RBRACE);
-    return ast_while(condition, body);
+    return ast_i2c_begin();
   }
-
-  // Extern Function definition: extern "C++" def name(param1)
-  if (parser_match(parser, TOK_EXTERN)) {
+  if (parser_match(parser, TOK_START)) {
     lexer_next_token(parser->lexer);
+    ASTNode *addr = parse_expression(parser);
+    return ast_i2c_start(addr);
+  }
+  if (parser_match(parser, TOK_SEND)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *data = parse_expression(parser);
+    return ast_i2c_send(data);
+  }
+  if (parser_match(parser, TOK_STOP)) {
+    lexer_next_token(parser->lexer);
+    return ast_i2c_stop();
+  }
+  return NULL;
+}
 
-    Token lang_tok = parser->lexer->current_token;
-    lang_tok.value = strdup(lang_tok.value);
-    parser_expect(parser, TOK_STRING_LIT);
-
-    parser_expect(parser, TOK_DEF);
-    Token name_tok = parser->lexer->current_token;
-    name_tok.value = strdup(name_tok.value);
-    parser_expect(parser, TOK_ID);
-    parser_expect(parser, TOK_LPAREN);
+// If statement (with else-if support)
+static ASTNode *parse_if_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  ASTNode *condition = parse_expression(parser);
+  parser_expect(parser, TOK_LBRACE);
+  ASTNode *then_block = parse_block(parser);
+  parser_expect(parser, TOK_RBRACE);
 
-    int param_capacity = 4;
-    char **param_names = malloc(sizeof(char *) * param_capacity);
-    Type **param_types = malloc(sizeof(Type *) * param_capacity);
-    int param_count = 0;
+  ASTNode *else_block = NULL;
+  if (parser_match(parser, TOK_ELSE)) {
+    lexer_next_token(parser->lexer);
+    // else if: parse the next if as the else block
+    if (parser_match(parser, TOK_IF)) {
+      // Recursively parse the else-if as a nested if statement
+      ASTNode *elif_stmt = parse_statement(parser);
+      // Wrap it in a block
+      ASTNode **stmts = ast_alloc(sizeof(ASTNode *));
+      stmts[0] = elif_stmt;
+      else_block = ast_block(stmts, 1);
+    } else {
+      parser_expect(parser, TOK_LBRACE);
+      else_block = parse_block(parser);
+      parser_expect(parser, TOK_RBRACE);
+    }
+  }
 
-    while (!parser_match(parser, TOK_RPAREN) &&
-           !parser_match(parser, TOK_EOF)) {
-      Token param_tok = parser->lexer->current_token;
-      param_tok.value = strdup(param_tok.value);
-      parser_expect(parser, TOK_ID);
+  return ast_if(condition, then_block, else_block);
+}
 
-      Type *ptype = type_float(); /* default */
-      if (parser_match(parser, TOK_COLON)) {
-        lexer_next_token(parser->lexer);
-        if (parser_match(parser, TOK_ARRAY)) {
-          lexer_next_token(parser->lexer);
-          Type *elem_type = type_float();
-          if (parser_match(parser, TOK_INT_KW)) {
-            elem_type = type_int();
-            lexer_next_token(parser->lexer);
-          } else if (parser_match(parser, TOK_FLOAT_KW)) {
-            elem_type = type_float();
-            lexer_next_token(parser->lexer);
-          }
-          ptype = type_array(elem_type, -1);
-        } else if (parser_match(parser, TOK_INT_KW)) {
-          ptype = type_int();
-          lexer_next_token(parser->lexer);
-        } else if (parser_match(parser, TOK_FLOAT_KW)) {
-          ptype = type_float();
-          lexer_next_token(parser->lexer);
-        } else if (parser_match(parser, TOK_BOOL_KW)) {
-          ptype = type_bool();
-          lexer_next_token(parser->lexer);
-        } else if (parser_match(parser, TOK_BYTE_KW)) {
-          ptype = type_byte();
-          lexer_next_token(parser->lexer);
-        }
-      }
+// While loop
+static ASTNode *parse_while_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  ASTNode *condition = parse_expression(parser);
+  parser_expect(parser, TOK_LBRACE);
+  parser->in_loop++;
+  ASTNode *body = parse_block(parser);
+  parser->in_loop--;
+  parser_expect(parser, TOK_RBRACE);
+  return ast_while(condition, body);
+}
 
-      if (param_count >= param_capacity) {
-        param_capacity *= 2;
-        param_names = realloc(param_names, sizeof(char *) * param_capacity);
-        param_types = realloc(param_types, sizeof(Type *) * param_capacity);
-      }
-      param_names[param_count] = strdup(param_tok.value);
-      param_types[param_count] = ptype;
-      param_count++;
-      if (parser_match(parser, TOK_COMMA)) {
-        lexer_next_token(parser->lexer);
-      }
-    }
-    parser_expect(parser, TOK_RPAREN);
+// Extern Function definition: extern "C++" def name(param1)
+static ASTNode *parse_extern_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+
+  Token lang_tok = parser->lexer->current_token;
+  lang_tok.value = token_text(&lang_tok);
+  parser_expect(parser, TOK_STRING_LIT);
+
+  parser_expect(parser, TOK_DEF);
+  Token name_tok = parser->lexer->current_token;
+  name_tok.value = token_text(&name_tok);
+  parser_expect(parser, TOK_ID);
+  parser_expect(parser, TOK_LPAREN);
+
+  int param_capacity = 4;
+  char **param_names = ast_alloc(sizeof(char *) * param_capacity);
+  Type **param_types = ast_alloc(sizeof(Type *) * param_capacity);
+  int param_count = 0;
+
+  while (!parser_match(parser, TOK_RPAREN) &&
+         !parser_match(parser, TOK_EOF)) {
+    Token param_tok = parser->lexer->current_token;
+    param_tok.value = token_text(&param_tok);
+    parser_expect(parser, TOK_ID);
 
-    Type *ret_type = type_void();
-    if (parser_match(parser, TOK_ARROW)) {
+    Type *ptype = type_float(); /* default */
+    if (parser_match(parser, TOK_COLON)) {
       lexer_next_token(parser->lexer);
       if (parser_match(parser, TOK_ARRAY)) {
         lexer_next_token(parser->lexer);
@@ -2329,38 +2341,8 @@ static ASTNode *parse_statement(Parser *parser) {
           elem_type = type_float();
           lexer_next_token(parser->lexer);
         }
-        ret_type = type_array(elem_type, -1);
+        ptype = type_array(elem_type, -1);
       } else if (parser_match(parser, TOK_INT_KW)) {
-        ret_type = type_int();
-        lexer_next_token(parser->lexer);
-      } else if (parser_match(parser, TOK_FLOAT_KW)) {
-        ret_type = type_float();
-        lexer_next_token(parser->lexer);
-      }
-    }
-
-    return ast_extern_function_def(name_tok.value, param_names, param_types,
-                                   param_count, ret_type, lang_tok.value);
-  }
-
-  // Function definition: def name(param1, param2) { }
-  if (parser_match(parser, TOK_DEF)) {
-    lexer_next_token(parser->lexer);
-    Token name_tok = parser->lexer->current_token;
-    name_tok.value = strdup(name_tok.value);
-    parser_expect(parser, TOK_ID);
-    parser_expect(parser, TOK_LPAREN);
-
-    int param_capacity = 4;
-    char **param_names = malloc(sizeof(char *) * param_capacity);
-    Type **param_types = malloc(sizeof(Type *) * param_capacity);
-    int param_count = 0;
-
-    while (!parser_match(parser, TOK_RPAREN) &&
-           !parser_match(parser, TOK_EOF)) {
-      /* Optional type annotation before parameter name */
-      Type *ptype = type_float(); /* default */
-      if (parser_match(parser, TOK_INT_KW)) {
         ptype = type_int();
         lexer_next_token(parser->lexer);
       } else if (parser_match(parser, TOK_FLOAT_KW)) {
@@ -2373,71 +2355,138 @@ static ASTNode *parse_statement(Parser *parser) {
         ptype = type_byte();
         lexer_next_token(parser->lexer);
       }
+    }
 
-      Token param_tok = parser->lexer->current_token;
-      param_tok.value = strdup(param_tok.value);
-      if (!parser_match(parser, TOK_ID)) {
-        error_report(parser->errors, ERROR_SYNTAX,
-                     parser->lexer->current_token.line,
-                     parser->lexer->current_token.column,
-                     "Expected parameter name in function definition");
-        break;
-      }
+    if (param_count >= param_capacity) {
+      param_names =
+          parser_grow_array(param_names, sizeof(char *), param_capacity);
+      param_types =
+          parser_grow_array(param_types, sizeof(Type *), param_capacity);
+      param_capacity *= 2;
+    }
+    param_names[param_count] = param_tok.value;
+    param_types[param_count] = ptype;
+    param_count++;
+    if (parser_match(parser, TOK_COMMA)) {
       lexer_next_token(parser->lexer);
-      if (param_count >= param_capacity) {
-        param_capacity *= 2;
-        param_names = realloc(param_names, sizeof(char *) * param_capacity);
-        param_types = realloc(param_types, sizeof(Type *) * param_capacity);
-      }
-      param_names[param_count] = strdup(param_tok.value);
-      param_types[param_count] = ptype;
-      param_count++;
-      if (parser_match(parser, TOK_COMMA))
-        lexer_next_token(parser->lexer);
     }
-    parser_expect(parser, TOK_RPAREN);
-    parser_expect(parser, TOK_LBRACE);
-    parser->in_function++;
-    symbol_table_enter_scope(parser->symbols);
-    ASTNode *body = parse_block(parser);
-    symbol_table_exit_scope(parser->symbols);
-    parser->in_function--;
-    parser_expect(parser, TOK_RBRACE);
-
-    return ast_function_def(name_tok.value, param_names, param_types,
-                            param_count, type_void(), body);
   }
+  parser_expect(parser, TOK_RPAREN);
 
-  // Loop (forever or N times)
-  if (parser_match(parser, TOK_LOOP)) {
+  Type *ret_type = type_void();
+  if (parser_match(parser, TOK_ARROW)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_FOREVER)) {
+    if (parser_match(parser, TOK_ARRAY)) {
       lexer_next_token(parser->lexer);
-      parser_expect(parser, TOK_LBRACE);
-      parser->in_loop++;
-      ASTNode *body = parse_block(parser);
-      parser->in_loop--;
-      parser_expect(parser, TOK_RBRACE);
-      return ast_forever(body);
-    } else {
-      ASTNode *count = parse_expression(parser);
-      if (parser_match(parser, TOK_ID) &&
-          strcmp(parser->lexer->current_token.value, "times") == 0) {
+      Type *elem_type = type_float();
+      if (parser_match(parser, TOK_INT_KW)) {
+        elem_type = type_int();
+        lexer_next_token(parser->lexer);
+      } else if (parser_match(parser, TOK_FLOAT_KW)) {
+        elem_type = type_float();
         lexer_next_token(parser->lexer);
       }
-      parser_expect(parser, TOK_LBRACE);
-      parser->in_loop++;
-      ASTNode *body = parse_block(parser);
-      parser->in_loop--;
-      parser_expect(parser, TOK_RBRACE);
-      return ast_repeat(count, body);
+      ret_type = type_array(elem_type, -1);
+    } else if (parser_match(parser, TOK_INT_KW)) {
+      ret_type = type_int();
+      lexer_next_token(parser->lexer);
+    } else if (parser_match(parser, TOK_FLOAT_KW)) {
+      ret_type = type_float();
+      lexer_next_token(parser->lexer);
+    }
+  }
+
+  return ast_extern_function_def(name_tok.value, param_names, param_types,
+                                 param_count, ret_type, lang_tok.value);
+  return NULL;
+}
+
+// Function definition: def name(param1, param2) { }
+static ASTNode *parse_def_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  Token name_tok = parser->lexer->current_token;
+  name_tok.value = token_text(&name_tok);
+  parser_expect(parser, TOK_ID);
+  parser_expect(parser, TOK_LPAREN);
+
+  int param_capacity = 4;
+  char **param_names = ast_alloc(sizeof(char *) * param_capacity);
+  Type **param_types = ast_alloc(sizeof(Type *) * param_capacity);
+  int param_count = 0;
+
+  while (!parser_match(parser, TOK_RPAREN) &&
+         !parser_match(parser, TOK_EOF)) {
+    /* Optional type annotation before parameter name; without one the
+     * type is left to ast_infer_types(), which falls back to float */
+    Type *ptype = type_inferred();
+    if (parser_match(parser, TOK_INT_KW)) {
+      ptype = type_int();
+      lexer_next_token(parser->lexer);
+    } else if (parser_match(parser, TOK_FLOAT_KW)) {
+      ptype = type_float();
+      lexer_next_token(parser->lexer);
+    } else if (parser_match(parser, TOK_BOOL_KW)) {
+      ptype = type_bool();
+      lexer_next_token(parser->lexer);
+    } else if (parser_match(parser, TOK_BYTE_KW)) {
+      ptype = type_byte();
+      lexer_next_token(parser->lexer);
+    }
+
+    Token param_tok = parser->lexer->current_token;
+    param_tok.value = token_text(&param_tok);
+    if (!parser_match(parser, TOK_ID)) {
+      error_report(parser->errors, ERROR_SYNTAX,
+                   parser->lexer->current_token.line,
+                   parser->lexer->current_token.column,
+                   "Expected parameter name in function definition");
+      break;
     }
+    lexer_next_token(parser->lexer);
+    if (param_count >= param_capacity) {
+      param_names =
+          parser_grow_array(param_names, sizeof(char *), param_capacity);
+      param_types =
+          parser_grow_array(param_types, sizeof(Type *), param_capacity);
+      param_capacity *= 2;
+    }
+    param_names[param_count] = param_tok.value;
+    param_types[param_count] = ptype;
+    param_count++;
+    if (parser_match(parser, TOK_COMMA))
+      lexer_next_token(parser->lexer);
   }
+  parser_expect(parser, TOK_RPAREN);
+  parser_expect(parser, TOK_LBRACE);
+  parser->in_function++;
+  symbol_table_enter_scope(parser->symbols);
+  ASTNode *body = parse_block(parser);
+  symbol_table_exit_scope(parser->symbols);
+  parser->in_function--;
+  parser_expect(parser, TOK_RBRACE);
+
+  return ast_function_def(name_tok.value, param_names, param_types,
+                          param_count, type_void(), body);
+  return NULL;
+}
 
-  // Repeat
-  if (parser_match(parser, TOK_REPEAT)) {
+// Loop (forever or N times)
+static ASTNode *parse_loop_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_FOREVER)) {
     lexer_next_token(parser->lexer);
-    ASTNode *count = parse_expression(parser);
+    parser_expect(parser, TOK_LBRACE);
+    parser->in_loop++;
+    ASTNode *body = parse_block(parser);
+    parser->in_loop--;
+    parser_expect(parser, TOK_RBRACE);
+    return ast_forever(body);
+  } else {
+    ASTNode *count = parse_expression(parser);
+    if (parser_match(parser, TOK_ID) &&
+        strcmp(parser->lexer->current_token.value, "times") == 0) {
+      lexer_next_token(parser->lexer);
+    }
     parser_expect(parser, TOK_LBRACE);
     parser->in_loop++;
     ASTNode *body = parse_block(parser);
@@ -2445,1300 +2494,1380 @@ static ASTNode *parse_statement(Parser *parser) {
     parser_expect(parser, TOK_RBRACE);
     return ast_repeat(count, body);
   }
+  return NULL;
+}
 
-  // For logic: for var from start to end { body }
-  if (parser_match(parser, TOK_FOR)) {
+// Repeat
+static ASTNode *parse_repeat_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  ASTNode *count = parse_expression(parser);
+  parser_expect(parser, TOK_LBRACE);
+  parser->in_loop++;
+  ASTNode *body = parse_block(parser);
+  parser->in_loop--;
+  parser_expect(parser, TOK_RBRACE);
+  return ast_repeat(count, body);
+}
+
+// For logic: for var from start to end { body }
+static ASTNode *parse_for_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  Token var_tok = parser->lexer->current_token;
+  var_tok.value = token_text(&var_tok);
+  parser_expect(parser, TOK_ID);
+  parser_expect(parser, TOK_FROM);
+  ASTNode *start_expr = parse_expression(parser);
+  parser_expect(parser, TOK_TO);
+  ASTNode *end_expr = parse_expression(parser);
+
+  ASTNode *step_expr = NULL;
+  if (parser_match(parser, TOK_BY)) {
     lexer_next_token(parser->lexer);
-    Token var_tok = parser->lexer->current_token;
-    var_tok.value = strdup(var_tok.value);
-    parser_expect(parser, TOK_ID);
-    parser_expect(parser, TOK_FROM);
-    ASTNode *start_expr = parse_expression(parser);
-    parser_expect(parser, TOK_TO);
-    ASTNode *end_expr = parse_expression(parser);
+    step_expr = parse_expression(parser);
+  }
 
-    ASTNode *step_expr = NULL;
-    if (parser_match(parser, TOK_BY)) {
-      lexer_next_token(parser->lexer);
-      step_expr = parse_expression(parser);
-    }
+  parser_expect(parser, TOK_LBRACE);
 
-    parser_expect(parser, TOK_LBRACE);
+  symbol_table_enter_scope(parser->symbols);
+  symbol_table_add(parser->symbols, var_tok.value, SYMBOL_VARIABLE,
+                   type_int(), var_tok.line);
 
-    symbol_table_enter_scope(parser->symbols);
-    symbol_table_add(parser->symbols, var_tok.value, SYMBOL_VARIABLE,
-                     type_int(), var_tok.line);
+  // Suppress unused warning since iterating a loop counts as semantic
+  // utilization
+  symbol_table_lookup_current_scope(parser->symbols, var_tok.value)->is_used =
+      1;
 
-    // Suppress unused warning since iterating a loop counts as semantic
-    // utilization
-    symbol_table_lookup_current_scope(parser->symbols, var_tok.value)->is_used =
-        1;
+  parser->in_loop++;
+  ASTNode *body = parse_block(parser);
+  parser->in_loop--;
 
-    parser->in_loop++;
-    ASTNode *body = parse_block(parser);
-    parser->in_loop--;
+  symbol_table_exit_scope(parser->symbols);
 
-    symbol_table_exit_scope(parser->symbols);
+  parser_expect(parser, TOK_RBRACE);
+  return ast_for(var_tok.value, start_expr, end_expr, step_expr, body);
+}
 
-    parser_expect(parser, TOK_RBRACE);
-    return ast_for(var_tok.value, start_expr, end_expr, step_expr, body);
+// Return
+static ASTNode *parse_return_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  ASTNode *value = NULL;
+  if (!parser_match(parser, TOK_RBRACE)) {
+    value = parse_expression(parser);
   }
+  return ast_return(value);
+}
 
-  // Return
-  if (parser_match(parser, TOK_RETURN)) {
-    lexer_next_token(parser->lexer);
-    ASTNode *value = NULL;
-    if (!parser_match(parser, TOK_RBRACE)) {
-      value = parse_expression(parser);
-    }
-    return ast_return(value);
-  }
+// Break
+static ASTNode *parse_break_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  return ast_break();
+}
+
+// Continue
+static ASTNode *parse_continue_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  return ast_continue();
+}
+
+/* ============================================================
+ * Library Wrapper Statement Handlers
+ * ============================================================ */
 
-  // Break
-  if (parser_match(parser, TOK_BREAK)) {
+/* attach servo pin N */
+/* attach dht11 pin N  /  attach dht22 pin N */
+/* attach strip pin N count C */
+/* attach lcd columns C rows R */
+static ASTNode *parse_attach_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+
+  /* --- Wave 1 Wrappers --- */
+  if (parser_match(parser, TOK_SERVO)) {
     lexer_next_token(parser->lexer);
-    return ast_break();
+    parser_expect(parser, TOK_PIN);
+    ASTNode *pin = parse_expression(parser);
+    return ast_servo_attach(pin);
   }
-
-  // Continue
-  if (parser_match(parser, TOK_CONTINUE)) {
+  if (parser_match_id(parser, "dht11") || parser_match_id(parser, "dht22")) {
+    int type = parser_match_id(parser, "dht11") ? 11 : 22;
     lexer_next_token(parser->lexer);
-    return ast_continue();
+    parser_expect(parser, TOK_PIN);
+    ASTNode *pin = parse_expression(parser);
+    return ast_dht_attach(pin, type);
   }
-
-  /* ============================================================
-   * Library Wrapper Statement Handlers
-   * ============================================================ */
-
-  /* attach servo pin N */
-  /* attach dht11 pin N  /  attach dht22 pin N */
-  /* attach strip pin N count C */
-  /* attach lcd columns C rows R */
-  if (parser_match_id(parser, "attach")) {
+  if (parser_match_id(parser, "strip")) {
     lexer_next_token(parser->lexer);
-
-    /* --- Wave 1 Wrappers --- */
-    if (parser_match(parser, TOK_SERVO)) {
-      lexer_next_token(parser->lexer);
-      parser_expect(parser, TOK_PIN);
-      ASTNode *pin = parse_expression(parser);
-      return ast_servo_attach(pin);
-    }
-    if (parser_match_id(parser, "dht11") || parser_match_id(parser, "dht22")) {
-      int type = parser_match_id(parser, "dht11") ? 11 : 22;
+    parser_expect(parser, TOK_PIN);
+    ASTNode *pin = parse_expression(parser);
+    if (!parser_match_id(parser, "count")) {
+      error_report(parser->errors, ERROR_SYNTAX,
+                   parser->lexer->current_token.line,
+                   parser->lexer->current_token.column, "Expected 'count'");
+    } else {
       lexer_next_token(parser->lexer);
-      parser_expect(parser, TOK_PIN);
-      ASTNode *pin = parse_expression(parser);
-      return ast_dht_attach(pin, type);
     }
-    if (parser_match_id(parser, "strip")) {
+    ASTNode *count = parse_expression(parser);
+    return ast_neopixel_init(pin, count);
+  }
+  if (parser_match_id(parser, "lcd")) {
+    lexer_next_token(parser->lexer);
+    if (!parser_match_id(parser, "columns")) {
+      error_report(parser->errors, ERROR_SYNTAX,
+                   parser->lexer->current_token.line,
+                   parser->lexer->current_token.column, "Expected 'columns'");
+    } else {
       lexer_next_token(parser->lexer);
-      parser_expect(parser, TOK_PIN);
-      ASTNode *pin = parse_expression(parser);
-      if (!parser_match_id(parser, "count")) {
-        error_report(parser->errors, ERROR_SYNTAX,
-                     parser->lexer->current_token.line,
-                     parser->lexer->current_token.column, "Expected 'count'");
-      } else {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *count = parse_expression(parser);
-      return ast_neopixel_init(pin, count);
     }
-    if (parser_match_id(parser, "lcd")) {
+    ASTNode *cols = parse_expression(parser);
+    if (!parser_match_id(parser, "rows")) {
+      error_report(parser->errors, ERROR_SYNTAX,
+                   parser->lexer->current_token.line,
+                   parser->lexer->current_token.column, "Expected 'rows'");
+    } else {
       lexer_next_token(parser->lexer);
-      if (!parser_match_id(parser, "columns")) {
-        error_report(parser->errors, ERROR_SYNTAX,
-                     parser->lexer->current_token.line,
-                     parser->lexer->current_token.column, "Expected 'columns'");
-      } else {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *cols = parse_expression(parser);
-      if (!parser_match_id(parser, "rows")) {
-        error_report(parser->errors, ERROR_SYNTAX,
-                     parser->lexer->current_token.line,
-                     parser->lexer->current_token.column, "Expected 'rows'");
-      } else {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *rows = parse_expression(parser);
-      return ast_lcd_init(cols, rows);
     }
+    ASTNode *rows = parse_expression(parser);
+    return ast_lcd_init(cols, rows);
+  }
 
-    /* --- Wave 2 Wrappers --- */
-    if (parser_match(parser, TOK_STEPPER)) {
+  /* --- Wave 2 Wrappers --- */
+  if (parser_match(parser, TOK_STEPPER)) {
+    lexer_next_token(parser->lexer);
+    if (!parser_match_id(parser, "step")) {
+      error_report(parser->errors, ERROR_SYNTAX,
+                   parser->lexer->current_token.line,
+                   parser->lexer->current_token.column, "Expected 'step'");
+    } else {
       lexer_next_token(parser->lexer);
-      if (!parser_match_id(parser, "step")) {
-        error_report(parser->errors, ERROR_SYNTAX,
-                     parser->lexer->current_token.line,
-                     parser->lexer->current_token.column, "Expected 'step'");
-      } else {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *step_pin = parse_expression(parser);
-      if (!parser_match_id(parser, "dir")) {
-        error_report(parser->errors, ERROR_SYNTAX,
-                     parser->lexer->current_token.line,
-                     parser->lexer->current_token.column, "Expected 'dir'");
-      } else {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *dir_pin = parse_expression(parser);
-      return ast_stepper_attach(step_pin, dir_pin);
     }
-    if (parser_match(parser, TOK_MOTOR)) {
+    ASTNode *step_pin = parse_expression(parser);
+    if (!parser_match_id(parser, "dir")) {
+      error_report(parser->errors, ERROR_SYNTAX,
+                   parser->lexer->current_token.line,
+                   parser->lexer->current_token.column, "Expected 'dir'");
+    } else {
       lexer_next_token(parser->lexer);
-      if (!parser_match_id(parser, "enable") &&
-          !parser_match(parser, TOK_ENABLE)) {
-        error_report(parser->errors, ERROR_SYNTAX,
-                     parser->lexer->current_token.line,
-                     parser->lexer->current_token.column, "Expected 'enable'");
-      } else {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *en_pin = parse_expression(parser);
-      if (!parser_match_id(parser, "forward")) {
-        error_report(parser->errors, ERROR_SYNTAX,
-                     parser->lexer->current_token.line,
-                     parser->lexer->current_token.column, "Expected 'forward'");
-      } else {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *fwd_pin = parse_expression(parser);
-      if (!parser_match_id(parser, "reverse")) {
-        error_report(parser->errors, ERROR_SYNTAX,
-                     parser->lexer->current_token.line,
-                     parser->lexer->current_token.column, "Expected 'reverse'");
-      } else {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *rev_pin = parse_expression(parser);
-      return ast_motor_attach(en_pin, fwd_pin, rev_pin);
     }
-    if (parser_match(parser, TOK_ENCODER)) {
+    ASTNode *dir_pin = parse_expression(parser);
+    return ast_stepper_attach(step_pin, dir_pin);
+  }
+  if (parser_match(parser, TOK_MOTOR)) {
+    lexer_next_token(parser->lexer);
+    if (!parser_match_id(parser, "enable") &&
+        !parser_match(parser, TOK_ENABLE)) {
+      error_report(parser->errors, ERROR_SYNTAX,
+                   parser->lexer->current_token.line,
+                   parser->lexer->current_token.column, "Expected 'enable'");
+    } else {
       lexer_next_token(parser->lexer);
-      if (!parser_match_id(parser, "pin_a")) {
-        error_report(parser->errors, ERROR_SYNTAX,
-                     parser->lexer->current_token.line,
-                     parser->lexer->current_token.column, "Expected 'pin_a'");
-      } else {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *pin_a = parse_expression(parser);
-      if (!parser_match_id(parser, "pin_b")) {
-        error_report(parser->errors, ERROR_SYNTAX,
-                     parser->lexer->current_token.line,
-                     parser->lexer->current_token.column, "Expected 'pin_b'");
-      } else {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *pin_b = parse_expression(parser);
-      return ast_encoder_attach(pin_a, pin_b);
     }
-    if (parser_match(parser, TOK_ESC)) {
+    ASTNode *en_pin = parse_expression(parser);
+    if (!parser_match_id(parser, "forward")) {
+      error_report(parser->errors, ERROR_SYNTAX,
+                   parser->lexer->current_token.line,
+                   parser->lexer->current_token.column, "Expected 'forward'");
+    } else {
       lexer_next_token(parser->lexer);
-      parser_expect(parser, TOK_PIN);
-      ASTNode *pin = parse_expression(parser);
-      return ast_esc_attach(pin);
     }
-    /* Wave 4 Wrappers */
-    if (parser_match(parser, TOK_IMU)) {
+    ASTNode *fwd_pin = parse_expression(parser);
+    if (!parser_match_id(parser, "reverse")) {
+      error_report(parser->errors, ERROR_SYNTAX,
+                   parser->lexer->current_token.line,
+                   parser->lexer->current_token.column, "Expected 'reverse'");
+    } else {
       lexer_next_token(parser->lexer);
-      ASTNode *port = NULL;
-      if (parser_match(parser, TOK_I2C) || parser_match(parser, TOK_SPI)) {
-        port = ast_string(parser->lexer->current_token.value);
-        lexer_next_token(parser->lexer);
-      } else {
-        port = parse_expression(parser);
-      }
-      return ast_imu_attach(port);
     }
-    if (parser_match(parser, TOK_GPS)) {
+    ASTNode *rev_pin = parse_expression(parser);
+    return ast_motor_attach(en_pin, fwd_pin, rev_pin);
+  }
+  if (parser_match(parser, TOK_ENCODER)) {
+    lexer_next_token(parser->lexer);
+    if (!parser_match_id(parser, "pin_a")) {
+      error_report(parser->errors, ERROR_SYNTAX,
+                   parser->lexer->current_token.line,
+                   parser->lexer->current_token.column, "Expected 'pin_a'");
+    } else {
       lexer_next_token(parser->lexer);
-      ASTNode *port = NULL;
-      if (parser_match(parser, TOK_SERIAL)) {
-        port = ast_string(parser->lexer->current_token.value);
-        lexer_next_token(parser->lexer);
-      } else {
-        port = parse_expression(parser);
-      }
-      ASTNode *baud = parse_expression(parser); /* Expect 9600 */
-      return ast_gps_attach(port, baud);
     }
-    if (parser_match(parser, TOK_LIDAR)) {
+    ASTNode *pin_a = parse_expression(parser);
+    if (!parser_match_id(parser, "pin_b")) {
+      error_report(parser->errors, ERROR_SYNTAX,
+                   parser->lexer->current_token.line,
+                   parser->lexer->current_token.column, "Expected 'pin_b'");
+    } else {
       lexer_next_token(parser->lexer);
-      ASTNode *port = NULL;
-      if (parser_match(parser, TOK_I2C) || parser_match(parser, TOK_SPI)) {
-        port = ast_string(parser->lexer->current_token.value);
-        lexer_next_token(parser->lexer);
-      } else {
-        port = parse_expression(parser);
-      }
-      return ast_lidar_attach(port);
     }
-    /* Wave 5 Wrappers */
-    if (parser_match(parser, TOK_OLED)) {
+    ASTNode *pin_b = parse_expression(parser);
+    return ast_encoder_attach(pin_a, pin_b);
+  }
+  if (parser_match(parser, TOK_ESC)) {
+    lexer_next_token(parser->lexer);
+    parser_expect(parser, TOK_PIN);
+    ASTNode *pin = parse_expression(parser);
+    return ast_esc_attach(pin);
+  }
+  /* Wave 4 Wrappers */
+  if (parser_match(parser, TOK_IMU)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *port = NULL;
+    if (parser_match(parser, TOK_I2C) || parser_match(parser, TOK_SPI)) {
+      port = ast_string(parser->lexer->current_token.value);
       lexer_next_token(parser->lexer);
-      ASTNode *width = NULL, *height = NULL;
-      if (parser_match_id(parser, "width")) {
-        lexer_next_token(parser->lexer);
-        width = parse_expression(parser);
-      } else { width = ast_number(128); }
-      if (parser_match_id(parser, "height")) {
-        lexer_next_token(parser->lexer);
-        height = parse_expression(parser);
-      } else { height = ast_number(64); }
-      return ast_oled_attach(width, height);
+    } else {
+      port = parse_expression(parser);
     }
-    if (parser_match(parser, TOK_AUDIO)) {
+    return ast_imu_attach(port);
+  }
+  if (parser_match(parser, TOK_GPS)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *port = NULL;
+    if (parser_match(parser, TOK_SERIAL)) {
+      port = ast_string(parser->lexer->current_token.value);
       lexer_next_token(parser->lexer);
-      ASTNode *pin = NULL;
-      if (parser_match(parser, TOK_PIN)) {
-        lexer_next_token(parser->lexer);
-        pin = parse_expression(parser);
-      } else { pin = ast_number(25); }
-      return ast_audio_attach(pin);
+    } else {
+      port = parse_expression(parser);
     }
-    if (parser_match(parser, TOK_CAMERA)) {
+    ASTNode *baud = parse_expression(parser); /* Expect 9600 */
+    return ast_gps_attach(port, baud);
+  }
+  if (parser_match(parser, TOK_LIDAR)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *port = NULL;
+    if (parser_match(parser, TOK_I2C) || parser_match(parser, TOK_SPI)) {
+      port = ast_string(parser->lexer->current_token.value);
       lexer_next_token(parser->lexer);
-      ASTNode *protocol = NULL;
-      if (parser_match_id(parser, "protocol")) {
-        lexer_next_token(parser->lexer);
-        protocol = ast_string(parser->lexer->current_token.value);
-        lexer_next_token(parser->lexer);
-      } else { protocol = ast_string("i2c"); }
-      return ast_cam_attach(protocol);
+    } else {
+      port = parse_expression(parser);
     }
-    /* Wave 6: attach mecanum fl N fr N bl N br N */
-    if (parser_match(parser, TOK_MECANUM)) {
+    return ast_lidar_attach(port);
+  }
+  /* Wave 5 Wrappers */
+  if (parser_match(parser, TOK_OLED)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *width = NULL, *height = NULL;
+    if (parser_match_id(parser, "width")) {
       lexer_next_token(parser->lexer);
-      ASTNode *fl = NULL, *fr = NULL, *bl = NULL, *br = NULL;
-      if (parser_match_id(parser, "fl")) {
-        lexer_next_token(parser->lexer);
-        fl = parse_expression(parser);
-      } else { fl = ast_number(2); }
-      if (parser_match_id(parser, "fr")) {
-        lexer_next_token(parser->lexer);
-        fr = parse_expression(parser);
-      } else { fr = ast_number(3); }
-      if (parser_match_id(parser, "bl")) {
-        lexer_next_token(parser->lexer);
-        bl = parse_expression(parser);
-      } else { bl = ast_number(4); }
-      if (parser_match_id(parser, "br")) {
-        lexer_next_token(parser->lexer);
-        br = parse_expression(parser);
-      } else { br = ast_number(5); }
-      return ast_mecanum_attach(fl, fr, bl, br);
-    }
-    /* Wave 6: attach kalman */
-    if (parser_match(parser, TOK_KALMAN)) {
+      width = parse_expression(parser);
+    } else { width = ast_number(128); }
+    if (parser_match_id(parser, "height")) {
       lexer_next_token(parser->lexer);
-      return ast_kalman_attach();
-    }
-    /* Wave 7: attach arm dof N length1 L1 length2 L2 length3 L3 */
-    if (parser_match(parser, TOK_ARM)) {
+      height = parse_expression(parser);
+    } else { height = ast_number(64); }
+    return ast_oled_attach(width, height);
+  }
+  if (parser_match(parser, TOK_AUDIO)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *pin = NULL;
+    if (parser_match(parser, TOK_PIN)) {
       lexer_next_token(parser->lexer);
-      parser_expect_id(parser, "dof");
-      ASTNode *dof = parse_expression(parser);
-      parser_expect_id(parser, "length1");
-      ASTNode *len1 = parse_expression(parser);
-      parser_expect_id(parser, "length2");
-      ASTNode *len2 = parse_expression(parser);
-      parser_expect_id(parser, "length3");
-      ASTNode *len3 = parse_expression(parser);
-      return ast_arm_attach(dof, len1, len2, len3);
-    }
-    /* Wave 7: attach quadcopter fl N fr N bl N br N */
-    if (parser_match(parser, TOK_QUADCOPTER)) {
+      pin = parse_expression(parser);
+    } else { pin = ast_number(25); }
+    return ast_audio_attach(pin);
+  }
+  if (parser_match(parser, TOK_CAMERA)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *protocol = NULL;
+    if (parser_match_id(parser, "protocol")) {
       lexer_next_token(parser->lexer);
-      ASTNode *fl = ast_number(2), *fr = ast_number(3), *bl = ast_number(4), *br = ast_number(5);
-      if (parser_match_id(parser, "fl")) {
-        lexer_next_token(parser->lexer);
-        fl = parse_expression(parser);
-      }
-      if (parser_match_id(parser, "fr")) {
-        lexer_next_token(parser->lexer);
-        fr = parse_expression(parser);
-      }
-      if (parser_match_id(parser, "bl")) {
-        lexer_next_token(parser->lexer);
-        bl = parse_expression(parser);
-      }
-      if (parser_match_id(parser, "br")) {
-        lexer_next_token(parser->lexer);
-        br = parse_expression(parser);
-      }
-      return ast_drone_attach(fl, fr, bl, br);
-    }
-    if (parser_match(parser, TOK_PID)) {
+      protocol = ast_string(parser->lexer->current_token.value);
       lexer_next_token(parser->lexer);
-      if (!parser_match_id(parser, "kp")) {
-        error_report(parser->errors, ERROR_SYNTAX,
-                     parser->lexer->current_token.line,
-                     parser->lexer->current_token.column, "Expected 'kp'");
-      } else {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *kp = parse_expression(parser);
-      if (!parser_match_id(parser, "ki")) {
-        error_report(parser->errors, ERROR_SYNTAX,
-                     parser->lexer->current_token.line,
-                     parser->lexer->current_token.column, "Expected 'ki'");
-      } else {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *ki = parse_expression(parser);
-      if (!parser_match_id(parser, "kd")) {
-        error_report(parser->errors, ERROR_SYNTAX,
-                     parser->lexer->current_token.line,
-                     parser->lexer->current_token.column, "Expected 'kd'");
-      } else {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *kd = parse_expression(parser);
-      return ast_pid_attach(kp, ki, kd);
-    }
+    } else { protocol = ast_string("i2c"); }
+    return ast_cam_attach(protocol);
   }
-
-  /* ============================================================
-   * Wave 4: Navigation & Storage Statement Handlers
-   * ============================================================ */
-
-  /* mount sd pin N */
-  if (parser_match_id(parser, "mount")) {
+  /* Wave 6: attach mecanum fl N fr N bl N br N */
+  if (parser_match(parser, TOK_MECANUM)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_SD)) {
+    ASTNode *fl = NULL, *fr = NULL, *bl = NULL, *br = NULL;
+    if (parser_match_id(parser, "fl")) {
       lexer_next_token(parser->lexer);
-      if (parser_match(parser, TOK_PIN))
-        lexer_next_token(parser->lexer);
-      ASTNode *pin = parse_expression(parser);
-      return ast_sd_mount(pin);
-    }
+      fl = parse_expression(parser);
+    } else { fl = ast_number(2); }
+    if (parser_match_id(parser, "fr")) {
+      lexer_next_token(parser->lexer);
+      fr = parse_expression(parser);
+    } else { fr = ast_number(3); }
+    if (parser_match_id(parser, "bl")) {
+      lexer_next_token(parser->lexer);
+      bl = parse_expression(parser);
+    } else { bl = ast_number(4); }
+    if (parser_match_id(parser, "br")) {
+      lexer_next_token(parser->lexer);
+      br = parse_expression(parser);
+    } else { br = ast_number(5); }
+    return ast_mecanum_attach(fl, fr, bl, br);
   }
-
-  /* open file "name" */
-  if (parser_match(parser, TOK_OPEN)) {
-    // If not matching serial/i2c/spi from Wave 1, check Wave 4 file
-    // The previous TOK_OPEN block for serial is far above. We need to be
-    // careful. Wait, TOK_OPEN is handled starting at line 2778. If we reach
-    // here, we are OUTSIDE the TOK_OPEN block because that block returned NULL
-    // if it didn't match serial/i2c/spi. Instead of overriding, we should
-    // capture `open file` here. Alternatively, we can let it evaluate. The
-    // parser_match(parser, TOK_OPEN) at 2778 consumes the token! We cannot
-    // catch `open` here if it was already consumed on line 2778. Let me fix
-    // this by injecting the open/write/close file logic as a separate tool call
-    // into the TOK_OPEN block. Wait, this block is inside parser_statement but
-    // outside the top TOK_OPEN.
+  /* Wave 6: attach kalman */
+  if (parser_match(parser, TOK_KALMAN)) {
+    lexer_next_token(parser->lexer);
+    return ast_kalman_attach();
   }
-
-  /* write file expr */
-  if (parser_match(parser, TOK_WRITE_KW)) {
-    // Similarly, write is consumed above at 2838. I must add the file logic
-    // directly into the TOK_WRITE_KW block or use a different keyword.
+  /* Wave 7: attach arm dof N length1 L1 length2 L2 length3 L3 */
+  if (parser_match(parser, TOK_ARM)) {
+    lexer_next_token(parser->lexer);
+    parser_expect_id(parser, "dof");
+    ASTNode *dof = parse_expression(parser);
+    parser_expect_id(parser, "length1");
+    ASTNode *len1 = parse_expression(parser);
+    parser_expect_id(parser, "length2");
+    ASTNode *len2 = parse_expression(parser);
+    parser_expect_id(parser, "length3");
+    ASTNode *len3 = parse_expression(parser);
+    return ast_arm_attach(dof, len1, len2, len3);
   }
-
-  /* close file */
-  if (parser_match_id(parser, "close")) {
+  /* Wave 7: attach quadcopter fl N fr N bl N br N */
+  if (parser_match(parser, TOK_QUADCOPTER)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_FILE)) {
+    ASTNode *fl = ast_number(2), *fr = ast_number(3), *bl = ast_number(4), *br = ast_number(5);
+    if (parser_match_id(parser, "fl")) {
       lexer_next_token(parser->lexer);
-      return ast_file_close();
+      fl = parse_expression(parser);
     }
-  }
-
-  /* ============================================================
-   * Wave 6: Advanced Locomotion, Sensor Fusion & Edge AI
-   * ============================================================ */
-
-  /* load ai model "file.tflite" */
-  if (parser_match(parser, TOK_LOAD)) {
-    lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_AI)) {
+    if (parser_match_id(parser, "fr")) {
       lexer_next_token(parser->lexer);
-      if (parser_match(parser, TOK_MODEL)) {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *model_path = parse_expression(parser);
-      return ast_ai_load(model_path);
+      fr = parse_expression(parser);
+    }
+    if (parser_match_id(parser, "bl")) {
+      lexer_next_token(parser->lexer);
+      bl = parse_expression(parser);
+    }
+    if (parser_match_id(parser, "br")) {
+      lexer_next_token(parser->lexer);
+      br = parse_expression(parser);
     }
+    return ast_drone_attach(fl, fr, bl, br);
   }
-
-  /* compute kalman raw N  (statement form) */
-  /* compute ai input      (statement form) */
-  if (parser_match(parser, TOK_COMPUTE_KW)) {
+  if (parser_match(parser, TOK_PID)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_KALMAN)) {
+    if (!parser_match_id(parser, "kp")) {
+      error_report(parser->errors, ERROR_SYNTAX,
+                   parser->lexer->current_token.line,
+                   parser->lexer->current_token.column, "Expected 'kp'");
+    } else {
       lexer_next_token(parser->lexer);
-      if (parser_match(parser, TOK_RAW)) {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *raw = parse_expression(parser);
-      return ast_kalman_compute(raw);
     }
-    if (parser_match(parser, TOK_AI)) {
+    ASTNode *kp = parse_expression(parser);
+    if (!parser_match_id(parser, "ki")) {
+      error_report(parser->errors, ERROR_SYNTAX,
+                   parser->lexer->current_token.line,
+                   parser->lexer->current_token.column, "Expected 'ki'");
+    } else {
       lexer_next_token(parser->lexer);
-      ASTNode *input = parse_expression(parser);
-      return ast_ai_compute(input);
     }
-    if (parser_match(parser, TOK_PID)) {
-      /* existing compute pid path - delegate back */
+    ASTNode *ki = parse_expression(parser);
+    if (!parser_match_id(parser, "kd")) {
+      error_report(parser->errors, ERROR_SYNTAX,
+                   parser->lexer->current_token.line,
+                   parser->lexer->current_token.column, "Expected 'kd'");
+    } else {
+      lexer_next_token(parser->lexer);
+    }
+    ASTNode *kd = parse_expression(parser);
+    return ast_pid_attach(kp, ki, kd);
+  }
+  return NULL;
+}
+
+/* ============================================================
+ * Wave 4: Navigation & Storage Statement Handlers
+ * ============================================================ */
+
+/* mount sd pin N */
+static ASTNode *parse_mount_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_SD)) {
+    lexer_next_token(parser->lexer);
+    if (parser_match(parser, TOK_PIN))
       lexer_next_token(parser->lexer);
-      ASTNode *val = parse_expression(parser);
-      return ast_pid_compute(val);
-    }
+    ASTNode *pin = parse_expression(parser);
+    return ast_sd_mount(pin);
   }
+  return NULL;
+}
 
-  /* ============================================================
-   * Wave 5: Output Systems & Edge AI Statement Handlers
-   * ============================================================ */
+/* close file */
+static ASTNode *parse_close_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_FILE)) {
+    lexer_next_token(parser->lexer);
+    return ast_file_close();
+  }
+  return NULL;
+}
 
-  /* oled print "text" at x N y N | oled show | oled clear | oled draw ... */
-  if (parser_match(parser, TOK_OLED)) {
+/* ============================================================
+ * Wave 6: Advanced Locomotion, Sensor Fusion & Edge AI
+ * ============================================================ */
+
+/* load ai model "file.tflite" */
+static ASTNode *parse_load_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_AI)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_PRINT)) {
-      lexer_next_token(parser->lexer);
-      ASTNode *text = parse_expression(parser);
-      ASTNode *x = ast_number(0), *y = ast_number(0);
-      if (parser_match_id(parser, "at")) {
-        lexer_next_token(parser->lexer);
-        if (parser_match_id(parser, "x")) { lexer_next_token(parser->lexer); x = parse_expression(parser); }
-        if (parser_match_id(parser, "y")) { lexer_next_token(parser->lexer); y = parse_expression(parser); }
-      }
-      return ast_oled_print(text, x, y);
-    }
-    if (parser_match(parser, TOK_SHOW)) {
+    if (parser_match(parser, TOK_MODEL)) {
       lexer_next_token(parser->lexer);
-      return ast_oled_show();
     }
-    if (parser_match(parser, TOK_CLEAR)) {
+    ASTNode *model_path = parse_expression(parser);
+    return ast_ai_load(model_path);
+  }
+  return NULL;
+}
+
+/* compute kalman raw N  (statement form) */
+/* compute ai input      (statement form) */
+static ASTNode *parse_compute_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_KALMAN)) {
+    lexer_next_token(parser->lexer);
+    if (parser_match(parser, TOK_RAW)) {
       lexer_next_token(parser->lexer);
-      return ast_oled_clear();
     }
-    if (parser_match(parser, TOK_DRAW)) {
+    ASTNode *raw = parse_expression(parser);
+    return ast_kalman_compute(raw);
+  }
+  if (parser_match(parser, TOK_AI)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *input = parse_expression(parser);
+    return ast_ai_compute(input);
+  }
+  if (parser_match(parser, TOK_PID)) {
+    /* existing compute pid path - delegate back */
+    lexer_next_token(parser->lexer);
+    ASTNode *val = parse_expression(parser);
+    return ast_pid_compute(val);
+  }
+  return NULL;
+}
+
+/* ============================================================
+ * Wave 5: Output Systems & Edge AI Statement Handlers
+ * ============================================================ */
+
+/* oled print "text" at x N y N | oled show | oled clear | oled draw ... */
+static ASTNode *parse_oled_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_PRINT)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *text = parse_expression(parser);
+    ASTNode *x = ast_number(0), *y = ast_number(0);
+    if (parser_match_id(parser, "at")) {
       lexer_next_token(parser->lexer);
-      int shape = 0;
-      if (parser_match(parser, TOK_CIRCLE)) { shape = 0; lexer_next_token(parser->lexer); }
-      else if (parser_match(parser, TOK_RECT)) { shape = 1; lexer_next_token(parser->lexer); }
-      else if (parser_match(parser, TOK_LINE)) { shape = 2; lexer_next_token(parser->lexer); }
-      ASTNode *x = ast_number(0), *y = ast_number(0), *p1 = ast_number(10), *p2 = NULL;
       if (parser_match_id(parser, "x")) { lexer_next_token(parser->lexer); x = parse_expression(parser); }
       if (parser_match_id(parser, "y")) { lexer_next_token(parser->lexer); y = parse_expression(parser); }
-      if (parser_match_id(parser, "radius") || parser_match_id(parser, "width") || parser_match_id(parser, "x2")) {
-        lexer_next_token(parser->lexer); p1 = parse_expression(parser);
-      }
-      if (parser_match_id(parser, "height") || parser_match_id(parser, "y2")) {
-        lexer_next_token(parser->lexer); p2 = parse_expression(parser);
-      }
-      return ast_oled_draw(shape, x, y, p1, p2);
     }
+    return ast_oled_print(text, x, y);
+  }
+  if (parser_match(parser, TOK_SHOW)) {
+    lexer_next_token(parser->lexer);
+    return ast_oled_show();
+  }
+  if (parser_match(parser, TOK_CLEAR)) {
+    lexer_next_token(parser->lexer);
+    return ast_oled_clear();
+  }
+  if (parser_match(parser, TOK_DRAW)) {
+    lexer_next_token(parser->lexer);
+    int shape = 0;
+    if (parser_match(parser, TOK_CIRCLE)) { shape = 0; lexer_next_token(parser->lexer); }
+    else if (parser_match(parser, TOK_RECT)) { shape = 1; lexer_next_token(parser->lexer); }
+    else if (parser_match(parser, TOK_LINE)) { shape = 2; lexer_next_token(parser->lexer); }
+    ASTNode *x = ast_number(0), *y = ast_number(0), *p1 = ast_number(10), *p2 = NULL;
+    if (parser_match_id(parser, "x")) { lexer_next_token(parser->lexer); x = parse_expression(parser); }
+    if (parser_match_id(parser, "y")) { lexer_next_token(parser->lexer); y = parse_expression(parser); }
+    if (parser_match_id(parser, "radius") || parser_match_id(parser, "width") || parser_match_id(parser, "x2")) {
+      lexer_next_token(parser->lexer); p1 = parse_expression(parser);
+    }
+    if (parser_match_id(parser, "height") || parser_match_id(parser, "y2")) {
+      lexer_next_token(parser->lexer); p2 = parse_expression(parser);
+    }
+    return ast_oled_draw(shape, x, y, p1, p2);
   }
+  return NULL;
+}
 
-  /* play frequency N duration N | play sound "name" */
-  if (parser_match(parser, TOK_PLAY)) {
+/* play frequency N duration N | play sound "name" */
+static ASTNode *parse_play_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_FREQUENCY)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_FREQUENCY)) {
-      lexer_next_token(parser->lexer);
-      ASTNode *freq = parse_expression(parser);
-      ASTNode *dur = ast_number(500);
-      if (parser_match(parser, TOK_DURATION)) {
-        lexer_next_token(parser->lexer);
-        dur = parse_expression(parser);
-      }
-      return ast_play_freq(freq, dur);
-    }
-    if (parser_match(parser, TOK_SOUND)) {
+    ASTNode *freq = parse_expression(parser);
+    ASTNode *dur = ast_number(500);
+    if (parser_match(parser, TOK_DURATION)) {
       lexer_next_token(parser->lexer);
-      ASTNode *name = parse_expression(parser);
-      return ast_play_sound(name);
+      dur = parse_expression(parser);
     }
+    return ast_play_freq(freq, dur);
+  }
+  if (parser_match(parser, TOK_SOUND)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *name = parse_expression(parser);
+    return ast_play_sound(name);
   }
+  return NULL;
+}
 
-  /* move servo/stepper/motor */
-  if (parser_match_id(parser, "move")) {
+/* move servo/stepper/motor */
+static ASTNode *parse_move_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_SERVO)) {
+    lexer_next_token(parser->lexer);
+    parser_expect(parser, TOK_TO);
+    ASTNode *angle = parse_expression(parser);
+    return ast_servo_move(angle);
+  }
+  if (parser_match(parser, TOK_STEPPER)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *steps = parse_expression(parser);
+    return ast_stepper_move(steps);
+  }
+  if (parser_match(parser, TOK_MOTOR)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_SERVO)) {
+    int dir = 1; /* Default forward */
+    if (parser_match_id(parser, "forward")) {
+      dir = 1;
       lexer_next_token(parser->lexer);
-      parser_expect(parser, TOK_TO);
-      ASTNode *angle = parse_expression(parser);
-      return ast_servo_move(angle);
-    }
-    if (parser_match(parser, TOK_STEPPER)) {
+    } else if (parser_match_id(parser, "reverse")) {
+      dir = -1;
       lexer_next_token(parser->lexer);
-      ASTNode *steps = parse_expression(parser);
-      return ast_stepper_move(steps);
     }
-    if (parser_match(parser, TOK_MOTOR)) {
+    if (parser_match_id(parser, "at")) {
       lexer_next_token(parser->lexer);
-      int dir = 1; /* Default forward */
-      if (parser_match_id(parser, "forward")) {
-        dir = 1;
-        lexer_next_token(parser->lexer);
-      } else if (parser_match_id(parser, "reverse")) {
-        dir = -1;
-        lexer_next_token(parser->lexer);
-      }
-      if (parser_match_id(parser, "at")) {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *speed = parse_expression(parser);
-      return ast_motor_move(dir, speed);
     }
-    /* Wave 6: move mecanum x N y N turn N */
-    if (parser_match(parser, TOK_MECANUM)) {
+    ASTNode *speed = parse_expression(parser);
+    return ast_motor_move(dir, speed);
+  }
+  /* Wave 6: move mecanum x N y N turn N */
+  if (parser_match(parser, TOK_MECANUM)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *x = NULL, *y = NULL, *turn = NULL;
+    if (parser_match_id(parser, "x")) {
       lexer_next_token(parser->lexer);
-      ASTNode *x = NULL, *y = NULL, *turn = NULL;
-      if (parser_match_id(parser, "x")) {
-        lexer_next_token(parser->lexer);
-        x = parse_expression(parser);
-      } else { x = ast_number(0); }
-      if (parser_match_id(parser, "y")) {
-        lexer_next_token(parser->lexer);
-        y = parse_expression(parser);
-      } else { y = ast_number(0); }
-      if (parser_match(parser, TOK_TURN)) {
-        lexer_next_token(parser->lexer);
-        turn = parse_expression(parser);
-      } else { turn = ast_number(0); }
-      return ast_mecanum_move(x, y, turn);
-    }
-    /* Wave 7: move arm to x N y N z N */
-    if (parser_match(parser, TOK_ARM)) {
+      x = parse_expression(parser);
+    } else { x = ast_number(0); }
+    if (parser_match_id(parser, "y")) {
       lexer_next_token(parser->lexer);
-      if (parser_match(parser, TOK_TO)) {
-        lexer_next_token(parser->lexer);
-      }
-      ASTNode *x = ast_number(0), *y = ast_number(0), *z = ast_number(0);
-      if (parser_match_id(parser, "x")) {
-        lexer_next_token(parser->lexer);
-        x = parse_expression(parser);
-      }
-      if (parser_match_id(parser, "y")) {
-        lexer_next_token(parser->lexer);
-        y = parse_expression(parser);
-      }
-      if (parser_match_id(parser, "z")) {
-        lexer_next_token(parser->lexer);
-        z = parse_expression(parser);
-      }
-      return ast_arm_move(x, y, z);
-    }
+      y = parse_expression(parser);
+    } else { y = ast_number(0); }
+    if (parser_match(parser, TOK_TURN)) {
+      lexer_next_token(parser->lexer);
+      turn = parse_expression(parser);
+    } else { turn = ast_number(0); }
+    return ast_mecanum_move(x, y, turn);
   }
-
-  /* detach servo pin N */
-  if (parser_match_id(parser, "detach")) {
+  /* Wave 7: move arm to x N y N z N */
+  if (parser_match(parser, TOK_ARM)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_SERVO) || parser_match_id(parser, "servo")) {
+    if (parser_match(parser, TOK_TO)) {
       lexer_next_token(parser->lexer);
-      if (parser_match(parser, TOK_PIN))
-        lexer_next_token(parser->lexer);
-      ASTNode *pin = parse_expression(parser);
-      return ast_servo_detach(pin);
     }
-  }
-
-  /* stop motor */
-  if (parser_match(parser, TOK_STOP)) {
-    lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_I2C)) {
+    ASTNode *x = ast_number(0), *y = ast_number(0), *z = ast_number(0);
+    if (parser_match_id(parser, "x")) {
       lexer_next_token(parser->lexer);
-      return ast_i2c_stop();
+      x = parse_expression(parser);
     }
-    if (parser_match(parser, TOK_MOTOR)) {
+    if (parser_match_id(parser, "y")) {
       lexer_next_token(parser->lexer);
-      return ast_motor_stop();
+      y = parse_expression(parser);
     }
-    /* Wave 6: stop mecanum */
-    if (parser_match(parser, TOK_MECANUM)) {
+    if (parser_match_id(parser, "z")) {
       lexer_next_token(parser->lexer);
-      return ast_mecanum_stop();
+      z = parse_expression(parser);
     }
+    return ast_arm_move(x, y, z);
   }
+  return NULL;
+}
 
-  /* show pixels */
-  if (parser_match(parser, TOK_SHOW) || parser_match_id(parser, "show")) {
+/* detach servo pin N */
+static ASTNode *parse_detach_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_SERVO) || parser_match_id(parser, "servo")) {
     lexer_next_token(parser->lexer);
-    if (parser_match_id(parser, "pixels")) {
+    if (parser_match(parser, TOK_PIN))
       lexer_next_token(parser->lexer);
-      return ast_neopixel_show();
-    }
+    ASTNode *pin = parse_expression(parser);
+    return ast_servo_detach(pin);
   }
+  return NULL;
+}
 
-  /* clear pixels */
-  if (parser_match(parser, TOK_CLEAR) || parser_match_id(parser, "clear")) {
+/* stop motor */
+static ASTNode *parse_stop_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_I2C)) {
     lexer_next_token(parser->lexer);
-    if (parser_match_id(parser, "pixels")) {
-      lexer_next_token(parser->lexer);
-      return ast_neopixel_clear();
-    }
+    return ast_i2c_stop();
+  }
+  if (parser_match(parser, TOK_MOTOR)) {
+    lexer_next_token(parser->lexer);
+    return ast_motor_stop();
+  }
+  /* Wave 6: stop mecanum */
+  if (parser_match(parser, TOK_MECANUM)) {
+    lexer_next_token(parser->lexer);
+    return ast_mecanum_stop();
   }
+  return NULL;
+}
 
-  /* reset encoder */
-  if (parser_match_id(parser, "reset")) {
+/* show pixels */
+static ASTNode *parse_show_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match_id(parser, "pixels")) {
     lexer_next_token(parser->lexer);
-    if (!parser_match(parser, TOK_ENCODER)) {
-      error_report(parser->errors, ERROR_SYNTAX,
-                   parser->lexer->current_token.line,
-                   parser->lexer->current_token.column, "Expected 'encoder'");
-    } else {
-      lexer_next_token(parser->lexer);
-    }
-    return ast_encoder_reset();
+    return ast_neopixel_show();
   }
+  return NULL;
+}
 
-  /* lcd print "text" line N  /  lcd clear */
-  if (parser_match_id(parser, "lcd")) {
+/* clear pixels */
+static ASTNode *parse_clear_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match_id(parser, "pixels")) {
     lexer_next_token(parser->lexer);
-    const char *action = parser->lexer->current_token.value;
-    if (strcmp(action, "print") == 0) {
-      lexer_next_token(parser->lexer);
-      ASTNode *text = parse_expression(parser);
-      ASTNode *line = NULL;
-      if (parser_match(parser, TOK_LINE) || parser_match_id(parser, "line")) {
-        lexer_next_token(parser->lexer);
-        line = parse_expression(parser);
-      }
-      return ast_lcd_print(text, line);
-    }
-    if (strcmp(action, "clear") == 0) {
-      lexer_next_token(parser->lexer);
-      return ast_lcd_clear();
-    }
+    return ast_neopixel_clear();
   }
+  return NULL;
+}
 
-  // Handle special identifier-based statements: const
-  if (parser_match(parser, TOK_ID)) {
-    const char *kw = parser->lexer->current_token.value;
+/* reset encoder */
+static ASTNode *parse_reset_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (!parser_match(parser, TOK_ENCODER)) {
+    error_report(parser->errors, ERROR_SYNTAX,
+                 parser->lexer->current_token.line,
+                 parser->lexer->current_token.column, "Expected 'encoder'");
+  } else {
+    lexer_next_token(parser->lexer);
+  }
+  return ast_encoder_reset();
+}
 
-    // Check for 'const' keyword pretending to be an identifier
-    if (strcmp(kw, "const") == 0) {
+/* lcd print "text" line N  /  lcd clear */
+static ASTNode *parse_lcd_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  const char *action = parser->lexer->current_token.value;
+  if (strcmp(action, "print") == 0) {
+    lexer_next_token(parser->lexer);
+    ASTNode *text = parse_expression(parser);
+    ASTNode *line = NULL;
+    if (parser_match(parser, TOK_LINE) || parser_match_id(parser, "line")) {
       lexer_next_token(parser->lexer);
-      Token name_tok = parser->lexer->current_token;
-      name_tok.value = strdup(name_tok.value);
-      parser_expect(parser, TOK_ID);
-      ASTNode *value = NULL;
-      if (parser_match(parser, TOK_ASSIGN)) {
-        lexer_next_token(parser->lexer);
-        value = parse_expression(parser);
-      }
-      return ast_var_decl_const(name_tok.value, NULL, value);
+      line = parse_expression(parser);
     }
+    return ast_lcd_print(text, line);
   }
+  if (strcmp(action, "clear") == 0) {
+    lexer_next_token(parser->lexer);
+    return ast_lcd_clear();
+  }
+  return NULL;
+}
 
-  // Function call as statement: name(args...)
-  if (parser_match(parser, TOK_ID)) {
-    Token name_tok = parser->lexer->current_token;
-    name_tok.value = strdup(name_tok.value);
-    // Peek ahead: if next token after ID is '(', it's a function call
-    lexer_next_token(parser->lexer); // consume the ID
-    if (parser_match(parser, TOK_LPAREN)) {
-      lexer_next_token(parser->lexer); // consume '('
-      int arg_capacity = 16;
-      ASTNode **args = malloc(sizeof(ASTNode *) * arg_capacity);
-      int arg_count = 0;
-      while (!parser_match(parser, TOK_RPAREN) &&
-             !parser_match(parser, TOK_EOF)) {
-        if (arg_count >= arg_capacity) {
-          arg_capacity *= 2;
-          args = realloc(args, sizeof(ASTNode *) * arg_capacity);
-        }
-        args[arg_count++] = parse_expression(parser);
-        if (parser_match(parser, TOK_COMMA))
-          lexer_next_token(parser->lexer);
-      }
-      parser_expect(parser, TOK_RPAREN);
-      return ast_call(name_tok.value, args, arg_count);
-    }
-    // Array element assignment: name[index] = expr
-    if (parser_match(parser, TOK_LBRACKET)) {
-      lexer_next_token(parser->lexer);
-      ASTNode *index = parse_expression(parser);
-      parser_expect(parser, TOK_RBRACKET);
-      ASTNode *target = ast_array_access(ast_identifier(name_tok.value), index);
-      // Could be chained: name[i].field = expr
-      while (parser_match(parser, TOK_DOT)) {
-        lexer_next_token(parser->lexer);
-        Token member_tok = parser->lexer->current_token;
-        member_tok.value = strdup(member_tok.value);
-        lexer_next_token(parser->lexer);
-        target = ast_struct_access(target, member_tok.value);
+/* const <name> = <expr> */
+static ASTNode *parse_const_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  Token name_tok = parser->lexer->current_token;
+  name_tok.value = token_text(&name_tok);
+  parser_expect(parser, TOK_ID);
+  ASTNode *value = NULL;
+  if (parser_match(parser, TOK_ASSIGN)) {
+    lexer_next_token(parser->lexer);
+    value = parse_expression(parser);
+  }
+  return ast_var_decl_const(name_tok.value, NULL, value);
+}
+
+// Function call as statement: name(args...)
+static ASTNode *parse_call_or_assignment(Parser *parser) {
+  Token name_tok = parser->lexer->current_token;
+  name_tok.value = token_text(&name_tok);
+  // Peek ahead: if next token after ID is '(', it's a function call
+  lexer_next_token(parser->lexer); // consume the ID
+  if (parser_match(parser, TOK_LPAREN)) {
+    lexer_next_token(parser->lexer); // consume '('
+    int arg_capacity = 16;
+    ASTNode **args = ast_alloc(sizeof(ASTNode *) * arg_capacity);
+    int arg_count = 0;
+    while (!parser_match(parser, TOK_RPAREN) &&
+           !parser_match(parser, TOK_EOF)) {
+      if (arg_count >= arg_capacity) {
+        args = parser_grow_array(args, sizeof(ASTNode *), arg_capacity);
+        arg_capacity *= 2;
       }
-      if (parser_match(parser, TOK_ASSIGN)) {
+      args[arg_count++] = parse_expression(parser);
+      if (parser_match(parser, TOK_COMMA))
         lexer_next_token(parser->lexer);
-        ASTNode *value = parse_expression(parser);
-        return ast_assignment(target, value);
-      }
-      return target; // expression statement
     }
-    // Struct field assignment: name.field = expr
-    if (parser_match(parser, TOK_DOT)) {
-      ASTNode *target = ast_identifier(name_tok.value);
-      while (parser_match(parser, TOK_DOT)) {
-        lexer_next_token(parser->lexer);
-        Token member_tok = parser->lexer->current_token;
-        member_tok.value = strdup(member_tok.value);
-        lexer_next_token(parser->lexer);
-        target = ast_struct_access(target, member_tok.value);
-      }
-      if (parser_match(parser, TOK_ASSIGN)) {
-        lexer_next_token(parser->lexer);
-        ASTNode *value = parse_expression(parser);
-        return ast_assignment(target, value);
-      }
-      return target; // expression statement
+    parser_expect(parser, TOK_RPAREN);
+    return ast_call(name_tok.value, args, arg_count);
+  }
+  // Array element assignment: name[index] = expr
+  if (parser_match(parser, TOK_LBRACKET)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *index = parse_expression(parser);
+    parser_expect(parser, TOK_RBRACKET);
+    ASTNode *target = ast_array_access(ast_identifier(name_tok.value), index);
+    // Could be chained: name[i].field = expr
+    while (parser_match(parser, TOK_DOT)) {
+      lexer_next_token(parser->lexer);
+      Token member_tok = parser->lexer->current_token;
+      member_tok.value = token_text(&member_tok);
+      lexer_next_token(parser->lexer);
+      target = ast_struct_access(target, member_tok.value);
     }
-    // Not a function call - it's an assignment like: varname = expr
-    // (already handled by set/change, but handle bare assignment too)
     if (parser_match(parser, TOK_ASSIGN)) {
       lexer_next_token(parser->lexer);
       ASTNode *value = parse_expression(parser);
-      ASTNode *target = ast_identifier(name_tok.value);
       return ast_assignment(target, value);
     }
-    // Unknown - just return identifier as expression
-    symbol_table_lookup(parser->symbols, name_tok.value);
-    return ast_identifier(name_tok.value);
-  }
-
-  /* ============================================================
-   * V3.0 Statement Handlers
-   * ============================================================ */
-
-  /* make array <name>[<size>] of <type>
-     make buffer <name>[<size>] of <type>
-     make int|float|bool|byte <name> = <expr>
-     make array int|float|bool|byte <name>[<size>]
-     shared make <type|var> <name> = <expr>        */
-  /* (TOK_MAKE already consumed above for 'make var' — we need to catch
-      the other forms BEFORE the var-only version.  The fix: we already
-      consumed 'make' + 'var' above, but for new keywords we fall through.
-      Insert these handlers BEFORE the existing make-var block by checking
-      inside the TOK_MAKE branch.  Since we can't rewrite that block here,
-      we handle the MAKE-prefixed forms that weren't caught above.)        */
-
-  /* push <buffer> <expr> */
-  if (parser_match(parser, TOK_PUSH)) {
-    lexer_next_token(parser->lexer);
-    Token buf_tok = parser->lexer->current_token;
-    buf_tok.value = strdup(buf_tok.value);
-    parser_expect(parser, TOK_ID);
-    ASTNode *val = parse_expression(parser);
-    return ast_buffer_push(buf_tok.value, val);
+    return target; // expression statement
   }
-
-  /* on pin N rising/falling/changing { } */
-  if (parser_match(parser, TOK_ON)) {
-    lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_PIN)) {
+  // Struct field assignment: name.field = expr
+  if (parser_match(parser, TOK_DOT)) {
+    ASTNode *target = ast_identifier(name_tok.value);
+    while (parser_match(parser, TOK_DOT)) {
       lexer_next_token(parser->lexer);
-      Token pin_tok = parser->lexer->current_token;
-      pin_tok.value = strdup(pin_tok.value);
-      int pin_num = (int)atof(pin_tok.value);
+      Token member_tok = parser->lexer->current_token;
+      member_tok.value = token_text(&member_tok);
       lexer_next_token(parser->lexer);
-      InterruptMode mode = INT_MODE_RISING;
-      if (parser_match(parser, TOK_RISING)) {
-        mode = INT_MODE_RISING;
-        lexer_next_token(parser->lexer);
-      } else if (parser_match(parser, TOK_FALLING)) {
-        mode = INT_MODE_FALLING;
-        lexer_next_token(parser->lexer);
-      } else if (parser_match(parser, TOK_CHANGING)) {
-        mode = INT_MODE_CHANGING;
-        lexer_next_token(parser->lexer);
-      }
-      parser_expect(parser, TOK_LBRACE);
-      ASTNode *body = parse_block(parser);
-      parser_expect(parser, TOK_RBRACE);
-      return ast_interrupt_pin(pin_num, mode, body);
+      target = ast_struct_access(target, member_tok.value);
     }
-    /* on timer every N us/ms { } */
-    if (parser_match(parser, TOK_TIMER)) {
-      lexer_next_token(parser->lexer);
-      /* expect 'every' */
-      if (parser_match(parser, TOK_EVERY))
-        lexer_next_token(parser->lexer);
-      Token interval_tok = parser->lexer->current_token;
-      interval_tok.value = strdup(interval_tok.value);
-      int interval = (int)atof(interval_tok.value);
+    if (parser_match(parser, TOK_ASSIGN)) {
       lexer_next_token(parser->lexer);
-      int is_us = 1;
-      if (parser_match(parser, TOK_MS_TOK)) {
-        is_us = 0;
-        lexer_next_token(parser->lexer);
-      } else if (parser_match(parser, TOK_US_TOK)) {
-        is_us = 1;
-        lexer_next_token(parser->lexer);
-      }
-      parser_expect(parser, TOK_LBRACE);
-      ASTNode *body = parse_block(parser);
-      parser_expect(parser, TOK_RBRACE);
-      return ast_interrupt_timer(interval, is_us, body);
+      ASTNode *value = parse_expression(parser);
+      return ast_assignment(target, value);
     }
-    /* on error { } — used inside try/on error: handled by try block */
-    error_report(parser->errors, ERROR_SYNTAX,
-                 parser->lexer->current_token.line,
-                 parser->lexer->current_token.column,
-                 "Expected 'pin N' or 'timer' after 'on'");
-    return NULL;
+    return target; // expression statement
   }
+  // Not a function call - it's an assignment like: varname = expr
+  // (already handled by set/change, but handle bare assignment too)
+  if (parser_match(parser, TOK_ASSIGN)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *value = parse_expression(parser);
+    ASTNode *target = ast_identifier(name_tok.value);
+    return ast_assignment(target, value);
+  }
+  // Unknown - just return identifier as expression
+  symbol_table_lookup(parser->symbols, name_tok.value);
+  return ast_identifier(name_tok.value);
+}
+
+/* ============================================================
+ * V3.0 Statement Handlers
+ * ============================================================ */
+
+/* push <buffer> <expr> */
+static ASTNode *parse_push_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  Token buf_tok = parser->lexer->current_token;
+  buf_tok.value = token_text(&buf_tok);
+  parser_expect(parser, TOK_ID);
+  ASTNode *val = parse_expression(parser);
+  return ast_buffer_push(buf_tok.value, val);
+}
 
-  /* open serial at N baud */
-  if (parser_match(parser, TOK_OPEN)) {
+/* on pin N rising/falling/changing { } */
+static ASTNode *parse_on_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_PIN)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_SERIAL)) {
+    Token pin_tok = parser->lexer->current_token;
+    pin_tok.value = token_text(&pin_tok);
+    int pin_num = (int)atof(pin_tok.value);
+    lexer_next_token(parser->lexer);
+    InterruptMode mode = INT_MODE_RISING;
+    if (parser_match(parser, TOK_RISING)) {
+      mode = INT_MODE_RISING;
       lexer_next_token(parser->lexer);
-      if (parser_match_id(parser, "at"))
-        lexer_next_token(parser->lexer);
-      Token baud_tok = parser->lexer->current_token;
-      baud_tok.value = strdup(baud_tok.value);
-      int baud = (int)atof(baud_tok.value);
+    } else if (parser_match(parser, TOK_FALLING)) {
+      mode = INT_MODE_FALLING;
       lexer_next_token(parser->lexer);
-      if (parser_match(parser, TOK_BAUD))
-        lexer_next_token(parser->lexer);
-      return ast_serial_open(baud);
-    }
-    if (parser_match(parser, TOK_I2C)) {
+    } else if (parser_match(parser, TOK_CHANGING)) {
+      mode = INT_MODE_CHANGING;
       lexer_next_token(parser->lexer);
-      return ast_i2c_open();
     }
-    if (parser_match(parser, TOK_SPI)) {
+    parser_expect(parser, TOK_LBRACE);
+    ASTNode *body = parse_block(parser);
+    parser_expect(parser, TOK_RBRACE);
+    return ast_interrupt_pin(pin_num, mode, body);
+  }
+  /* on timer every N us/ms { } */
+  if (parser_match(parser, TOK_TIMER)) {
+    lexer_next_token(parser->lexer);
+    /* expect 'every' */
+    if (parser_match(parser, TOK_EVERY))
       lexer_next_token(parser->lexer);
-      if (parser_match_id(parser, "at"))
-        lexer_next_token(parser->lexer);
-      Token freq_tok = parser->lexer->current_token;
-      freq_tok.value = strdup(freq_tok.value);
-      int freq = (int)atof(freq_tok.value);
+    Token interval_tok = parser->lexer->current_token;
+    interval_tok.value = token_text(&interval_tok);
+    int interval = (int)atof(interval_tok.value);
+    lexer_next_token(parser->lexer);
+    int is_us = 1;
+    if (parser_match(parser, TOK_MS_TOK)) {
+      is_us = 0;
       lexer_next_token(parser->lexer);
-      if (parser_match(parser, TOK_HZ))
-        lexer_next_token(parser->lexer);
-      return ast_spi_open(freq);
-    }
-    /* Wave 4: open file "name" */
-    if (parser_match(parser, TOK_FILE)) {
+    } else if (parser_match(parser, TOK_US_TOK)) {
+      is_us = 1;
       lexer_next_token(parser->lexer);
-      ASTNode *filename = parse_expression(parser);
-      return ast_file_open(filename);
     }
-    error_report(parser->errors, ERROR_SYNTAX,
-                 parser->lexer->current_token.line,
-                 parser->lexer->current_token.column,
-                 "Expected 'serial', 'i2c', 'spi', or 'file' after 'open'");
-    return NULL;
+    parser_expect(parser, TOK_LBRACE);
+    ASTNode *body = parse_block(parser);
+    parser_expect(parser, TOK_RBRACE);
+    return ast_interrupt_timer(interval, is_us, body);
   }
+  /* on error { } — used inside try/on error: handled by try block */
+  error_report(parser->errors, ERROR_SYNTAX,
+               parser->lexer->current_token.line,
+               parser->lexer->current_token.column,
+               "Expected 'pin N' or 'timer' after 'on'");
+  return NULL;
+}
 
-  /* send serial <expr> */
-  if (parser_match(parser, TOK_SEND)) {
+/* open serial at N baud */
+static ASTNode *parse_open_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_SERIAL)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_SERIAL)) {
+    if (parser_match_id(parser, "at"))
       lexer_next_token(parser->lexer);
-      ASTNode *val = parse_expression(parser);
-      return ast_serial_send(val);
-    }
+    Token baud_tok = parser->lexer->current_token;
+    baud_tok.value = token_text(&baud_tok);
+    int baud = (int)atof(baud_tok.value);
+    lexer_next_token(parser->lexer);
+    if (parser_match(parser, TOK_BAUD))
+      lexer_next_token(parser->lexer);
+    return ast_serial_open(baud);
+  }
+  if (parser_match(parser, TOK_I2C)) {
+    lexer_next_token(parser->lexer);
+    return ast_i2c_open();
+  }
+  if (parser_match(parser, TOK_SPI)) {
+    lexer_next_token(parser->lexer);
+    if (parser_match_id(parser, "at"))
+      lexer_next_token(parser->lexer);
+    Token freq_tok = parser->lexer->current_token;
+    freq_tok.value = token_text(&freq_tok);
+    int freq = (int)atof(freq_tok.value);
+    lexer_next_token(parser->lexer);
+    if (parser_match(parser, TOK_HZ))
+      lexer_next_token(parser->lexer);
+    return ast_spi_open(freq);
+  }
+  /* Wave 4: open file "name" */
+  if (parser_match(parser, TOK_FILE)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *filename = parse_expression(parser);
+    return ast_file_open(filename);
   }
+  error_report(parser->errors, ERROR_SYNTAX,
+               parser->lexer->current_token.line,
+               parser->lexer->current_token.column,
+               "Expected 'serial', 'i2c', 'spi', or 'file' after 'open'");
+  return NULL;
+}
 
-  /* radio_send_peer(peer_id, data) */
-  if (parser_match(parser, TOK_RADIO_SEND)) {
+/* send serial <expr> */
+static ASTNode *parse_send_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_SERIAL)) {
     lexer_next_token(parser->lexer);
-    parser_expect(parser, TOK_LPAREN);
-    ASTNode *peer = parse_expression(parser);
-    parser_expect(parser, TOK_COMMA);
-    ASTNode *data = parse_expression(parser);
-    parser_expect(parser, TOK_RPAREN);
-    return ast_radio_send(peer, data);
+    ASTNode *val = parse_expression(parser);
+    return ast_serial_send(val);
   }
+  return NULL;
+}
+
+/* radio_send_peer(peer_id, data) */
+static ASTNode *parse_radio_send_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  parser_expect(parser, TOK_LPAREN);
+  ASTNode *peer = parse_expression(parser);
+  parser_expect(parser, TOK_COMMA);
+  ASTNode *data = parse_expression(parser);
+  parser_expect(parser, TOK_RPAREN);
+  return ast_radio_send(peer, data);
+}
 
-  /* write i2c device <addr> value <val>
-     write i2c device <addr> register <reg>   (high-level write) */
-  if (parser_match(parser, TOK_WRITE_KW)) {
+/* write i2c device <addr> value <val>
+   write i2c device <addr> register <reg>   (high-level write) */
+static ASTNode *parse_write_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_I2C)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_I2C)) {
-      lexer_next_token(parser->lexer);
-      if (parser_match(parser, TOK_DEVICE))
-        lexer_next_token(parser->lexer);
-      ASTNode *addr = parse_expression(parser);
-      if (parser_match_id(parser, "value"))
-        lexer_next_token(parser->lexer);
-      ASTNode *val = parse_expression(parser);
-      return ast_i2c_device_write(addr, val);
-    } else if (parser_match(parser, TOK_FILE)) {
-      /* Wave 4: write file expr */
+    if (parser_match(parser, TOK_DEVICE))
       lexer_next_token(parser->lexer);
-      ASTNode *data = parse_expression(parser);
-      return ast_file_write(data);
-    } else if (parser_match(parser, TOK_DEVICE)) {
+    ASTNode *addr = parse_expression(parser);
+    if (parser_match_id(parser, "value"))
       lexer_next_token(parser->lexer);
-      Token dev_name = parser->lexer->current_token;
-      dev_name.value = strdup(dev_name.value);
-      parser_expect(parser, TOK_ID);
+    ASTNode *val = parse_expression(parser);
+    return ast_i2c_device_write(addr, val);
+  } else if (parser_match(parser, TOK_FILE)) {
+    /* Wave 4: write file expr */
+    lexer_next_token(parser->lexer);
+    ASTNode *data = parse_expression(parser);
+    return ast_file_write(data);
+  } else if (parser_match(parser, TOK_DEVICE)) {
+    lexer_next_token(parser->lexer);
+    Token dev_name = parser->lexer->current_token;
+    dev_name.value = token_text(&dev_name);
+    parser_expect(parser, TOK_ID);
 
-      if (parser_match_id(parser, "value"))
-        lexer_next_token(parser->lexer);
-      ASTNode *val = parse_expression(parser);
+    if (parser_match_id(parser, "value"))
+      lexer_next_token(parser->lexer);
+    ASTNode *val = parse_expression(parser);
 
-      ProtocolType proto = PROTOCOL_UART;
-      Symbol *sym = symbol_table_lookup(parser->symbols, dev_name.value);
-      if (sym && sym->kind == SYMBOL_DEVICE)
-        proto = sym->protocol;
+    ProtocolType proto = PROTOCOL_UART;
+    Symbol *sym = symbol_table_lookup(parser->symbols, dev_name.value);
+    if (sym && sym->kind == SYMBOL_DEVICE)
+      proto = sym->protocol;
 
-      return ast_device_write(dev_name.value, proto, val);
-    }
+    return ast_device_write(dev_name.value, proto, val);
   }
+  return NULL;
+}
 
-  /* read i2c device <addr> register <reg> count <expr> into <array>
-     In statements context, catch "read i2c device" array operations
-     that look like expressions but execute statelessly into buffers */
-  if (parser_match(parser, TOK_READ)) {
-    // Parse 'read' as an expression statement (covers read pin, read analog,
-    // read i2c device array, etc.)  Return the AST node directly.
-    ASTNode *expr = parse_expression(parser);
-    if (expr) {
-      return expr;
-    }
-  }
+/* read i2c device <addr> register <reg> count <expr> into <array>
+   In statements context, catch "read i2c device" array operations
+   that look like expressions but execute statelessly into buffers */
+static ASTNode *parse_read_statement(Parser *parser) {
+  // Parse 'read' as an expression statement (covers read pin, read analog,
+  // read i2c device array, etc.)  Return the AST node directly.
+  return parse_expression(parser);
+}
 
-  /* try { } on error { } */
-  if (parser_match(parser, TOK_TRY)) {
+/* try { } on error { } */
+static ASTNode *parse_try_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  parser_expect(parser, TOK_LBRACE);
+  ASTNode *try_blk = parse_block(parser);
+  parser_expect(parser, TOK_RBRACE);
+  ASTNode *err_blk = NULL;
+  /* expect 'on error' */
+  if (parser_match(parser, TOK_ON)) {
     lexer_next_token(parser->lexer);
-    parser_expect(parser, TOK_LBRACE);
-    ASTNode *try_blk = parse_block(parser);
-    parser_expect(parser, TOK_RBRACE);
-    ASTNode *err_blk = NULL;
-    /* expect 'on error' */
-    if (parser_match(parser, TOK_ON)) {
+    /* consume 'error' identifier */
+    if (parser_match(parser, TOK_ID) &&
+        strcmp(parser->lexer->current_token.value, "error") == 0) {
       lexer_next_token(parser->lexer);
-      /* consume 'error' identifier */
-      if (parser_match(parser, TOK_ID) &&
-          strcmp(parser->lexer->current_token.value, "error") == 0) {
-        lexer_next_token(parser->lexer);
-      }
-      parser_expect(parser, TOK_LBRACE);
-      err_blk = parse_block(parser);
-      parser_expect(parser, TOK_RBRACE);
     }
-    return ast_try(try_blk, err_blk);
+    parser_expect(parser, TOK_LBRACE);
+    err_blk = parse_block(parser);
+    parser_expect(parser, TOK_RBRACE);
   }
+  return ast_try(try_blk, err_blk);
+}
 
-  /* enable watchdog timeout <N>ms OR enable ota "name" [password "pw"] OR
-   * enable interrupts */
-  if (parser_match(parser, TOK_ENABLE)) {
+/* enable watchdog timeout <N>ms OR enable ota "name" [password "pw"] OR
+ * enable interrupts */
+static ASTNode *parse_enable_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_WATCHDOG)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_WATCHDOG)) {
+    if (parser_match(parser, TOK_TIMEOUT))
       lexer_next_token(parser->lexer);
-      if (parser_match(parser, TOK_TIMEOUT))
-        lexer_next_token(parser->lexer);
-      Token ms_tok = parser->lexer->current_token;
-      ms_tok.value = strdup(ms_tok.value);
-      int ms = (int)atof(ms_tok.value);
+    Token ms_tok = parser->lexer->current_token;
+    ms_tok.value = token_text(&ms_tok);
+    int ms = (int)atof(ms_tok.value);
+    lexer_next_token(parser->lexer);
+    if (parser_match(parser, TOK_MS_TOK))
       lexer_next_token(parser->lexer);
-      if (parser_match(parser, TOK_MS_TOK))
-        lexer_next_token(parser->lexer);
-      return ast_watchdog_enable(ms);
-    } else if (parser_match_id(parser, "ota")) {
-      /* enable ota "hostname" [password "secret"] */
+    return ast_watchdog_enable(ms);
+  } else if (parser_match_id(parser, "ota")) {
+    /* enable ota "hostname" [password "secret"] */
+    lexer_next_token(parser->lexer);
+    char *hostname = strdup("kinetrix");
+    char *password = NULL;
+    if (parser_match(parser, TOK_STRING_LIT)) {
+      free(hostname);
+      hostname = strdup(parser->lexer->current_token.value);
+      lexer_next_token(parser->lexer);
+    }
+    if (parser_match_id(parser, "password")) {
       lexer_next_token(parser->lexer);
-      char *hostname = strdup("kinetrix");
-      char *password = NULL;
       if (parser_match(parser, TOK_STRING_LIT)) {
-        free(hostname);
-        hostname = strdup(parser->lexer->current_token.value);
-        lexer_next_token(parser->lexer);
-      }
-      if (parser_match_id(parser, "password")) {
+        password = strdup(parser->lexer->current_token.value);
         lexer_next_token(parser->lexer);
-        if (parser_match(parser, TOK_STRING_LIT)) {
-          password = strdup(parser->lexer->current_token.value);
-          lexer_next_token(parser->lexer);
-        }
       }
-      ASTNode *node = ast_ota_enable(hostname, password);
-      free(hostname);
-      if (password)
-        free(password);
-      return node;
-    } else if (parser_match(parser, TOK_INTERRUPTS)) {
-      lexer_next_token(parser->lexer);
-      return ast_enable_interrupts();
-    } else if (parser_match(parser, TOK_BLE)) {
-      lexer_next_token(parser->lexer);
-      Token name_tok = parser->lexer->current_token;
-      name_tok.value = strdup(name_tok.value);
-      parser_expect(parser, TOK_STRING_LIT);
-      ASTNode *name = ast_string(name_tok.value);
-      free(name_tok.value);
-      return ast_ble_enable(name);
     }
+    ASTNode *node = ast_ota_enable(hostname, password);
+    free(hostname);
+    if (password)
+      free(password);
+    return node;
+  } else if (parser_match(parser, TOK_INTERRUPTS)) {
+    lexer_next_token(parser->lexer);
+    return ast_enable_interrupts();
+  } else if (parser_match(parser, TOK_BLE)) {
+    lexer_next_token(parser->lexer);
+    Token name_tok = parser->lexer->current_token;
+    name_tok.value = strdup(name_tok.value);
+    parser_expect(parser, TOK_STRING_LIT);
+    ASTNode *name = ast_string(name_tok.value);
+    free(name_tok.value);
+    return ast_ble_enable(name);
   }
+  return NULL;
+}
 
-  if (parser_match(parser, TOK_DISABLE)) {
+static ASTNode *parse_disable_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_INTERRUPTS)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_INTERRUPTS)) {
-      lexer_next_token(parser->lexer);
-      return ast_disable_interrupts();
-    }
+    return ast_disable_interrupts();
   }
+  return NULL;
+}
 
-  /* ============================================================
-   * Wave 3: Communication Statement Handlers
-   * ============================================================ */
+/* ============================================================
+ * Wave 3: Communication Statement Handlers
+ * ============================================================ */
 
-  /* connect wifi "ssid" password "pass" | connect mqtt "url" port N | connect
-   * websocket "url" */
-  if (parser_match(parser, TOK_CONNECT)) {
+/* connect wifi "ssid" password "pass" | connect mqtt "url" port N | connect
+ * websocket "url" */
+static ASTNode *parse_connect_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_WIFI)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_WIFI)) {
-      lexer_next_token(parser->lexer);
-      ASTNode *ssid = parse_expression(parser);
-      parser_expect_id(parser, "password");
-      ASTNode *password = parse_expression(parser);
-      return ast_wifi_connect(ssid, password);
-    } else if (parser_match(parser, TOK_MQTT)) {
-      lexer_next_token(parser->lexer);
-      ASTNode *broker = parse_expression(parser);
-      parser_expect_id(parser, "port");
-      ASTNode *port = parse_expression(parser);
-      return ast_mqtt_connect(broker, port);
-    } else if (parser_match(parser, TOK_WEBSOCKET)) {
-      lexer_next_token(parser->lexer);
-      ASTNode *url = parse_expression(parser);
-      return ast_ws_connect(url);
-    }
+    ASTNode *ssid = parse_expression(parser);
+    parser_expect_id(parser, "password");
+    ASTNode *password = parse_expression(parser);
+    return ast_wifi_connect(ssid, password);
+  } else if (parser_match(parser, TOK_MQTT)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *broker = parse_expression(parser);
+    parser_expect_id(parser, "port");
+    ASTNode *port = parse_expression(parser);
+    return ast_mqtt_connect(broker, port);
+  } else if (parser_match(parser, TOK_WEBSOCKET)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *url = parse_expression(parser);
+    return ast_ws_connect(url);
   }
+  return NULL;
+}
 
-  /* ble advertise "data" | ble send expr */
-  if (parser_match(parser, TOK_BLE)) {
+/* ble advertise "data" | ble send expr */
+static ASTNode *parse_ble_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match_id(parser, "advertise")) {
     lexer_next_token(parser->lexer);
-    if (parser_match_id(parser, "advertise")) {
-      lexer_next_token(parser->lexer);
-      ASTNode *data = parse_expression(parser);
-      return ast_ble_advertise(data);
-    } else if (parser_match(parser, TOK_SEND)) {
-      lexer_next_token(parser->lexer);
-      ASTNode *data = parse_expression(parser);
-      return ast_ble_send(data);
-    }
+    ASTNode *data = parse_expression(parser);
+    return ast_ble_advertise(data);
+  } else if (parser_match(parser, TOK_SEND)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *data = parse_expression(parser);
+    return ast_ble_send(data);
   }
+  return NULL;
+}
 
-  /* mqtt subscribe "topic" | mqtt publish "topic" expr */
-  if (parser_match(parser, TOK_MQTT)) {
+/* mqtt subscribe "topic" | mqtt publish "topic" expr */
+static ASTNode *parse_mqtt_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_SUBSCRIBE)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_SUBSCRIBE)) {
-      lexer_next_token(parser->lexer);
-      ASTNode *topic = parse_expression(parser);
-      return ast_mqtt_subscribe(topic);
-    } else if (parser_match(parser, TOK_PUBLISH)) {
-      lexer_next_token(parser->lexer);
-      ASTNode *topic = parse_expression(parser);
-      ASTNode *payload = parse_expression(parser);
-      return ast_mqtt_publish(topic, payload);
-    }
+    ASTNode *topic = parse_expression(parser);
+    return ast_mqtt_subscribe(topic);
+  } else if (parser_match(parser, TOK_PUBLISH)) {
+    lexer_next_token(parser->lexer);
+    ASTNode *topic = parse_expression(parser);
+    ASTNode *payload = parse_expression(parser);
+    return ast_mqtt_publish(topic, payload);
   }
+  return NULL;
+}
 
-  /* http post "url" body expr */
-  if (parser_match(parser, TOK_HTTP)) {
+/* http post "url" body expr */
+static ASTNode *parse_http_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match_id(parser, "post")) {
     lexer_next_token(parser->lexer);
-    if (parser_match_id(parser, "post")) {
-      lexer_next_token(parser->lexer);
-      ASTNode *url = parse_expression(parser);
-      parser_expect_id(parser, "body");
-      ASTNode *body = parse_expression(parser);
-      return ast_http_post(url, body);
-    }
+    ASTNode *url = parse_expression(parser);
+    parser_expect_id(parser, "body");
+    ASTNode *body = parse_expression(parser);
+    return ast_http_post(url, body);
   }
+  return NULL;
+}
 
-  /* ws send expr | ws close */
-  if (parser_match(parser, TOK_WEBSOCKET)) {
+/* ws send expr | ws close */
+static ASTNode *parse_websocket_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_SEND)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_SEND)) {
-      lexer_next_token(parser->lexer);
-      ASTNode *data = parse_expression(parser);
-      return ast_ws_send(data);
-    } else if (parser_match_id(parser, "close")) {
-      lexer_next_token(parser->lexer);
-      return ast_ws_close();
-    }
+    ASTNode *data = parse_expression(parser);
+    return ast_ws_send(data);
+  } else if (parser_match_id(parser, "close")) {
+    lexer_next_token(parser->lexer);
+    return ast_ws_close();
   }
+  return NULL;
+}
 
-  /* feed watchdog */
-  if (parser_match(parser, TOK_FEED)) {
+/* feed watchdog */
+static ASTNode *parse_feed_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_WATCHDOG))
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_WATCHDOG))
-      lexer_next_token(parser->lexer);
-    return ast_watchdog_feed();
-  }
+  return ast_watchdog_feed();
+}
 
-  /* assert <expr> else <call> */
-  if (parser_match(parser, TOK_ASSERT)) {
+/* assert <expr> else <call> */
+static ASTNode *parse_assert_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  ASTNode *cond = parse_expression(parser);
+  ASTNode *action = NULL;
+  if (parser_match(parser, TOK_ELSE)) {
     lexer_next_token(parser->lexer);
-    ASTNode *cond = parse_expression(parser);
-    ASTNode *action = NULL;
-    if (parser_match(parser, TOK_ELSE)) {
-      lexer_next_token(parser->lexer);
-      action = parse_expression(parser);
-    }
-    return ast_assert(cond, action);
+    action = parse_expression(parser);
   }
+  return ast_assert(cond, action);
+}
 
-  /* define type Name { T field ... }
-     define device name as uart/i2c/spi at addr  */
-  if (parser_match(parser, TOK_DEFINE)) {
+/* define type Name { T field ... }
+   define device name as uart/i2c/spi at addr  */
+static ASTNode *parse_define_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_TYPE_KW)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_TYPE_KW)) {
-      lexer_next_token(parser->lexer);
-      Token name_tok = parser->lexer->current_token;
-      name_tok.value = strdup(name_tok.value);
-      parser_expect(parser, TOK_ID);
-      parser_expect(parser, TOK_LBRACE);
-      /* Parse fields: each field is "<type> <fieldname>" */
-      StructField *fields = malloc(sizeof(StructField) * 32);
-      int nfields = 0;
-      while (!parser_match(parser, TOK_RBRACE) &&
-             !parser_match(parser, TOK_EOF)) {
-        Type *ftype = type_float(); /* default */
-        if (parser_match(parser, TOK_INT_KW)) {
-          ftype = type_int();
-          lexer_next_token(parser->lexer);
-        } else if (parser_match(parser, TOK_FLOAT_KW)) {
-          ftype = type_float();
-          lexer_next_token(parser->lexer);
-        } else if (parser_match(parser, TOK_BOOL_KW)) {
-          ftype = type_bool();
-          lexer_next_token(parser->lexer);
-        } else if (parser_match(parser, TOK_BYTE_KW)) {
-          ftype = type_byte();
-          lexer_next_token(parser->lexer);
-        } else if (parser_match(parser, TOK_VAR)) {
-          lexer_next_token(parser->lexer);
-        }
-
-        Token fname_tok = parser->lexer->current_token;
-        fname_tok.value = strdup(fname_tok.value);
-        lexer_next_token(parser->lexer); // Advance token unconditionally
-
-        if (!fname_tok.value || fname_tok.value[0] == '\0') {
-          error_report(
-              parser->errors, ERROR_SYNTAX, fname_tok.line, fname_tok.column,
-              "Expected valid field name (ID or keyword) in struct definition");
-          continue;
-        }
-
-        if (nfields < 32) {
-          fields[nfields].name = strdup(fname_tok.value);
-          fields[nfields].type = ftype;
-          nfields++;
-        }
-      }
-      parser_expect(parser, TOK_RBRACE);
-      return ast_struct_def(name_tok.value, fields, nfields);
-    }
-    if (parser_match(parser, TOK_DEVICE)) {
-      lexer_next_token(parser->lexer);
-      Token dev_name = parser->lexer->current_token;
-      dev_name.value = strdup(dev_name.value);
-      parser_expect(parser, TOK_ID);
-      if (parser_match_id(parser, "as"))
+    Token name_tok = parser->lexer->current_token;
+    name_tok.value = token_text(&name_tok);
+    parser_expect(parser, TOK_ID);
+    parser_expect(parser, TOK_LBRACE);
+    /* Parse fields: each field is "<type> <fieldname>" */
+    StructField *fields = ast_alloc(sizeof(StructField) * 32);
+    int nfields = 0;
+    while (!parser_match(parser, TOK_RBRACE) &&
+           !parser_match(parser, TOK_EOF)) {
+      Type *ftype = type_float(); /* default */
+      if (parser_match(parser, TOK_INT_KW)) {
+        ftype = type_int();
         lexer_next_token(parser->lexer);
-      ProtocolType proto = PROTOCOL_UART;
-      if (parser_match(parser, TOK_SERIAL)) {
-        proto = PROTOCOL_UART;
+      } else if (parser_match(parser, TOK_FLOAT_KW)) {
+        ftype = type_float();
         lexer_next_token(parser->lexer);
-      } else if (parser_match(parser, TOK_I2C)) {
-        proto = PROTOCOL_I2C;
+      } else if (parser_match(parser, TOK_BOOL_KW)) {
+        ftype = type_bool();
         lexer_next_token(parser->lexer);
-      } else if (parser_match(parser, TOK_SPI)) {
-        proto = PROTOCOL_SPI;
+      } else if (parser_match(parser, TOK_BYTE_KW)) {
+        ftype = type_byte();
         lexer_next_token(parser->lexer);
-      } else if (parser_match(parser, TOK_ID) &&
-                 strcmp(parser->lexer->current_token.value, "uart") == 0) {
-        proto = PROTOCOL_UART;
+      } else if (parser_match(parser, TOK_VAR)) {
         lexer_next_token(parser->lexer);
       }
-      if (parser_match_id(parser, "at"))
-        lexer_next_token(parser->lexer);
-      ASTNode *addr = parse_expression(parser);
-      symbol_table_add_device(parser->symbols, dev_name.value, proto);
-      return ast_device_def(dev_name.value, proto, addr);
-    }
-    return NULL;
-  }
 
-  /* task <name> { body } */
-  if (parser_match(parser, TOK_TASK)) {
-    lexer_next_token(parser->lexer);
-    Token tname = parser->lexer->current_token;
-    tname.value = strdup(tname.value);
-    parser_expect(parser, TOK_ID);
-    parser_expect(parser, TOK_LBRACE);
-    ASTNode *body = parse_block(parser);
+      Token fname_tok = parser->lexer->current_token;
+      fname_tok.value = token_text(&fname_tok);
+      lexer_next_token(parser->lexer); // Advance token unconditionally
+
+      if (!fname_tok.value || fname_tok.value[0] == '\0') {
+        error_report(
+            parser->errors, ERROR_SYNTAX, fname_tok.line, fname_tok.column,
+            "Expected valid field name (ID or keyword) in struct definition");
+        continue;
+      }
+
+      if (nfields < 32) {
+        fields[nfields].name = fname_tok.value;
+        fields[nfields].type = ftype;
+        nfields++;
+      }
+    }
     parser_expect(parser, TOK_RBRACE);
-    return ast_task_def(tname.value, body);
+    return ast_struct_def(name_tok.value, fields, nfields);
   }
-
-  /* start task <name> */
-  if (parser_match(parser, TOK_START)) {
+  if (parser_match(parser, TOK_DEVICE)) {
     lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_TASK))
-      lexer_next_token(parser->lexer);
-    Token tname = parser->lexer->current_token;
-    tname.value = strdup(tname.value);
+    Token dev_name = parser->lexer->current_token;
+    dev_name.value = token_text(&dev_name);
     parser_expect(parser, TOK_ID);
-    return ast_task_start(tname.value);
-  }
-
-  /* shared make <type|var> <name> = <expr> */
-  if (parser_match(parser, TOK_SHARED)) {
-    lexer_next_token(parser->lexer);
-    if (parser_match(parser, TOK_MAKE))
-      lexer_next_token(parser->lexer);
-    Type *t = type_float();
-    if (parser_match(parser, TOK_INT_KW)) {
-      t = type_int();
-      lexer_next_token(parser->lexer);
-    } else if (parser_match(parser, TOK_FLOAT_KW)) {
-      t = type_float();
+    if (parser_match_id(parser, "as"))
       lexer_next_token(parser->lexer);
-    } else if (parser_match(parser, TOK_BOOL_KW)) {
-      t = type_bool();
+    ProtocolType proto = PROTOCOL_UART;
+    if (parser_match(parser, TOK_SERIAL)) {
+      proto = PROTOCOL_UART;
       lexer_next_token(parser->lexer);
-    } else if (parser_match(parser, TOK_BYTE_KW)) {
-      t = type_byte();
+    } else if (parser_match(parser, TOK_I2C)) {
+      proto = PROTOCOL_I2C;
       lexer_next_token(parser->lexer);
-    } else if (parser_match(parser, TOK_VAR)) {
+    } else if (parser_match(parser, TOK_SPI)) {
+      proto = PROTOCOL_SPI;
       lexer_next_token(parser->lexer);
-    } else if (parser_match_id(parser, "string")) {
-      t = type_string();
+    } else if (parser_match(parser, TOK_ID) &&
+               strcmp(parser->lexer->current_token.value, "uart") == 0) {
+      proto = PROTOCOL_UART;
       lexer_next_token(parser->lexer);
     }
-    Token vname = parser->lexer->current_token;
-    vname.value = strdup(vname.value);
-    parser_expect(parser, TOK_ID);
-    ASTNode *init = NULL;
-    if (parser_match(parser, TOK_ASSIGN)) {
+    if (parser_match_id(parser, "at"))
       lexer_next_token(parser->lexer);
-      init = parse_expression(parser);
-    }
-    return ast_var_decl_ex(vname.value, t, init, 1 /* is_shared */);
+    ASTNode *addr = parse_expression(parser);
+    symbol_table_add_device(parser->symbols, dev_name.value, proto);
+    return ast_device_def(dev_name.value, proto, addr);
   }
-
   return NULL;
 }
 
+/* task <name> { body } */
+static ASTNode *parse_task_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  Token tname = parser->lexer->current_token;
+  tname.value = token_text(&tname);
+  parser_expect(parser, TOK_ID);
+  parser_expect(parser, TOK_LBRACE);
+  ASTNode *body = parse_block(parser);
+  parser_expect(parser, TOK_RBRACE);
+  return ast_task_def(tname.value, body);
+}
+
+/* start task <name> */
+static ASTNode *parse_start_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_TASK))
+    lexer_next_token(parser->lexer);
+  Token tname = parser->lexer->current_token;
+  tname.value = token_text(&tname);
+  parser_expect(parser, TOK_ID);
+  return ast_task_start(tname.value);
+}
+
+/* shared make <type|var> <name> = <expr> */
+static ASTNode *parse_shared_statement(Parser *parser) {
+  lexer_next_token(parser->lexer);
+  if (parser_match(parser, TOK_MAKE))
+    lexer_next_token(parser->lexer);
+  Type *t = type_float();
+  if (parser_match(parser, TOK_INT_KW)) {
+    t = type_int();
+    lexer_next_token(parser->lexer);
+  } else if (parser_match(parser, TOK_FLOAT_KW)) {
+    t = type_float();
+    lexer_next_token(parser->lexer);
+  } else if (parser_match(parser, TOK_BOOL_KW)) {
+    t = type_bool();
+    lexer_next_token(parser->lexer);
+  } else if (parser_match(parser, TOK_BYTE_KW)) {
+    t = type_byte();
+    lexer_next_token(parser->lexer);
+  } else if (parser_match(parser, TOK_VAR)) {
+    lexer_next_token(parser->lexer);
+  } else if (parser_match_id(parser, "string")) {
+    t = type_string();
+    lexer_next_token(parser->lexer);
+  }
+  Token vname = parser->lexer->current_token;
+  vname.value = token_text(&vname);
+  parser_expect(parser, TOK_ID);
+  ASTNode *init = NULL;
+  if (parser_match(parser, TOK_ASSIGN)) {
+    lexer_next_token(parser->lexer);
+    init = parse_expression(parser);
+  }
+  return ast_var_decl_ex(vname.value, t, init, 1 /* is_shared */);
+}
+
+// ============================================================================
+// STATEMENT DISPATCH
+// ============================================================================
+
+typedef ASTNode *(*StatementParser)(Parser *parser);
+
+/* Words that start a statement without being reserved keywords. They stay
+ * ordinary identifiers everywhere else, so they are matched here, before a
+ * leading identifier is taken as a call or an assignment. */
+static const struct {
+  const char *word;
+  StatementParser parse;
+} word_statements[] = {
+    {"attach", parse_attach_statement}, {"mount", parse_mount_statement},
+    {"close", parse_close_statement},   {"move", parse_move_statement},
+    {"detach", parse_detach_statement}, {"reset", parse_reset_statement},
+    {"lcd", parse_lcd_statement},       {"const", parse_const_statement},
+};
+
+static ASTNode *parse_identifier_statement(Parser *parser) {
+  const char *word = parser->lexer->current_token.value;
+  for (size_t i = 0; i < sizeof(word_statements) / sizeof(word_statements[0]);
+       i++) {
+    if (strcmp(word, word_statements[i].word) == 0)
+      return word_statements[i].parse(parser);
+  }
+  return parse_call_or_assignment(parser);
+}
+
+/* One entry per token that can open a statement; NULL means the token
+ * cannot start one and parse_statement reports nothing parsed. */
+static const StatementParser statement_parsers[TOK_TYPE_COUNT] = {
+    [TOK_ID] = parse_identifier_statement,
+    [TOK_MAKE] = parse_make_statement,
+    [TOK_SET] = parse_set_statement,
+    [TOK_CHANGE] = parse_change_statement,
+    [TOK_TURN] = parse_turn_statement,
+    [TOK_WAIT] = parse_wait_statement,
+    [TOK_WAIT_US] = parse_wait_us_statement,
+    [TOK_PRINT] = parse_print_statement,
+    [TOK_PRINTLN] = parse_print_statement,
+    [TOK_I2C] = parse_i2c_statement,
+    [TOK_IF] = parse_if_statement,
+    [TOK_WHILE] = parse_while_statement,
+    [TOK_EXTERN] = parse_extern_statement,
+    [TOK_DEF] = parse_def_statement,
+    [TOK_LOOP] = parse_loop_statement,
+    [TOK_REPEAT] = parse_repeat_statement,
+    [TOK_FOR] = parse_for_statement,
+    [TOK_RETURN] = parse_return_statement,
+    [TOK_BREAK] = parse_break_statement,
+    [TOK_CONTINUE] = parse_continue_statement,
+    [TOK_LOAD] = parse_load_statement,
+    [TOK_COMPUTE_KW] = parse_compute_statement,
+    [TOK_OLED] = parse_oled_statement,
+    [TOK_PLAY] = parse_play_statement,
+    [TOK_STOP] = parse_stop_statement,
+    [TOK_SHOW] = parse_show_statement,
+    [TOK_CLEAR] = parse_clear_statement,
+    [TOK_PUSH] = parse_push_statement,
+    [TOK_ON] = parse_on_statement,
+    [TOK_OPEN] = parse_open_statement,
+    [TOK_SEND] = parse_send_statement,
+    [TOK_RADIO_SEND] = parse_radio_send_statement,
+    [TOK_WRITE_KW] = parse_write_statement,
+    [TOK_READ] = parse_read_statement,
+    [TOK_TRY] = parse_try_statement,
+    [TOK_ENABLE] = parse_enable_statement,
+    [TOK_DISABLE] = parse_disable_statement,
+    [TOK_CONNECT] = parse_connect_statement,
+    [TOK_BLE] = parse_ble_statement,
+    [TOK_MQTT] = parse_mqtt_statement,
+    [TOK_HTTP] = parse_http_statement,
+    [TOK_WEBSOCKET] = parse_websocket_statement,
+    [TOK_FEED] = parse_feed_statement,
+    [TOK_ASSERT] = parse_assert_statement,
+    [TOK_DEFINE] = parse_define_statement,
+    [TOK_TASK] = parse_task_statement,
+    [TOK_START] = parse_start_statement,
+    [TOK_SHARED] = parse_shared_statement,
+};
+
+// Parse statement
+static ASTNode *parse_statement(Parser *parser) {
+  StatementParser parse =
+      statement_parsers[parser->lexer->current_token.type];
+  return parse ? parse(parser) : NULL;
+}
+
 // Parse block
 static ASTNode *parse_block(Parser *parser) {
-  int capacity = 100;
-  ASTNode **statements = malloc(sizeof(ASTNode *) * capacity);
+  int capacity = 8;
+  ASTNode **statements = ast_alloc(sizeof(ASTNode *) * capacity);
   int count = 0;
   int is_unreachable = 0;
 
   while (!parser_match(parser, TOK_RBRACE) && !parser_match(parser, TOK_EOF)) {
-    Token start_tok = parser->lexer->current_token;
-    start_tok.value = strdup(start_tok.value);
+    int start_line = parser->lexer->current_token.line;
     ASTNode *stmt = parse_statement(parser);
     if (stmt) {
       if (is_unreachable) {
-        // Hardcode warning emission without blocking compilation
-        fprintf(stderr, "Warning: Unreachable code detected at line %d\n",
-                start_tok.line);
+        error_warning(parser->errors,
+                      "Warning: Unreachable code detected at line %d",
+                      start_line);
         is_unreachable = 0; // Only warn once per block to prevent spam
       }
 
@@ -3748,8 +3877,8 @@ static ASTNode *parse_block(Parser *parser) {
       }
 
       if (count >= capacity) {
+        statements = parser_grow_array(statements, sizeof(ASTNode *), capacity);
         capacity *= 2;
-        statements = realloc(statements, sizeof(ASTNode *) * capacity);
       }
       statements[count++] = stmt;
     } else {
@@ -3764,21 +3893,254 @@ static ASTNode *parse_block(Parser *parser) {
                        : "NULL");
       lexer_next_token(parser->lexer); // Advance to prevent infinite loop
     }
-    free(start_tok.value); // Free the strdup'd copy used only for line tracking
   }
 
   return ast_block(statements, count);
 }
 
 // Main parse function
+// ============================================================================
+// MODULE CACHE
+// ============================================================================
+
+/* Append the statements of a parsed or cached block to the program */
+static ASTNode **append_block(ASTNode **statements, int *count, int *capacity,
+                              ASTNode *block) {
+  for (int i = 0; i < block->data.block.statement_count; i++) {
+    if (*count >= *capacity) {
+      statements =
+          parser_grow_array(statements, sizeof(ASTNode *), *capacity);
+      *capacity *= 2;
+    }
+    statements[(*count)++] = block->data.block.statements[i];
+  }
+  return statements;
+}
+
+/* Redo what a cached module did besides producing its tree */
+static void replay_notes(Parser *parser, const CacheNotes *notes) {
+  error_emit_warnings(parser->errors, notes->warnings);
+  for (int i = 0; i < notes->symbol_count; i++) {
+    const Symbol *saved = &notes->symbols[i];
+    Symbol *sym = NULL;
+    if (saved->kind == SYMBOL_DEVICE)
+      sym = symbol_table_add_device(parser->symbols, saved->name,
+                                    saved->protocol);
+    else if (symbol_table_add(parser->symbols, saved->name, saved->kind,
+                              saved->type, saved->line_defined))
+      sym = symbol_table_lookup_current_scope(parser->symbols, saved->name);
+    if (sym) {
+      sym->is_initialized = saved->is_initialized;
+      sym->is_used = saved->is_used;
+      sym->line_defined = saved->line_defined;
+    }
+  }
+  for (int i = 0; i < notes->use_count; i++) {
+    Symbol *sym = symbol_table_lookup(parser->symbols, notes->uses[i]);
+    if (sym)
+      sym->is_used = 1;
+  }
+}
+
+/* Parse an included file, or load it from the module cache when neither it
+ * nor anything it includes has changed. `key` names it in the cache and
+ * `first` is its index in the included set. Returns its top-level
+ * statements. */
+static ASTNode *parse_included_file(Parser *parser, FILE *file,
+                                    const char *path, const char *key,
+                                    int first) {
+  uint64_t hash = 0;
+  int cacheable = parser->cache && module_cache_hash_stream(file, &hash);
+  if (cacheable) {
+    if (parser->deps)
+      cache_deps_add(parser->deps, key, hash);
+    CacheDeps loaded = {NULL, 0, 0};
+    CacheNotes notes;
+    ASTNode *block =
+        module_cache_load(parser->cache, key, hash, &loaded, &notes);
+    if (block && !claim_included(parser, &loaded)) {
+      module_cache_reject(parser->cache);
+      block = NULL;
+    }
+    if (block) {
+      if (parser->deps)
+        cache_deps_append(parser->deps, &loaded);
+      replay_notes(parser, &notes);
+    }
+    cache_deps_free(&loaded);
+    if (block)
+      return block;
+  }
+  rewind(file);
+
+  CacheDeps deps = {NULL, 0, 0};
+  size_t warnings_start = parser->errors->warnings_length;
+  Parser *inc_parser = parser_create_child(file, path, parser);
+  inc_parser->deps = cacheable ? &deps : NULL;
+  ASTNode *inc_ast = parser_parse(inc_parser);
+  /* Leaving out a file included before this one started makes the tree
+   * depend on this compilation, so it cannot be saved */
+  int complete = inc_parser->skipped_from >= first;
+  if (inc_parser->skipped_from < parser->skipped_from)
+    parser->skipped_from = inc_parser->skipped_from;
+  // The included AST lives in the shared arena, so it is safe to free the
+  // parser and its lexer here. Freeing it prints its unused-variable
+  // warnings, which belong in the cache entry too.
+  parser_free(inc_parser);
+  error_list_set_file(parser->errors, parser->lexer->file_path);
+
+  ASTNode *block = NULL;
+  if (inc_ast && inc_ast->type == NODE_PROGRAM)
+    block = inc_ast->data.program.main_block;
+  if (cacheable && complete && block && parser->errors->count == 0) {
+    CacheNotes notes = {NULL, NULL, 0, NULL, 0};
+    if (parser->errors->warnings_length > warnings_start)
+      notes.warnings = parser->errors->warnings + warnings_start;
+    module_cache_store(parser->cache, key, hash, &deps, &notes, block);
+  }
+  if (parser->deps)
+    cache_deps_append(parser->deps, &deps);
+  cache_deps_free(&deps);
+  return block;
+}
+
+/* Take the file an include names into the compilation: parsed, loaded or,
+ * if the compilation already has it, left out. Returns its statements. */
+static ASTNode *include_file(Parser *parser, FILE *file, const char *path) {
+  IncludedFile id;
+  if (!identify_file(path, &id))
+    return parse_included_file(parser, file, path, path,
+                               parser->included->count);
+  int index = include_set_find(parser->included, &id);
+  if (index >= 0) {
+    free(id.path);
+    if (index < parser->skipped_from)
+      parser->skipped_from = index;
+    return NULL;
+  }
+  const char *key = id.path;
+  index = include_set_add(parser->included, &id);
+  return parse_included_file(parser, file, path, key, index);
+}
+
+/* State of the installed module whose statements are being collected */
+typedef struct {
+  int source; /* lexer source index, or -1 */
+  int first;  /* index of its first statement */
+  int included_from; /* its index in the included set */
+  int skipped_before; /* parser->skipped_from when it started */
+  uint64_t hash;
+  CacheDeps deps;
+  size_t warnings_start;
+  int symbols_start; /* global symbols declared before the module */
+  int *was_used;     /* their is_used flags when it started */
+} ModuleRecord;
+
+static void start_module(Parser *parser, ModuleRecord *record, int source,
+                         int first, uint64_t hash, int included_from) {
+  SymbolTable *symbols = parser->symbols;
+  record->source = source;
+  record->first = first;
+  record->included_from = included_from;
+  record->skipped_before = parser->skipped_from;
+  parser->skipped_from = INT_MAX;
+  record->hash = hash;
+  record->warnings_start = parser->errors->warnings_length;
+  record->symbols_start = symbols->symbol_count;
+  record->was_used = malloc(sizeof(int) * (symbols->symbol_count + 1));
+  for (int i = 0; i < symbols->symbol_count; i++)
+    record->was_used[i] = symbols->symbols[i].is_used;
+  parser->deps = &record->deps;
+}
+
+/* Save the recorded module if the lexer got past its end without errors */
+static void finish_module(Parser *parser, ModuleRecord *record,
+                          ASTNode **statements, int count) {
+  if (record->source < 0)
+    return;
+  SymbolTable *symbols = parser->symbols;
+  if (parser->lexer->source_index != record->source &&
+      parser->skipped_from >= record->included_from &&
+      parser->errors->count == 0 && symbols->scope_depth == 0) {
+    CacheNotes notes = {NULL, NULL, 0, NULL, 0};
+    if (parser->errors->warnings_length > record->warnings_start)
+      notes.warnings = parser->errors->warnings + record->warnings_start;
+    notes.symbols = symbols->symbols + record->symbols_start;
+    notes.symbol_count = symbols->symbol_count - record->symbols_start;
+    notes.uses = malloc(sizeof(char *) * (record->symbols_start + 1));
+    for (int i = 0; i < record->symbols_start; i++)
+      if (symbols->symbols[i].is_used && !record->was_used[i])
+        notes.uses[notes.use_count++] = (char *)symbols->symbols[i].name;
+    ASTNode *block =
+        ast_block(statements + record->first, count - record->first);
+    module_cache_store(parser->cache,
+                       parser->lexer->sources[record->source].path,
+                       record->hash, &record->deps, &notes, block);
+    free(notes.uses);
+  }
+  if (record->skipped_before < parser->skipped_from)
+    parser->skipped_from = record->skipped_before;
+  free(record->was_used);
+  record->was_used = NULL;
+  cache_deps_free(&record->deps);
+  record->source = -1;
+  parser->deps = NULL;
+}
+
 ASTNode *parser_parse(Parser *parser) {
-  int capacity = 1024;
-  ASTNode **statements = malloc(sizeof(ASTNode *) * capacity);
+  int capacity = 64;
+  ASTNode **statements = ast_alloc(sizeof(ASTNode *) * capacity);
   int count = 0;
+  Lexer *lexer = parser->lexer;
+  /* Every source but the last is an installed module, cached on its own */
+  int source = -1;
+  ModuleRecord record = {-1, 0, 0, 0, 0, {NULL, 0, 0}, 0, 0, NULL};
 
   // Parse global top-level declarations (functions, variables, definitions,
   // shared tasks)
   while (!parser_match(parser, TOK_PROGRAM) && !parser_match(parser, TOK_EOF)) {
+    if (lexer->source_index != source) {
+      finish_module(parser, &record, statements, count);
+      source = lexer->source_index;
+      int module = source + 1 < lexer->source_count;
+      /* A module an earlier one already included is not read again */
+      IncludedFile id;
+      int index = parser->included->count;
+      if (lexer->sources[source].path &&
+          identify_file(lexer->sources[source].path, &id)) {
+        index = include_set_find(parser->included, &id);
+        if (index >= 0) {
+          free(id.path);
+          if (module) {
+            lexer_skip_source(lexer);
+            continue;
+          }
+        } else {
+          index = include_set_add(parser->included, &id);
+        }
+      }
+      if (module && parser->cache) {
+        const char *path = lexer->sources[source].path;
+        uint64_t hash = lexer_source_hash(lexer, source);
+        CacheDeps loaded = {NULL, 0, 0};
+        CacheNotes notes;
+        ASTNode *block =
+            module_cache_load(parser->cache, path, hash, &loaded, &notes);
+        if (block && !claim_included(parser, &loaded)) {
+          module_cache_reject(parser->cache);
+          block = NULL;
+        }
+        cache_deps_free(&loaded);
+        if (block) {
+          replay_notes(parser, &notes);
+          statements = append_block(statements, &count, &capacity, block);
+          lexer_skip_source(lexer);
+          continue;
+        }
+        start_module(parser, &record, source, count, hash, index);
+      }
+    }
+
     if (parser_match(parser, TOK_INCLUDE)) {
       lexer_next_token(parser->lexer);
       if (parser_match(parser, TOK_STRING_LIT)) {
@@ -3813,24 +4175,10 @@ ASTNode *parser_parse(Parser *parser) {
                        parser->lexer->current_token.column,
                        "Could not open included file: %s", full_path);
         } else {
-          Parser *inc_parser =
-              parser_create(inc_file, full_path, parser->errors);
-          ASTNode *inc_ast = parser_parse(inc_parser);
-          if (inc_ast && inc_ast->type == NODE_PROGRAM &&
-              inc_ast->data.program.main_block) {
-            ASTNode *inc_block = inc_ast->data.program.main_block;
-            for (int i = 0; i < inc_block->data.block.statement_count; i++) {
-              if (count >= capacity) {
-                capacity *= 2;
-                statements = realloc(statements, sizeof(ASTNode *) * capacity);
-              }
-              statements[count++] = inc_block->data.block.statements[i];
-            }
-          }
+          ASTNode *inc_block = include_file(parser, inc_file, full_path);
+          if (inc_block)
+            statements = append_block(statements, &count, &capacity, inc_block);
           fclose(inc_file);
-          // AST string values are strdup'd into the nodes, so it is safe to
-          // free the parser and its lexer here.
-          parser_free(inc_parser);
         }
       } else {
         error_report(parser->errors, ERROR_SYNTAX,
@@ -3845,8 +4193,8 @@ ASTNode *parser_parse(Parser *parser) {
     ASTNode *stmt = parse_statement(parser);
     if (stmt) {
       if (count >= capacity) {
+        statements = parser_grow_array(statements, sizeof(ASTNode *), capacity);
         capacity *= 2;
-        statements = realloc(statements, sizeof(ASTNode *) * capacity);
       }
       statements[count++] = stmt;
     } else {
@@ -3857,6 +4205,8 @@ ASTNode *parser_parse(Parser *parser) {
       lexer_next_token(parser->lexer);
     }
   }
+  /* A module that ran into 'program' is not complete and is not saved */
+  finish_module(parser, &record, statements, count);
 
   // Skip optional "program" keyword and optional name
   if (parser_match(parser, TOK_PROGRAM)) {
@@ -3875,8 +4225,9 @@ ASTNode *parser_parse(Parser *parser) {
       ASTNode *stmt = parse_statement(parser);
       if (stmt) {
         if (count >= capacity) {
+          statements =
+              parser_grow_array(statements, sizeof(ASTNode *), capacity);
           capacity *= 2;
-          statements = realloc(statements, sizeof(ASTNode *) * capacity);
         }
         statements[count++] = stmt;
       } else {
@@ -3917,7 +4268,7 @@ static ASTNode *clone_target(ASTNode *node) {
   } else if (node->type == NODE_CALL) {
     ASTNode **args = NULL;
     if (node->data.call.arg_count > 0) {
-      args = malloc(sizeof(ASTNode *) * node->data.call.arg_count);
+      args = ast_alloc(sizeof(ASTNode *) * node->data.call.arg_count);
       for (int i = 0; i < node->data.call.arg_count; ++i) {
         args[i] = clone_target(node->data.call.args[i]);
       }
@@ -8,6 +8,7 @@
 #define KINETRIX_PARSER_H
 
 #include "ast.h"
+#include "ast_cache.h"
 #include "error.h"
 #include "symbol_table.h"
 
@@ -239,30 +240,72 @@ typedef enum {
   TOK_DOT, /* .  */
 
   /* Control */
-  TOK_ELSE_KW /* kept for clarity */
+  TOK_ELSE_KW, /* kept for clarity */
+
+  TOK_TYPE_COUNT /* number of token types; keep last */
 } TokenType;
 
+/* A token is a slice of the lexer's source buffer. `value` is a
+ * NUL-terminated view of the token text that stays valid only until the next
+ * lexer_next_token() call; copy it if it must outlive the current token. */
 typedef struct {
   TokenType type;
   char *value;
-  int capacity;
+  const char *start; /* first character of the token in the source */
+  size_t length;     /* length of the source slice */
   int line;
   int column;
 } Token;
 
+/* An input file handed to the lexer; it is read to the end on creation.
+ * When `text` is set it is copied instead and `file` is not touched. */
 typedef struct {
   FILE *file;
-  const char *file_path;
+  const char *path;
+  const char *text;
+  size_t length; /* bytes in text */
+} SourceFile;
+
+typedef struct {
+  char *text;    /* whole file, read once */
+  size_t length; /* bytes in text (excluding the trailing NUL) */
+  char *path;
+} LexerSource;
+
+typedef struct {
+  char *source;  /* buffer of the source being scanned */
+  size_t length; /* bytes in source (excluding the trailing NUL) */
+  size_t pos;    /* index of current_char in source */
+  const char *file_path; /* path of the source being scanned */
+  LexerSource *sources;  /* every input, scanned in order */
+  int source_count;
+  int source_index;
   int current_char;
   int line;
   int column;
   Token current_token;
   ErrorList *errors;
+  size_t saved_pos;    /* where the current token's terminator was written */
+  char saved_char;     /* character overwritten by that terminator */
+  char number_text[24]; /* decimal text for hex/binary literals */
+  StringPool *strings;  /* interns identifier tokens (optional) */
 } Lexer;
 
-Lexer *lexer_create(FILE *file, const char *file_path, ErrorList *errors);
+/* With a string pool, TOK_ID values are interned and stay valid for the
+ * pool's lifetime instead of only until the next token. */
+Lexer *lexer_create(FILE *file, const char *file_path, ErrorList *errors,
+                    StringPool *strings);
+/* Lexes several files as one token stream. Line numbers restart in each
+ * file, and the error list is told which file is current. */
+Lexer *lexer_create_multi(const SourceFile *files, int count,
+                          ErrorList *errors, StringPool *strings);
 void lexer_free(Lexer *lexer);
 void lexer_next_token(Lexer *lexer);
+/* Abandon the rest of the current source and read the first token of the
+ * next one (or TOK_EOF) */
+void lexer_skip_source(Lexer *lexer);
+/* module_cache_hash() of the text of sources[index] */
+uint64_t lexer_source_hash(Lexer *lexer, int index);
 Token lexer_peek(Lexer *lexer);
 
 // ============================================================================
@@ -273,12 +316,34 @@ typedef struct {
   Lexer *lexer;
   SymbolTable *symbols;
   ErrorList *errors;
+  Arena *arena;    /* Backs every AST node, type and string of the parse */
+  StringPool *strings; /* Interned identifiers, shared with child parsers */
+  int owns_arena;  /* Child parsers (includes) share the parent's arena */
+  ModuleCache *cache; /* Saved module ASTs, or NULL; shared with children */
+  CacheDeps *deps;    /* Files the module being parsed includes, or NULL */
+  struct IncludeSet *included; /* Files already taken into the compilation,
+                                  each at most once; shared with children */
+  int skipped_from; /* Lowest included-set index an include was skipped
+                       for, or INT_MAX */
   int in_loop;     /* For break statement validation */
   int in_function; /* For return statement validation */
 } Parser;
 
+/* Creates a parser with a fresh per-compilation arena and installs it for
+ * the ast_* constructors. The AST returned by parser_parse() lives in that
+ * arena and is released by parser_free(). */
 Parser *parser_create(FILE *file, const char *file_path, ErrorList *errors);
+/* Same, parsing `files` in order as one program */
+Parser *parser_create_multi(const SourceFile *files, int count,
+                            ErrorList *errors);
+/* Parser for an included file; shares the parent's arena, string pool and
+ * error list */
+Parser *parser_create_child(FILE *file, const char *file_path,
+                            Parser *parent);
 void parser_free(Parser *parser);
+/* Load unchanged installed modules and included files from `cache` instead
+ * of parsing them, and save the ones that had to be parsed */
+void parser_set_cache(Parser *parser, ModuleCache *cache);
 
 /* Main parsing function */
 ASTNode *parser_parse(Parser *parser);
@@ -0,0 +1,213 @@
+/* Kinetrix Pass Manager Implementation */
+
+#include "pass_manager.h"
+#include "dce.h"
+#include "feature_usage.h"
+#include "fold.h"
+#include "pin_tracker.h"
+#include "type_infer.h"
+#include "value_range.h"
+#include <string.h>
+
+// ============================================================================
+// PASSES
+// ============================================================================
+
+static int run_fold(PassUnit *unit) {
+  return ast_fold_constants(unit->program);
+}
+
+static int run_dce(PassUnit *unit) {
+  return ast_eliminate_dead_code(unit->program);
+}
+
+static int run_features(PassUnit *unit) {
+  return ast_track_features(unit->program);
+}
+
+/* Without feature tracking a backend emits its whole runtime */
+static int skip_features(PassUnit *unit) {
+  ast_use_all_features(unit->program);
+  return 0;
+}
+
+static int run_ranges(PassUnit *unit) {
+  return ast_analyze_ranges(unit->program);
+}
+
+static int run_types(PassUnit *unit) {
+  return ast_infer_types(unit->program, 1);
+}
+
+/* Backends still need every expression typed, only without narrowing */
+static int skip_types(PassUnit *unit) {
+  ast_infer_types(unit->program, 0);
+  return 0;
+}
+
+/* The tree passes are done; what follows reads the IR */
+static int run_lower(PassUnit *unit) {
+  unit->ir = ir_lower(unit->program);
+  int blocks = 0;
+  for (int f = 0; f < unit->ir->count; f++)
+    blocks += unit->ir->functions[f].block_count;
+  return blocks;
+}
+
+static int run_unreachable(PassUnit *unit) {
+  return ir_remove_unreachable(unit->ir);
+}
+
+static int run_pins(PassUnit *unit) {
+  return ir_track_pins(unit->ir, unit->program);
+}
+
+static int run_timers(PassUnit *unit) {
+  return ast_number_timers(unit->program);
+}
+
+typedef struct {
+  const char *name; /* as in --time-passes */
+  const char *flag; /* -f<flag> / -fno-<flag>, NULL if it always runs */
+  int level;        /* lowest -O level that runs it */
+  const char *unit; /* what its change count counts */
+  int (*run)(PassUnit *unit);
+  int (*skip)(PassUnit *unit); /* run instead when disabled, or NULL */
+} Pass;
+
+/* In PassId order, which is the order they run in */
+static const Pass passes[PASS_COUNT] = {
+    {"constant folding", "fold-constants", 1, "nodes folded", run_fold,
+     NULL},
+    {"dead code", "dce", 1, "statements removed", run_dce, NULL},
+    {"feature usage", "strip-runtime", 1, "runtime features kept",
+     run_features, skip_features},
+    {"range analysis", "elide-div-guards", 2, "division guards dropped",
+     run_ranges, NULL},
+    {"type inference", "narrow-ints", 2, "declarations narrowed", run_types,
+     skip_types},
+    {"ir lowering", NULL, 0, "basic blocks", run_lower, NULL},
+    {"unreachable blocks", NULL, 0, "blocks removed", run_unreachable, NULL},
+    {"pin tracking", NULL, 0, "pins found", run_pins, NULL},
+    {"timer numbering", NULL, 0, "timer interrupts", run_timers, NULL},
+};
+
+// ============================================================================
+// OPTIONS
+// ============================================================================
+
+void pass_options_init(PassOptions *options) {
+  options->level = PASS_LEVEL_DEFAULT;
+  memset(options->force, -1, sizeof(options->force));
+}
+
+int pass_options_parse(PassOptions *options, const char *arg, char *error,
+                       size_t error_size) {
+  if (strncmp(arg, "-O", 2) == 0) {
+    const char *level = arg + 2;
+    if (*level == '\0') {
+      options->level = 1; // -O alone is -O1, as in cc
+      return 1;
+    }
+    if (level[0] < '0' || level[0] > '9' || level[1] != '\0') {
+      snprintf(error, error_size, "Unknown optimization level '%s'", arg);
+      return -1;
+    }
+    options->level = level[0] - '0';
+    if (options->level > PASS_LEVEL_MAX)
+      options->level = PASS_LEVEL_MAX;
+    return 1;
+  }
+  if (strncmp(arg, "-f", 2) != 0)
+    return 0;
+  int on = strncmp(arg, "-fno-", 5) != 0;
+  const char *flag = arg + (on ? 2 : 5);
+  for (int p = 0; p < PASS_COUNT; p++) {
+    if (passes[p].flag && strcmp(passes[p].flag, flag) == 0) {
+      options->force[p] = (signed char)on;
+      return 1;
+    }
+  }
+  int length = snprintf(error, error_size, "Unknown pass '%s'; known:", flag);
+  for (int p = 0; p < PASS_COUNT; p++) {
+    if (passes[p].flag && length >= 0 && (size_t)length < error_size)
+      length += snprintf(error + length, error_size - length, " %s",
+                         passes[p].flag);
+  }
+  return -1;
+}
+
+int pass_options_format(const PassOptions *options, char *out,
+                        size_t out_size) {
+  size_t length = 0;
+  out[0] = '\0';
+  if (options->level != PASS_LEVEL_DEFAULT)
+    length += snprintf(out, out_size, "-O%d", options->level);
+  for (int p = 0; p < PASS_COUNT; p++) {
+    if (options->force[p] < 0 || length >= out_size)
+      continue;
+    length += snprintf(out + length, out_size - length, "%s-f%s%s",
+                       length ? " " : "", options->force[p] ? "" : "no-",
+                       passes[p].flag);
+  }
+  return length > 0;
+}
+
+int pass_enabled(const PassOptions *options, PassId pass) {
+  if (!passes[pass].flag)
+    return 1;
+  if (options->force[pass] >= 0)
+    return options->force[pass];
+  return options->level >= passes[pass].level;
+}
+
+// ============================================================================
+// PIPELINE
+// ============================================================================
+
+IrModule *pass_pipeline_run(ASTNode *program, const PassOptions *options,
+                            PassTimes *times, PassStats *stats) {
+  PassOptions defaults;
+  if (!options) {
+    pass_options_init(&defaults);
+    options = &defaults;
+  }
+  if (stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->level = options->level;
+  }
+  PassUnit unit = {program, NULL};
+  Arena *arena = ast_get_arena();
+  for (int p = 0; p < PASS_COUNT; p++) {
+    int enabled = pass_enabled(options, (PassId)p);
+    int (*run)(PassUnit *) = enabled ? passes[p].run : passes[p].skip;
+    if (!run)
+      continue;
+    double start = pass_clock_ms();
+    size_t allocations = arena ? arena->alloc_count : 0;
+    size_t bytes = arena ? arena->bytes_allocated : 0;
+    int changes = run(&unit);
+    if (times)
+      pass_times_add(times, passes[p].name, pass_clock_ms() - start,
+                     arena ? arena->alloc_count - allocations : 0,
+                     arena ? arena->bytes_allocated - bytes : 0);
+    if (stats) {
+      stats->enabled[p] = enabled;
+      stats->changes[p] = enabled ? changes : 0;
+    }
+  }
+  return unit.ir;
+}
+
+void pass_stats_print(const PassStats *stats, FILE *out) {
+  fprintf(out, "Pass statistics (-O%d):\n", stats->level);
+  for (int p = 0; p < PASS_COUNT; p++) {
+    if (stats->enabled[p])
+      fprintf(out, "  %-18s %6d %s\n", passes[p].name, stats->changes[p],
+              passes[p].unit);
+    else
+      fprintf(out, "  %-18s    off (-f%s)\n", passes[p].name,
+              passes[p].flag);
+  }
+  fprintf(out, "\n");
+}
@@ -0,0 +1,75 @@
+/* Kinetrix Pass Manager
+ * The middle-end passes that run between parsing and code generation, in
+ * order. Optimizations are picked by -O level and can be switched one by
+ * one with -f<flag> / -fno-<flag>; analyses every backend needs always
+ * run. Each pass reports how much it changed, for --pass-stats. The tree
+ * passes come first; then the program is lowered to the IR once and the
+ * passes after that read the IR.
+ */
+
+#ifndef KINETRIX_PASS_MANAGER_H
+#define KINETRIX_PASS_MANAGER_H
+
+#include "ast.h"
+#include "ir.h"
+#include "pass_timer.h"
+#include <stddef.h>
+#include <stdio.h>
+
+typedef enum {
+    PASS_FOLD,
+    PASS_DCE,
+    PASS_FEATURES,
+    PASS_RANGES,
+    PASS_TYPES,
+    PASS_LOWER, // The passes from here on read the IR
+    PASS_UNREACHABLE,
+    PASS_PINS,
+    PASS_TIMERS,
+    PASS_COUNT
+} PassId;
+
+#define PASS_LEVEL_MAX 2
+#define PASS_LEVEL_DEFAULT PASS_LEVEL_MAX
+
+typedef struct {
+    int level;                     // -O level, 0 .. PASS_LEVEL_MAX
+    signed char force[PASS_COUNT]; // 1 -f, 0 -fno-, -1 as the level says
+} PassOptions;
+
+typedef struct {
+    int level;
+    int enabled[PASS_COUNT];
+    int changes[PASS_COUNT]; // In the unit pass_stats_print() names
+} PassStats;
+
+void pass_options_init(PassOptions *options);
+
+/* Apply one command-line argument: 1 if it was a pass option, 0 if not,
+ * -1 with a message in `error` if it was malformed or names no pass */
+int pass_options_parse(PassOptions *options, const char *arg, char *error,
+                       size_t error_size);
+
+/* Write `options` back out as the arguments that give them ("-O0
+ * -fno-dce"); writes "" and returns 0 if they are the defaults */
+int pass_options_format(const PassOptions *options, char *out,
+                        size_t out_size);
+
+int pass_enabled(const PassOptions *options, PassId pass);
+
+/* What a pass works on: the tree, and the IR once it has been lowered */
+typedef struct {
+    ASTNode *program;
+    IrModule *ir; // NULL before PASS_LOWER
+} PassUnit;
+
+/* Run every pass over `program`; NULL options for the defaults. Times and
+ * stats may be NULL. Needs the program's AST arena installed (see
+ * ast_set_arena). Returns the program lowered to the IR, which the caller
+ * frees with ir_free(). */
+IrModule *pass_pipeline_run(ASTNode *program, const PassOptions *options,
+                            PassTimes *times, PassStats *stats);
+
+void pass_stats_print(const PassStats *stats, FILE *out);
+
+#endif // KINETRIX_PASS_MANAGER_H
@@ -0,0 +1,95 @@
+/* Kinetrix Pass Timer Implementation */
+
+#define _POSIX_C_SOURCE 200809L
+#include "pass_timer.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+double pass_clock_ms(void) {
+#ifdef _WIN32
+  LARGE_INTEGER frequency, now;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&now);
+  return (double)now.QuadPart * 1000.0 / (double)frequency.QuadPart;
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1e6;
+#endif
+}
+
+long pass_peak_rss_kb(void) {
+#ifdef _WIN32
+  return -1;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return -1;
+#ifdef __APPLE__
+  return (long)(usage.ru_maxrss / 1024); // bytes on macOS
+#else
+  return (long)usage.ru_maxrss;
+#endif
+#endif
+}
+
+void pass_times_init(PassTimes *times) {
+  times->count = 0;
+  times->start_ms = pass_clock_ms();
+}
+
+void pass_times_add_sampled(PassTimes *times, const char *name,
+                            double wall_ms, long peak_rss_kb,
+                            size_t allocations, size_t bytes) {
+  if (times->count == PASS_TIMES_MAX)
+    return;
+  PassTime *pass = &times->passes[times->count++];
+  snprintf(pass->name, sizeof(pass->name), "%s", name);
+  pass->wall_ms = wall_ms;
+  pass->peak_rss_kb = peak_rss_kb;
+  pass->allocations = allocations;
+  pass->bytes = bytes;
+}
+
+void pass_times_add(PassTimes *times, const char *name, double wall_ms,
+                    size_t allocations, size_t bytes) {
+  pass_times_add_sampled(times, name, wall_ms, pass_peak_rss_kb(),
+                         allocations, bytes);
+}
+
+void pass_times_print(const PassTimes *times, FILE *out) {
+  double total = pass_clock_ms() - times->start_ms;
+  fprintf(out, "Pass timings:\n");
+  fprintf(out, "  %-20s %10s %8s %14s %12s %12s\n", "Pass", "Wall ms", "%",
+          "Peak RSS KB", "Allocs", "Bytes");
+  for (int i = 0; i < times->count; i++) {
+    const PassTime *pass = &times->passes[i];
+    fprintf(out, "  %-20s %10.3f %7.1f%% %14ld %12zu %12zu\n", pass->name,
+            pass->wall_ms, total > 0 ? pass->wall_ms * 100.0 / total : 0.0,
+            pass->peak_rss_kb, pass->allocations, pass->bytes);
+  }
+  fprintf(out, "  %-20s %10.3f %8s %14ld\n\n", "total", total, "",
+          pass_peak_rss_kb());
+}
+
+void pass_times_print_json(const PassTimes *times, FILE *out) {
+  double total = pass_clock_ms() - times->start_ms;
+  fprintf(out, "{\"passes\": [");
+  for (int i = 0; i < times->count; i++) {
+    const PassTime *pass = &times->passes[i];
+    // Pass names are fixed identifiers, nothing to escape
+    fprintf(out,
+            "%s\n  {\"name\": \"%s\", \"wall_ms\": %.3f, "
+            "\"peak_rss_kb\": %ld, \"allocations\": %zu, \"bytes\": %zu}",
+            i ? "," : "", pass->name, pass->wall_ms, pass->peak_rss_kb,
+            pass->allocations, pass->bytes);
+  }
+  fprintf(out, "\n], \"total_ms\": %.3f, \"peak_rss_kb\": %ld}\n", total,
+          pass_peak_rss_kb());
+}
@@ -0,0 +1,45 @@
+/* Kinetrix Pass Timer
+ * Wall time, peak memory and allocation counts per compiler pass, for
+ * --time-passes. Reports are plain text for people or JSON for scripts.
+ */
+
+#ifndef KINETRIX_PASS_TIMER_H
+#define KINETRIX_PASS_TIMER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define PASS_TIMES_MAX 24
+
+typedef struct {
+    char name[32];
+    double wall_ms;
+    long peak_rss_kb;   // Process high-water mark after the pass, -1 if unknown
+    size_t allocations; // Heap or arena allocations the pass made
+    size_t bytes;       // Bytes read, allocated or generated by the pass
+} PassTime;
+
+typedef struct {
+    PassTime passes[PASS_TIMES_MAX];
+    int count;
+    double start_ms;    // When the compile began
+} PassTimes;
+
+/* Monotonic wall clock in milliseconds */
+double pass_clock_ms(void);
+/* Peak resident set size of the process in KB, or -1 if unavailable */
+long pass_peak_rss_kb(void);
+
+void pass_times_init(PassTimes *times);
+/* Record a finished pass; peak RSS is sampled now. Not thread-safe. */
+void pass_times_add(PassTimes *times, const char *name, double wall_ms,
+                    size_t allocations, size_t bytes);
+/* Same, for a pass whose peak RSS was sampled when it ended */
+void pass_times_add_sampled(PassTimes *times, const char *name,
+                            double wall_ms, long peak_rss_kb,
+                            size_t allocations, size_t bytes);
+
+void pass_times_print(const PassTimes *times, FILE *out);
+void pass_times_print_json(const PassTimes *times, FILE *out);
+
+#endif // KINETRIX_PASS_TIMER_H
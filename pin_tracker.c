@@ -1,121 +1,284 @@
-/* Pin Tracker for Hardware Diagnostics */
+/* Pin Tracker Implementation
+ *
+ * Runs on the IR rather than the tree: every def, task and handler is a
+ * function there, every operand of a pin operation is a temporary whose
+ * definition is one lookup away, and the blocks nothing reaches are gone.
+ * A pin operand is resolved when it is a constant, or a load of a variable
+ * that is declared once with a constant and never written again.
+ */
 
-#include "ast.h"
+#include "pin_tracker.h"
 #include <stdlib.h>
 #include <string.h>
 
-// Helper to check if pin already tracked
-static int pin_exists(int *pins, int count, int pin) {
-    for (int i = 0; i < count; i++) {
-        if (pins[i] == pin) return 1;
-    }
-    return 0;
+#define MAX_PINS 50
+
+typedef struct {
+  int pins[MAX_PINS];
+  int count;
+} PinSet;
+
+/* Operations with a pin as their first operand (gpio_fields) */
+static int drives_pin(NodeType type) {
+  return type == NODE_GPIO_WRITE || type == NODE_ANALOG_WRITE ||
+         type == NODE_SERVO_WRITE || type == NODE_TONE || type == NODE_NOTONE;
+}
+
+static int reads_pin(NodeType type) {
+  return type == NODE_GPIO_READ || type == NODE_ANALOG_READ ||
+         type == NODE_PULSE_READ;
+}
+
+static void pin_add(PinSet *set, double value) {
+  int pin = (int)value;
+  if (pin != value || pin < 0 || set->count >= MAX_PINS)
+    return;
+  for (int i = 0; i < set->count; i++)
+    if (set->pins[i] == pin)
+      return;
+  set->pins[set->count++] = pin;
+}
+
+// ============================================================================
+// VARIABLE TABLE
+// ============================================================================
+
+/* How often each name is declared or written, and the constant of its
+ * declaration if it had one */
+typedef struct {
+  const char *name;
+  int writes;
+  int constant;
+  double value;
+} VarInfo;
+
+typedef struct {
+  VarInfo *slots;
+  size_t capacity; /* power of 2 */
+  size_t count;
+} VarTable;
+
+static size_t name_hash(const char *name) {
+  size_t hash = 2166136261u;
+  for (const unsigned char *p = (const unsigned char *)name; *p; p++)
+    hash = (hash ^ *p) * 16777619u;
+  return hash;
 }
 
-// Recursive function to scan AST for GPIO operations
-static void scan_for_pins(ASTNode *node, int *out_pins, int *out_count, int *in_pins, int *in_count) {
-    if (!node) return;
-    
-    switch (node->type) {
-        // Output Pins
-        case NODE_GPIO_WRITE:
-        case NODE_ANALOG_WRITE:
-        case NODE_SERVO_WRITE:
-        case NODE_TONE:
-        case NODE_NOTONE:
-            if (*out_count >= 50) break;
-            if (node->data.gpio.pin && node->data.gpio.pin->type == NODE_NUMBER) {
-                int pin = (int)node->data.gpio.pin->data.number.value;
-                if (!pin_exists(out_pins, *out_count, pin)) {
-                    out_pins[(*out_count)++] = pin;
-                }
-            }
-            break;
-            
-        // Input Pins
-        case NODE_GPIO_READ:
-        case NODE_ANALOG_READ:
-        case NODE_PULSE_READ:
-            if (*in_count >= 50) break;
-            if (node->data.gpio.pin && node->data.gpio.pin->type == NODE_NUMBER) {
-                int pin = (int)node->data.gpio.pin->data.number.value;
-                if (!pin_exists(in_pins, *in_count, pin)) {
-                    in_pins[(*in_count)++] = pin;
-                }
-            }
-            break;
-            
-        case NODE_BLOCK:
-            for (int i = 0; i < node->data.block.statement_count; i++) {
-                scan_for_pins(node->data.block.statements[i], out_pins, out_count, in_pins, in_count);
-            }
-            break;
-            
-        case NODE_IF:
-            scan_for_pins(node->data.if_stmt.then_block, out_pins, out_count, in_pins, in_count);
-            scan_for_pins(node->data.if_stmt.else_block, out_pins, out_count, in_pins, in_count);
-            break;
-            
-        case NODE_WHILE:
-            scan_for_pins(node->data.while_loop.body, out_pins, out_count, in_pins, in_count);
-            break;
-            
-        case NODE_REPEAT:
-            scan_for_pins(node->data.repeat_loop.body, out_pins, out_count, in_pins, in_count);
-            break;
-            
-        case NODE_FOREVER:
-            scan_for_pins(node->data.forever_loop.body, out_pins, out_count, in_pins, in_count);
-            break;
-            
-        case NODE_VAR_DECL:
-            scan_for_pins(node->data.var_decl.initializer, out_pins, out_count, in_pins, in_count);
-            break;
-            
-        case NODE_ASSIGNMENT:
-            scan_for_pins(node->data.assignment.value, out_pins, out_count, in_pins, in_count);
-            break;
-            
-        case NODE_CALL:
-            for (int i = 0; i < node->data.call.arg_count; i++) {
-                scan_for_pins(node->data.call.args[i], out_pins, out_count, in_pins, in_count);
-            }
-            break;
-            
-        default:
-            break;
+static VarInfo *var_lookup(const VarTable *table, const char *name) {
+  if (table->count == 0)
+    return NULL;
+  size_t mask = table->capacity - 1;
+  for (size_t i = name_hash(name) & mask; table->slots[i].name;
+       i = (i + 1) & mask)
+    if (strcmp(table->slots[i].name, name) == 0)
+      return &table->slots[i];
+  return NULL;
+}
+
+static VarInfo *var_insert(VarTable *table, const char *name) {
+  VarInfo *info = var_lookup(table, name);
+  if (info)
+    return info;
+  if ((table->count + 1) * 2 > table->capacity) {
+    VarTable grown = {NULL, table->capacity ? table->capacity * 2 : 64, 0};
+    grown.slots = calloc(grown.capacity, sizeof(VarInfo));
+    for (size_t i = 0; i < table->capacity; i++)
+      if (table->slots[i].name)
+        *var_insert(&grown, table->slots[i].name) = table->slots[i];
+    free(table->slots);
+    *table = grown;
+  }
+  size_t mask = table->capacity - 1;
+  size_t i = name_hash(name) & mask;
+  while (table->slots[i].name)
+    i = (i + 1) & mask;
+  table->slots[i].name = name;
+  table->count++;
+  return &table->slots[i];
+}
+
+/* Count the names an operation the IR keeps whole may write: anything but
+ * an identifier read or a call, and everything in an opaque operand */
+static void census(VarTable *table, const ASTNode *node, int deep) {
+  if (!node)
+    return;
+  if (node->type == NODE_ASSIGNMENT && node->data.assignment.target &&
+      node->data.assignment.target->type == NODE_IDENTIFIER)
+    var_insert(table, node->data.assignment.target->data.identifier.name)
+        ->writes++;
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    const char *base = (const char *)node + field->offset;
+    int count = field->count_offset
+                    ? *(const int *)((const char *)node + field->count_offset)
+                    : 0;
+    switch (field->kind) {
+    case AST_FIELD_NAME:
+      if (node->type != NODE_IDENTIFIER && node->type != NODE_CALL &&
+          *(char *const *)base)
+        var_insert(table, *(char *const *)base)->writes++;
+      break;
+    case AST_FIELD_NAME_LIST:
+      for (int i = 0; i < count; i++)
+        if ((*(char **const *)base)[i])
+          var_insert(table, (*(char **const *)base)[i])->writes++;
+      break;
+    case AST_FIELD_NODE:
+      if (deep)
+        census(table, *(ASTNode *const *)base, deep);
+      break;
+    case AST_FIELD_NODE_LIST:
+      for (int i = 0; deep && i < count; i++)
+        census(table, (*(ASTNode **const *)base)[i], deep);
+      break;
+    default:
+      break;
     }
+  }
 }
 
-// Track pins used in a program for diagnostics and initialization
-void ast_track_pins(ASTNode *program) {
-    if (!program || program->type != NODE_PROGRAM) return;
-    
-    int out_pins[50];  // Max 50 pins
-    int out_count = 0;
-    
-    int in_pins[50];
-    int in_count = 0;
-    
-    // Scan main block
-    scan_for_pins(program->data.program.main_block, out_pins, &out_count, in_pins, &in_count);
-    
-    // Scan all functions
-    for (int i = 0; i < program->data.program.function_count; i++) {
-        scan_for_pins(program->data.program.functions[i]->data.function_def.body, out_pins, &out_count, in_pins, &in_count);
+/* The instruction that defines each temporary of `fn` */
+static const IrInstr **definitions(const IrFunction *fn) {
+  const IrInstr **defs = calloc(fn->temp_count + 1, sizeof(IrInstr *));
+  for (int b = 0; b < fn->block_count; b++)
+    for (int i = 0; i < fn->blocks[b].count; i++) {
+      const IrInstr *instr = &fn->blocks[b].instrs[i];
+      if (instr->dst >= 0)
+        defs[instr->dst] = instr;
     }
-    
-    // Store OUT results
-    if (out_count > 0) {
-        program->data.program.pins_used = malloc(sizeof(int) * out_count);
-        memcpy(program->data.program.pins_used, out_pins, sizeof(int) * out_count);
-        program->data.program.pin_count = out_count;
+  return defs;
+}
+
+static void census_function(VarTable *table, const IrFunction *fn) {
+  const IrInstr **defs = definitions(fn);
+  if (fn->kind == IR_FUNC_DEF)
+    for (int p = 0; p < fn->source->data.function_def.param_count; p++)
+      var_insert(table, fn->source->data.function_def.param_names[p])
+          ->writes++;
+  for (int b = 0; b < fn->block_count; b++)
+    for (int i = 0; i < fn->blocks[b].count; i++) {
+      const IrInstr *instr = &fn->blocks[b].instrs[i];
+      switch (instr->op) {
+      case IR_DECLARE: {
+        VarInfo *var = var_insert(table, instr->name);
+        const IrInstr *init = instr->a >= 0 ? defs[instr->a] : NULL;
+        var->writes++;
+        var->constant = init && init->op == IR_CONST;
+        var->value = var->constant ? init->number : 0;
+        break;
+      }
+      case IR_STORE:
+      case IR_DECLARE_ARRAY:
+      case IR_STORE_INDEX:
+        var_insert(table, instr->name)->writes++;
+        break;
+      case IR_NATIVE:
+        census(table, instr->node, instr->args == NULL);
+        break;
+      default:
+        break;
+      }
     }
-    
-    // Store IN results
-    if (in_count > 0) {
-        program->data.program.in_pins_used = malloc(sizeof(int) * in_count);
-        memcpy(program->data.program.in_pins_used, in_pins, sizeof(int) * in_count);
-        program->data.program.in_pin_count = in_count;
+  free(defs);
+}
+
+// ============================================================================
+// PINS
+// ============================================================================
+
+static void resolve_name(PinSet *set, const VarTable *vars,
+                         const char *name) {
+  const VarInfo *var = var_lookup(vars, name);
+  if (var && var->writes == 1 && var->constant)
+    pin_add(set, var->value);
+}
+
+/* Add the pin operand `temp` to `set` if it has one known value */
+static void resolve_pin(PinSet *set, const IrInstr **defs,
+                        const VarTable *vars, int temp) {
+  const IrInstr *def = temp >= 0 ? defs[temp] : NULL;
+  if (def && def->op == IR_CONST)
+    pin_add(set, def->number);
+  else if (def && def->op == IR_LOAD)
+    resolve_name(set, vars, def->name);
+}
+
+/* An operation the IR keeps whole, such as a try block: its pin operations
+ * are still trees */
+static void scan_opaque(PinSet *out, PinSet *in, const ASTNode *node,
+                        const VarTable *vars) {
+  if (!node)
+    return;
+  PinSet *set = NULL;
+  if (drives_pin(node->type))
+    set = out;
+  else if (reads_pin(node->type))
+    set = in;
+  const ASTNode *pin = set ? node->data.gpio.pin : NULL;
+  if (pin && pin->type == NODE_NUMBER)
+    pin_add(set, pin->data.number.value);
+  else if (pin && pin->type == NODE_IDENTIFIER)
+    resolve_name(set, vars, pin->data.identifier.name);
+
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    const char *base = (const char *)node + field->offset;
+    int count = field->count_offset
+                    ? *(const int *)((const char *)node + field->count_offset)
+                    : 0;
+    if (field->kind == AST_FIELD_NODE)
+      scan_opaque(out, in, *(ASTNode *const *)base, vars);
+    for (int i = 0; field->kind == AST_FIELD_NODE_LIST && i < count; i++)
+      scan_opaque(out, in, (*(ASTNode **const *)base)[i], vars);
+  }
+}
+
+static void scan_function(PinSet *out, PinSet *in, const IrFunction *fn,
+                          const VarTable *vars) {
+  const IrInstr **defs = definitions(fn);
+  for (int b = 0; b < fn->block_count; b++)
+    for (int i = 0; i < fn->blocks[b].count; i++) {
+      const IrInstr *instr = &fn->blocks[b].instrs[i];
+      if (instr->op != IR_NATIVE)
+        continue;
+      if (!instr->args) {
+        scan_opaque(out, in, instr->node, vars);
+        continue;
+      }
+      if (drives_pin(instr->node->type))
+        resolve_pin(out, defs, vars, instr->args[0]);
+      else if (reads_pin(instr->node->type))
+        resolve_pin(in, defs, vars, instr->args[0]);
     }
+  free(defs);
+}
+
+static int *pins_copy(const PinSet *set) {
+  if (set->count == 0)
+    return NULL;
+  int *pins = ast_alloc(sizeof(int) * set->count);
+  memcpy(pins, set->pins, sizeof(int) * set->count);
+  return pins;
+}
+
+int ir_track_pins(const IrModule *module, ASTNode *program) {
+  if (!program || program->type != NODE_PROGRAM)
+    return 0;
+  VarTable vars = {NULL, 0, 0};
+  for (int f = 0; f < module->count; f++)
+    census_function(&vars, &module->functions[f]);
+
+  PinSet out = {{0}, 0}, in = {{0}, 0};
+  for (int f = 0; f < module->count; f++)
+    scan_function(&out, &in, &module->functions[f], &vars);
+  free(vars.slots);
+
+  program->data.program.pins_used = pins_copy(&out);
+  program->data.program.pin_count = out.count;
+  program->data.program.in_pins_used = pins_copy(&in);
+  program->data.program.in_pin_count = in.count;
+  return out.count + in.count;
 }
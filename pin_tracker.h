@@ -1,11 +1,19 @@
-/* Pin Tracker Header */
+/* Pin Tracker
+ * Finds the GPIO pins a program drives and reads, so the backends can set
+ * their modes up front and --diagnostics can test them. Works on the IR:
+ * pins used in any function, task or handler count, including those held
+ * in a variable that never changes, and pins only unreachable code uses do
+ * not.
+ */
 
 #ifndef KINETRIX_PIN_TRACKER_H
 #define KINETRIX_PIN_TRACKER_H
 
 #include "ast.h"
+#include "ir.h"
 
-// Track all GPIO pins used in a program
-void ast_track_pins(ASTNode *program);
+/* Set program.pins_used / in_pins_used from `module`, the program lowered
+ * to the IR; returns how many pins were found */
+int ir_track_pins(const IrModule *module, ASTNode *program);
 
 #endif
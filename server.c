@@ -0,0 +1,358 @@
+/* Kinetrix Compile Server Implementation */
+
+#define _POSIX_C_SOURCE 200809L
+#include "server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#define SERVE_MAX_REQUEST (64u << 20) /* bytes, headers included */
+#define SERVE_TIMEOUT_SECONDS 30      /* per connection, reads and writes */
+
+void serve_section(OutBuf *reply, const char *header, const char *data,
+                   size_t length) {
+  outbuf_printf(reply, "%s %zu\n", header, length);
+  outbuf_write(reply, data, length);
+}
+
+int serve_next_section(const char **cursor, const char *end, char *header,
+                       size_t header_size, const char **data,
+                       size_t *length) {
+  const char *line = *cursor;
+  const char *newline = memchr(line, '\n', (size_t)(end - line));
+  const char *space = newline ? newline : line;
+  while (space > line && space[-1] != ' ')
+    space--;
+  if (newline == NULL || space == line ||
+      (size_t)(space - line) > header_size)
+    return 0;
+  char *stop;
+  unsigned long long n = strtoull(space, &stop, 10);
+  if (stop != newline || n > (size_t)(end - newline - 1))
+    return 0;
+  memcpy(header, line, (size_t)(space - line - 1));
+  header[space - line - 1] = '\0';
+  *data = newline + 1;
+  *length = (size_t)n;
+  *cursor = newline + 1 + n;
+  return 1;
+}
+
+#ifdef _WIN32
+
+int serve_unix_socket(const char *socket_path, ServeHandler handler,
+                      void *context) {
+  (void)socket_path;
+  (void)handler;
+  (void)context;
+  fprintf(stderr, "Error: --serve needs Unix domain sockets, which this "
+                  "build does not support\n");
+  return 1;
+}
+
+int serve_request(const char *socket_path, const ServeRequest *request,
+                  OutBuf *reply) {
+  (void)socket_path;
+  (void)request;
+  (void)reply;
+  return 0;
+}
+
+#else
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_stop_signal(int signal_number) {
+  (void)signal_number;
+  stop_requested = 1;
+}
+
+static int write_all(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t n = write(fd, data, length);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return 0;
+    data += n;
+    length -= (size_t)n;
+  }
+  return 1;
+}
+
+/* Append whatever arrives next; returns 0 at EOF or on an error */
+static int read_more(int fd, OutBuf *in) {
+  char chunk[16384];
+  for (;;) {
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n < 0 && errno == EINTR && !stop_requested)
+      continue;
+    if (n <= 0)
+      return 0;
+    outbuf_write(in, chunk, (size_t)n);
+    return 1;
+  }
+}
+
+static int fill_address(struct sockaddr_un *address, const char *path) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address->sun_path)) {
+    fprintf(stderr, "Error: Socket path '%s' is too long\n", path);
+    return 0;
+  }
+  strcpy(address->sun_path, path);
+  return 1;
+}
+
+static void set_timeouts(int fd) {
+  struct timeval timeout = {SERVE_TIMEOUT_SECONDS, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+// ============================================================================
+// REQUESTS
+// ============================================================================
+
+static char *copy_value(const char *start, size_t length) {
+  char *value = malloc(length + 1);
+  memcpy(value, start, length);
+  value[length] = '\0';
+  return value;
+}
+
+static void request_free(ServeRequest *request) {
+  free(request->targets);
+  free(request->passes);
+  free(request->path);
+  free(request->dir);
+  free(request->source);
+  memset(request, 0, sizeof(*request));
+}
+
+/* Read and parse one request; on failure `error` says why */
+static int read_request(int fd, ServeRequest *request, const char **error) {
+  OutBuf in;
+  outbuf_init(&in);
+  memset(request, 0, sizeof(*request));
+  size_t pos = 0;
+  int have_protocol = 0;
+  int ok = 0;
+  *error = "malformed request";
+
+  for (;;) {
+    char *newline = in.length > pos ? memchr(in.data + pos, '\n',
+                                             in.length - pos)
+                                    : NULL;
+    if (newline == NULL) {
+      if (in.length > SERVE_MAX_REQUEST || !read_more(fd, &in))
+        goto done;
+      continue;
+    }
+    const char *line = in.data + pos;
+    size_t line_length = (size_t)(newline - line);
+    pos += line_length + 1;
+
+    if (!have_protocol) {
+      if (line_length != strlen(SERVE_PROTOCOL) ||
+          memcmp(line, SERVE_PROTOCOL, line_length) != 0) {
+        *error = "unsupported protocol";
+        goto done;
+      }
+      have_protocol = 1;
+      continue;
+    }
+    const char *space = memchr(line, ' ', line_length);
+    if (space == NULL)
+      goto done;
+    size_t key_length = (size_t)(space - line);
+    const char *value = space + 1;
+    size_t value_length = line_length - key_length - 1;
+    char **field = NULL;
+    if (key_length == 6 && memcmp(line, "target", 6) == 0)
+      field = &request->targets;
+    else if (key_length == 6 && memcmp(line, "passes", 6) == 0)
+      field = &request->passes;
+    else if (key_length == 4 && memcmp(line, "path", 4) == 0)
+      field = &request->path;
+    else if (key_length == 3 && memcmp(line, "dir", 3) == 0)
+      field = &request->dir;
+    if (field) {
+      free(*field);
+      *field = copy_value(value, value_length);
+      continue;
+    }
+    if (key_length != 6 || memcmp(line, "source", 6) != 0) {
+      *error = "unknown request field";
+      goto done;
+    }
+
+    char *number = copy_value(value, value_length);
+    char *end;
+    unsigned long long length = strtoull(number, &end, 10);
+    int valid = end != number && *end == '\0';
+    free(number);
+    if (!valid || length > SERVE_MAX_REQUEST) {
+      *error = "bad source length";
+      goto done;
+    }
+    while (in.length - pos < length)
+      if (!read_more(fd, &in)) {
+        *error = "truncated source";
+        goto done;
+      }
+    request->source = copy_value(in.data + pos, (size_t)length);
+    request->source_length = (size_t)length;
+    ok = 1;
+    goto done;
+  }
+
+done:
+  outbuf_free(&in);
+  if (!ok)
+    request_free(request);
+  return ok;
+}
+
+static void answer(int fd, ServeHandler handler, void *context) {
+  ServeRequest request;
+  const char *error;
+  OutBuf reply;
+  outbuf_init(&reply);
+  OutBuf sections;
+  outbuf_init(&sections);
+
+  int ok = 0;
+  if (read_request(fd, &request, &error)) {
+    ok = handler(context, &request, &sections);
+    request_free(&request);
+  } else {
+    char message[80];
+    snprintf(message, sizeof(message), "Error: %s\n", error);
+    serve_section(&sections, "diagnostics", message, strlen(message));
+  }
+  outbuf_printf(&reply, "%s %s\n", SERVE_PROTOCOL, ok ? "ok" : "error");
+  outbuf_write(&reply, sections.data, sections.length);
+  outbuf_puts(&reply, "end\n");
+  write_all(fd, reply.data, reply.length);
+  outbuf_free(&sections);
+  outbuf_free(&reply);
+}
+
+// ============================================================================
+// SERVER
+// ============================================================================
+
+int serve_unix_socket(const char *socket_path, ServeHandler handler,
+                      void *context) {
+  struct sockaddr_un address;
+  if (!fill_address(&address, socket_path))
+    return 1;
+
+  // A socket file nobody answers on is left over from a killed server
+  int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (probe >= 0) {
+    if (connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0) {
+      fprintf(stderr, "Error: A server is already listening on '%s'\n",
+              socket_path);
+      close(probe);
+      return 1;
+    }
+    close(probe);
+  }
+  unlink(socket_path);
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0 ||
+      bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(listener, 16) != 0) {
+    fprintf(stderr, "Error: Could not listen on '%s': %s\n", socket_path,
+            strerror(errno));
+    if (listener >= 0)
+      close(listener);
+    return 1;
+  }
+
+  // No SA_RESTART: a signal has to interrupt accept() to stop the loop
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_stop_signal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  printf("Kinetrix compile server listening on %s\n", socket_path);
+  fflush(stdout);
+  while (!stop_requested) {
+    int client = accept(listener, NULL, NULL);
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      fprintf(stderr, "Error: accept failed: %s\n", strerror(errno));
+      break;
+    }
+    set_timeouts(client);
+    answer(client, handler, context);
+    close(client);
+  }
+
+  close(listener);
+  unlink(socket_path);
+  printf("Kinetrix compile server stopped\n");
+  return 0;
+}
+
+// ============================================================================
+// CLIENT
+// ============================================================================
+
+static void header_line(OutBuf *out, const char *key, const char *value) {
+  if (value)
+    outbuf_printf(out, "%s %s\n", key, value);
+}
+
+int serve_request(const char *socket_path, const ServeRequest *request,
+                  OutBuf *reply) {
+  struct sockaddr_un address;
+  if (!fill_address(&address, socket_path))
+    return 0;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return 0;
+  if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    close(fd);
+    return 0;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  OutBuf out;
+  outbuf_init(&out);
+  outbuf_printf(&out, "%s\n", SERVE_PROTOCOL);
+  header_line(&out, "target", request->targets);
+  header_line(&out, "passes", request->passes);
+  header_line(&out, "path", request->path);
+  header_line(&out, "dir", request->dir);
+  serve_section(&out, "source", request->source, request->source_length);
+  int ok = write_all(fd, out.data, out.length);
+  outbuf_free(&out);
+  if (ok) {
+    shutdown(fd, SHUT_WR);
+    while (read_more(fd, reply))
+      ;
+  }
+  close(fd);
+  return ok && reply->length > 0;
+}
+
+#endif
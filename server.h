@@ -0,0 +1,62 @@
+/* Kinetrix Compile Server
+ * `kcc --serve <socket>` keeps one compiler process alive and answers
+ * compile requests on a local Unix socket, so installed modules stay parsed
+ * between builds. One request per connection:
+ *
+ *   request:  KCC/1\n
+ *             target <spec>\n          (optional, as for --target)
+ *             passes <options>\n       (optional, e.g. "-O0 -fno-dce")
+ *             path <file.kx>\n         (optional, for diagnostics/includes)
+ *             dir <directory>\n        (optional, holds kinetrix_modules/)
+ *             source <n>\n<n bytes>
+ *
+ *   reply:    KCC/1 ok|error\n
+ *             diagnostics <n>\n<n bytes>
+ *             output <target> <n>\n<n bytes>   (one per target, on success)
+ *             end\n
+ */
+
+#ifndef KINETRIX_SERVER_H
+#define KINETRIX_SERVER_H
+
+#include "outbuf.h"
+#include <stddef.h>
+
+#define SERVE_PROTOCOL "KCC/1"
+
+typedef struct {
+    char *targets;  // NULL for the default target
+    char *passes;   // -O/-f arguments, space-separated; NULL for defaults
+    char *path;     // NULL if the client did not name the file
+    char *dir;      // NULL to use the server's working directory
+    char *source;   // Main file text, NUL-terminated
+    size_t source_length;
+} ServeRequest;
+
+/* Compile one request and append the reply sections (everything after the
+ * status line) to `reply`; returns 1 on success */
+typedef int (*ServeHandler)(void *context, const ServeRequest *request,
+                            OutBuf *reply);
+
+/* Append one "<header> <n>\n<n bytes>" section */
+void serve_section(OutBuf *reply, const char *header, const char *data,
+                   size_t length);
+
+/* Read the section at `*cursor` (before `end`) and step past it: its
+ * header goes to `header`, its bytes are `data`/`length`. Returns 0 at the
+ * closing "end" line or on a malformed reply. */
+int serve_next_section(const char **cursor, const char *end, char *header,
+                       size_t header_size, const char **data,
+                       size_t *length);
+
+/* Listen on `socket_path` and answer requests until SIGINT or SIGTERM;
+ * returns a process exit status */
+int serve_unix_socket(const char *socket_path, ServeHandler handler,
+                      void *context);
+
+/* Client side: send `request` to the server at `socket_path` and read the
+ * whole reply into `reply`; returns 0 if the server cannot be reached */
+int serve_request(const char *socket_path, const ServeRequest *request,
+                  OutBuf *reply);
+
+#endif // KINETRIX_SERVER_H
@@ -6,133 +6,203 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define HASH_TABLE_SIZE 128
+#define INITIAL_SLOTS 64
+#define INITIAL_SYMBOLS 32
+#define INITIAL_SCOPES 16
 
-// ============================================================================
-// HASH FUNCTION
-// ============================================================================
+#define SLOT_EMPTY 0
+#define SLOT_DELETED -1
 
-static unsigned int hash(const char *str) {
-  unsigned int hash = 5381;
-  int c;
-  while ((c = *str++)) {
-    hash = ((hash << 5) + hash) + c;
-  }
-  return hash % HASH_TABLE_SIZE;
-}
+/* Grow or rebuild the index once live + deleted slots pass 70% */
+#define SLOT_LOAD_NUM 7
+#define SLOT_LOAD_DEN 10
 
 // ============================================================================
-// SCOPE MANAGEMENT
+// HASH INDEX
 // ============================================================================
 
-static Scope *scope_create(Scope *parent) {
-  Scope *scope = malloc(sizeof(Scope));
-  if (!scope)
-    return NULL;
-  scope->symbols = calloc(HASH_TABLE_SIZE, sizeof(Symbol *));
-  if (!scope->symbols) {
-    free(scope);
-    return NULL;
-  }
-  scope->table_size = HASH_TABLE_SIZE;
-  scope->parent = parent;
-  scope->depth = parent ? parent->depth + 1 : 0;
-  return scope;
+/* Names are interned; their hash was computed once by the string pool.
+ * djb2 is weak in the low bits used for masking, so mix it first. */
+static unsigned int hash(const char *name) {
+  unsigned int h = intern_hash(name);
+  h ^= h >> 16;
+  h *= 0x45d9f3bu;
+  h ^= h >> 16;
+  return h;
 }
 
-static void scope_free(Scope *scope) {
-  if (scope == NULL)
-    return;
+/* Slot holding `name`, or -1 if absent. When absent and `insert_at` is
+ * given, it receives the slot a new entry should use. */
+static int find_slot(SymbolTable *table, const char *name, int *insert_at) {
+  int mask = table->slot_capacity - 1;
+  int i = (int)(hash(name) & (unsigned int)mask);
+  int first_deleted = -1;
+
+  while (table->slots[i] != SLOT_EMPTY) {
+    if (table->slots[i] == SLOT_DELETED) {
+      if (first_deleted < 0)
+        first_deleted = i;
+    } else if (table->symbols[table->slots[i] - 1].name == name) {
+      return i;
+    }
+    i = (i + 1) & mask;
+  }
+  if (insert_at)
+    *insert_at = first_deleted >= 0 ? first_deleted : i;
+  return -1;
+}
 
-  for (int i = 0; i < scope->table_size; i++) {
-    Symbol *sym = scope->symbols[i];
-    while (sym != NULL) {
-      Symbol *next = sym->next;
-      free(sym->name);
-      type_free(sym->type);
-      free(sym);
-      sym = next;
+/* Rebuild the index at `capacity`, dropping deleted markers. Symbols are
+ * replayed in declaration order so the innermost declaration wins. */
+static void rebuild_slots(SymbolTable *table, int capacity) {
+  free(table->slots);
+  table->slots = calloc(capacity, sizeof(int));
+  table->slot_capacity = capacity;
+  table->slots_used = 0;
+
+  for (int s = 0; s < table->symbol_count; s++) {
+    int insert_at;
+    int slot = find_slot(table, table->symbols[s].name, &insert_at);
+    if (slot >= 0) {
+      table->slots[slot] = s + 1;
+    } else {
+      table->slots[insert_at] = s + 1;
+      table->slots_used++;
     }
   }
+}
 
-  free(scope->symbols);
-  free(scope);
+static void reserve_slot(SymbolTable *table) {
+  if ((table->slots_used + 1) * SLOT_LOAD_DEN <
+      table->slot_capacity * SLOT_LOAD_NUM)
+    return;
+  /* Double only if live names need it; otherwise just sweep deleted slots */
+  int capacity = table->slot_capacity;
+  if ((table->symbol_count + 1) * 2 * SLOT_LOAD_DEN >=
+      capacity * SLOT_LOAD_NUM)
+    capacity *= 2;
+  rebuild_slots(table, capacity);
 }
 
 // ============================================================================
 // SYMBOL TABLE OPERATIONS
 // ============================================================================
 
-SymbolTable *symbol_table_create() {
+SymbolTable *symbol_table_create(StringPool *strings) {
   SymbolTable *table = malloc(sizeof(SymbolTable));
   if (!table)
     return NULL;
-  table->global_scope = scope_create(NULL);
-  if (!table->global_scope) {
+  table->strings = strings;
+  table->errors = NULL;
+  table->symbol_capacity = INITIAL_SYMBOLS;
+  table->symbol_count = 0;
+  table->symbols = malloc(sizeof(Symbol) * table->symbol_capacity);
+  table->slot_capacity = INITIAL_SLOTS;
+  table->slots_used = 0;
+  table->slots = calloc(table->slot_capacity, sizeof(int));
+  table->scope_capacity = INITIAL_SCOPES;
+  table->scope_depth = 0;
+  table->scope_marks = malloc(sizeof(int) * table->scope_capacity);
+  if (!table->symbols || !table->slots || !table->scope_marks) {
+    free(table->symbols);
+    free(table->slots);
+    free(table->scope_marks);
     free(table);
     return NULL;
   }
-  table->current_scope = table->global_scope;
   return table;
 }
 
+static void warn_unused(SymbolTable *table, int from) {
+  for (int s = from; s < table->symbol_count; s++) {
+    Symbol *sym = &table->symbols[s];
+    if (sym->kind == SYMBOL_VARIABLE && !sym->is_used) {
+      error_warning(table->errors,
+                    "Warning: Variable '%s' declared at line %d is never used",
+                    sym->name, sym->line_defined);
+    }
+  }
+}
+
+/* Pop symbols down to `count`, re-exposing whatever they shadowed */
+static void truncate_symbols(SymbolTable *table, int count) {
+  while (table->symbol_count > count) {
+    int s = table->symbol_count - 1;
+    Symbol *sym = &table->symbols[s];
+    int slot = find_slot(table, sym->name, NULL);
+    if (slot >= 0)
+      table->slots[slot] = sym->shadowed >= 0 ? sym->shadowed + 1
+                                              : SLOT_DELETED;
+    type_free(sym->type);
+    table->symbol_count--;
+  }
+}
+
 void symbol_table_free(SymbolTable *table) {
   if (table == NULL)
     return;
 
-  // Free all scopes (walk up from current to global)
-  Scope *scope = table->current_scope;
-  while (scope != NULL) {
-    // Check for unused variables before freeing
-    for (int i = 0; i < scope->table_size; i++) {
-      Symbol *sym = scope->symbols[i];
-      while (sym != NULL) {
-        if (sym->kind == SYMBOL_VARIABLE && !sym->is_used) {
-          fprintf(stderr,
-                  "Warning: Variable '%s' declared at line %d is never used\n",
-                  sym->name, sym->line_defined);
-        }
-        sym = sym->next;
-      }
-    }
-
-    Scope *parent = scope->parent;
-    scope_free(scope);
-    scope = parent;
+  // Check for unused variables in every scope still open, innermost first
+  for (int d = table->scope_depth; d >= 0; d--) {
+    int from = d > 0 ? table->scope_marks[d - 1] : 0;
+    warn_unused(table, from);
+    truncate_symbols(table, from);
   }
 
+  free(table->symbols);
+  free(table->slots);
+  free(table->scope_marks);
   free(table);
 }
 
 void symbol_table_enter_scope(SymbolTable *table) {
-  table->current_scope = scope_create(table->current_scope);
+  if (table->scope_depth >= table->scope_capacity) {
+    table->scope_capacity *= 2;
+    table->scope_marks =
+        realloc(table->scope_marks, sizeof(int) * table->scope_capacity);
+  }
+  table->scope_marks[table->scope_depth++] = table->symbol_count;
 }
 
 void symbol_table_exit_scope(SymbolTable *table) {
-  if (table->current_scope == table->global_scope) {
+  if (table->scope_depth == 0) {
     fprintf(stderr, "Error: Cannot exit global scope\n");
     return;
   }
 
-  Scope *old_scope = table->current_scope;
-
-  // Check for unused variables before freeing
-  for (int i = 0; i < old_scope->table_size; i++) {
-    Symbol *sym = old_scope->symbols[i];
-    while (sym != NULL) {
-      if (sym->kind == SYMBOL_VARIABLE && !sym->is_used) {
-        // Hardcode warning emission without blocking compilation (since error.h
-        // lacks warnings)
-        fprintf(stderr,
-                "Warning: Variable '%s' declared at line %d is never used\n",
-                sym->name, sym->line_defined);
-      }
-      sym = sym->next;
-    }
+  int mark = table->scope_marks[--table->scope_depth];
+  // Check for unused variables before dropping the scope
+  warn_unused(table, mark);
+  truncate_symbols(table, mark);
+}
+
+/* Push a new innermost declaration of an interned name */
+static Symbol *push_symbol(SymbolTable *table, const char *name) {
+  reserve_slot(table);
+  if (table->symbol_count >= table->symbol_capacity) {
+    table->symbol_capacity *= 2;
+    table->symbols =
+        realloc(table->symbols, sizeof(Symbol) * table->symbol_capacity);
+  }
+
+  int index = table->symbol_count++;
+  Symbol *sym = &table->symbols[index];
+  int insert_at;
+  int slot = find_slot(table, name, &insert_at);
+  if (slot >= 0) {
+    sym->shadowed = table->slots[slot] - 1;
+  } else {
+    sym->shadowed = -1;
+    slot = insert_at;
+    if (table->slots[slot] == SLOT_EMPTY)
+      table->slots_used++;
   }
+  table->slots[slot] = index + 1;
 
-  table->current_scope = old_scope->parent;
-  scope_free(old_scope);
+  sym->name = name;
+  sym->depth = table->scope_depth;
+  sym->protocol = PROTOCOL_UART; // Only meaningful for devices
+  return sym;
 }
 
 int symbol_table_add(SymbolTable *table, const char *name, SymbolKind kind,
@@ -140,29 +210,19 @@ int symbol_table_add(SymbolTable *table, const char *name, SymbolKind kind,
   if (table == NULL || name == NULL)
     return 0;
 
+  name = string_pool_intern_str(table->strings, name);
+
   // Check if symbol already exists in current scope
   if (symbol_table_lookup_current_scope(table, name) != NULL) {
     return 0; // Symbol already exists
   }
 
-  unsigned int index = hash(name);
-
-  Symbol *sym = malloc(sizeof(Symbol));
-  if (!sym)
-    return 0;
-  sym->name = strdup(name);
-  if (!sym->name) {
-    free(sym);
-    return 0;
-  }
+  Symbol *sym = push_symbol(table, name);
   sym->kind = kind;
   sym->type = type_clone(type);
   sym->is_initialized = 0;
   sym->is_used = 0;
   sym->line_defined = line;
-  sym->next = table->current_scope->symbols[index];
-
-  table->current_scope->symbols[index] = sym;
   return 1;
 }
 
@@ -170,26 +230,15 @@ Symbol *symbol_table_add_device(SymbolTable *table, const char *name,
                                 ProtocolType protocol) {
   if (!table || !name)
     return NULL;
-  Scope *scope = table->current_scope;
-  unsigned int index = hash(name);
+  name = string_pool_intern_str(table->strings, name);
 
-  Symbol *sym = malloc(sizeof(Symbol));
-  if (!sym)
-    return NULL;
-  sym->name = strdup(name);
-  if (!sym->name) {
-    free(sym);
-    return NULL;
-  }
+  Symbol *sym = push_symbol(table, name);
   sym->kind = SYMBOL_DEVICE;
   sym->type = type_void();
   sym->protocol = protocol;
   sym->is_initialized = 1;
   sym->is_used = 0;
   sym->line_defined = 0;
-
-  sym->next = scope->symbols[index];
-  scope->symbols[index] = sym;
   return sym;
 }
 
@@ -197,23 +246,14 @@ Symbol *symbol_table_lookup(SymbolTable *table, const char *name) {
   if (table == NULL || name == NULL)
     return NULL;
 
-  Scope *scope = table->current_scope;
-  unsigned int index = hash(name);
-
-  // Search from current scope up to global scope
-  while (scope != NULL) {
-    Symbol *sym = scope->symbols[index];
-    while (sym != NULL) {
-      if (strcmp(sym->name, name) == 0) {
-        sym->is_used = 1;
-        return sym;
-      }
-      sym = sym->next;
-    }
-    scope = scope->parent;
-  }
+  name = string_pool_intern_str(table->strings, name);
+  int slot = find_slot(table, name, NULL);
+  if (slot < 0)
+    return NULL;
 
-  return NULL;
+  Symbol *sym = &table->symbols[table->slots[slot] - 1];
+  sym->is_used = 1;
+  return sym;
 }
 
 Symbol *symbol_table_lookup_current_scope(SymbolTable *table,
@@ -221,18 +261,16 @@ Symbol *symbol_table_lookup_current_scope(SymbolTable *table,
   if (table == NULL || name == NULL)
     return NULL;
 
-  unsigned int index = hash(name);
-  Symbol *sym = table->current_scope->symbols[index];
-
-  while (sym != NULL) {
-    if (strcmp(sym->name, name) == 0) {
-      sym->is_used = 1;
-      return sym;
-    }
-    sym = sym->next;
-  }
+  name = string_pool_intern_str(table->strings, name);
+  int slot = find_slot(table, name, NULL);
+  if (slot < 0)
+    return NULL;
 
-  return NULL;
+  Symbol *sym = &table->symbols[table->slots[slot] - 1];
+  if (sym->depth != table->scope_depth)
+    return NULL;
+  sym->is_used = 1;
+  return sym;
 }
 
 void symbol_table_print(SymbolTable *table) {
@@ -240,18 +278,15 @@ void symbol_table_print(SymbolTable *table) {
     return;
 
   printf("=== Symbol Table ===\n");
-  Scope *scope = table->current_scope;
-
-  while (scope != NULL) {
-    printf("Scope depth %d:\n", scope->depth);
-    for (int i = 0; i < scope->table_size; i++) {
-      Symbol *sym = scope->symbols[i];
-      while (sym != NULL) {
-        printf("  %s: %s (line %d)\n", sym->name, type_to_string(sym->type),
-               sym->line_defined);
-        sym = sym->next;
-      }
+  for (int d = table->scope_depth; d >= 0; d--) {
+    int from = d > 0 ? table->scope_marks[d - 1] : 0;
+    int to = d < table->scope_depth ? table->scope_marks[d]
+                                    : table->symbol_count;
+    printf("Scope depth %d:\n", d);
+    for (int s = from; s < to; s++) {
+      Symbol *sym = &table->symbols[s];
+      printf("  %s: %s (line %d)\n", sym->name, type_to_string(sym->type),
+             sym->line_defined);
     }
-    scope = scope->parent;
   }
 }
@@ -6,6 +6,7 @@
 #define KINETRIX_SYMBOL_TABLE_H
 
 #include "ast.h"
+#include "error.h"
 
 // ============================================================================
 // SYMBOL TABLE
@@ -19,41 +20,50 @@ typedef enum {
 } SymbolKind;
 
 typedef struct Symbol {
-    char *name;
+    const char *name;  // Interned: compare with ==
     SymbolKind kind;
     Type *type;
     ProtocolType protocol;
     int is_initialized;
     int is_used;
     int line_defined;  // For error messages
-    struct Symbol *next;  // For hash table chaining
+    int depth;         // Scope depth the symbol was declared at
+    int shadowed;      // Index of the outer symbol this one hides, or -1
 } Symbol;
 
-typedef struct Scope {
-    Symbol **symbols;  // Hash table
-    int table_size;
-    struct Scope *parent;  // For nested scopes
-    int depth;
-} Scope;
-
+/* All scopes share one flat table. Symbols are pushed on a stack in
+ * declaration order and an open-addressing index maps each name to its
+ * innermost declaration, so lookup is a single probe sequence and leaving
+ * a scope just pops the symbols declared since it was entered. */
 typedef struct SymbolTable {
-    Scope *current_scope;
-    Scope *global_scope;
+    Symbol *symbols;      // Declaration stack, innermost scope on top
+    int symbol_count;
+    int symbol_capacity;
+    int *slots;           // Index: symbol index + 1, 0 = empty, -1 = deleted
+    int slot_capacity;    // Power of two
+    int slots_used;       // Live + deleted slots, drives the resize policy
+    int *scope_marks;     // symbol_count when each open scope was entered
+    int scope_depth;      // 0 = global
+    int scope_capacity;
+    StringPool *strings;  // Canonicalises names passed in by callers
+    ErrorList *errors;    // Receives unused-variable warnings, may be NULL
 } SymbolTable;
 
 // ============================================================================
 // SYMBOL TABLE OPERATIONS
 // ============================================================================
 
-// Create/destroy
-SymbolTable* symbol_table_create();
+// Create/destroy. Names are interned through `strings`; callers that already
+// hold interned pointers (the parser) skip the hashing.
+SymbolTable* symbol_table_create(StringPool *strings);
 void symbol_table_free(SymbolTable *table);
 
 // Scope management
 void symbol_table_enter_scope(SymbolTable *table);
 void symbol_table_exit_scope(SymbolTable *table);
 
-// Symbol operations
+// Symbol operations. Returned Symbol pointers stay valid until the next
+// add or scope exit.
 int symbol_table_add(SymbolTable *table, const char *name, SymbolKind kind, Type *type, int line);
 Symbol* symbol_table_lookup(SymbolTable *table, const char *name);
 Symbol* symbol_table_lookup_current_scope(SymbolTable *table, const char *name);
@@ -29,22 +29,88 @@ for file in $EXAMPLES; do
     if [ ! -f "$file" ]; then continue; fi
     
     echo "Testing $file..."
+    # One kcc run parses the file once and writes every target's output
+    outbase="/tmp/kx_ci_$$"
+    ./kcc "$file" -t all -o "$outbase" > /dev/null 2>&1
+    status=$?
     for target in "${TARGETS[@]}"; do
         total_tests=$((total_tests + 1))
-        
-        # Use target-specific output file to prevent overwrite conflicts
-        outfile="/tmp/kx_ci_${target}_$$"
-        if ./kcc "$file" -t "$target" -o "$outfile" > /dev/null 2>&1; then
+
+        outfile=$(ls "${outbase}_${target}".* 2>/dev/null)
+        if [ $status -eq 0 ] && [ -s "$outfile" ]; then
             echo -e "  [${GREEN}PASS${NC}] $target"
             passed_tests=$((passed_tests + 1))
         else
             echo -e "  [${RED}FAIL${NC}] $target"
             failed_tests+=("$file ($target)")
         fi
-        rm -f "$outfile" "$outfile".*
     done
+    rm -f "${outbase}"_*
 done
 
+# Checks on what a compile prints or generates: pass if the output of the
+# command matches the pattern
+check() {
+    local name="$1" pattern="$2"
+    shift 2
+    total_tests=$((total_tests + 1))
+    if "$@" 2>&1 | grep -Eq "$pattern"; then
+        echo -e "  [${GREEN}PASS${NC}] $name"
+        passed_tests=$((passed_tests + 1))
+    else
+        echo -e "  [${RED}FAIL${NC}] $name"
+        failed_tests+=("$name")
+    fi
+}
+
+echo "Testing examples/modules..."
+check "module named only in a top-level initializer" \
+    "Using 1 of 1 installed modules" \
+    bash -c "cd examples/modules && ../../kcc top_level_use.kx --no-cache \
+             -o /tmp/kx_ci_$$.ino"
+rm -f /tmp/kx_ci_$$.ino
+
+echo "Testing examples/v3_div_wrap.kx guards..."
+wrap_out="./kcc examples/v3_div_wrap.kx -t all -o /tmp/kx_ci_$$ >/dev/null &&
+          cat /tmp/kx_ci_$$"
+check "arduino keeps the guard of i * 256" '\(i \* 256\)\) == 0 \? 0' \
+    bash -c "$wrap_out""_arduino.ino"
+check "arduino keeps the guard of a * b * 2 - 14464" '14464\)\) == 0 \? 0' \
+    bash -c "$wrap_out""_arduino.ino"
+check "esp32 drops the guard of i * 256" '\(\(total\) / \(\(i \* 256\)\)\)' \
+    bash -c "$wrap_out""_esp32.cpp"
+rm -f /tmp/kx_ci_$$_*
+
+echo "Testing examples/v3_div_global.kx top-level divisions..."
+global_out="./kcc examples/v3_div_global.kx -t all -o /tmp/kx_ci_$$ >/dev/null &&
+            cat /tmp/kx_ci_$$"
+check "arduino initializer calls _kx_div" \
+    '^float x = _kx_div\(100, analogRead\(A3\)\);' \
+    bash -c "$global_out""_arduino.ino"
+check "esp32 initializer calls _kx_div" \
+    '^float total = _kx_div\(100, scale\(3\)\);' \
+    bash -c "$global_out""_esp32.cpp"
+check "ros2 initializer calls _kx_div" '= _kx_div\(100, scale\(3\)\);' \
+    bash -c "$global_out""_ros2.cpp"
+rm -f /tmp/kx_ci_$$_*
+
+echo "Testing examples/v3_pin_tracking.kx pin setup..."
+pins_out="./kcc examples/v3_pin_tracking.kx -o /tmp/kx_ci_$$.ino >/dev/null &&
+          cat /tmp/kx_ci_$$.ino"
+check "pin held in an unchanged variable is set up" 'pinMode\(12, OUTPUT\)' \
+    bash -c "$pins_out"
+check "pin used only in a task is set up" 'pinMode\(7, OUTPUT\)' \
+    bash -c "$pins_out"
+check "pin read inside an expression is set up" 'pinMode\(4, INPUT\)' \
+    bash -c "$pins_out"
+rm -f /tmp/kx_ci_$$.ino
+
+echo "Testing ESP32 library includes..."
+check "esp32 includes Wire.h for i2c" '^#include <Wire.h>' \
+    bash -c "./kcc examples/v3_i2c_array_test.kx -t esp32 --no-cache \
+             -o /tmp/kx_ci_$$.cpp >/dev/null && cat /tmp/kx_ci_$$.cpp"
+rm -f /tmp/kx_ci_$$.cpp
+
 # Always clean up generated output files
 rm -f Kinetrix_Output.*
 
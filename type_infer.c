@@ -0,0 +1,511 @@
+/* Type Inference Implementation
+ *
+ * An integer is only chosen where it computes what the float did. Every
+ * value the name is given must be a whole number that fits, the name may
+ * not be an operand of `/` (C would divide integers), and arithmetic it
+ * takes part in must stay within what its type is promoted to. On AVR
+ * that is a 16-bit int, so an operand of arithmetic that can leave int16
+ * needs int32_t storage. A call's value is not bounded by the ranges, so a
+ * function whose result is used in arithmetic keeps returning float.
+ *
+ * Types may be shared between nodes (see ast_cache.c), so they are
+ * replaced, never modified.
+ */
+
+#include "type_infer.h"
+#include "value_range.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_INTEGER 64 /* min_bits of a name that must not be an integer */
+
+// ============================================================================
+// BINDINGS
+// ============================================================================
+
+typedef struct {
+  const char *name;
+  int min_bits;  /* Narrowest integer its arithmetic allows */
+  int bindings;  /* Declarations, parameters and loops of this name */
+  Type *storage; /* The type all of them agree on, or NULL */
+  int functions;
+  Type *returns; /* Return type of the function of this name */
+} Binding;
+
+typedef struct {
+  Binding *slots;
+  size_t capacity; /* power of 2 */
+  size_t count;
+} BindingTable;
+
+typedef struct {
+  BindingTable names;
+  RangeAnalysis *ranges;
+  Type *byte, *int16, *int32; /* Storage picked for whole numbers */
+  Type *integer, *floating, *boolean, *string;
+  int narrow_ints; /* 0: whole numbers keep their declared storage */
+  int narrowed;    /* Declarations, parameters and counters narrowed */
+} Inference;
+
+static size_t name_hash(const char *name) {
+  size_t hash = 2166136261u;
+  for (const unsigned char *p = (const unsigned char *)name; *p; p++)
+    hash = (hash ^ *p) * 16777619u;
+  return hash;
+}
+
+static Binding *binding_lookup(const BindingTable *table, const char *name) {
+  if (table->count == 0 || !name)
+    return NULL;
+  size_t mask = table->capacity - 1;
+  for (size_t i = name_hash(name) & mask; table->slots[i].name;
+       i = (i + 1) & mask)
+    if (strcmp(table->slots[i].name, name) == 0)
+      return &table->slots[i];
+  return NULL;
+}
+
+static Binding *binding_insert(BindingTable *table, const char *name) {
+  Binding *binding = binding_lookup(table, name);
+  if (binding)
+    return binding;
+  if ((table->count + 1) * 2 > table->capacity) {
+    BindingTable grown = {NULL, table->capacity ? table->capacity * 2 : 64,
+                          0};
+    grown.slots = calloc(grown.capacity, sizeof(Binding));
+    for (size_t i = 0; i < table->capacity; i++)
+      if (table->slots[i].name)
+        *binding_insert(&grown, table->slots[i].name) = table->slots[i];
+    free(table->slots);
+    *table = grown;
+  }
+  size_t mask = table->capacity - 1;
+  size_t i = name_hash(name) & mask;
+  while (table->slots[i].name)
+    i = (i + 1) & mask;
+  table->slots[i].name = name;
+  table->count++;
+  return &table->slots[i];
+}
+
+/* `name` is bound as `type`; NULL for anything that is not a scalar */
+static void bind(Inference *inf, const char *name, Type *type) {
+  if (!name)
+    return;
+  Binding *binding = binding_insert(&inf->names, name);
+  if (binding->bindings++ == 0)
+    binding->storage = type;
+  else if (!type || !binding->storage || binding->storage->kind != type->kind ||
+           (type->kind == TYPE_INT && binding->storage->bits != type->bits))
+    binding->storage = NULL;
+}
+
+static Type *int_of_bits(int bits) {
+  Type *t = type_int();
+  t->bits = bits;
+  return t;
+}
+
+static int is_integer_kind(const Type *type) {
+  return type && (type->kind == TYPE_INT || type->kind == TYPE_BYTE ||
+                  type->kind == TYPE_BOOL);
+}
+
+static int within(ValueRange r, double lo, double hi) {
+  return r.lo >= lo && r.hi <= hi;
+}
+
+/* The narrowest storage holding every value of `r`, or NULL for float */
+static Type *integer_type(const Inference *inf, ValueRange r, int min_bits) {
+  if (!inf->narrow_ints || !r.whole || min_bits > 32 || !within(r, -2147483648.0, 2147483647.0))
+    return NULL;
+  if (min_bits <= 8 && within(r, 0, 255))
+    return inf->byte;
+  if (min_bits <= 16 && within(r, -32768, 32767))
+    return inf->int16;
+  return inf->int32;
+}
+
+static Type *variable_type(Inference *inf, const char *name) {
+  Binding *binding = binding_lookup(&inf->names, name);
+  return integer_type(inf, range_of_variable(inf->ranges, name),
+                      binding ? binding->min_bits : 0);
+}
+
+// ============================================================================
+// ARITHMETIC
+// ============================================================================
+
+/* Every name under `node` needs at least `bits` of integer storage; a
+ * called function, at least `call_bits` */
+static void require(Inference *inf, const ASTNode *node, int bits,
+                    int call_bits) {
+  if (!node)
+    return;
+  const char *name = NULL;
+  int needed = bits;
+  if (node->type == NODE_IDENTIFIER) {
+    name = node->data.identifier.name;
+  } else if (node->type == NODE_CALL) {
+    name = node->data.call.name;
+    needed = call_bits;
+  }
+  if (name) {
+    Binding *binding = binding_insert(&inf->names, name);
+    if (binding->min_bits < needed)
+      binding->min_bits = needed;
+  }
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    const char *base = (const char *)node + field->offset;
+    if (field->kind == AST_FIELD_NODE) {
+      require(inf, *(ASTNode *const *)base, bits, call_bits);
+    } else if (field->kind == AST_FIELD_NODE_LIST) {
+      int count = *(const int *)((const char *)node + field->count_offset);
+      for (int i = 0; i < count; i++)
+        require(inf, (*(ASTNode **const *)base)[i], bits, call_bits);
+    }
+  }
+}
+
+static void scan_arithmetic(Inference *inf, const ASTNode *node) {
+  if (!node)
+    return;
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    const char *base = (const char *)node + field->offset;
+    if (field->kind == AST_FIELD_NODE) {
+      scan_arithmetic(inf, *(ASTNode *const *)base);
+    } else if (field->kind == AST_FIELD_NODE_LIST) {
+      int count = *(const int *)((const char *)node + field->count_offset);
+      for (int i = 0; i < count; i++)
+        scan_arithmetic(inf, (*(ASTNode **const *)base)[i]);
+    }
+  }
+
+  Operator op;
+  if (node->type == NODE_BINARY_OP)
+    op = node->data.binary_op.op;
+  else if (node->type == NODE_UNARY_OP)
+    op = node->data.unary_op.op;
+  else
+    return;
+  if (op == OP_DIV) {
+    require(inf, node, NO_INTEGER, NO_INTEGER);
+  } else if (op == OP_ADD || op == OP_SUB || op == OP_MUL || op == OP_NEG) {
+    ValueRange r = range_of_expr(inf->ranges, node);
+    if (!r.whole)
+      require(inf, node, 0, NO_INTEGER); // Floating point, or unbounded
+    else if (!within(r, -32768, 32767))
+      require(inf, node,
+              within(r, -2147483648.0, 2147483647.0) ? 32 : NO_INTEGER,
+              NO_INTEGER);
+  }
+}
+
+// ============================================================================
+// DECLARATIONS
+// ============================================================================
+
+/* An untyped or int-typed declaration narrowed to what its values need.
+ * A declared int only ever narrows, since on AVR it is 16 bits already. */
+static Type *narrow(Inference *inf, const char *name, Type *declared) {
+  if (declared && declared->kind != TYPE_INFERRED &&
+      declared->kind != TYPE_INT)
+    return declared;
+  Type *type = variable_type(inf, name);
+  if (!type || (declared && declared->kind == TYPE_INT && type == inf->int32))
+    return declared;
+  inf->narrowed++;
+  return type;
+}
+
+/* Hull of the values `node` returns, skipping nested functions */
+static void collect_returns(const Inference *inf, const ASTNode *node,
+                            ValueRange *hull, int *count, int *string) {
+  if (!node || node->type == NODE_FUNCTION_DEF)
+    return;
+  if (node->type == NODE_RETURN && node->data.return_stmt.value) {
+    const ASTNode *value = node->data.return_stmt.value;
+    ValueRange r = range_of_expr(inf->ranges, value);
+    if (value->type == NODE_STRING ||
+        (value->value_type && value->value_type->kind == TYPE_STRING))
+      *string = 1;
+    if ((*count)++ == 0) {
+      *hull = r;
+    } else {
+      hull->lo = r.lo < hull->lo ? r.lo : hull->lo;
+      hull->hi = r.hi > hull->hi ? r.hi : hull->hi;
+      hull->whole = hull->whole && r.whole;
+    }
+  }
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    const char *base = (const char *)node + field->offset;
+    if (field->kind == AST_FIELD_NODE) {
+      collect_returns(inf, *(ASTNode *const *)base, hull, count, string);
+    } else if (field->kind == AST_FIELD_NODE_LIST) {
+      int count_of = *(const int *)((const char *)node + field->count_offset);
+      for (int i = 0; i < count_of; i++)
+        collect_returns(inf, (*(ASTNode **const *)base)[i], hull, count,
+                        string);
+    }
+  }
+}
+
+/* The parser types every `def` void; one that returns a value gets the
+ * type of what it returns */
+static Type *return_type(Inference *inf, const ASTNode *function) {
+  Type *declared = function->data.function_def.return_type;
+  if (declared && declared->kind != TYPE_VOID)
+    return declared;
+  ValueRange hull = {0, 0, 1};
+  int count = 0, string = 0;
+  collect_returns(inf, function->data.function_def.body, &hull, &count,
+                  &string);
+  if (count == 0)
+    return declared;
+  if (string)
+    return inf->string;
+  Binding *binding = binding_lookup(&inf->names,
+                                    function->data.function_def.name);
+  Type *type = integer_type(inf, hull, binding ? binding->min_bits : 0);
+  return type ? type : inf->floating;
+}
+
+static void apply(Inference *inf, ASTNode *node);
+
+static void apply_function(Inference *inf, ASTNode *node) {
+  if (node->data.function_def.is_extern) {
+    Binding *binding = binding_insert(&inf->names,
+                                      node->data.function_def.name);
+    binding->functions++;
+    binding->returns = node->data.function_def.return_type;
+    return;
+  }
+  for (int i = 0; i < node->data.function_def.param_count; i++) {
+    const char *name = node->data.function_def.param_names[i];
+    Type **type = &node->data.function_def.param_types[i];
+    *type = narrow(inf, name, *type);
+    bind(inf, name, *type && (*type)->kind != TYPE_INFERRED ? *type
+                                                            : inf->floating);
+  }
+  node->data.function_def.return_type = return_type(inf, node);
+  Binding *binding = binding_insert(&inf->names, node->data.function_def.name);
+  binding->functions++;
+  binding->returns = node->data.function_def.return_type;
+  apply(inf, node->data.function_def.body);
+}
+
+/* A for loop without a step leaves its counter one step past the last
+ * value it held, up or down as the bounds decide */
+static void apply_for(Inference *inf, ASTNode *node) {
+  const char *name = node->data.for_loop.var_name;
+  Type *counter = NULL;
+  if (!node->data.for_loop.step_expr) {
+    ValueRange r = range_of_variable(inf->ranges, name);
+    ValueRange start =
+        range_of_expr(inf->ranges, node->data.for_loop.start_expr);
+    ValueRange end = range_of_expr(inf->ranges, node->data.for_loop.end_expr);
+    if (start.hi <= end.lo) {
+      r.hi += 1;
+    } else if (start.lo >= end.hi) {
+      r.lo -= 1;
+    } else {
+      r.lo -= 1;
+      r.hi += 1;
+    }
+    Binding *binding = binding_lookup(&inf->names, name);
+    counter = integer_type(inf, r, binding ? binding->min_bits : 0);
+  }
+  if (counter) {
+    node->value_type = counter;
+    inf->narrowed++;
+  }
+  bind(inf, name, counter ? counter : inf->integer);
+  apply(inf, node->data.for_loop.start_expr);
+  apply(inf, node->data.for_loop.end_expr);
+  apply(inf, node->data.for_loop.step_expr);
+  apply(inf, node->data.for_loop.body);
+}
+
+static void apply(Inference *inf, ASTNode *node) {
+  if (!node)
+    return;
+  switch (node->type) {
+  case NODE_VAR_DECL: {
+    Type *type = node->data.var_decl.declared_type;
+    ASTNode *init = node->data.var_decl.initializer;
+    if (!node->data.var_decl.is_array) {
+      Type *narrowed = narrow(inf, node->data.var_decl.name, type);
+      // A whole number initializer no longer needs its ".0"
+      if (narrowed != type && init && init->type == NODE_NUMBER)
+        init->value_type = inf->integer;
+      node->data.var_decl.declared_type = type = narrowed;
+    }
+    bind(inf, node->data.var_decl.name,
+         node->data.var_decl.is_array ? NULL : type ? type : inf->floating);
+    apply(inf, init);
+    return;
+  }
+  case NODE_FUNCTION_DEF:
+    apply_function(inf, node);
+    return;
+  case NODE_FOR:
+    apply_for(inf, node);
+    return;
+  default:
+    break;
+  }
+
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    char *base = (char *)node + field->offset;
+    int count = field->count_offset
+                    ? *(int *)((char *)node + field->count_offset)
+                    : 0;
+    switch (field->kind) {
+    case AST_FIELD_NAME:
+      // Bound some other way (read into, array, member): left untyped
+      if (node->type != NODE_IDENTIFIER && node->type != NODE_CALL)
+        bind(inf, *(char **)base, NULL);
+      break;
+    case AST_FIELD_NAME_LIST:
+      for (int i = 0; i < count; i++)
+        bind(inf, (*(char ***)base)[i], NULL);
+      break;
+    case AST_FIELD_NODE:
+      apply(inf, *(ASTNode **)base);
+      break;
+    case AST_FIELD_NODE_LIST:
+      for (int i = 0; i < count; i++)
+        apply(inf, (*(ASTNode ***)base)[i]);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+// ============================================================================
+// EXPRESSIONS
+// ============================================================================
+
+static Type *binary_type(const Inference *inf, const ASTNode *node) {
+  const Type *left = node->data.binary_op.left->value_type;
+  const Type *right = node->data.binary_op.right->value_type;
+  switch (node->data.binary_op.op) {
+  case OP_EQ:
+  case OP_NEQ:
+  case OP_LT:
+  case OP_GT:
+  case OP_LTE:
+  case OP_GTE:
+  case OP_AND:
+  case OP_OR:
+    return inf->boolean;
+  case OP_MOD:
+    return inf->integer; // Every C backend casts the operands to int
+  case OP_ADD:
+    if ((left && left->kind == TYPE_STRING) ||
+        (right && right->kind == TYPE_STRING))
+      return inf->string;
+    // fall through
+  case OP_SUB:
+  case OP_MUL:
+  case OP_DIV:
+    if (is_integer_kind(left) && is_integer_kind(right))
+      return inf->integer;
+    if ((left && left->kind == TYPE_FLOAT) ||
+        (right && right->kind == TYPE_FLOAT))
+      return inf->floating;
+    return NULL;
+  default:
+    return NULL;
+  }
+}
+
+/* Type every expression the parser left inferred, operands first */
+static void fill(Inference *inf, ASTNode *node) {
+  if (!node)
+    return;
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    char *base = (char *)node + field->offset;
+    if (field->kind == AST_FIELD_NODE) {
+      fill(inf, *(ASTNode **)base);
+    } else if (field->kind == AST_FIELD_NODE_LIST) {
+      int count = *(int *)((char *)node + field->count_offset);
+      for (int i = 0; i < count; i++)
+        fill(inf, (*(ASTNode ***)base)[i]);
+    }
+  }
+  if (node->value_type && node->value_type->kind != TYPE_INFERRED)
+    return;
+
+  Type *type = NULL;
+  Binding *binding;
+  switch (node->type) {
+  case NODE_IDENTIFIER:
+    binding = binding_lookup(&inf->names, node->data.identifier.name);
+    type = binding ? binding->storage : NULL;
+    break;
+  case NODE_BINARY_OP:
+    if (node->data.binary_op.left && node->data.binary_op.right)
+      type = binary_type(inf, node);
+    break;
+  case NODE_UNARY_OP:
+    if (node->data.unary_op.op == OP_NOT)
+      type = inf->boolean;
+    else if (node->data.unary_op.operand)
+      type = node->data.unary_op.operand->value_type;
+    break;
+  case NODE_CAST:
+    type = node->data.cast_op.target_type;
+    break;
+  case NODE_CALL:
+    binding = binding_lookup(&inf->names, node->data.call.name);
+    if (binding && binding->functions == 1 && binding->returns &&
+        binding->returns->kind != TYPE_VOID)
+      type = binding->returns;
+    break;
+  case NODE_GPIO_READ:
+  case NODE_ANALOG_READ:
+    type = inf->integer;
+    break;
+  case NODE_MATH_FUNC:
+    type = inf->floating;
+    break;
+  default:
+    break;
+  }
+  if (type && type->kind != TYPE_INFERRED)
+    node->value_type = type;
+}
+
+int ast_infer_types(ASTNode *program, int narrow_ints) {
+  Inference inf;
+  memset(&inf, 0, sizeof(inf));
+  inf.narrow_ints = narrow_ints;
+  inf.ranges = range_analysis_create(program, 0);
+  inf.byte = type_byte();
+  inf.int16 = int_of_bits(16);
+  inf.int32 = int_of_bits(32);
+  inf.integer = type_int();
+  inf.floating = type_float();
+  inf.boolean = type_bool();
+  inf.string = type_string();
+
+  scan_arithmetic(&inf, program);
+  apply(&inf, program);
+  fill(&inf, program);
+
+  range_analysis_free(inf.ranges);
+  free(inf.names.slots);
+  return inf.narrowed;
+}
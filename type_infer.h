@@ -0,0 +1,22 @@
+/* Type Inference
+ * Middle-end pass run after range analysis. Gives every expression a
+ * value_type, and stores each untyped variable, parameter and loop counter
+ * that value_range.h proves only ever holds whole numbers in the narrowest
+ * integer that fits (uint8_t, int16_t, int32_t) instead of float, so AVR
+ * boards run integer instructions instead of soft-float calls. A function
+ * that returns a value gets a return type instead of void. The Python
+ * backends ignore storage types.
+ */
+
+#ifndef KINETRIX_TYPE_INFER_H
+#define KINETRIX_TYPE_INFER_H
+
+#include "ast.h"
+
+/* Rewrite the types of `program` in place; with `narrow_ints` 0 whole
+ * numbers keep int or float storage. Returns how many declarations,
+ * parameters and loop counters were narrowed. Needs the program's AST
+ * arena installed (see ast_set_arena). */
+int ast_infer_types(ASTNode *program, int narrow_ints);
+
+#endif
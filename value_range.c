@@ -0,0 +1,559 @@
+/* Value Range Analysis Implementation
+ *
+ * A variable's range is the hull of everything assigned to it anywhere in
+ * the program, so one name declared in several scopes gets the union. A
+ * parameter gets the arguments of every call to its function. A name
+ * bound any other way (read-into targets, struct members) is unbounded.
+ * Ranges are computed over the reals, except that for a given int width
+ * an integer sum, difference, product or negation that may not fit is
+ * unbounded: on AVR, where int is 16 bits, 256 * 256 wraps to 0. A
+ * division proven safe for 16-bit ints is safe for 32-bit ones too, so
+ * binary_op.divisor_nonzero holds the narrowest width its proof holds for.
+ */
+
+#include "value_range.h"
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ANALOG_MAX 65535.0 /* widest ADC reading of any target (Pico u16) */
+#define MAX_WIDENINGS 3    /* a range still growing after this is unbounded */
+#define PI_BOUND 3.1415927 /* just above pi */
+
+static const ValueRange RANGE_ALL = {-INFINITY, INFINITY, 0};
+static const ValueRange RANGE_NONE = {INFINITY, -INFINITY, 1};
+
+static int range_empty(ValueRange r) { return r.lo > r.hi; }
+
+static ValueRange range_of(double lo, double hi, int whole) {
+  ValueRange r = {lo, hi, whole};
+  if (isnan(lo) || isnan(hi))
+    return RANGE_ALL;
+  return r;
+}
+
+static ValueRange range_hull(ValueRange a, ValueRange b) {
+  if (range_empty(a))
+    return b;
+  if (range_empty(b))
+    return a;
+  return range_of(fmin(a.lo, b.lo), fmax(a.hi, b.hi), a.whole && b.whole);
+}
+
+static ValueRange range_truncate(ValueRange r) {
+  if (range_empty(r))
+    return r;
+  return range_of(trunc(r.lo), trunc(r.hi), 1);
+}
+
+static int range_equal(ValueRange a, ValueRange b) {
+  return a.lo == b.lo && a.hi == b.hi && a.whole == b.whole;
+}
+
+static int is_integer_type(const Type *type) {
+  return type && (type->kind == TYPE_INT || type->kind == TYPE_BYTE ||
+                  type->kind == TYPE_BOOL);
+}
+
+// ============================================================================
+// VARIABLES
+// ============================================================================
+
+/* One value a variable is given: `value`, or any whole number between
+ * `value` and `end` for a loop variable; NULL `value` for an unknown one */
+typedef struct {
+  const ASTNode *value;
+  const ASTNode *end;
+} Definition;
+
+typedef struct {
+  const char *name;
+  Definition *defs;
+  int def_count;
+  int def_capacity;
+  int integer;              /* -1 untold, 1 every declaration is an int */
+  const ASTNode *function;  /* The function of this name, if exactly one */
+  int functions;
+  ValueRange range;
+  int widenings;
+} Variable;
+
+struct RangeAnalysis {
+  Variable *slots;
+  size_t capacity; /* power of 2 */
+  size_t count;
+  int int_bits;    /* 0: integers never wrap */
+};
+
+typedef RangeAnalysis VariableTable;
+
+static size_t name_hash(const char *name) {
+  size_t hash = 2166136261u;
+  for (const unsigned char *p = (const unsigned char *)name; *p; p++)
+    hash = (hash ^ *p) * 16777619u;
+  return hash;
+}
+
+static Variable *variable_lookup(const VariableTable *table,
+                                 const char *name) {
+  if (table->count == 0 || !name)
+    return NULL;
+  size_t mask = table->capacity - 1;
+  for (size_t i = name_hash(name) & mask; table->slots[i].name;
+       i = (i + 1) & mask)
+    if (strcmp(table->slots[i].name, name) == 0)
+      return &table->slots[i];
+  return NULL;
+}
+
+static Variable *variable_insert(VariableTable *table, const char *name) {
+  Variable *var = variable_lookup(table, name);
+  if (var)
+    return var;
+  if ((table->count + 1) * 2 > table->capacity) {
+    VariableTable grown = {NULL, table->capacity ? table->capacity * 2 : 64,
+                           0, table->int_bits};
+    grown.slots = calloc(grown.capacity, sizeof(Variable));
+    for (size_t i = 0; i < table->capacity; i++)
+      if (table->slots[i].name)
+        *variable_insert(&grown, table->slots[i].name) = table->slots[i];
+    free(table->slots);
+    *table = grown;
+  }
+  size_t mask = table->capacity - 1;
+  size_t i = name_hash(name) & mask;
+  while (table->slots[i].name)
+    i = (i + 1) & mask;
+  table->slots[i].name = name;
+  table->slots[i].integer = -1;
+  table->slots[i].range = RANGE_NONE;
+  table->count++;
+  return &table->slots[i];
+}
+
+static void define(VariableTable *table, const char *name,
+                   const ASTNode *value, const ASTNode *end) {
+  if (!name)
+    return;
+  Variable *var = variable_insert(table, name);
+  if (var->def_count == var->def_capacity) {
+    var->def_capacity = var->def_capacity ? var->def_capacity * 2 : 4;
+    var->defs = realloc(var->defs, sizeof(Definition) * var->def_capacity);
+  }
+  var->defs[var->def_count].value = value;
+  var->defs[var->def_count].end = end;
+  var->def_count++;
+}
+
+/* A declaration of `name` as `type`; C truncates what an int-typed
+ * variable is given */
+static void declare(VariableTable *table, const char *name, const Type *type) {
+  if (!name)
+    return;
+  Variable *var = variable_insert(table, name);
+  var->integer = var->integer != 0 && is_integer_type(type);
+}
+
+static void define_params(VariableTable *table, const ASTNode *function,
+                          ASTNode *const *args, int arg_count) {
+  for (int i = 0; i < function->data.function_def.param_count; i++)
+    define(table, function->data.function_def.param_names[i],
+           args && i < arg_count ? args[i] : NULL, NULL);
+}
+
+/* Record every way `node` and its children give a variable a value */
+static void collect(VariableTable *table, const ASTNode *node) {
+  if (!node)
+    return;
+  switch (node->type) {
+  case NODE_VAR_DECL:
+    // An array or a declaration without a value holds anything
+    declare(table, node->data.var_decl.name, node->data.var_decl.declared_type);
+    define(table, node->data.var_decl.name,
+           node->data.var_decl.is_array ? NULL
+                                        : node->data.var_decl.initializer,
+           NULL);
+    collect(table, node->data.var_decl.initializer);
+    return;
+  case NODE_ASSIGNMENT:
+    if (node->data.assignment.target &&
+        node->data.assignment.target->type == NODE_IDENTIFIER)
+      define(table, node->data.assignment.target->data.identifier.name,
+             node->data.assignment.value, NULL);
+    else
+      collect(table, node->data.assignment.target);
+    collect(table, node->data.assignment.value);
+    return;
+  case NODE_FOR:
+    // Every backend keeps the loop variable between start and end
+    define(table, node->data.for_loop.var_name,
+           node->data.for_loop.start_expr, node->data.for_loop.end_expr);
+    collect(table, node->data.for_loop.start_expr);
+    collect(table, node->data.for_loop.end_expr);
+    collect(table, node->data.for_loop.step_expr);
+    collect(table, node->data.for_loop.body);
+    return;
+  case NODE_FUNCTION_DEF: {
+    // Parameters are bound by the calls, once every function is known
+    Variable *var = variable_insert(table, node->data.function_def.name);
+    var->functions++;
+    var->function = node->data.function_def.is_extern ? NULL : node;
+    for (int i = 0; i < node->data.function_def.param_count; i++)
+      declare(table, node->data.function_def.param_names[i],
+              node->data.function_def.param_types
+                  ? node->data.function_def.param_types[i]
+                  : NULL);
+    collect(table, node->data.function_def.body);
+    return;
+  }
+  default:
+    break;
+  }
+
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    const char *base = (const char *)node + field->offset;
+    int count = field->count_offset
+                    ? *(const int *)((const char *)node + field->count_offset)
+                    : 0;
+    switch (field->kind) {
+    case AST_FIELD_NAME:
+      if (node->type != NODE_IDENTIFIER && node->type != NODE_CALL)
+        define(table, *(char *const *)base, NULL, NULL);
+      break;
+    case AST_FIELD_NAME_LIST:
+      for (int i = 0; i < count; i++)
+        define(table, (*(char **const *)base)[i], NULL, NULL);
+      break;
+    case AST_FIELD_NODE:
+      collect(table, *(ASTNode *const *)base);
+      break;
+    case AST_FIELD_NODE_LIST:
+      for (int i = 0; i < count; i++)
+        collect(table, (*(ASTNode **const *)base)[i]);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+/* Give parameters the arguments of each call. A function whose name is
+ * defined twice, or called with the wrong arity, has unknown parameters. */
+static void bind_calls(VariableTable *table, const ASTNode *node) {
+  if (!node)
+    return;
+  if (node->type == NODE_CALL) {
+    Variable *var = variable_lookup(table, node->data.call.name);
+    if (var && var->function) {
+      int exact = var->functions == 1 &&
+                  node->data.call.arg_count ==
+                      var->function->data.function_def.param_count;
+      define_params(table, var->function, exact ? node->data.call.args : NULL,
+                    node->data.call.arg_count);
+    }
+  }
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    const char *base = (const char *)node + field->offset;
+    if (field->kind == AST_FIELD_NODE) {
+      bind_calls(table, *(ASTNode *const *)base);
+    } else if (field->kind == AST_FIELD_NODE_LIST) {
+      int count = *(const int *)((const char *)node + field->count_offset);
+      for (int i = 0; i < count; i++)
+        bind_calls(table, (*(ASTNode **const *)base)[i]);
+    }
+  }
+}
+
+// ============================================================================
+// EXPRESSIONS
+// ============================================================================
+
+static ValueRange expr_range(const VariableTable *table, const ASTNode *e);
+
+/* An integer result an int of the table's width may not hold wraps around
+ * to anything, zero included */
+static ValueRange fit_int(const VariableTable *table, ValueRange r) {
+  if (table->int_bits == 0 || !r.whole || range_empty(r))
+    return r;
+  double max = ldexp(1, table->int_bits - 1);
+  return r.lo < -max || r.hi > max - 1 ? RANGE_ALL : r;
+}
+
+static ValueRange multiply(ValueRange a, ValueRange b) {
+  int whole = a.whole && b.whole;
+  double p[4] = {a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi};
+  ValueRange r = range_of(p[0], p[0], whole);
+  for (int i = 1; i < 4; i++)
+    r = range_hull(r, range_of(p[i], p[i], whole));
+  // A product too small for a float rounds to zero
+  if (r.lo > 0 && r.lo < FLT_MIN)
+    r.lo = 0;
+  if (r.hi < 0 && r.hi > -FLT_MIN)
+    r.hi = 0;
+  return r;
+}
+
+/* Division as the backends emit it: by zero gives 0, and an integer
+ * quotient is truncated */
+static ValueRange divide(ValueRange a, ValueRange b) {
+  if (b.lo <= 0 && b.hi >= 0)
+    return RANGE_ALL; // Near zero the quotient is unbounded
+  ValueRange r = multiply(a, range_of(1 / b.hi, 1 / b.lo, 0));
+  if (r.lo > 0)
+    r.lo = floor(r.lo);
+  if (r.hi < 0)
+    r.hi = ceil(r.hi);
+  return r;
+}
+
+static ValueRange binary_range(const VariableTable *table,
+                               const ASTNode *node) {
+  ValueRange a = expr_range(table, node->data.binary_op.left);
+  ValueRange b = expr_range(table, node->data.binary_op.right);
+  if (range_empty(a) || range_empty(b))
+    return RANGE_NONE;
+  int whole = a.whole && b.whole;
+  switch (node->data.binary_op.op) {
+  case OP_ADD:
+    return fit_int(table, range_of(a.lo + b.lo, a.hi + b.hi, whole));
+  case OP_SUB:
+    return fit_int(table, range_of(a.lo - b.hi, a.hi - b.lo, whole));
+  case OP_MUL:
+    return fit_int(table, multiply(a, b));
+  case OP_DIV:
+    return divide(a, b);
+  case OP_MOD: {
+    // Smaller than the divisor; the sign differs between C and Python
+    double m = fmax(fabs(b.lo), fabs(b.hi));
+    return range_of(-m, m, 1);
+  }
+  case OP_EQ:
+  case OP_NEQ:
+  case OP_LT:
+  case OP_GT:
+  case OP_LTE:
+  case OP_GTE:
+  case OP_AND:
+  case OP_OR:
+    return range_of(0, 1, 1);
+  default:
+    return RANGE_ALL;
+  }
+}
+
+static ValueRange math_range(const VariableTable *table, const ASTNode *node) {
+  switch (node->data.math_func.func) {
+  case MATH_SIN:
+  case MATH_COS:
+    return range_of(-1, 1, 0);
+  case MATH_ATAN:
+    return range_of(-PI_BOUND / 2, PI_BOUND / 2, 0);
+  case MATH_ATAN2:
+    return range_of(-PI_BOUND, PI_BOUND, 0);
+  case MATH_SQRT: {
+    ValueRange a = expr_range(table, node->data.math_func.arg1);
+    if (range_empty(a))
+      return a;
+    return a.lo < 0 ? RANGE_ALL : range_of(sqrt(a.lo), sqrt(a.hi), 0);
+  }
+  default:
+    return RANGE_ALL;
+  }
+}
+
+static ValueRange expr_range(const VariableTable *table, const ASTNode *e) {
+  if (!e)
+    return RANGE_ALL;
+  switch (e->type) {
+  case NODE_NUMBER: {
+    double value = e->data.number.value;
+    return range_of(value, value, value == floor(value));
+  }
+  case NODE_BOOL:
+    return range_of(e->data.boolean.value, e->data.boolean.value, 1);
+  case NODE_IDENTIFIER: {
+    Variable *var = variable_lookup(table, e->data.identifier.name);
+    return var ? var->range : RANGE_ALL;
+  }
+  case NODE_BINARY_OP:
+    return binary_range(table, e);
+  case NODE_UNARY_OP: {
+    ValueRange a = expr_range(table, e->data.unary_op.operand);
+    if (e->data.unary_op.op == OP_NOT)
+      return range_of(0, 1, 1);
+    return range_empty(a) ? a
+                          : fit_int(table, range_of(-a.hi, -a.lo, a.whole));
+  }
+  case NODE_CAST: {
+    Type *target = e->data.cast_op.target_type;
+    ValueRange a = expr_range(table, e->data.cast_op.operand);
+    if (!target || range_empty(a))
+      return target ? a : RANGE_ALL;
+    switch (target->kind) {
+    case TYPE_INT:
+      return range_truncate(a);
+    case TYPE_FLOAT:
+      return a;
+    case TYPE_BOOL:
+      return range_of(0, 1, 1);
+    case TYPE_BYTE:
+      a = range_truncate(a);
+      return a.lo >= 0 && a.hi <= 255 ? a : range_of(0, 255, 1);
+    default:
+      return RANGE_ALL;
+    }
+  }
+  case NODE_MATH_FUNC:
+    return math_range(table, e);
+  case NODE_GPIO_READ:
+    return range_of(0, 1, 1);
+  case NODE_ANALOG_READ:
+    return range_of(0, ANALOG_MAX, 1);
+  default:
+    return RANGE_ALL;
+  }
+}
+
+static ValueRange definition_range(const VariableTable *table,
+                                   const Definition *def) {
+  if (!def->value)
+    return RANGE_ALL;
+  ValueRange r = expr_range(table, def->value);
+  if (def->end) // Loop bounds are converted to int
+    r = range_truncate(range_hull(r, expr_range(table, def->end)));
+  return r;
+}
+
+/* Grow every range until each covers all its definitions */
+static void solve(VariableTable *table) {
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (size_t i = 0; i < table->capacity; i++) {
+      Variable *var = &table->slots[i];
+      if (!var->name || range_equal(var->range, RANGE_ALL))
+        continue;
+      ValueRange r = var->range;
+      for (int d = 0; d < var->def_count; d++)
+        r = range_hull(r, definition_range(table, &var->defs[d]));
+      if (var->integer == 1)
+        r = range_truncate(r);
+      if (range_equal(r, var->range))
+        continue;
+      var->range = ++var->widenings > MAX_WIDENINGS ? RANGE_ALL : r;
+      changed = 1;
+    }
+  }
+  // Only ever assigned from itself, or never: nothing is known
+  for (size_t i = 0; i < table->capacity; i++)
+    if (table->slots[i].name && range_empty(table->slots[i].range))
+      table->slots[i].range = RANGE_ALL;
+}
+
+RangeAnalysis *range_analysis_create(const ASTNode *program, int int_bits) {
+  RangeAnalysis *ranges = calloc(1, sizeof(RangeAnalysis));
+  ranges->int_bits = int_bits;
+  collect(ranges, program);
+  bind_calls(ranges, program);
+  solve(ranges);
+  return ranges;
+}
+
+void range_analysis_free(RangeAnalysis *ranges) {
+  for (size_t i = 0; i < ranges->capacity; i++)
+    free(ranges->slots[i].defs);
+  free(ranges->slots);
+  free(ranges);
+}
+
+ValueRange range_of_expr(const RangeAnalysis *ranges, const ASTNode *expr) {
+  ValueRange r = expr_range(ranges, expr);
+  return range_empty(r) ? RANGE_ALL : r;
+}
+
+ValueRange range_of_variable(const RangeAnalysis *ranges, const char *name) {
+  Variable *var = variable_lookup(ranges, name);
+  return var ? var->range : RANGE_ALL;
+}
+
+// ============================================================================
+// DIVISIONS
+// ============================================================================
+
+/* Record the divisions proven safe with the analysis' int width, the
+ * widest first; returns how many were not proven safe before */
+static int mark_divisions(const RangeAnalysis *ranges, ASTNode *node) {
+  if (!node)
+    return 0;
+  int marked = 0;
+  if (node->type == NODE_BINARY_OP && node->data.binary_op.op == OP_DIV) {
+    ValueRange r = range_of_expr(ranges, node->data.binary_op.right);
+    int *bits = &node->data.binary_op.divisor_nonzero;
+    if (r.lo > 0 || r.hi < 0) {
+      marked += *bits == 0;
+      *bits = ranges->int_bits;
+    } else if (ranges->int_bits == RANGE_INT_BITS) {
+      *bits = 0;
+    }
+  }
+  const AstLayout *layout = ast_layout(node->type);
+  for (int f = 0; f < layout->field_count; f++) {
+    const AstField *field = &layout->fields[f];
+    char *base = (char *)node + field->offset;
+    if (field->kind == AST_FIELD_NODE) {
+      marked += mark_divisions(ranges, *(ASTNode **)base);
+    } else if (field->kind == AST_FIELD_NODE_LIST) {
+      int count = *(int *)((char *)node + field->count_offset);
+      for (int i = 0; i < count; i++)
+        marked += mark_divisions(ranges, (*(ASTNode ***)base)[i]);
+    }
+  }
+  return marked;
+}
+
+int ast_analyze_ranges(ASTNode *program) {
+  static const int widths[] = {RANGE_INT_BITS, RANGE_INT_BITS_AVR};
+  int marked = 0;
+  for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i++) {
+    RangeAnalysis *ranges = range_analysis_create(program, widths[i]);
+    marked += mark_divisions(ranges, program);
+    range_analysis_free(ranges);
+  }
+  return marked;
+}
+
+int ast_divisor_nonzero(const ASTNode *division, int int_bits) {
+  int bits = division->data.binary_op.divisor_nonzero;
+  return bits > 0 && bits <= int_bits;
+}
+
+int ast_expr_is_pure(const ASTNode *expr) {
+  if (!expr)
+    return 1;
+  switch (expr->type) {
+  case NODE_NUMBER:
+  case NODE_BOOL:
+  case NODE_STRING:
+  case NODE_IDENTIFIER:
+    return 1;
+  case NODE_BINARY_OP:
+    return ast_expr_is_pure(expr->data.binary_op.left) &&
+           ast_expr_is_pure(expr->data.binary_op.right);
+  case NODE_UNARY_OP:
+    return ast_expr_is_pure(expr->data.unary_op.operand);
+  case NODE_CAST:
+    return ast_expr_is_pure(expr->data.cast_op.operand);
+  case NODE_STRUCT_ACCESS:
+    return ast_expr_is_pure(expr->data.struct_access.object);
+  case NODE_ARRAY_ACCESS:
+    return ast_expr_is_pure(expr->data.array_access.array) &&
+           ast_expr_is_pure(expr->data.array_access.index);
+  default:
+    return 0; // Calls, hardware reads and math functions
+  }
+}
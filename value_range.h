@@ -0,0 +1,46 @@
+/* Value Range Analysis
+ * Bounds every numeric variable by the values it is ever given, ignoring
+ * control flow, and marks each division whose divisor can never be zero
+ * for a given width of C's int.
+ * Backends drop the divide-by-zero guard for those; for the rest they
+ * evaluate the divisor once (see ast_expr_is_pure). Type inference reads
+ * the same ranges to pick integer widths.
+ */
+
+#ifndef KINETRIX_VALUE_RANGE_H
+#define KINETRIX_VALUE_RANGE_H
+
+#include "ast.h"
+
+typedef struct {
+    double lo, hi;  // lo > hi: no value seen; +-INFINITY: unbounded
+    int whole;      // Only ever a whole number, as the C backends compute it
+} ValueRange;
+
+typedef struct RangeAnalysis RangeAnalysis;
+
+#define RANGE_INT_BITS_AVR 16 /* int on the Arduino (AVR) backend */
+#define RANGE_INT_BITS 32     /* int on every other C target */
+
+/* Solve the ranges of every variable in `program`. With `int_bits` set,
+ * integer arithmetic whose result may not fit an int of that width wraps
+ * in C, so its range is unbounded; 0 computes over the reals. */
+RangeAnalysis *range_analysis_create(const ASTNode *program, int int_bits);
+void range_analysis_free(RangeAnalysis *ranges);
+
+ValueRange range_of_expr(const RangeAnalysis *ranges, const ASTNode *expr);
+ValueRange range_of_variable(const RangeAnalysis *ranges, const char *name);
+
+/* Set binary_op.divisor_nonzero on every division in `program`; returns
+ * how many divisions were proven safe for at least one int width */
+int ast_analyze_ranges(ASTNode *program);
+
+/* 1 if the divisor of `division` is never zero when C's int has
+ * `int_bits` bits; needs ast_analyze_ranges() first */
+int ast_divisor_nonzero(const ASTNode *division, int int_bits);
+
+/* 1 if evaluating `expr` twice is cheap and has no side effects, so a
+ * guard may repeat it instead of binding it to a temporary */
+int ast_expr_is_pure(const ASTNode *expr);
+
+#endif